@@ -52,7 +52,8 @@ TCCX += -I$(TOP)/ext/async
 #
 LIBOBJ+= alter.o analyze.o attach.o auth.o \
          backup.o bitvec.o btmutex.o btree.o build.o \
-         callback.o complete.o ctime.o date.o delete.o expr.o fault.o fkey.o \
+         callback.o complete.o compress.o ctime.o date.o delete.o \
+         expr.o fault.o fkey.o \
          fts3.o fts3_expr.o fts3_hash.o fts3_icu.o fts3_porter.o \
          fts3_snippet.o fts3_tokenizer.o fts3_tokenizer1.o fts3_write.o \
          func.o global.o hash.o \
@@ -62,8 +63,8 @@ LIBOBJ+= alter.o analyze.o attach.o auth.o \
          mutex.o mutex_noop.o mutex_os2.o mutex_unix.o mutex_w32.o \
          notify.o opcodes.o os.o os_os2.o os_unix.o os_win.o \
          pager.o parse.o pcache.o pcache1.o pragma.o prepare.o printf.o \
-         random.o resolve.o rowset.o rtree.o select.o status.o \
-         table.o tokenize.o trigger.o \
+         random.o resolve.o rowset.o rtree.o select.o snapshot.o status.o \
+         table.o tokenize.o trigger.o tvp.o \
          update.o util.o vacuum.o \
          vdbe.o vdbeapi.o vdbeaux.o vdbeblob.o vdbemem.o vdbetrace.o \
          wal.o walker.o where.o utf.o vtab.o
@@ -86,6 +87,7 @@ SRC = \
   $(TOP)/src/build.c \
   $(TOP)/src/callback.c \
   $(TOP)/src/complete.c \
+  $(TOP)/src/compress.c \
   $(TOP)/src/ctime.c \
   $(TOP)/src/date.c \
   $(TOP)/src/delete.c \
@@ -135,6 +137,7 @@ SRC = \
   $(TOP)/src/resolve.c \
   $(TOP)/src/rowset.c \
   $(TOP)/src/select.c \
+  $(TOP)/src/snapshot.c \
   $(TOP)/src/status.c \
   $(TOP)/src/shell.c \
   $(TOP)/src/sqlite.h.in \
@@ -145,6 +148,7 @@ SRC = \
   $(TOP)/src/tclsqlite.c \
   $(TOP)/src/tokenize.c \
   $(TOP)/src/trigger.c \
+  $(TOP)/src/tvp.c \
   $(TOP)/src/utf.c \
   $(TOP)/src/update.c \
   $(TOP)/src/util.c \
@@ -232,6 +236,7 @@ TESTSRC = \
   $(TOP)/src/test_async.c \
   $(TOP)/src/test_backup.c \
   $(TOP)/src/test_btree.c \
+  $(TOP)/src/test_compress.c \
   $(TOP)/src/test_config.c \
   $(TOP)/src/test_demovfs.c \
   $(TOP)/src/test_devsym.c \
@@ -271,6 +276,7 @@ TESTSRC2 = \
   $(TOP)/src/insert.c \
   $(TOP)/src/wal.c \
   $(TOP)/src/mem5.c \
+  $(TOP)/src/mutex_unix.c \
   $(TOP)/src/os.c \
   $(TOP)/src/os_os2.c \
   $(TOP)/src/os_unix.c \
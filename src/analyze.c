@@ -387,6 +387,7 @@ static void analyzeDatabase(Parse *pParse, int iDb){
   pParse->nTab += 2;
   openStatTable(pParse, iDb, iStatCur, 0);
   iMem = pParse->nMem+1;
+  sqlite3LazyLoadAll(db, iDb);
   for(k=sqliteHashFirst(&pSchema->tblHash); k; k=sqliteHashNext(k)){
     Table *pTab = (Table*)sqliteHashData(k);
     analyzeOneTable(pParse, pTab, iStatCur, iMem);
@@ -486,45 +487,46 @@ void sqlite3Analyze(Parse *pParse, Token *pName1, Token *pName2){
 typedef struct analysisInfo analysisInfo;
 struct analysisInfo {
   sqlite3 *db;
+  int iDb;
   const char *zDatabase;
 };
 
 /*
-** This callback is invoked once for each index when reading the
-** sqlite_stat1 table.  
+** Apply one row of the sqlite_stat1 table of database iDb to the
+** in-memory schema:
 **
-**     argv[0] = name of the table
-**     argv[1] = name of the index (might be NULL)
-**     argv[2] = results of analysis - on integer for each column
+**     zTab  = name of the table
+**     zIdx  = name of the index (might be NULL)
+**     zStat = results of analysis - on integer for each column
 **
-** Entries for which argv[1]==NULL simply record the number of rows in
+** Entries for which zIdx==NULL simply record the number of rows in
 ** the table.
 */
-static int analysisLoader(void *pData, int argc, char **argv, char **NotUsed){
-  analysisInfo *pInfo = (analysisInfo*)pData;
+void sqlite3AnalysisApply(
+  sqlite3 *db,
+  int iDb,
+  const char *zTab,
+  const char *zIdx,
+  const char *zStat
+){
+  const char *zDb = db->aDb[iDb].zName;
   Index *pIndex;
   Table *pTable;
   int i, c, n;
   unsigned int v;
   const char *z;
 
-  assert( argc==3 );
-  UNUSED_PARAMETER2(NotUsed, argc);
-
-  if( argv==0 || argv[0]==0 || argv[2]==0 ){
-    return 0;
-  }
-  pTable = sqlite3FindTable(pInfo->db, argv[0], pInfo->zDatabase);
+  pTable = sqlite3FindTable(db, zTab, zDb);
   if( pTable==0 ){
-    return 0;
+    return;
   }
-  if( argv[1] ){
-    pIndex = sqlite3FindIndex(pInfo->db, argv[1], pInfo->zDatabase);
+  if( zIdx ){
+    pIndex = sqlite3FindIndex(db, zIdx, zDb);
   }else{
     pIndex = 0;
   }
   n = pIndex ? pIndex->nColumn : 0;
-  z = argv[2];
+  z = zStat;
   for(i=0; *z && i<=n; i++){
     v = 0;
     while( (c=z[0])>='0' && c<='9' ){
@@ -536,6 +538,31 @@ static int analysisLoader(void *pData, int argc, char **argv, char **NotUsed){
     pIndex->aiRowEst[i] = v;
     if( *z==' ' ) z++;
   }
+}
+
+/*
+** This callback is invoked once for each index when reading the
+** sqlite_stat1 table.  
+**
+**     argv[0] = name of the table
+**     argv[1] = name of the index (might be NULL)
+**     argv[2] = results of analysis - on integer for each column
+**
+** If the table has not been parsed yet because lazy schema loading
+** is enabled, the row is saved and applied when the table is loaded.
+*/
+static int analysisLoader(void *pData, int argc, char **argv, char **NotUsed){
+  analysisInfo *pInfo = (analysisInfo*)pData;
+
+  assert( argc==3 );
+  UNUSED_PARAMETER2(NotUsed, argc);
+
+  if( argv==0 || argv[0]==0 || argv[2]==0 ){
+    return 0;
+  }
+  if( sqlite3LazySaveStat(pInfo->db, pInfo->iDb, argv)==0 ){
+    sqlite3AnalysisApply(pInfo->db, pInfo->iDb, argv[0], argv[1], argv[2]);
+  }
   return 0;
 }
 
@@ -598,9 +625,17 @@ int sqlite3AnalysisLoad(sqlite3 *db, int iDb){
     sqlite3DeleteIndexSamples(db, pIdx);
     pIdx->aSample = 0;
   }
+  for(i=sqliteHashFirst(&db->aDb[iDb].pSchema->lazyHash);i;i=sqliteHashNext(i)){
+    LazyObj *p;
+    for(p=sqliteHashData(i); p; p=p->pNext){
+      sqlite3DbFree(0, p->zStat);
+      p->zStat = 0;
+    }
+  }
 
   /* Check to make sure the sqlite_stat1 table exists */
   sInfo.db = db;
+  sInfo.iDb = iDb;
   sInfo.zDatabase = db->aDb[iDb].zName;
   if( sqlite3FindTable(db, "sqlite_stat1", sInfo.zDatabase)==0 ){
     return SQLITE_ERROR;
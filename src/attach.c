@@ -144,6 +144,14 @@ static void attachFunc(
     sqlite3PagerLockingMode(pPager, db->dfltLockMode);
     sqlite3BtreeSecureDelete(aNew->pBt,
                              sqlite3BtreeSecureDelete(db->aDb[0].pBt,-1) );
+    sqlite3BtreePrefixKeys(aNew->pBt,
+                           sqlite3BtreePrefixKeys(db->aDb[0].pBt,-1) );
+    sqlite3BtreeFreePageMap(aNew->pBt,
+                            sqlite3BtreeFreePageMap(db->aDb[0].pBt,-1) );
+    sqlite3BtreeExtentSize(aNew->pBt,
+                           sqlite3BtreeExtentSize(db->aDb[0].pBt,-1) );
+    sqlite3BtreeLazyClear(aNew->pBt,
+                          sqlite3BtreeLazyClear(db->aDb[0].pBt,-1) );
   }
   aNew->safety_level = 3;
   aNew->zName = sqlite3DbStrDup(db, zName);
@@ -21,6 +21,28 @@
 # define MIN(x,y) ((x)<(y)?(x):(y))
 #endif
 
+/* Number of change-tracking entries read at a time by incremental backups.
+*/
+#define BACKUP_NGEN 1024
+
+/* The generation returned by sqlite3_backup_generation() for change-tracking
+** generation number G of a change-tracking file with salt S. The salt is
+** used to check that a generation passed to SQLITE_BACKUPCONFIG_INCREMENTAL
+** belongs to the current change-tracking file.
+*/
+#define BACKUP_GENERATION(S,G) ((((i64)(S))&0x7fffffff)<<32 | (i64)(G))
+
+/*
+** When the page size is converted, an instance of the following structure
+** describes each b-tree copied from the source to the destination.
+*/
+typedef struct BackupTree BackupTree;
+struct BackupTree {
+  Pgno iSrc;               /* Root page of the b-tree in the source */
+  Pgno iDest;              /* Root page of the b-tree in the destination */
+  int isIndex;             /* True for an index b-tree */
+};
+
 /*
 ** Structure allocated for each backup operation.
 */
@@ -44,6 +66,34 @@ struct sqlite3_backup {
 
   int isAttached;          /* True once backup has been registered with pager */
   sqlite3_backup *pNext;   /* Next backup associated with source pager */
+
+  /* These are set by sqlite3_backup_config(). */
+  int bSnapshot;           /* True to copy a snapshot of the source */
+  int nReadPage;           /* Number of source pages to read at a time */
+  int nRate;               /* Maximum bytes read per second, or 0 */
+  i64 iSince;              /* Copy pages written since this generation */
+
+  sqlite3 *pSnapDb;        /* Private connection to source, if bSnapshot */
+  sqlite3_int64 iRateStart;  /* Time of the first step, in ms, if nRate>0 */
+  sqlite3_int64 nRateByte;   /* Bytes read from the source since iRateStart */
+
+  /* Used by incremental backups only. aGen is NULL otherwise. */
+  i64 iGeneration;         /* Change-tracking generation of the snapshot */
+  u32 *aGen;               /* BACKUP_NGEN change-tracking entries */
+  Pgno iGenFirst;          /* Page number that aGen[0] is the entry for */
+
+  /* Used when the page size is converted only. aTree is NULL otherwise. */
+  int szPage;              /* Page size of the destination, or 0 */
+  BackupTree *aTree;       /* B-trees to copy. The last is sqlite_master */
+  int nTree;               /* Number of entries in aTree[] */
+  int iTree;               /* Index in aTree[] of the b-tree being copied */
+  int bCursor;             /* True if pSrcCur and pDestCur are open */
+  BtCursor *pSrcCur;       /* Cursor on aTree[iTree] in the source */
+  BtCursor *pDestCur;      /* Cursor on aTree[iTree] in the destination */
+  KeyInfo keyInfo;         /* For index cursors. Never used to compare keys */
+  u8 *aBuf;                /* Buffer for entries with overflow pages */
+  int nBuf;                /* Allocated size of aBuf[] */
+  i64 nCopied;             /* Bytes of b-tree entries copied so far */
 };
 
 /*
@@ -197,6 +247,15 @@ static int isFatalError(int rc){
   return (rc!=SQLITE_OK && rc!=SQLITE_BUSY && ALWAYS(rc!=SQLITE_LOCKED));
 }
 
+/*
+** Return the b-tree that source pages are read from. In snapshot mode
+** this is the b-tree of the private connection that holds the snapshot
+** open. Otherwise it is the source b-tree itself.
+*/
+static Btree *backupReadBtree(sqlite3_backup *p){
+  return p->pSnapDb ? p->pSnapDb->aDb[0].pBt : p->pSrc;
+}
+
 /*
 ** Parameter zSrcData points to a buffer containing the data for 
 ** page iSrcPg from the source database. Copy this data into the 
@@ -204,7 +263,7 @@ static int isFatalError(int rc){
 */
 static int backupOnePage(sqlite3_backup *p, Pgno iSrcPg, const u8 *zSrcData){
   Pager * const pDestPager = sqlite3BtreePager(p->pDest);
-  const int nSrcPgsz = sqlite3BtreeGetPageSize(p->pSrc);
+  const int nSrcPgsz = sqlite3BtreeGetPageSize(backupReadBtree(p));
   int nDestPgsz = sqlite3BtreeGetPageSize(p->pDest);
   const int nCopy = MIN(nSrcPgsz, nDestPgsz);
   const i64 iEnd = (i64)iSrcPg*(i64)nSrcPgsz;
@@ -261,6 +320,10 @@ static int backupOnePage(sqlite3_backup *p, Pgno iSrcPg, const u8 *zSrcData){
     sqlite3PagerUnref(pDestPg);
   }
 
+  /* The destination free-list has been overwritten, so any free-page map
+  ** built from it is stale. */
+  p->pDest->pBt->freeMapOk = 0;
+
   return rc;
 }
 
@@ -294,6 +357,523 @@ static void attachBackupObject(sqlite3_backup *p){
   p->isAttached = 1;
 }
 
+/*
+** Open the private connection used to read the source database in
+** snapshot mode, if it is not already open.
+*/
+static int backupOpenSnapshot(sqlite3_backup *p){
+  int rc = SQLITE_OK;
+  if( p->pSnapDb==0 ){
+    Pager *pPager = sqlite3BtreePager(p->pSrc);
+    int flags = (p->aGen ? SQLITE_OPEN_READWRITE : SQLITE_OPEN_READONLY);
+    rc = sqlite3_open_v2(sqlite3PagerFilename(pPager), &p->pSnapDb,
+        flags|SQLITE_OPEN_PRIVATECACHE, sqlite3PagerVfs(pPager)->zName
+    );
+    if( rc!=SQLITE_OK ){
+      sqlite3_close(p->pSnapDb);
+      p->pSnapDb = 0;
+    }
+  }
+  return rc;
+}
+
+/*
+** Close the private connection used in snapshot mode, if it is open,
+** ending the read transaction on the snapshot.
+*/
+static void backupCloseSnapshot(sqlite3_backup *p){
+  if( p->pSnapDb ){
+    sqlite3_close(p->pSnapDb);
+    p->pSnapDb = 0;
+  }
+}
+
+/*
+** Start a new change-tracking generation on the source database of an
+** incremental backup, before the snapshot is taken. Because the write
+** lock is held while the generation number is incremented, every page
+** written at or before generation p->iGeneration is in the snapshot.
+**
+** All pages are copied if the destination database is empty (it has no
+** pages, or just the page 1 created when the write transaction on it was
+** opened). They are also copied if p->iSince is not an earlier generation
+** of the current change-tracking file. For example, because change
+** tracking has been turned off and on again since the earlier backup was
+** taken, which starts the generation numbers again from 1.
+*/
+static int backupNextGeneration(sqlite3_backup *p, Btree *pSrc){
+  u32 iGen = 0;
+  u32 iSalt = 0;
+  int rc = sqlite3BtreeBeginTrans(pSrc, 1);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3PagerTrackNext(sqlite3BtreePager(pSrc), &iGen, &iSalt);
+    if( rc==SQLITE_OK ) rc = sqlite3BtreeCommitPhaseOne(pSrc, 0);
+    if( rc==SQLITE_OK ) rc = sqlite3BtreeCommitPhaseTwo(pSrc);
+    if( rc!=SQLITE_OK ){
+      sqlite3BtreeRollback(pSrc);
+    }
+  }
+  if( rc==SQLITE_OK ){
+    int nDest = 0;
+    sqlite3PagerPagecount(sqlite3BtreePager(p->pDest), &nDest);
+    p->iGeneration = BACKUP_GENERATION(iSalt, iGen);
+    if( nDest<=1
+     || (p->iSince>>32)!=(p->iGeneration>>32)
+     || (u32)p->iSince>=iGen
+    ){
+      p->iSince = 0;
+    }
+  }
+  return rc;
+}
+
+/*
+** In an incremental backup, advance p->iNext past any source pages that
+** have not been written since generation p->iSince. Page 1 is always
+** copied.
+*/
+static int backupSkipUnchanged(
+  sqlite3_backup *p,              /* Backup object */
+  Pager *pSrcPager,               /* Pager to read change-tracking entries */
+  Pgno nSrcPage                   /* Size of source database in pages */
+){
+  int rc = SQLITE_OK;
+  if( p->iSince==0 ) return SQLITE_OK;
+  while( p->iNext<=nSrcPage ){
+    if( p->iGenFirst==0 || p->iNext>=p->iGenFirst+BACKUP_NGEN ){
+      p->iGenFirst = p->iNext;
+      rc = sqlite3PagerTrackRead(pSrcPager, p->iGenFirst, BACKUP_NGEN, p->aGen);
+      if( rc!=SQLITE_OK ) break;
+    }
+    if( p->iNext==1 || p->aGen[p->iNext-p->iGenFirst]>(u32)p->iSince ) break;
+    p->iNext++;
+  }
+  return rc;
+}
+
+/*
+** In an incremental backup, return the number of pages, up to nMax, in
+** the run of pages written since generation p->iSince that begins with
+** page iPg. The entry for page iPg must be in the p->aGen[] array.
+*/
+static int backupChangedRun(sqlite3_backup *p, Pgno iPg, int nMax){
+  int n = 1;
+  if( p->iSince==0 ) return nMax;
+  assert( iPg>=p->iGenFirst && iPg<p->iGenFirst+BACKUP_NGEN );
+  while( n<nMax && iPg+n<p->iGenFirst+BACKUP_NGEN
+      && p->aGen[iPg+n-p->iGenFirst]>(u32)p->iSince
+  ){
+    n++;
+  }
+  return n;
+}
+
+/*
+** Return the number of microseconds that sqlite3_backup_step() should
+** sleep for to keep the rate at which pages are read from the source
+** below the configured limit, having just read nByte bytes.
+*/
+static int backupThrottle(sqlite3_backup *p, int nByte){
+  sqlite3_int64 iNow;
+  sqlite3_int64 iDue;     /* Time at which nRateByte may have been read */
+  if( p->nRate<=0 || nByte==0 ) return 0;
+  p->nRateByte += nByte;
+  sqlite3OsCurrentTimeInt64(p->pSrcDb->pVfs, &iNow);
+  iDue = p->iRateStart + p->nRateByte*1000/p->nRate;
+  if( iDue<=iNow ) return 0;
+  return (int)MIN(iDue-iNow, 10*60*1000)*1000;
+}
+
+/*
+** Return the number of bytes used by a value of serial type t in the
+** body of a record.
+*/
+static int backupSerialLen(u32 t){
+  static const u8 aLen[] = { 0, 1, 2, 3, 4, 6, 8, 8, 0, 0, 0, 0 };
+  return (t>=12) ? (int)((t-12)/2) : aLen[t];
+}
+
+/*
+** Find field iField of the record aRec[], which is nRec bytes in size.
+** Set *piHdr to the offset of the serial type of the field in the record
+** header and *piOff to the offset of its value. Return its serial type,
+** or -1 if the record has no such field or is corrupt.
+*/
+static int backupRecordField(
+  const u8 *aRec, int nRec,       /* The record */
+  int iField,                     /* Field to find. 0 is the first */
+  int *piHdr,                     /* OUT: Offset of serial type */
+  int *piOff                      /* OUT: Offset of value */
+){
+  u32 nHdr;
+  u32 t;
+  int iHdr;
+  int iOff;
+  int i;
+
+  if( nRec<1 ) return -1;
+  iHdr = getVarint32(aRec, nHdr);
+  if( nHdr>(u32)nRec ) return -1;
+  iOff = (int)nHdr;
+  for(i=0; iHdr<(int)nHdr; i++){
+    int iType = iHdr;
+    iHdr += getVarint32(&aRec[iHdr], t);
+    if( i==iField ){
+      if( iOff+backupSerialLen(t)>nRec ) return -1;
+      *piHdr = iType;
+      *piOff = iOff;
+      return (int)t;
+    }
+    iOff += backupSerialLen(t);
+  }
+  return -1;
+}
+
+/*
+** Return the value of the integer of serial type t stored at a[]. Values
+** of other types are returned as 0.
+*/
+static i64 backupSerialInt(const u8 *a, int t){
+  i64 v;
+  int i;
+  if( t==9 ) return 1;
+  if( t<1 || t>6 ) return 0;
+  v = (signed char)a[0];
+  for(i=1; i<backupSerialLen(t); i++){
+    v = (v<<8) | a[i];
+  }
+  return v;
+}
+
+/*
+** Close the cursors used to copy b-tree p->aTree[p->iTree], if they are
+** open.
+*/
+static void backupConvertClose(sqlite3_backup *p){
+  if( p->bCursor ){
+    sqlite3_mutex_enter(p->pSnapDb->mutex);
+    sqlite3BtreeCloseCursor(p->pSrcCur);
+    sqlite3_mutex_leave(p->pSnapDb->mutex);
+    sqlite3BtreeCloseCursor(p->pDestCur);
+    p->bCursor = 0;
+  }
+}
+
+/*
+** Make sure p->aBuf[] is at least n bytes in size.
+*/
+static int backupBufferSize(sqlite3_backup *p, int n){
+  if( n>p->nBuf ){
+    u8 *aNew = (u8*)sqlite3Realloc(p->aBuf, n);
+    if( aNew==0 ) return SQLITE_NOMEM;
+    p->aBuf = aNew;
+    p->nBuf = n;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Start converting the page size. This is called once the read
+** transaction on the source is open. The destination, which must be
+** empty, is given the new page size and the auto-vacuum setting of the
+** source and locked. Then the list of b-trees to copy is read from the
+** source schema, and an empty b-tree is created in the destination for
+** each of them.
+*/
+static int backupConvertBegin(sqlite3_backup *p, Btree *pSrc){
+  const int szCursor = sqlite3BtreeCursorSize();
+  const int autoVacuum = sqlite3BtreeGetAutoVacuum(pSrc);
+  BtCursor *pCur;
+  int rc = SQLITE_OK;
+  int bEof = 0;
+  int nAlloc = 0;
+  int i;
+
+  if( p->bDestLocked==0 ){
+    /* These fail with SQLITE_READONLY if the destination page size is
+    ** already fixed. Whether or not it is the one required is checked
+    ** once the destination is locked. */
+    sqlite3BtreeSetPageSize(p->pDest, p->szPage,
+                            sqlite3BtreeGetReserve(pSrc), 0);
+    sqlite3BtreeSetAutoVacuum(p->pDest, autoVacuum);
+    rc = sqlite3BtreeBeginTrans(p->pDest, 2);
+    if( rc==SQLITE_OK ) p->bDestLocked = 1;
+  }
+  if( rc==SQLITE_OK ){
+    if( sqlite3BtreeGetPageSize(p->pDest)!=p->szPage
+     || sqlite3BtreeGetAutoVacuum(p->pDest)!=autoVacuum
+     || sqlite3BtreeLastPage(p->pDest)>1
+    ){
+      rc = SQLITE_ERROR;
+    }else{
+      rc = sqlite3BtreeLockTable(p->pDest, MASTER_ROOT, 1);
+    }
+  }
+  if( rc!=SQLITE_OK ) return rc;
+  sqlite3BtreeGetMeta(pSrc, BTREE_SCHEMA_VERSION, &p->iDestSchema);
+
+  p->pSrcCur = (BtCursor*)sqlite3MallocZero(2*szCursor);
+  pCur = (BtCursor*)sqlite3MallocZero(szCursor);
+  if( p->pSrcCur==0 || pCur==0 ){
+    sqlite3_free(pCur);
+    return SQLITE_NOMEM;
+  }
+  p->pDestCur = (BtCursor*)&((u8*)p->pSrcCur)[szCursor];
+
+  /* Read the root page of each table and index from the sqlite_master
+  ** table of the source. The sqlite_master table itself is copied last,
+  ** so that the root page numbers stored in it can be changed to those
+  ** of the new b-trees. */
+  rc = sqlite3BtreeCursor(pSrc, MASTER_ROOT, 0, 0, pCur);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3BtreeFirst(pCur, &bEof);
+  }else if( rc==SQLITE_EMPTY ){
+    rc = SQLITE_OK;
+    bEof = 1;
+  }
+  while( rc==SQLITE_OK ){
+    const u8 *aRec;
+    u32 nRec = 0;
+    int nLocal = 0;
+    int iHdr, iOff, t;
+    i64 iRoot;
+
+    if( nAlloc<=p->nTree ){
+      BackupTree *aNew;
+      nAlloc = nAlloc*2 + 16;
+      aNew = (BackupTree*)sqlite3Realloc(p->aTree, nAlloc*sizeof(BackupTree));
+      if( aNew==0 ){
+        rc = SQLITE_NOMEM;
+        break;
+      }
+      p->aTree = aNew;
+    }
+    if( bEof ){
+      p->aTree[p->nTree].iSrc = MASTER_ROOT;
+      p->aTree[p->nTree].iDest = MASTER_ROOT;
+      p->aTree[p->nTree].isIndex = 0;
+      p->nTree++;
+      break;
+    }
+
+    sqlite3BtreeDataSize(pCur, &nRec);
+    aRec = (const u8*)sqlite3BtreeDataFetch(pCur, &nLocal);
+    if( nLocal<(int)nRec ){
+      rc = backupBufferSize(p, (int)nRec);
+      if( rc==SQLITE_OK ) rc = sqlite3BtreeData(pCur, 0, nRec, p->aBuf);
+      if( rc!=SQLITE_OK ) break;
+      aRec = p->aBuf;
+    }
+    t = backupRecordField(aRec, (int)nRec, 3, &iHdr, &iOff);
+    if( t<0 ){
+      rc = SQLITE_CORRUPT_BKPT;
+      break;
+    }
+    iRoot = backupSerialInt(&aRec[iOff], t);
+    if( iRoot>0 ){
+      BackupTree *pTree = &p->aTree[p->nTree++];
+      if( iRoot==MASTER_ROOT || iRoot>sqlite3BtreeLastPage(pSrc) ){
+        rc = SQLITE_CORRUPT_BKPT;
+        break;
+      }
+      t = backupRecordField(aRec, (int)nRec, 0, &iHdr, &iOff);
+      pTree->iSrc = (Pgno)iRoot;
+      pTree->iDest = 0;
+      pTree->isIndex = (t==13+2*5 && memcmp(&aRec[iOff], "index", 5)==0);
+    }
+    rc = sqlite3BtreeNext(pCur, &bEof);
+  }
+  sqlite3BtreeCloseCursor(pCur);
+  sqlite3_free(pCur);
+
+  for(i=0; rc==SQLITE_OK && i<p->nTree-1; i++){
+    int iDest = 0;
+    rc = sqlite3BtreeCreateTable(p->pDest, &iDest,
+        p->aTree[i].isIndex ? BTREE_BLOBKEY : BTREE_INTKEY
+    );
+    p->aTree[i].iDest = (Pgno)iDest;
+  }
+  return rc;
+}
+
+/*
+** Change the root page number stored in the sqlite_master record *paRec,
+** which is *pnRec bytes in size, from that of the source b-tree to that
+** of the destination b-tree. The new record is written to p->aBuf[],
+** which may also hold the old one, and *paRec and *pnRec are set to
+** describe it.
+*/
+static int backupRemapRoot(sqlite3_backup *p, const u8 **paRec, int *pnRec){
+  const u8 *aRec = *paRec;
+  const int nRec = *pnRec;
+  int iHdr, iOff, t, nOld;
+  i64 iRoot;
+  int i;
+  int rc;
+
+  t = backupRecordField(aRec, nRec, 3, &iHdr, &iOff);
+  if( t<0 ) return SQLITE_CORRUPT_BKPT;
+  iRoot = backupSerialInt(&aRec[iOff], t);
+  if( iRoot<=0 ) return SQLITE_OK;
+  for(i=0; i<p->nTree && p->aTree[i].iSrc!=(Pgno)iRoot; i++);
+  if( i>=p->nTree ) return SQLITE_CORRUPT_BKPT;
+
+  /* Store the new root page number as a 4-byte integer (serial type 4).
+  ** The serial types of integers are all one byte in size, so the size
+  ** of the record header does not change. */
+  nOld = backupSerialLen(t);
+  if( aRec==p->aBuf ){
+    rc = backupBufferSize(p, nRec-nOld+4);
+    if( rc!=SQLITE_OK ) return rc;
+    memmove(&p->aBuf[iOff+4], &p->aBuf[iOff+nOld], nRec-iOff-nOld);
+  }else{
+    rc = backupBufferSize(p, nRec-nOld+4);
+    if( rc!=SQLITE_OK ) return rc;
+    memcpy(p->aBuf, aRec, iOff);
+    memcpy(&p->aBuf[iOff+4], &aRec[iOff+nOld], nRec-iOff-nOld);
+  }
+  p->aBuf[iHdr] = 4;
+  put4byte(&p->aBuf[iOff], p->aTree[i].iDest);
+  *paRec = p->aBuf;
+  *pnRec = nRec-nOld+4;
+  return SQLITE_OK;
+}
+
+/*
+** Copy the entry that p->pSrcCur points to onto the end of the b-tree that
+** p->pDestCur is open on. Add the size of the entry to *pnByte.
+*/
+static int backupCopyEntry(sqlite3_backup *p, int *pnByte){
+  BackupTree *pTree = &p->aTree[p->iTree];
+  BtCursor *pCur = p->pSrcCur;
+  const u8 *aData;
+  i64 nKey = 0;
+  u32 nData = 0;
+  int nLocal = 0;
+  int n;
+  int bEmpty = 0;
+  int rc;
+
+  sqlite3BtreeKeySize(pCur, &nKey);
+  if( pTree->isIndex ){
+    n = (int)nKey;
+    aData = (const u8*)sqlite3BtreeKeyFetch(pCur, &nLocal);
+  }else{
+    sqlite3BtreeDataSize(pCur, &nData);
+    n = (int)nData;
+    aData = (const u8*)sqlite3BtreeDataFetch(pCur, &nLocal);
+  }
+  if( nLocal<n ){
+    rc = backupBufferSize(p, n);
+    if( rc!=SQLITE_OK ) return rc;
+    if( pTree->isIndex ){
+      rc = sqlite3BtreeKey(pCur, 0, n, p->aBuf);
+    }else{
+      rc = sqlite3BtreeData(pCur, 0, n, p->aBuf);
+    }
+    if( rc!=SQLITE_OK ) return rc;
+    aData = p->aBuf;
+  }
+  if( pTree->iSrc==MASTER_ROOT ){
+    rc = backupRemapRoot(p, &aData, &n);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  *pnByte += n;
+
+  /* The source b-tree is read in order, so each entry is appended to the
+  ** destination b-tree. Keys are never compared. */
+  rc = sqlite3BtreeLast(p->pDestCur, &bEmpty);
+  if( rc==SQLITE_OK ){
+    if( pTree->isIndex ){
+      rc = sqlite3BtreeInsert(p->pDestCur, aData, n, 0, 0, 0, 1, -1);
+    }else{
+      rc = sqlite3BtreeInsert(p->pDestCur, 0, nKey, aData, n, 0, 1, -1);
+    }
+  }
+  return rc;
+}
+
+/*
+** Copy about nPage source pages worth of b-tree entries to the
+** destination, or all remaining entries if nPage is negative. Return
+** SQLITE_DONE once every b-tree has been copied.
+*/
+static int backupConvertStep(
+  sqlite3_backup *p,              /* Backup object */
+  Btree *pSrc,                    /* B-tree to read from */
+  int nPage,                      /* Number of pages worth to copy */
+  int *pnByte                     /* IN/OUT: Bytes read from the source */
+){
+  const int pgszSrc = sqlite3BtreeGetPageSize(pSrc);
+  const int nSrcPage = (int)sqlite3BtreeLastPage(pSrc);
+  i64 nBudget = (nPage<0) ? LARGEST_INT64 : (i64)nPage*pgszSrc;
+  int nByte = 0;
+  int rc = SQLITE_OK;
+
+  while( rc==SQLITE_OK && p->iTree<p->nTree && nByte<nBudget ){
+    BackupTree *pTree = &p->aTree[p->iTree];
+    int bEof = 0;
+    if( p->bCursor==0 ){
+      KeyInfo *pKeyInfo = pTree->isIndex ? &p->keyInfo : 0;
+      sqlite3BtreeCursorZero(p->pSrcCur);
+      sqlite3BtreeCursorZero(p->pDestCur);
+      p->bCursor = 1;
+      rc = sqlite3BtreeLockTable(pSrc, pTree->iSrc, 0);
+      if( rc==SQLITE_OK ){
+        rc = sqlite3BtreeCursor(pSrc, pTree->iSrc, 0, pKeyInfo, p->pSrcCur);
+      }
+      if( rc==SQLITE_OK ){
+        rc = sqlite3BtreeCursor(p->pDest, pTree->iDest, 1, pKeyInfo,
+                                p->pDestCur);
+      }
+      if( rc==SQLITE_OK ){
+        rc = sqlite3BtreeFirst(p->pSrcCur, &bEof);
+      }else if( rc==SQLITE_EMPTY ){
+        rc = SQLITE_OK;
+        bEof = 1;
+      }
+    }else{
+      rc = backupCopyEntry(p, &nByte);
+      if( rc==SQLITE_OK ) rc = sqlite3BtreeNext(p->pSrcCur, &bEof);
+    }
+    if( rc==SQLITE_OK && bEof ){
+      backupConvertClose(p);
+      p->iTree++;
+    }
+  }
+  if( rc==SQLITE_OK && p->iTree>=p->nTree ){
+    /* Copy the meta values that describe the database as a whole. */
+    static const unsigned char aCopy[] = {
+       BTREE_FILE_FORMAT,
+       BTREE_DEFAULT_CACHE_SIZE,
+       BTREE_TEXT_ENCODING,
+       BTREE_USER_VERSION,
+       BTREE_INCR_VACUUM,
+    };
+    int i;
+    for(i=0; rc==SQLITE_OK && i<ArraySize(aCopy); i++){
+      u32 meta;
+      if( aCopy[i]==BTREE_INCR_VACUUM && !sqlite3BtreeGetAutoVacuum(pSrc) ){
+        continue;
+      }
+      sqlite3BtreeGetMeta(pSrc, aCopy[i], &meta);
+      rc = sqlite3BtreeUpdateMeta(p->pDest, aCopy[i], meta);
+    }
+    if( rc==SQLITE_OK ) rc = SQLITE_DONE;
+  }
+
+  p->nCopied += nByte;
+  p->nPagecount = nSrcPage;
+  if( rc==SQLITE_DONE ){
+    p->nRemaining = 0;
+  }else{
+    i64 nDone = p->nCopied/pgszSrc;
+    p->nRemaining = (nDone<nSrcPage) ? (Pgno)(nSrcPage-nDone) : 1;
+  }
+  *pnByte += nByte;
+  return rc;
+}
+
 /*
 ** Copy nPage pages from the source b-tree to the destination.
 */
@@ -302,79 +882,161 @@ int sqlite3_backup_step(sqlite3_backup *p, int nPage){
   int destMode;       /* Destination journal mode */
   int pgszSrc = 0;    /* Source page size */
   int pgszDest = 0;   /* Destination page size */
+  int nByte = 0;      /* Bytes read from the source by this call */
+  int nSleep = 0;     /* Microseconds to sleep for before returning */
 
   sqlite3_mutex_enter(p->pSrcDb->mutex);
   sqlite3BtreeEnter(p->pSrc);
   if( p->pDestDb ){
     sqlite3_mutex_enter(p->pDestDb->mutex);
   }
+  if( p->nRate>0 && p->iRateStart==0 ){
+    sqlite3OsCurrentTimeInt64(p->pSrcDb->pVfs, &p->iRateStart);
+  }
 
   rc = p->rc;
+  if( !isFatalError(rc) && p->bSnapshot ){
+    rc = backupOpenSnapshot(p);
+    if( rc!=SQLITE_OK ){
+      p->rc = rc;
+    }
+  }
   if( !isFatalError(rc) ){
-    Pager * const pSrcPager = sqlite3BtreePager(p->pSrc);     /* Source pager */
+    Btree * const pSrc = backupReadBtree(p);                  /* Read from */
+    Pager * const pSrcPager = sqlite3BtreePager(pSrc);        /* Source pager */
     Pager * const pDestPager = sqlite3BtreePager(p->pDest);   /* Dest pager */
     int ii;                            /* Iterator variable */
     int nSrcPage = -1;                 /* Size of source db in pages */
     int bCloseTrans = 0;               /* True if src db requires unlocking */
+    u8 *aRead = 0;                     /* Buffer for p->nReadPage pages */
+
+    if( p->pSnapDb ){
+      sqlite3_mutex_enter(p->pSnapDb->mutex);
+      sqlite3BtreeEnter(pSrc);
+    }
 
     /* If the source pager is currently in a write-transaction, return
-    ** SQLITE_BUSY immediately.
+    ** SQLITE_BUSY immediately. This does not apply in snapshot mode, as
+    ** pages are then read using a separate connection.
     */
-    if( p->pDestDb && p->pSrc->pBt->inTransaction==TRANS_WRITE ){
+    if( p->pDestDb && pSrc->pBt->inTransaction==TRANS_WRITE ){
       rc = SQLITE_BUSY;
     }else{
       rc = SQLITE_OK;
     }
 
-    /* Lock the destination database, if it is not locked already. */
-    if( SQLITE_OK==rc && p->bDestLocked==0
+    /* Lock the destination database, if it is not locked already. When
+    ** the page size is converted, this is done by backupConvertBegin().
+    */
+    if( SQLITE_OK==rc && p->bDestLocked==0 && p->szPage==0
      && SQLITE_OK==(rc = sqlite3BtreeBeginTrans(p->pDest, 2)) 
     ){
       p->bDestLocked = 1;
       sqlite3BtreeGetMeta(p->pDest, BTREE_SCHEMA_VERSION, &p->iDestSchema);
     }
 
+    /* In an incremental backup, start a new change-tracking generation
+    ** before the snapshot is taken. */
+    if( rc==SQLITE_OK && p->aGen && p->iGeneration==0 ){
+      rc = backupNextGeneration(p, pSrc);
+    }
+
     /* If there is no open read-transaction on the source database, open
     ** one now. If a transaction is opened here, then it will be closed
-    ** before this function exits.
+    ** before this function exits. Except in snapshot mode, where it
+    ** remains open until sqlite3_backup_finish() is called.
     */
-    if( rc==SQLITE_OK && 0==sqlite3BtreeIsInReadTrans(p->pSrc) ){
-      rc = sqlite3BtreeBeginTrans(p->pSrc, 0);
-      bCloseTrans = 1;
+    if( rc==SQLITE_OK && 0==sqlite3BtreeIsInReadTrans(pSrc) ){
+      rc = sqlite3BtreeBeginTrans(pSrc, 0);
+      bCloseTrans = (p->pSnapDb==0);
+    }
+    if( rc==SQLITE_OK && p->szPage && p->aTree==0 ){
+      sqlite3BtreeEnter(p->pDest);
+      rc = backupConvertBegin(p, pSrc);
+      sqlite3BtreeLeave(p->pDest);
     }
 
     /* Do not allow backup if the destination database is in WAL mode
     ** and the page sizes are different between source and destination */
-    pgszSrc = sqlite3BtreeGetPageSize(p->pSrc);
+    pgszSrc = sqlite3BtreeGetPageSize(pSrc);
     pgszDest = sqlite3BtreeGetPageSize(p->pDest);
     destMode = sqlite3PagerGetJournalMode(sqlite3BtreePager(p->pDest));
-    if( SQLITE_OK==rc && destMode==PAGER_JOURNALMODE_WAL && pgszSrc!=pgszDest ){
+    if( SQLITE_OK==rc && destMode==PAGER_JOURNALMODE_WAL && pgszSrc!=pgszDest
+     && p->szPage==0
+    ){
       rc = SQLITE_READONLY;
     }
+
+    /* An incremental backup copies source pages over the same pages of an
+    ** earlier backup, so the page sizes must match. */
+    if( SQLITE_OK==rc && p->aGen && p->iSince>0 && pgszSrc!=pgszDest ){
+      rc = SQLITE_ERROR;
+    }
   
     /* Now that there is a read-lock on the source database, query the
     ** source pager for the number of pages in the database.
     */
-    nSrcPage = (int)sqlite3BtreeLastPage(p->pSrc);
+    nSrcPage = (int)sqlite3BtreeLastPage(pSrc);
     assert( nSrcPage>=0 );
-    for(ii=0; (nPage<0 || ii<nPage) && p->iNext<=(Pgno)nSrcPage && !rc; ii++){
+    if( rc==SQLITE_OK && p->nReadPage>1 ){
+      aRead = (u8*)sqlite3Malloc(p->nReadPage*pgszSrc);
+      if( aRead==0 ) rc = SQLITE_NOMEM;
+    }
+    if( rc==SQLITE_OK && p->aGen ){
+      rc = backupSkipUnchanged(p, pSrcPager, (Pgno)nSrcPage);
+    }
+    for(ii=0; (nPage<0 || ii<nPage) && p->iNext<=(Pgno)nSrcPage && !rc
+        && p->aTree==0; ){
       const Pgno iSrcPg = p->iNext;                 /* Source page number */
-      if( iSrcPg!=PENDING_BYTE_PAGE(p->pSrc->pBt) ){
+      const Pgno iPending = PENDING_BYTE_PAGE(pSrc->pBt);
+      int nRun = 1;                                 /* Pages read at once */
+      if( aRead ){
+        nRun = MIN(p->nReadPage, nSrcPage+1-(int)iSrcPg);
+        if( nPage>=0 ) nRun = MIN(nRun, nPage-ii);
+        if( iSrcPg<iPending && iSrcPg+nRun>iPending ){
+          nRun = (int)(iPending - iSrcPg);
+        }
+        if( p->aGen && nRun>1 ){
+          nRun = backupChangedRun(p, iSrcPg, nRun);
+        }
+      }
+      if( iSrcPg==iPending ){
+        nRun = 1;
+      }else if( nRun>1 ){
+        int jj;
+        rc = sqlite3PagerReadRun(pSrcPager, iSrcPg, nRun, aRead);
+        for(jj=0; rc==SQLITE_OK && jj<nRun; jj++){
+          rc = backupOnePage(p, iSrcPg+jj, &aRead[jj*pgszSrc]);
+        }
+        nByte += nRun*pgszSrc;
+      }else{
         DbPage *pSrcPg;                             /* Source page object */
         rc = sqlite3PagerGet(pSrcPager, iSrcPg, &pSrcPg);
         if( rc==SQLITE_OK ){
           rc = backupOnePage(p, iSrcPg, sqlite3PagerGetData(pSrcPg));
           sqlite3PagerUnref(pSrcPg);
         }
+        nByte += pgszSrc;
+      }
+      p->iNext += nRun;
+      ii += nRun;
+      if( rc==SQLITE_OK && p->aGen ){
+        rc = backupSkipUnchanged(p, pSrcPager, (Pgno)nSrcPage);
       }
-      p->iNext++;
     }
-    if( rc==SQLITE_OK ){
+    sqlite3_free(aRead);
+    if( rc==SQLITE_OK && p->aTree ){
+      /* The page size is being converted. B-tree entries are copied
+      ** instead of pages. */
+      sqlite3BtreeEnter(p->pDest);
+      rc = backupConvertStep(p, pSrc, nPage, &nByte);
+      sqlite3BtreeLeave(p->pDest);
+    }else if( rc==SQLITE_OK ){
       p->nPagecount = nSrcPage;
       p->nRemaining = nSrcPage+1-p->iNext;
       if( p->iNext>(Pgno)nSrcPage ){
         rc = SQLITE_DONE;
-      }else if( !p->isAttached ){
+      }else if( !p->isAttached && p->pSnapDb==0 ){
         attachBackupObject(p);
       }
     }
@@ -384,7 +1046,20 @@ int sqlite3_backup_step(sqlite3_backup *p, int nPage){
     ** the case where the source and destination databases have the
     ** same schema version.
     */
-    if( rc==SQLITE_DONE 
+    if( rc==SQLITE_DONE && p->aTree
+     && (rc = sqlite3BtreeUpdateMeta(p->pDest,1,p->iDestSchema+1))==SQLITE_OK
+    ){
+      /* The page size was converted. The destination was empty, so there
+      ** is nothing to truncate. */
+      if( p->pDestDb ){
+        sqlite3ResetInternalSchema(p->pDestDb, 0);
+      }
+      if( SQLITE_OK==(rc = sqlite3BtreeCommitPhaseOne(p->pDest, 0))
+       && SQLITE_OK==(rc = sqlite3BtreeCommitPhaseTwo(p->pDest))
+      ){
+        rc = SQLITE_DONE;
+      }
+    }else if( rc==SQLITE_DONE 
      && (rc = sqlite3BtreeUpdateMeta(p->pDest,1,p->iDestSchema+1))==SQLITE_OK
     ){
       int nDestTruncate;
@@ -405,7 +1080,7 @@ int sqlite3_backup_step(sqlite3_backup *p, int nPage){
       ** journalled by PagerCommitPhaseOne() before they are destroyed
       ** by the file truncation.
       */
-      assert( pgszSrc==sqlite3BtreeGetPageSize(p->pSrc) );
+      assert( pgszSrc==sqlite3BtreeGetPageSize(pSrc) );
       assert( pgszDest==sqlite3BtreeGetPageSize(p->pDest) );
       if( pgszSrc<pgszDest ){
         int ratio = pgszDest/pgszSrc;
@@ -476,21 +1151,29 @@ int sqlite3_backup_step(sqlite3_backup *p, int nPage){
     */
     if( bCloseTrans ){
       TESTONLY( int rc2 );
-      TESTONLY( rc2  = ) sqlite3BtreeCommitPhaseOne(p->pSrc, 0);
-      TESTONLY( rc2 |= ) sqlite3BtreeCommitPhaseTwo(p->pSrc);
+      TESTONLY( rc2  = ) sqlite3BtreeCommitPhaseOne(pSrc, 0);
+      TESTONLY( rc2 |= ) sqlite3BtreeCommitPhaseTwo(pSrc);
       assert( rc2==SQLITE_OK );
     }
+    if( p->pSnapDb ){
+      sqlite3BtreeLeave(pSrc);
+      sqlite3_mutex_leave(p->pSnapDb->mutex);
+    }
   
     if( rc==SQLITE_IOERR_NOMEM ){
       rc = SQLITE_NOMEM;
     }
     p->rc = rc;
+    nSleep = backupThrottle(p, nByte);
   }
   if( p->pDestDb ){
     sqlite3_mutex_leave(p->pDestDb->mutex);
   }
   sqlite3BtreeLeave(p->pSrc);
   sqlite3_mutex_leave(p->pSrcDb->mutex);
+  if( nSleep>0 ){
+    sqlite3OsSleep(p->pSrcDb->pVfs, nSleep);
+  }
   return rc;
 }
 
@@ -523,9 +1206,18 @@ int sqlite3_backup_finish(sqlite3_backup *p){
     *pp = p->pNext;
   }
 
-  /* If a transaction is still open on the Btree, roll it back. */
+  /* If a transaction is still open on the Btree, roll it back. Close the
+  ** cursors used to convert the page size first. */
+  backupConvertClose(p);
   sqlite3BtreeRollback(p->pDest);
 
+  /* End the read transaction on the snapshot, if there is one. */
+  backupCloseSnapshot(p);
+  sqlite3_free(p->aGen);
+  sqlite3_free(p->aTree);
+  sqlite3_free(p->pSrcCur);
+  sqlite3_free(p->aBuf);
+
   /* Set the error code of the destination database handle. */
   rc = (p->rc==SQLITE_DONE) ? SQLITE_OK : p->rc;
   sqlite3Error(p->pDestDb, rc, 0);
@@ -561,6 +1253,108 @@ int sqlite3_backup_pagecount(sqlite3_backup *p){
   return p->nPagecount;
 }
 
+/*
+** Return the change-tracking generation of the snapshot copied by an
+** incremental backup, or zero if it is not yet known.
+*/
+sqlite3_int64 sqlite3_backup_generation(sqlite3_backup *p){
+  return p->iGeneration;
+}
+
+/*
+** Return true if a snapshot of the source database of backup p may be
+** read using a private connection.
+*/
+static int backupSnapshotOk(sqlite3_backup *p){
+  Pager *pPager = sqlite3BtreePager(p->pSrc);
+  return !sqlite3PagerIsMemdb(pPager)
+      && sqlite3PagerFilename(pPager)[0]!=0
+#ifdef SQLITE_HAS_CODEC
+      && sqlite3PagerGetCodec(pPager)==0
+#endif
+  ;
+}
+
+/*
+** Configure the backup. See the documentation of sqlite3_backup_config()
+** and the SQLITE_BACKUPCONFIG_XXX constants in sqlite.h.in for details.
+*/
+int sqlite3_backup_config(sqlite3_backup *p, int op, ...){
+  va_list ap;
+  int rc = SQLITE_OK;
+  int iVal = 0;
+  i64 iVal64 = 0;
+
+  sqlite3_mutex_enter(p->pSrcDb->mutex);
+  va_start(ap, op);
+  if( op==SQLITE_BACKUPCONFIG_INCREMENTAL ){
+    iVal64 = va_arg(ap, sqlite3_int64);
+  }else{
+    iVal = va_arg(ap, int);
+  }
+  if( op!=SQLITE_BACKUPCONFIG_RATELIMIT
+   && (p->bDestLocked || isFatalError(p->rc))
+  ){
+    rc = SQLITE_MISUSE;
+  }else{
+    switch( op ){
+      case SQLITE_BACKUPCONFIG_SNAPSHOT: {
+        if( iVal ? !backupSnapshotOk(p) : (p->aGen!=0 || p->szPage!=0) ){
+          rc = SQLITE_ERROR;
+        }else{
+          p->bSnapshot = (iVal!=0);
+        }
+        break;
+      }
+      case SQLITE_BACKUPCONFIG_READSIZE: {
+        if( iVal<1 || iVal>4096 ){
+          rc = SQLITE_ERROR;
+        }else{
+          p->nReadPage = iVal;
+        }
+        break;
+      }
+      case SQLITE_BACKUPCONFIG_RATELIMIT: {
+        p->nRate = (iVal>0 ? iVal : 0);
+        p->iRateStart = 0;
+        p->nRateByte = 0;
+        break;
+      }
+      case SQLITE_BACKUPCONFIG_INCREMENTAL: {
+        if( iVal64<0 || !backupSnapshotOk(p) || p->szPage ){
+          rc = SQLITE_ERROR;
+        }else if( p->aGen==0
+               && 0==(p->aGen = (u32*)sqlite3Malloc(BACKUP_NGEN*sizeof(u32)))
+        ){
+          rc = SQLITE_NOMEM;
+        }else{
+          p->bSnapshot = 1;
+          p->iSince = iVal64;
+        }
+        break;
+      }
+      case SQLITE_BACKUPCONFIG_PAGESIZE: {
+        if( iVal<512 || iVal>SQLITE_MAX_PAGE_SIZE || (iVal&(iVal-1))!=0
+         || !backupSnapshotOk(p) || p->aGen!=0
+        ){
+          rc = SQLITE_ERROR;
+        }else{
+          p->bSnapshot = 1;
+          p->szPage = iVal;
+        }
+        break;
+      }
+      default: {
+        rc = SQLITE_ERROR;
+        break;
+      }
+    }
+  }
+  va_end(ap);
+  sqlite3_mutex_leave(p->pSrcDb->mutex);
+  return rc;
+}
+
 /*
 ** This function is called after the contents of page iPage of the
 ** source database have been modified. If page iPage has already been 
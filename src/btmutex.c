@@ -20,7 +20,33 @@
 #if SQLITE_THREADSAFE
 
 /*
-** Obtain the BtShared mutex associated with B-Tree handle p. Also,
+** Return the number of Btree handles that hold a shared lock on pBt.
+*/
+static int btreeReaderCount(BtShared *pBt){
+  int nReader;
+  sqlite3_mutex_enter(pBt->pLatch);
+  nReader = pBt->nReader;
+  sqlite3_mutex_leave(pBt->pLatch);
+  return nReader;
+}
+
+/*
+** This is called by a thread that holds the BtShared mutex of p in
+** order to wait for the connections that hold shared locks on the
+** same BtShared to release them. No new shared locks may be taken
+** while the mutex is held.
+*/
+static void waitForReaders(Btree *p){
+  while( btreeReaderCount(p->pBt)>0 ){
+    if( sqlite3LockWait(1)==0 ){
+      sqlite3OsSleep(p->db->pVfs, 100);
+    }
+  }
+}
+
+/*
+** Obtain the BtShared mutex associated with B-Tree handle p and wait
+** for any shared locks held by other connections to be released. Also,
 ** set BtShared.db to the database handle associated with p and the
 ** p->locked boolean to true.
 */
@@ -30,21 +56,62 @@ static void lockBtreeMutex(Btree *p){
   assert( sqlite3_mutex_held(p->db->mutex) );
 
   sqlite3_mutex_enter(p->pBt->mutex);
+  waitForReaders(p);
   p->pBt->db = p->db;
   p->locked = 1;
 }
 
 /*
-** Release the BtShared mutex associated with B-Tree handle p and
-** clear the p->locked boolean.
+** Obtain a shared lock on the BtShared associated with B-Tree handle p.
+** A shared lock allows only read-only access to the btree, and does not
+** set BtShared.db. Any number of database connections may hold shared
+** locks at the same time.
+**
+** If another connection has a write transaction open on the BtShared,
+** or if the BtShared has no mutexes, the BtShared mutex is obtained
+** instead, exactly as by lockBtreeMutex().
+*/
+static void lockBtreeShared(Btree *p){
+  BtShared *pBt = p->pBt;
+  assert( p->locked==0 );
+  assert( sqlite3_mutex_notheld(pBt->mutex) );
+  assert( sqlite3_mutex_held(p->db->mutex) );
+
+  sqlite3_mutex_enter(pBt->mutex);
+  if( pBt->pLatch==0 || pBt->inTransaction==TRANS_WRITE ){
+    assert( pBt->nReader==0 );
+    pBt->db = p->db;
+  }else{
+    sqlite3_mutex_enter(pBt->pLatch);
+    pBt->nReader++;
+    sqlite3_mutex_leave(pBt->pLatch);
+    sqlite3_mutex_leave(pBt->mutex);
+    p->shareLock = 1;
+  }
+  p->locked = 1;
+}
+
+/*
+** Release the BtShared mutex or shared lock associated with B-Tree 
+** handle p and clear the p->locked boolean.
 */
 static void unlockBtreeMutex(Btree *p){
+  BtShared *pBt = p->pBt;
   assert( p->locked==1 );
-  assert( sqlite3_mutex_held(p->pBt->mutex) );
   assert( sqlite3_mutex_held(p->db->mutex) );
-  assert( p->db==p->pBt->db );
 
-  sqlite3_mutex_leave(p->pBt->mutex);
+  if( p->shareLock ){
+    int nReader;
+    sqlite3_mutex_enter(pBt->pLatch);
+    nReader = --pBt->nReader;
+    sqlite3_mutex_leave(pBt->pLatch);
+    if( nReader==0 ) sqlite3LockWakeup();
+    p->shareLock = 0;
+  }else{
+    assert( sqlite3_mutex_held(pBt->mutex) );
+    assert( p->db==pBt->db );
+    sqlite3_mutex_leave(pBt->mutex);
+  }
   p->locked = 0;
 }
 
@@ -84,9 +151,10 @@ void sqlite3BtreeEnter(Btree *p){
   /* We should already hold a lock on the database connection */
   assert( sqlite3_mutex_held(p->db->mutex) );
 
-  /* Unless the database is sharable and unlocked, then BtShared.db
-  ** should already be set correctly. */
-  assert( (p->locked==0 && p->sharable) || p->pBt->db==p->db );
+  /* Unless the database is sharable and unlocked, or locked with a
+  ** shared lock, then BtShared.db should already be set correctly. */
+  assert( (p->locked==0 && p->sharable) || p->shareLock 
+       || p->pBt->db==p->db );
 
   if( !p->sharable ) return;
   p->wantToLock++;
@@ -97,9 +165,12 @@ void sqlite3BtreeEnter(Btree *p){
   ** procedure that follows.  Just be sure not to block.
   */
   if( sqlite3_mutex_try(p->pBt->mutex)==SQLITE_OK ){
-    p->pBt->db = p->db;
-    p->locked = 1;
-    return;
+    if( btreeReaderCount(p->pBt)==0 ){
+      p->pBt->db = p->db;
+      p->locked = 1;
+      return;
+    }
+    sqlite3_mutex_leave(p->pBt->mutex);
   }
 
   /* To avoid deadlock, first release all locks with a larger
@@ -138,15 +209,17 @@ void sqlite3BtreeLeave(Btree *p){
 
 #ifndef NDEBUG
 /*
-** Return true if the BtShared mutex is held on the btree, or if the
-** B-Tree is not marked as sharable.
+** Return true if the BtShared mutex or a shared lock is held on the 
+** btree, or if the B-Tree is not marked as sharable.
 **
 ** This routine is used only from within assert() statements.
 */
 int sqlite3BtreeHoldsMutex(Btree *p){
   assert( p->sharable==0 || p->locked==0 || p->wantToLock>0 );
-  assert( p->sharable==0 || p->locked==0 || p->db==p->pBt->db );
-  assert( p->sharable==0 || p->locked==0 || sqlite3_mutex_held(p->pBt->mutex) );
+  assert( p->sharable==0 || p->locked==0 || p->shareLock 
+       || p->db==p->pBt->db );
+  assert( p->sharable==0 || p->locked==0 || p->shareLock
+       || sqlite3_mutex_held(p->pBt->mutex) );
   assert( p->sharable==0 || p->locked==0 || sqlite3_mutex_held(p->db->mutex) );
 
   return (p->sharable==0 || p->locked);
@@ -187,13 +260,21 @@ void sqlite3BtreeEnterAll(sqlite3 *db){
   int i;
   Btree *p, *pLater;
   assert( sqlite3_mutex_held(db->mutex) );
+
+  /* Shared locks are not sufficient for the callers of this routine,
+  ** which may modify the schema. Release any that are held so that
+  ** the BtShared mutexes may be obtained below. */
+  for(i=0; i<db->nDb; i++){
+    p = db->aDb[i].pBt;
+    if( p && p->locked && p->shareLock ) unlockBtreeMutex(p);
+  }
+
   for(i=0; i<db->nDb; i++){
     p = db->aDb[i].pBt;
     assert( !p || (p->locked==0 && p->sharable) || p->pBt->db==p->db );
     if( p && p->sharable ){
       p->wantToLock++;
       if( !p->locked ){
-        assert( p->wantToLock==1 );
         while( p->pPrev ) p = p->pPrev;
         /* Reason for ALWAYS:  There must be at least on unlocked Btree in
         ** the chain.  Otherwise the !p->locked test above would have failed */
@@ -243,7 +324,8 @@ int sqlite3BtreeHoldsAllMutexes(sqlite3 *db){
     Btree *p;
     p = db->aDb[i].pBt;
     if( p && p->sharable &&
-         (p->wantToLock==0 || !sqlite3_mutex_held(p->pBt->mutex)) ){
+         (p->wantToLock==0 || p->shareLock
+          || !sqlite3_mutex_held(p->pBt->mutex)) ){
       return 0;
     }
   }
@@ -296,9 +378,19 @@ void sqlite3BtreeMutexArrayInsert(BtreeMutexArray *pArray, Btree *pBtree){
 ** Enter the mutex of every btree in the array.  This routine is
 ** called at the beginning of sqlite3VdbeExec().  The mutexes are
 ** exited at the end of the same function.
+**
+** If a shared lock is held on any btree in the array, it is released
+** and replaced by the BtShared mutex. To preserve the lock ordering,
+** the locks on all btrees that follow it in the array are released 
+** and reacquired too.
 */
 void sqlite3BtreeMutexArrayEnter(BtreeMutexArray *pArray){
   int i;
+  for(i=0; i<pArray->nMutex && !pArray->aBtree[i]->shareLock; i++);
+  for(; i<pArray->nMutex; i++){
+    Btree *p = pArray->aBtree[i];
+    if( p->locked ) unlockBtreeMutex(p);
+  }
   for(i=0; i<pArray->nMutex; i++){
     Btree *p = pArray->aBtree[i];
     /* Some basic sanity checking */
@@ -315,6 +407,77 @@ void sqlite3BtreeMutexArrayEnter(BtreeMutexArray *pArray){
     p->wantToLock++;
     if( !p->locked ){
       lockBtreeMutex(p);
+    }else{
+      /* The mutex may have been obtained by sqlite3BtreeMutexArrayEnterRead()
+      ** on behalf of an enclosing read-only statement. */
+      waitForReaders(p);
+    }
+  }
+}
+
+/*
+** This routine is used instead of sqlite3BtreeMutexArrayEnter() by
+** read-only statements.
+**
+** If the bShared argument is true, a shared lock is taken on each 
+** btree that is not already locked (see lockBtreeShared()). Otherwise,
+** the BtShared mutexes are obtained, replacing any shared locks held
+** as sqlite3BtreeMutexArrayEnter() does. But this routine does not
+** wait for other connections to release their shared locks, so the
+** caller may only open or close read transactions and obtain or release
+** read table locks while holding the mutexes.
+*/
+void sqlite3BtreeMutexArrayEnterRead(BtreeMutexArray *pArray, int bShared){
+  int i;
+  if( !bShared ){
+    for(i=0; i<pArray->nMutex && !pArray->aBtree[i]->shareLock; i++);
+    for(; i<pArray->nMutex; i++){
+      Btree *p = pArray->aBtree[i];
+      if( p->locked ) unlockBtreeMutex(p);
+    }
+  }
+  for(i=0; i<pArray->nMutex; i++){
+    Btree *p = pArray->aBtree[i];
+    assert( i==0 || pArray->aBtree[i-1]->pBt<p->pBt );
+    assert( !p->locked || p->wantToLock>0 );
+    assert( sqlite3_mutex_held(p->db->mutex) );
+    assert( p->sharable );
+
+    p->wantToLock++;
+    if( p->locked ) continue;
+    if( bShared ){
+      lockBtreeShared(p);
+    }else{
+      sqlite3_mutex_enter(p->pBt->mutex);
+      p->pBt->db = p->db;
+      p->locked = 1;
+    }
+  }
+}
+
+/*
+** Replace the BtShared mutex held on each btree in the array with a
+** shared lock, unless a write transaction is open on the BtShared or
+** the mutex is also required by an enclosing call to 
+** sqlite3BtreeEnter(). This is called by read-only statements once 
+** they have opened their read transactions and obtained their table
+** locks, which require the mutex.
+*/
+void sqlite3BtreeMutexArrayDowngrade(BtreeMutexArray *pArray){
+  int i;
+  for(i=0; i<pArray->nMutex; i++){
+    Btree *p = pArray->aBtree[i];
+    BtShared *pBt = p->pBt;
+    assert( p->locked );
+    if( p->shareLock==0 && p->wantToLock==1 && pBt->pLatch
+     && pBt->inTransaction!=TRANS_WRITE
+    ){
+      assert( sqlite3_mutex_held(pBt->mutex) );
+      sqlite3_mutex_enter(pBt->pLatch);
+      pBt->nReader++;
+      sqlite3_mutex_leave(pBt->pLatch);
+      sqlite3_mutex_leave(pBt->mutex);
+      p->shareLock = 1;
     }
   }
 }
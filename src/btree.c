@@ -165,18 +165,22 @@ static int hasSharedCacheTableLock(
 
   /* Search for the required lock. Either a write-lock on root-page iTab, a 
   ** write-lock on the schema table, or (if the client is reading) a
-  ** read-lock on iTab will suffice. Return 1 if any of these are found.  */
+  ** read-lock on iTab will suffice. Return 1 if any of these are found.  
+  ** The list is searched while holding the pLatch mutex, as the caller
+  ** may hold only a shared lock on the BtShared.  */
+  sqlite3_mutex_enter(pBtree->pBt->pLatch);
   for(pLock=pBtree->pBt->pLock; pLock; pLock=pLock->pNext){
     if( pLock->pBtree==pBtree 
      && (pLock->iTable==iTab || (pLock->eLock==WRITE_LOCK && pLock->iTable==1))
      && pLock->eLock>=eLockType 
     ){
-      return 1;
+      break;
     }
   }
+  sqlite3_mutex_leave(pBtree->pBt->pLatch);
 
-  /* Failed to find the required lock. */
-  return 0;
+  /* Return 0 if the required lock was not found. */
+  return pLock!=0;
 }
 #endif /* SQLITE_DEBUG */
 
@@ -329,8 +333,10 @@ static int setSharedCacheTableLock(Btree *p, Pgno iTable, u8 eLock){
     }
     pLock->iTable = iTable;
     pLock->pBtree = p;
+    sqlite3_mutex_enter(pBt->pLatch);
     pLock->pNext = pBt->pLock;
     pBt->pLock = pLock;
+    sqlite3_mutex_leave(pBt->pLatch);
   }
 
   /* Set the BtLock.eLock variable to the maximum of the current lock
@@ -363,6 +369,7 @@ static void clearAllSharedCacheTableLocks(Btree *p){
   assert( p->sharable || 0==*ppIter );
   assert( p->inTrans>0 );
 
+  sqlite3_mutex_enter(pBt->pLatch);
   while( *ppIter ){
     BtLock *pLock = *ppIter;
     assert( pBt->isExclusive==0 || pBt->pWriter==pLock->pBtree );
@@ -377,6 +384,7 @@ static void clearAllSharedCacheTableLocks(Btree *p){
       ppIter = &pLock->pNext;
     }
   }
+  sqlite3_mutex_leave(pBt->pLatch);
 
   assert( pBt->isPending==0 || pBt->pWriter );
   if( pBt->pWriter==p ){
@@ -419,13 +427,19 @@ static void downgradeAllSharedCacheTableLocks(Btree *p){
 static void releasePage(MemPage *pPage);  /* Forward reference */
 
 /*
-***** This routine is used inside of assert() only ****
+***** These routines are used inside of assert() only ****
 **
-** Verify that the cursor holds the mutex on its BtShared
+** Verify that the BtShared mutex is held, or that some connection holds
+** a shared lock on the BtShared (see btmutex.c). In the second case the
+** current thread should hold one of the shared locks, but there is no
+** way to check that.
 */
 #ifdef SQLITE_DEBUG
+static int btreeMutexHeld(BtShared *pBt){
+  return sqlite3_mutex_held(pBt->mutex) || pBt->nReader>0;
+}
 static int cursorHoldsMutex(BtCursor *p){
-  return sqlite3_mutex_held(p->pBt->mutex);
+  return btreeMutexHeld(p->pBt);
 }
 #endif
 
@@ -480,11 +494,35 @@ static void invalidateIncrblobCursors(
   }
 }
 
+/*
+** Invalidate any incrblob cursors open on a row of the table with root
+** page iRoot whose rowid lies between iFirst and iLast, inclusive. This
+** is called before the rows are deleted by sqlite3BtreeDeleteRange().
+*/
+static void invalidateIncrblobRange(
+  Btree *pBtree,          /* The database file to check */
+  Pgno iRoot,             /* Root page of the table being modified */
+  i64 iFirst,             /* First rowid being deleted */
+  i64 iLast               /* Last rowid being deleted */
+){
+  BtCursor *p;
+  BtShared *pBt = pBtree->pBt;
+  assert( sqlite3BtreeHoldsMutex(pBtree) );
+  for(p=pBt->pCursor; p; p=p->pNext){
+    if( p->isIncrblobHandle && p->pgnoRoot==iRoot 
+     && p->info.nKey>=iFirst && p->info.nKey<=iLast
+    ){
+      p->eState = CURSOR_INVALID;
+    }
+  }
+}
+
 #else
   /* Stub functions when INCRBLOB is omitted */
   #define invalidateOverflowCache(x)
   #define invalidateAllOverflowCache(x)
   #define invalidateIncrblobCursors(x,y,z)
+  #define invalidateIncrblobRange(w,x,y,z)
 #endif /* SQLITE_OMIT_INCRBLOB */
 
 /*
@@ -738,7 +776,7 @@ int sqlite3BtreeCursorHasMoved(BtCursor *pCur, int *pHasMoved){
 static Pgno ptrmapPageno(BtShared *pBt, Pgno pgno){
   int nPagesPerMapPage;
   Pgno iPtrMap, ret;
-  assert( sqlite3_mutex_held(pBt->mutex) );
+  assert( btreeMutexHeld(pBt) );
   if( pgno<2 ) return 0;
   nPagesPerMapPage = (pBt->usableSize/5)+1;
   iPtrMap = (pgno-2)/nPagesPerMapPage;
@@ -817,10 +855,12 @@ static int ptrmapGet(BtShared *pBt, Pgno key, u8 *pEType, Pgno *pPgno){
   int offset;        /* Offset of entry in pointer map */
   int rc;
 
-  assert( sqlite3_mutex_held(pBt->mutex) );
+  assert( btreeMutexHeld(pBt) );
 
   iPtrmap = PTRMAP_PAGENO(pBt, key);
+  sqlite3_mutex_enter(pBt->pLatch);
   rc = sqlite3PagerGet(pBt->pPager, iPtrmap, &pDbPage);
+  sqlite3_mutex_leave(pBt->pLatch);
   if( rc!=0 ){
     return rc;
   }
@@ -831,7 +871,9 @@ static int ptrmapGet(BtShared *pBt, Pgno key, u8 *pEType, Pgno *pPgno){
   *pEType = pPtrmap[offset];
   if( pPgno ) *pPgno = get4byte(&pPtrmap[offset+1]);
 
+  sqlite3_mutex_enter(pBt->pLatch);
   sqlite3PagerUnref(pDbPage);
+  sqlite3_mutex_leave(pBt->pLatch);
   if( *pEType<1 || *pEType>5 ) return SQLITE_CORRUPT_BKPT;
   return SQLITE_OK;
 }
@@ -858,7 +900,7 @@ static int ptrmapGet(BtShared *pBt, Pgno key, u8 *pEType, Pgno *pPgno){
 */
 static u8 *findOverflowCell(MemPage *pPage, int iCell){
   int i;
-  assert( sqlite3_mutex_held(pPage->pBt->mutex) );
+  assert( btreeMutexHeld(pPage->pBt) );
   for(i=pPage->nOverflow-1; i>=0; i--){
     int k;
     struct _OvflCell *pOvfl;
@@ -891,9 +933,10 @@ static void btreeParseCellPtr(
   u16 n;                  /* Number bytes in cell content header */
   u32 nPayload;           /* Number of bytes of cell payload */
 
-  assert( sqlite3_mutex_held(pPage->pBt->mutex) );
+  assert( btreeMutexHeld(pPage->pBt) );
 
   pInfo->pCell = pCell;
+  pInfo->nShared = 0;
   assert( pPage->leaf==0 || pPage->leaf==1 );
   n = pPage->childPtrSize;
   assert( n==4-4*pPage->leaf );
@@ -909,6 +952,25 @@ static void btreeParseCellPtr(
     pInfo->nData = 0;
     n += getVarint32(&pCell[n], nPayload);
     pInfo->nKey = nPayload;
+    if( pPage->hasPrefix ){
+      u32 nShared;
+      n += getVarint32(&pCell[n], nShared);
+      if( nShared ){
+        /* The cell shares nShared bytes with the page prefix. Such a
+        ** cell is always stored entirely on the local page. */
+        int nSize;
+        if( nShared>nPayload ) nShared = nPayload;
+        pInfo->nShared = (u16)nShared;
+        pInfo->nPayload = nPayload;
+        pInfo->nHeader = n;
+        pInfo->nLocal = (u16)(nPayload - nShared);
+        pInfo->iOverflow = 0;
+        nSize = pInfo->nLocal + n;
+        if( nSize<4 ) nSize = 4;
+        pInfo->nSize = (u16)nSize;
+        return;
+      }
+    }
   }
   pInfo->nPayload = nPayload;
   pInfo->nHeader = n;
@@ -998,6 +1060,16 @@ static u16 cellSizePtr(MemPage *pPage, u8 *pCell){
     while( (*pIter++)&0x80 && pIter<pEnd );
   }else{
     pIter += getVarint32(pIter, nSize);
+    if( pPage->hasPrefix ){
+      u32 nShared;
+      pIter += getVarint32(pIter, nShared);
+      if( nShared ){
+        nSize = (nShared<nSize ? nSize-nShared : 0) + (u32)(pIter - pCell);
+        if( nSize<4 ) nSize = 4;
+        assert( nSize==debuginfo.nSize );
+        return (u16)nSize;
+      }
+    }
   }
 
   testcase( nSize==pPage->maxLocal );
@@ -1031,6 +1103,206 @@ static u16 cellSize(MemPage *pPage, int iCell){
 }
 #endif
 
+/*
+** Return the offset of the first byte past the cell content area of page
+** pPage. This is the usable size of the page, except on prefix pages,
+** where the page prefix and its 2-byte size follow the content area.
+*/
+#define contentEnd(P) \
+  ((int)(P)->pBt->usableSize - ((P)->hasPrefix ? 2+(P)->nPrefix : 0))
+
+/*
+** Return a pointer to the page prefix of prefix page P.
+*/
+#define pagePrefix(P) (&(P)->aData[(P)->pBt->usableSize-2-(P)->nPrefix])
+
+/*
+** Copy amt bytes, beginning at offset, of the payload of a cell that
+** shares nShared bytes of its record with the page prefix aPrefix into
+** buffer pBuf. aLocal points to the nLocal bytes of payload stored in
+** the cell itself: the record header followed by the part of the record
+** body that is not shared. The caller guarantees that offset+amt is not
+** greater than nLocal+nShared.
+**
+** SQLITE_CORRUPT is returned if the record header does not fit within
+** the local payload.
+*/
+static int copySharedPayload(
+  const u8 *aLocal,      /* Payload stored in the cell */
+  u32 nLocal,            /* Size of aLocal[] in bytes */
+  const u8 *aPrefix,     /* Page prefix */
+  u32 nShared,           /* Bytes of aPrefix[] shared by the record body */
+  u32 offset,            /* Begin copying this far into the payload */
+  u32 amt,               /* Copy this many bytes */
+  u8 *pBuf               /* Write the bytes here */
+){
+  u32 nHdr;
+  if( nLocal==0 ) return SQLITE_CORRUPT_BKPT;
+  getVarint32(aLocal, nHdr);
+  if( nHdr>nLocal ) return SQLITE_CORRUPT_BKPT;
+  assert( offset+amt<=nLocal+nShared );
+  while( amt>0 ){
+    const u8 *pSrc;
+    u32 n;
+    if( offset<nHdr ){
+      pSrc = &aLocal[offset];
+      n = nHdr - offset;
+    }else if( offset<nHdr+nShared ){
+      pSrc = &aPrefix[offset-nHdr];
+      n = nHdr + nShared - offset;
+    }else{
+      pSrc = &aLocal[offset-nShared];
+      n = nLocal + nShared - offset;
+    }
+    if( n>amt ) n = amt;
+    memcpy(pBuf, pSrc, n);
+    pBuf += n;
+    offset += n;
+    amt -= n;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Cell pCell belongs to prefix page pPage and is in expanded form: its
+** nShared field is zero. If the payload of the cell is stored entirely
+** on the page, return a pointer to the record body (the part of the
+** record that follows the record header) and set *pnBody to its size.
+** Otherwise, or if the cell is malformed, return NULL.
+*/
+static u8 *cellRecordBody(MemPage *pPage, u8 *pCell, int *pnBody){
+  u8 *pRec = &pCell[pPage->childPtrSize];
+  u32 nPayload;
+  u32 nHdr;
+
+  assert( pPage->hasPrefix && !pPage->intKey );
+  pRec += getVarint32(pRec, nPayload);
+  if( *(pRec++)!=0 || nPayload==0 || nPayload>pPage->maxLocal ){
+    return 0;
+  }
+  getVarint32(pRec, nHdr);
+  if( nHdr>nPayload ){
+    return 0;
+  }
+  *pnBody = (int)(nPayload - nHdr);
+  return &pRec[nHdr];
+}
+
+/*
+** Return the number of bytes of the nPrefix byte prefix aPrefix[] that
+** expanded cell pCell could share with it. This is zero if the cell
+** payload uses overflow pages.
+*/
+static int cellShare(
+  MemPage *pPage,         /* Prefix page the cell belongs to */
+  u8 *pCell,              /* The cell, in expanded form */
+  const u8 *aPrefix,      /* The prefix */
+  int nPrefix             /* Size of aPrefix[] in bytes */
+){
+  u8 *pBody;
+  int nBody;
+  int i;
+  if( nPrefix==0 || (pBody = cellRecordBody(pPage, pCell, &nBody))==0 ){
+    return 0;
+  }
+  if( nBody<nPrefix ) nPrefix = nBody;
+  for(i=0; i<nPrefix && pBody[i]==aPrefix[i]; i++);
+  return i;
+}
+
+/*
+** Return the size that expanded cell pCell, which is sz bytes in size,
+** has once it shares nShared bytes of its record with a page prefix.
+*/
+static int sharedCellSize(int sz, int nShared){
+  if( nShared>0 ){
+    sz = sz - nShared + (nShared>127);
+    if( sz<4 ) sz = 4;
+  }
+  return sz;
+}
+
+/*
+** Write into pOut a copy of the sz byte expanded cell pCell that shares
+** as much of its record body as possible with prefix aPrefix[], and
+** return the size of the new cell. pOut may be the same as pCell, but
+** the two must not otherwise overlap.
+*/
+static int compressCell(
+  MemPage *pPage,         /* Prefix page the cell is for */
+  u8 *pCell,              /* The cell, in expanded form */
+  int sz,                 /* Size of pCell in bytes */
+  const u8 *aPrefix,      /* The prefix */
+  int nPrefix,            /* Size of aPrefix[] in bytes */
+  u8 *pOut                /* Write the new cell here */
+){
+  int nShared = cellShare(pPage, pCell, aPrefix, nPrefix);
+  int iShared;            /* Offset of the nShared field */
+  int nBody;              /* Size of the record body */
+  u8 *pRec;               /* Start of the record */
+  u8 *pBody;              /* Start of the record body */
+  int nHdr;               /* Size of the record header */
+  u32 nDummy;
+  int n;
+
+  if( nShared==0 ){
+    if( pOut!=pCell ) memcpy(pOut, pCell, sz);
+    return sz;
+  }
+  pBody = cellRecordBody(pPage, pCell, &nBody);
+  iShared = pPage->childPtrSize;
+  iShared += getVarint32(&pCell[iShared], nDummy);
+  pRec = &pCell[iShared+1];
+  nHdr = (int)(pBody - pRec);
+  if( pOut!=pCell ) memcpy(pOut, pCell, iShared);
+
+  /* Move the record header before writing the nShared field, as a 2-byte
+  ** nShared field overwrites the first byte of the header. */
+  n = iShared + sqlite3VarintLen(nShared);
+  memmove(&pOut[n], pRec, nHdr);
+  putVarint32(&pOut[iShared], nShared);
+  n += nHdr;
+  memmove(&pOut[n], &pBody[nShared], nBody-nShared);
+  n += nBody - nShared;
+  if( n<4 ) n = 4;
+  assert( n==sharedCellSize(sz, nShared) );
+  return n;
+}
+
+/*
+** Write the expanded form of cell pCell from prefix page pPage, in which
+** the nShared field is zero and the whole record is stored in the cell,
+** into buffer pOut and set *pnOut to its size. pOut must not overlap
+** pCell.
+*/
+static int expandCell(MemPage *pPage, u8 *pCell, u8 *pOut, u16 *pnOut){
+  CellInfo info;
+  int n;
+  u32 nDummy;
+  int rc;
+
+  assert( pPage->hasPrefix );
+  btreeParseCellPtr(pPage, pCell, &info);
+  if( info.nShared==0 ){
+    memcpy(pOut, pCell, info.nSize);
+    *pnOut = info.nSize;
+    return SQLITE_OK;
+  }
+  if( info.nShared>pPage->nPrefix ){
+    return SQLITE_CORRUPT_BKPT;
+  }
+  n = pPage->childPtrSize;
+  n += getVarint32(&pCell[n], nDummy);
+  memcpy(pOut, pCell, n);
+  pOut[n++] = 0;
+  rc = copySharedPayload(&pCell[info.nHeader], info.nLocal, pagePrefix(pPage),
+                         info.nShared, 0, info.nPayload, &pOut[n]);
+  n += info.nPayload;
+  if( n<4 ) n = 4;
+  *pnOut = (u16)n;
+  return rc;
+}
+
 #ifndef SQLITE_OMIT_AUTOVACUUM
 /*
 ** If the cell pCell, part of page pPage contains a pointer
@@ -1083,7 +1355,7 @@ static int defragmentPage(MemPage *pPage){
   cellOffset = pPage->cellOffset;
   nCell = pPage->nCell;
   assert( nCell==get2byte(&data[hdr+3]) );
-  usableSize = pPage->pBt->usableSize;
+  usableSize = contentEnd(pPage);  /* Cells never extend into the prefix */
   cbrk = get2byte(&data[hdr+5]);
   memcpy(&temp[cbrk], &data[cbrk], usableSize - cbrk);
   cbrk = usableSize;
@@ -1336,6 +1608,8 @@ static int freeSpace(MemPage *pPage, int start, int size){
 **
 **         PTF_ZERODATA
 **         PTF_ZERODATA | PTF_LEAF
+**         PTF_ZERODATA | PTF_PREFIX
+**         PTF_ZERODATA | PTF_PREFIX | PTF_LEAF
 **         PTF_LEAFDATA | PTF_INTKEY
 **         PTF_LEAFDATA | PTF_INTKEY | PTF_LEAF
 */
@@ -1343,11 +1617,17 @@ static int decodeFlags(MemPage *pPage, int flagByte){
   BtShared *pBt;     /* A copy of pPage->pBt */
 
   assert( pPage->hdrOffset==(pPage->pgno==1 ? 100 : 0) );
-  assert( sqlite3_mutex_held(pPage->pBt->mutex) );
+  assert( btreeMutexHeld(pPage->pBt) );
+  pPage->hasPrefix = (flagByte & PTF_PREFIX)!=0;
+  pPage->nPrefix = 0;
+  flagByte &= ~PTF_PREFIX;
   pPage->leaf = (u8)(flagByte>>3);  assert( PTF_LEAF == 1<<3 );
   flagByte &= ~PTF_LEAF;
   pPage->childPtrSize = 4-4*pPage->leaf;
   pBt = pPage->pBt;
+  if( pPage->hasPrefix && flagByte!=PTF_ZERODATA ){
+    return SQLITE_CORRUPT_BKPT;
+  }
   if( flagByte==(PTF_LEAFDATA | PTF_INTKEY) ){
     pPage->intKey = 1;
     pPage->hasData = pPage->leaf;
@@ -1376,7 +1656,7 @@ static int decodeFlags(MemPage *pPage, int flagByte){
 static int btreeInitPage(MemPage *pPage){
 
   assert( pPage->pBt!=0 );
-  assert( sqlite3_mutex_held(pPage->pBt->mutex) );
+  assert( btreeMutexHeld(pPage->pBt) );
   assert( pPage->pgno==sqlite3PagerPagenumber(pPage->pDbPage) );
   assert( pPage == sqlite3PagerGetExtra(pPage->pDbPage) );
   assert( pPage->aData == sqlite3PagerGetData(pPage->pDbPage) );
@@ -1418,6 +1698,19 @@ static int btreeInitPage(MemPage *pPage){
     ** past the end of a page boundary and causes SQLITE_CORRUPT to be 
     ** returned if it does.
     */
+    if( pPage->hasPrefix ){
+      /* The page prefix and its size are stored at the end of the page,
+      ** following the cell content area. */
+      int nPrefix = get2byte(&data[usableSize-2]);
+      if( nPrefix>pPage->maxLocal ){
+        return SQLITE_CORRUPT_BKPT;
+      }
+      pPage->nPrefix = (u16)nPrefix;
+      usableSize -= 2 + nPrefix;
+      if( top>usableSize ){
+        return SQLITE_CORRUPT_BKPT;
+      }
+    }
     iCellFirst = cellOffset + 2*pPage->nCell;
     iCellLast = usableSize - 4;
 #if defined(SQLITE_ENABLE_OVERSIZE_CELL_CHECK)
@@ -1501,9 +1794,12 @@ static void zeroPage(MemPage *pPage, int flags){
   first = hdr + 8 + 4*((flags&PTF_LEAF)==0 ?1:0);
   memset(&data[hdr+1], 0, 4);
   data[hdr+7] = 0;
-  put2byte(&data[hdr+5], pBt->usableSize);
-  pPage->nFree = (u16)(pBt->usableSize - first);
   decodeFlags(pPage, flags);
+  if( pPage->hasPrefix ){
+    put2byte(&data[pBt->usableSize-2], 0);
+  }
+  put2byte(&data[hdr+5], contentEnd(pPage));
+  pPage->nFree = (u16)(contentEnd(pPage) - first);
   pPage->hdrOffset = hdr;
   pPage->cellOffset = first;
   pPage->nOverflow = 0;
@@ -1513,6 +1809,24 @@ static void zeroPage(MemPage *pPage, int flags){
   pPage->isInit = 1;
 }
 
+/*
+** Install the nPrefix byte prefix aPrefix[] as the page prefix of the
+** empty prefix page pPage, just zeroed by zeroPage().
+*/
+static void setPagePrefix(MemPage *pPage, const u8 *aPrefix, int nPrefix){
+  u8 * const data = pPage->aData;
+  const int hdr = pPage->hdrOffset;
+
+  assert( pPage->hasPrefix && pPage->nCell==0 && pPage->nPrefix==0 );
+  assert( nPrefix>=0 && nPrefix<=pPage->maxLocal );
+  assert( get2byte(&data[hdr+5])==contentEnd(pPage) );
+  pPage->nPrefix = (u16)nPrefix;
+  memcpy(pagePrefix(pPage), aPrefix, nPrefix);
+  put2byte(&data[pPage->pBt->usableSize-2], nPrefix);
+  put2byte(&data[hdr+5], contentEnd(pPage));
+  pPage->nFree -= (u16)nPrefix;
+}
+
 
 /*
 ** Convert a DbPage obtained from the pager into a MemPage used by
@@ -1548,11 +1862,14 @@ static int btreeGetPage(
   int rc;
   DbPage *pDbPage;
 
-  assert( sqlite3_mutex_held(pBt->mutex) );
+  assert( btreeMutexHeld(pBt) );
+  sqlite3_mutex_enter(pBt->pLatch);
   rc = sqlite3PagerAcquire(pBt->pPager, pgno, (DbPage**)&pDbPage, noContent);
-  if( rc ) return rc;
-  *ppPage = btreePageFromDbPage(pDbPage, pgno, pBt);
-  return SQLITE_OK;
+  if( rc==SQLITE_OK ){
+    *ppPage = btreePageFromDbPage(pDbPage, pgno, pBt);
+  }
+  sqlite3_mutex_leave(pBt->pLatch);
+  return rc;
 }
 
 /*
@@ -1586,7 +1903,9 @@ u32 sqlite3BtreeLastPage(Btree *p){
 /*
 ** Get a page from the pager and initialize it.  This routine is just a
 ** convenience wrapper around separate calls to btreeGetPage() and 
-** btreeInitPage().
+** btreeInitPage(). The page is initialized while holding the 
+** BtShared.pLatch mutex, as other connections with shared locks may be
+** initializing the same page.
 **
 ** If an error occurs, then the value *ppPage is set to is undefined. It
 ** may remain unchanged, or it may be set to an invalid value.
@@ -1597,14 +1916,16 @@ static int getAndInitPage(
   MemPage **ppPage     /* Write the page pointer here */
 ){
   int rc;
-  assert( sqlite3_mutex_held(pBt->mutex) );
+  assert( btreeMutexHeld(pBt) );
 
   if( pgno>btreePagecount(pBt) ){
     rc = SQLITE_CORRUPT_BKPT;
   }else{
     rc = btreeGetPage(pBt, pgno, ppPage, 0);
     if( rc==SQLITE_OK ){
+      sqlite3_mutex_enter(pBt->pLatch);
       rc = btreeInitPage(*ppPage);
+      sqlite3_mutex_leave(pBt->pLatch);
       if( rc!=SQLITE_OK ){
         releasePage(*ppPage);
       }
@@ -1622,12 +1943,17 @@ static int getAndInitPage(
 */
 static void releasePage(MemPage *pPage){
   if( pPage ){
+    /* Once the page is unreferenced it may be recycled by another
+    ** thread, so pPage->pBt must not be read after that point. */
+    BtShared *pBt = pPage->pBt;
     assert( pPage->aData );
-    assert( pPage->pBt );
+    assert( pBt );
     assert( sqlite3PagerGetExtra(pPage->pDbPage) == (void*)pPage );
     assert( sqlite3PagerGetData(pPage->pDbPage)==pPage->aData );
-    assert( sqlite3_mutex_held(pPage->pBt->mutex) );
+    assert( btreeMutexHeld(pBt) );
+    sqlite3_mutex_enter(pBt->pLatch);
     sqlite3PagerUnref(pPage->pDbPage);
+    sqlite3_mutex_leave(pBt->pLatch);
   }
 }
 
@@ -1881,7 +2207,10 @@ int sqlite3BtreeOpen(
       mutexShared = sqlite3MutexAlloc(SQLITE_MUTEX_STATIC_MASTER);
       if( SQLITE_THREADSAFE && sqlite3GlobalConfig.bCoreMutex ){
         pBt->mutex = sqlite3MutexAlloc(SQLITE_MUTEX_FAST);
-        if( pBt->mutex==0 ){
+        pBt->pLatch = sqlite3MutexAlloc(SQLITE_MUTEX_FAST);
+        if( pBt->mutex==0 || pBt->pLatch==0 ){
+          sqlite3_mutex_free(pBt->mutex);
+          sqlite3_mutex_free(pBt->pLatch);
           rc = SQLITE_NOMEM;
           db->mallocFailed = 0;
           goto btree_open_out;
@@ -1982,6 +2311,7 @@ static int removeFromSharingList(BtShared *pBt){
     }
     if( SQLITE_THREADSAFE ){
       sqlite3_mutex_free(pBt->mutex);
+      sqlite3_mutex_free(pBt->pLatch);
     }
     removed = 1;
   }
@@ -2054,6 +2384,7 @@ int sqlite3BtreeClose(Btree *p){
     }
     sqlite3DbFree(0, pBt->pSchema);
     freeTempSpace(pBt);
+    sqlite3_free(pBt->aFreeTrunk);
     sqlite3_free(pBt);
   }
 
@@ -2229,6 +2560,91 @@ int sqlite3BtreeSecureDelete(Btree *p, int newFlag){
   sqlite3BtreeLeave(p);
   return b;
 }
+
+/*
+** Set the prefixKeys flag if newFlag is 0 or 1.  If newFlag is -1,
+** then make no changes.  Always return the value of the prefixKeys
+** setting after the change.
+**
+** When the flag is set, indexes subsequently created in the database
+** store their keys on prefix pages. Existing indexes are not affected.
+*/
+int sqlite3BtreePrefixKeys(Btree *p, int newFlag){
+  int b;
+  if( p==0 ) return 0;
+  sqlite3BtreeEnter(p);
+  if( newFlag>=0 ){
+    p->pBt->prefixKeys = (newFlag!=0) ? 1 : 0;
+  } 
+  b = p->pBt->prefixKeys;
+  sqlite3BtreeLeave(p);
+  return b;
+}
+
+/*
+** Set the freePageMap flag if newFlag is 0 or 1.  If newFlag is -1,
+** then make no changes.  Always return the value of the freePageMap
+** setting after the change.
+**
+** While the flag is set, pages are allocated from the free-list as
+** close as possible to the page requested by the caller, and the
+** free-list is kept sorted so that this can be done efficiently.
+*/
+int sqlite3BtreeFreePageMap(Btree *p, int newFlag){
+  int b;
+  if( p==0 ) return 0;
+  sqlite3BtreeEnter(p);
+  if( newFlag>=0 ){
+    p->pBt->freePageMap = (newFlag!=0) ? 1 : 0;
+    p->pBt->freeMapOk = 0;
+  } 
+  b = p->pBt->freePageMap;
+  sqlite3BtreeLeave(p);
+  return b;
+}
+
+/*
+** Set the number of pages in each extent reserved for a growing b-tree 
+** to nPage, if nPage is non-negative. Values of 0 and 1 disable extents.
+** Return the extent size after the change.
+**
+** Extents are only reserved while the free-page map is in use.
+*/
+int sqlite3BtreeExtentSize(Btree *p, int nPage){
+  int n;
+  if( p==0 ) return 0;
+  sqlite3BtreeEnter(p);
+  if( nPage>=0 ){
+    if( nPage>BTREE_MAX_EXTENT_SIZE ) nPage = BTREE_MAX_EXTENT_SIZE;
+    p->pBt->nExtentSize = (u32)nPage;
+    memset(p->pBt->aExtent, 0, sizeof(p->pBt->aExtent));
+  }
+  n = (int)p->pBt->nExtentSize;
+  sqlite3BtreeLeave(p);
+  return n;
+}
+
+/*
+** Set the lazyClear flag if newFlag is 0 or 1.  If newFlag is -1,
+** then make no changes.  Always return the value of the lazyClear
+** setting after the change.
+**
+** While the flag is set, sqlite3BtreeClearTable() detaches the b-tree
+** being cleared instead of freeing its pages. Detached pages are returned
+** to the free-list when the free-list is empty and a page is needed, or
+** by sqlite3BtreeReclaim().
+*/
+int sqlite3BtreeLazyClear(Btree *p, int newFlag){
+  int b;
+  if( p==0 ) return 0;
+  sqlite3BtreeEnter(p);
+  if( newFlag>=0 ){
+    p->pBt->lazyClear = (newFlag!=0) ? 1 : 0;
+  } 
+  b = p->pBt->lazyClear;
+  sqlite3BtreeLeave(p);
+  return b;
+}
 #endif /* !defined(SQLITE_OMIT_PAGER_PRAGMAS) || !defined(SQLITE_OMIT_VACUUM) */
 
 /*
@@ -2319,29 +2735,31 @@ static int lockBtree(BtShared *pBt){
     }
 
 #ifdef SQLITE_OMIT_WAL
-    if( page1[18]>1 ){
+    if( page1[18]>BTREE_VERSION_EXT || page1[18]==2 ){
       pBt->readOnly = 1;
     }
-    if( page1[19]>1 ){
+    if( page1[19]>BTREE_VERSION_EXT || page1[19]==2 ){
       goto page1_init_failed;
     }
 #else
-    if( page1[18]>2 ){
+    if( page1[18]>BTREE_VERSION_EXT+1 ){
       pBt->readOnly = 1;
     }
-    if( page1[19]>2 ){
+    if( page1[19]>BTREE_VERSION_EXT+1 ){
       goto page1_init_failed;
     }
 
-    /* If the write version is set to 2, this database should be accessed
-    ** in WAL mode. If the log is not already open, open it now. Then 
-    ** return SQLITE_OK and return without populating BtShared.pPage1.
+    /* If the write version is set to 2 (or 4), this database should be
+    ** accessed in WAL mode. If the log is not already open, open it now.
+    ** Then return SQLITE_OK and return without populating BtShared.pPage1.
     ** The caller detects this and calls this function again. This is
     ** required as the version of page 1 currently in the page1 buffer
     ** may not be the latest version - there may be a newer one in the log
     ** file.
     */
-    if( page1[19]==2 && pBt->doNotUseWAL==0 ){
+    if( (page1[19]==2 || page1[19]==BTREE_VERSION_EXT+1)
+     && pBt->doNotUseWAL==0
+    ){
       int isOpen = 0;
       rc = sqlite3PagerOpenWal(pBt->pPager, &isOpen);
       if( rc!=SQLITE_OK ){
@@ -2438,7 +2856,7 @@ page1_init_failed:
 ** If there is a transaction in progress, this routine is a no-op.
 */
 static void unlockBtreeIfUnused(BtShared *pBt){
-  assert( sqlite3_mutex_held(pBt->mutex) );
+  assert( btreeMutexHeld(pBt) );
   assert( pBt->pCursor==0 || pBt->inTransaction>TRANS_NONE );
   if( pBt->inTransaction==TRANS_NONE && pBt->pPage1!=0 ){
     assert( pBt->pPage1->aData );
@@ -2449,6 +2867,26 @@ static void unlockBtreeIfUnused(BtShared *pBt){
   }
 }
 
+/*
+** Set the read and write versions in the header of the database to their
+** extended form, if they are not already set, so that earlier versions of
+** SQLite will not try to read or write it. This is called before a b-tree
+** feature that those versions do not understand is first used.
+*/
+static int btreeSetExtended(BtShared *pBt){
+  u8 *data = pBt->pPage1->aData;
+  int rc = SQLITE_OK;
+  assert( sqlite3_mutex_held(pBt->mutex) );
+  if( data[18]<BTREE_VERSION_EXT || data[19]<BTREE_VERSION_EXT ){
+    rc = sqlite3PagerWrite(pBt->pPage1->pDbPage);
+    if( rc==SQLITE_OK ){
+      data[18] = BTREE_EXT_VERSION(data[18]);
+      data[19] = BTREE_EXT_VERSION(data[19]);
+    }
+  }
+  return rc;
+}
+
 /*
 ** If pBt points to an empty file then convert that empty file
 ** into a new empty database by initializing the first page of
@@ -2493,6 +2931,32 @@ static int newDatabase(BtShared *pBt){
   return SQLITE_OK;
 }
 
+/*
+** Return true if the transaction about to be opened on Btree p is part
+** of a BEGIN CONCURRENT transaction that the pager can run without
+** holding the WAL write-lock until commit. Shared-cache and auto-vacuum
+** databases do not support this, and a BEGIN CONCURRENT on one of these
+** is the same as an ordinary BEGIN.
+*/
+static int btreeIsConcurrent(Btree *p){
+#ifndef SQLITE_OMIT_WAL
+  sqlite3 *db = p->db;
+  if( db->isConcurrent==0 || db->autoCommit ) return 0;
+#ifndef SQLITE_OMIT_SHARED_CACHE
+  /* Test BtShared.nRef, not Btree.sharable. In debug builds every
+  ** persistent database is marked sharable, even if it is not shared. */
+  if( p->pBt->nRef>1 ) return 0;
+#endif
+#ifndef SQLITE_OMIT_AUTOVACUUM
+  if( p->pBt->autoVacuum ) return 0;
+#endif
+  return 1;
+#else
+  UNUSED_PARAMETER(p);
+  return 0;
+#endif
+}
+
 /*
 ** Attempt to start a new transaction. A write-transaction
 ** is started if the second argument is nonzero, otherwise a read-
@@ -2550,6 +3014,10 @@ int sqlite3BtreeBeginTrans(Btree *p, int wrflag){
     goto trans_begun;
   }
 
+  /* No connection may hold a shared lock while a write transaction is
+  ** opened (see sqlite3BtreeMutexArrayEnter()). */
+  assert( wrflag==0 || pBt->nReader==0 );
+
 #ifndef SQLITE_OMIT_SHARED_CACHE
   /* If another database handle has already opened a write transaction 
   ** on this shared-btree structure and a second write transaction is
@@ -2590,6 +3058,12 @@ int sqlite3BtreeBeginTrans(Btree *p, int wrflag){
     */
     while( pBt->pPage1==0 && SQLITE_OK==(rc = lockBtree(pBt)) );
 
+    if( rc==SQLITE_OK && pBt->inTransaction==TRANS_NONE
+     && btreeIsConcurrent(p)
+    ){
+      rc = sqlite3PagerBeginConcurrent(pBt->pPager);
+    }
+
     if( rc==SQLITE_OK && wrflag ){
       if( pBt->readOnly ){
         rc = SQLITE_READONLY;
@@ -2614,8 +3088,10 @@ int sqlite3BtreeBeginTrans(Btree *p, int wrflag){
       if( p->sharable ){
 	assert( p->lock.pBtree==p && p->lock.iTable==1 );
         p->lock.eLock = READ_LOCK;
+        sqlite3_mutex_enter(pBt->pLatch);
         p->lock.pNext = pBt->pLock;
         pBt->pLock = &p->lock;
+        sqlite3_mutex_leave(pBt->pLatch);
       }
 #endif
     }
@@ -2853,6 +3329,9 @@ static int relocatePage(
 /* Forward declaration required by incrVacuumStep(). */
 static int allocateBtreePage(BtShared *, MemPage **, Pgno *, Pgno, u8);
 
+/* Forward declaration required by allocateBtreePage(). */
+static int reclaimDetached(BtShared *, int, int *);
+
 /*
 ** Perform a single step of an incremental-vacuum. If successful,
 ** return SQLITE_OK. If there is no work to do (and therefore no
@@ -3000,62 +3479,290 @@ int sqlite3BtreeIncrVacuum(Btree *p){
   return rc;
 }
 
+/* Forward declaration required by defragMovePage(). */
+static int freePage2(BtShared *, MemPage *, Pgno);
+
 /*
-** This routine is called prior to sqlite3PagerCommit when a transaction
-** is commited for an auto-vacuum database.
+** Return the first page number greater than iPg that may be used to
+** store a non-root b-tree page. Pointer-map pages and the locking page
+** are skipped.
+*/
+static Pgno defragNextSlot(BtShared *pBt, Pgno iPg){
+  do{
+    iPg++;
+  }while( PTRMAP_ISPAGE(pBt, iPg) || iPg==PENDING_BYTE_PAGE(pBt) );
+  return iPg;
+}
+
+/*
+** Move b-tree page iPg, a child of page iParent, to page number iTo and
+** add page iPg to the free-list.
 **
-** If SQLITE_OK is returned, then *pnTrunc is set to the number of pages
-** the database file should be truncated to during the commit process. 
-** i.e. the database has been reorganized so that only the first *pnTrunc
-** pages are in use.
+** If page iTo is on the free-list, it is removed from the free-list
+** first. Otherwise, whatever page currently occupies iTo is moved to a
+** free page (or to a new page at the end of the file) to make room.
 */
-static int autoVacuumCommit(BtShared *pBt){
-  int rc = SQLITE_OK;
-  Pager *pPager = pBt->pPager;
-  VVA_ONLY( int nRef = sqlite3PagerRefcount(pPager) );
+static int defragMovePage(BtShared *pBt, Pgno iPg, Pgno iParent, Pgno iTo){
+  MemPage *pPg;             /* The page being moved */
+  MemPage *pFreePg;         /* Page allocated from the free-list */
+  Pgno iFreePg;             /* Page number of pFreePg */
+  u8 eType;                 /* Pointer map 'type' entry for page iTo */
+  Pgno iPtrPage;            /* Pointer map 'page-no' entry for page iTo */
+  int rc;
 
   assert( sqlite3_mutex_held(pBt->mutex) );
-  invalidateAllOverflowCache(pBt);
-  assert(pBt->autoVacuum);
-  if( !pBt->incrVacuum ){
-    Pgno nFin;         /* Number of pages in database after autovacuuming */
-    Pgno nFree;        /* Number of pages on the freelist initially */
-    Pgno nPtrmap;      /* Number of PtrMap pages to be freed */
-    Pgno iFree;        /* The next page to be freed */
-    int nEntry;        /* Number of entries on one ptrmap page */
-    Pgno nOrig;        /* Database size before freeing */
+  assert( iPg!=iTo );
 
-    nOrig = btreePagecount(pBt);
-    if( PTRMAP_ISPAGE(pBt, nOrig) || nOrig==PENDING_BYTE_PAGE(pBt) ){
-      /* It is not possible to create a database for which the final page
-      ** is either a pointer-map page or the pending-byte page. If one
-      ** is encountered, this indicates corruption.
-      */
-      return SQLITE_CORRUPT_BKPT;
-    }
+  rc = ptrmapGet(pBt, iTo, &eType, &iPtrPage);
+  if( rc!=SQLITE_OK ){
+    return rc;
+  }
+  if( eType==PTRMAP_ROOTPAGE || iTo>btreePagecount(pBt) ){
+    return SQLITE_CORRUPT_BKPT;
+  }
 
-    nFree = get4byte(&pBt->pPage1->aData[36]);
-    nEntry = pBt->usableSize/5;
-    nPtrmap = (nFree-nOrig+PTRMAP_PAGENO(pBt, nOrig)+nEntry)/nEntry;
-    nFin = nOrig - nFree - nPtrmap;
-    if( nOrig>PENDING_BYTE_PAGE(pBt) && nFin<PENDING_BYTE_PAGE(pBt) ){
-      nFin--;
+  if( eType==PTRMAP_FREEPAGE ){
+    rc = allocateBtreePage(pBt, &pFreePg, &iFreePg, iTo, 1);
+    if( rc!=SQLITE_OK ){
+      return rc;
     }
-    while( PTRMAP_ISPAGE(pBt, nFin) || nFin==PENDING_BYTE_PAGE(pBt) ){
-      nFin--;
+    releasePage(pFreePg);
+    if( iFreePg!=iTo ){
+      return SQLITE_CORRUPT_BKPT;
     }
-    if( nFin>nOrig ) return SQLITE_CORRUPT_BKPT;
+  }else{
+    MemPage *pOldPg;        /* The page currently stored at iTo */
 
-    for(iFree=nOrig; iFree>nFin && rc==SQLITE_OK; iFree--){
-      rc = incrVacuumStep(pBt, nFin, iFree);
-    }
-    if( (rc==SQLITE_DONE || rc==SQLITE_OK) && nFree>0 ){
-      rc = sqlite3PagerWrite(pBt->pPage1->pDbPage);
-      put4byte(&pBt->pPage1->aData[32], 0);
-      put4byte(&pBt->pPage1->aData[36], 0);
-      put4byte(&pBt->pPage1->aData[28], nFin);
-      sqlite3PagerTruncateImage(pBt->pPager, nFin);
-      pBt->nPage = nFin;
+    rc = btreeGetPage(pBt, iTo, &pOldPg, 0);
+    if( rc!=SQLITE_OK ){
+      return rc;
+    }
+    rc = allocateBtreePage(pBt, &pFreePg, &iFreePg, 0, 0);
+    if( rc!=SQLITE_OK ){
+      releasePage(pOldPg);
+      return rc;
+    }
+    releasePage(pFreePg);
+    rc = sqlite3PagerWrite(pOldPg->pDbPage);
+    if( rc==SQLITE_OK ){
+      rc = relocatePage(pBt, pOldPg, eType, iPtrPage, iFreePg, 0);
+    }
+    releasePage(pOldPg);
+    if( rc!=SQLITE_OK ){
+      return rc;
+    }
+  }
+
+  rc = btreeGetPage(pBt, iPg, &pPg, 0);
+  if( rc!=SQLITE_OK ){
+    return rc;
+  }
+  rc = sqlite3PagerWrite(pPg->pDbPage);
+  if( rc==SQLITE_OK ){
+    rc = relocatePage(pBt, pPg, PTRMAP_BTREE, iParent, iTo, 0);
+  }
+  releasePage(pPg);
+  if( rc==SQLITE_OK ){
+    rc = freePage2(pBt, 0, iPg);
+  }
+  return rc;
+}
+
+/*
+** Arrange for the non-root pages of the b-tree rooted at page iRoot
+** to occupy the slots that follow page *piSlot, in the order that a
+** depth-first walk of the tree visits them. *piSlot is left set to
+** the last slot used.
+**
+** Each page moved decrements *pnBudget. If a page needs to be moved
+** when *pnBudget is already zero, this function returns SQLITE_OK
+** without finishing the b-tree.
+**
+** All leaves of a b-tree are at the same depth, so once the first
+** leaf has been seen the remaining leaves are only read if they have
+** to be moved.
+*/
+static int defragTree(BtShared *pBt, Pgno iRoot, Pgno *piSlot, int *pnBudget){
+  MemPage *apPage[BTCURSOR_MAX_DEPTH];  /* Pages from root to current page */
+  int aiIdx[BTCURSOR_MAX_DEPTH];        /* Next child of each apPage[] */
+  int iDepth = 0;                       /* Index of current page in apPage */
+  int iLeafDepth = -1;                  /* Depth of leaves, if known */
+  int rc;
+
+  rc = getAndInitPage(pBt, iRoot, &apPage[0]);
+  if( rc!=SQLITE_OK ){
+    return rc;
+  }
+  aiIdx[0] = 0;
+  while( iDepth>=0 ){
+    MemPage *pPage = apPage[iDepth];
+    Pgno iChild;
+
+    if( pPage->leaf || aiIdx[iDepth]>pPage->nCell ){
+      if( pPage->leaf ) iLeafDepth = iDepth;
+      releasePage(pPage);
+      iDepth--;
+      continue;
+    }
+    if( aiIdx[iDepth]<pPage->nCell ){
+      iChild = get4byte(findCell(pPage, aiIdx[iDepth]));
+    }else{
+      iChild = get4byte(&pPage->aData[pPage->hdrOffset+8]);
+    }
+    aiIdx[iDepth]++;
+
+    *piSlot = defragNextSlot(pBt, *piSlot);
+    if( iChild!=*piSlot ){
+      if( *pnBudget<=0 ) break;
+      rc = defragMovePage(pBt, iChild, pPage->pgno, *piSlot);
+      if( rc!=SQLITE_OK ) break;
+      (*pnBudget)--;
+      iChild = *piSlot;
+    }
+
+    if( iDepth+1!=iLeafDepth ){
+      if( iDepth+1>=BTCURSOR_MAX_DEPTH ){
+        rc = SQLITE_CORRUPT_BKPT;
+        break;
+      }
+      rc = getAndInitPage(pBt, iChild, &apPage[iDepth+1]);
+      if( rc!=SQLITE_OK ) break;
+      iDepth++;
+      aiIdx[iDepth] = 0;
+    }
+  }
+
+  while( iDepth>=0 ){
+    releasePage(apPage[iDepth--]);
+  }
+  return rc;
+}
+
+/*
+** A write-transaction must be opened before calling this function.
+** It moves up to nStep pages towards an online defragmentation of the
+** database and sets *pnDone to the number of pages actually moved. If
+** *pnDone is less than nStep, the defragmentation is finished.
+**
+** Root pages never move. The other pages of each b-tree are moved so
+** that they directly follow the largest root page, one b-tree after
+** another in root page order, each in the order that a depth-first
+** walk of the tree visits them. Overflow pages are moved out of the way
+** but are not ordered. Once every b-tree page is in place, pages are
+** moved off the end of the file as by an incremental vacuum so that
+** the free-list is emptied and the file truncated.
+**
+** Because each call does a bounded amount of work, the caller may
+** commit between calls so that other connections can read the database
+** while it is being defragmented. This only works for auto-vacuum
+** databases, as the pointer-map is needed to move pages. For other
+** databases *pnDone is always set to zero.
+*/
+int sqlite3BtreeDefragment(Btree *p, int nStep, int *pnDone){
+  int rc = SQLITE_OK;
+  int nBudget = nStep;
+  BtShared *pBt = p->pBt;
+
+  sqlite3BtreeEnter(p);
+  assert( pBt->inTransaction==TRANS_WRITE && p->inTrans==TRANS_WRITE );
+  if( pBt->autoVacuum && nBudget>0 ){
+    Pgno nRoot;             /* Largest root page in the database */
+    Pgno iRoot;             /* Root page of b-tree being defragmented */
+    Pgno iSlot;             /* Last page number used by a b-tree */
+
+    rc = saveAllCursors(pBt, 0, 0);
+    invalidateAllOverflowCache(pBt);
+    nRoot = get4byte(&pBt->pPage1->aData[36 + BTREE_LARGEST_ROOT_PAGE*4]);
+    iSlot = nRoot;
+    for(iRoot=1; rc==SQLITE_OK && nBudget>0 && iRoot<=nRoot; iRoot++){
+      if( iRoot>1 ){
+        u8 eType;
+        if( PTRMAP_ISPAGE(pBt, iRoot) || iRoot==PENDING_BYTE_PAGE(pBt) ){
+          continue;
+        }
+        rc = ptrmapGet(pBt, iRoot, &eType, 0);
+        if( rc!=SQLITE_OK || eType!=PTRMAP_ROOTPAGE ) continue;
+      }
+      rc = defragTree(pBt, iRoot, &iSlot, &nBudget);
+    }
+
+    /* If every b-tree page is in place, use the rest of the budget to
+    ** shrink the file. Any free pages now lie after the b-tree pages,
+    ** so this does not disturb the order established above. */
+    while( rc==SQLITE_OK && nBudget>0 ){
+      rc = incrVacuumStep(pBt, 0, btreePagecount(pBt));
+      if( rc==SQLITE_OK ) nBudget--;
+    }
+    if( rc==SQLITE_DONE ){
+      rc = SQLITE_OK;
+    }
+    if( rc==SQLITE_OK && nBudget<nStep ){
+      rc = sqlite3PagerWrite(pBt->pPage1->pDbPage);
+      put4byte(&pBt->pPage1->aData[28], pBt->nPage);
+    }
+  }
+  *pnDone = nStep - nBudget;
+  sqlite3BtreeLeave(p);
+  return rc;
+}
+
+/*
+** This routine is called prior to sqlite3PagerCommit when a transaction
+** is commited for an auto-vacuum database.
+**
+** If SQLITE_OK is returned, then *pnTrunc is set to the number of pages
+** the database file should be truncated to during the commit process. 
+** i.e. the database has been reorganized so that only the first *pnTrunc
+** pages are in use.
+*/
+static int autoVacuumCommit(BtShared *pBt){
+  int rc = SQLITE_OK;
+  Pager *pPager = pBt->pPager;
+  VVA_ONLY( int nRef = sqlite3PagerRefcount(pPager) );
+
+  assert( sqlite3_mutex_held(pBt->mutex) );
+  invalidateAllOverflowCache(pBt);
+  assert(pBt->autoVacuum);
+  if( !pBt->incrVacuum ){
+    Pgno nFin;         /* Number of pages in database after autovacuuming */
+    Pgno nFree;        /* Number of pages on the freelist initially */
+    Pgno nPtrmap;      /* Number of PtrMap pages to be freed */
+    Pgno iFree;        /* The next page to be freed */
+    int nEntry;        /* Number of entries on one ptrmap page */
+    Pgno nOrig;        /* Database size before freeing */
+
+    nOrig = btreePagecount(pBt);
+    if( PTRMAP_ISPAGE(pBt, nOrig) || nOrig==PENDING_BYTE_PAGE(pBt) ){
+      /* It is not possible to create a database for which the final page
+      ** is either a pointer-map page or the pending-byte page. If one
+      ** is encountered, this indicates corruption.
+      */
+      return SQLITE_CORRUPT_BKPT;
+    }
+
+    nFree = get4byte(&pBt->pPage1->aData[36]);
+    nEntry = pBt->usableSize/5;
+    nPtrmap = (nFree-nOrig+PTRMAP_PAGENO(pBt, nOrig)+nEntry)/nEntry;
+    nFin = nOrig - nFree - nPtrmap;
+    if( nOrig>PENDING_BYTE_PAGE(pBt) && nFin<PENDING_BYTE_PAGE(pBt) ){
+      nFin--;
+    }
+    while( PTRMAP_ISPAGE(pBt, nFin) || nFin==PENDING_BYTE_PAGE(pBt) ){
+      nFin--;
+    }
+    if( nFin>nOrig ) return SQLITE_CORRUPT_BKPT;
+
+    for(iFree=nOrig; iFree>nFin && rc==SQLITE_OK; iFree--){
+      rc = incrVacuumStep(pBt, nFin, iFree);
+    }
+    if( (rc==SQLITE_DONE || rc==SQLITE_OK) && nFree>0 ){
+      rc = sqlite3PagerWrite(pBt->pPage1->pDbPage);
+      put4byte(&pBt->pPage1->aData[32], 0);
+      put4byte(&pBt->pPage1->aData[36], 0);
+      put4byte(&pBt->pPage1->aData[28], nFin);
+      pBt->freeMapOk = 0;
+      sqlite3PagerTruncateImage(pBt->pPager, nFin);
+      pBt->nPage = nFin;
     }
     if( rc!=SQLITE_OK ){
       sqlite3PagerRollback(pPager);
@@ -3301,6 +4008,7 @@ int sqlite3BtreeRollback(Btree *p){
     if( rc2!=SQLITE_OK ){
       rc = rc2;
     }
+    pBt->freeMapOk = 0;
 
     /* The rollback may have destroyed the pPage1->aData value.  So
     ** call btreeGetPage() on page 1 again to make
@@ -3378,6 +4086,7 @@ int sqlite3BtreeSavepoint(Btree *p, int op, int iSavepoint){
     assert( op==SAVEPOINT_RELEASE || op==SAVEPOINT_ROLLBACK );
     assert( iSavepoint>=0 || (iSavepoint==-1 && op==SAVEPOINT_ROLLBACK) );
     sqlite3BtreeEnter(p);
+    if( op==SAVEPOINT_ROLLBACK ) pBt->freeMapOk = 0;
     rc = sqlite3PagerSavepoint(pBt->pPager, op, iSavepoint);
     if( rc==SQLITE_OK ){
       if( iSavepoint<0 && pBt->initiallyEmpty ) pBt->nPage = 0;
@@ -3465,11 +4174,13 @@ static int btreeCursor(
   pCur->pBtree = p;
   pCur->pBt = pBt;
   pCur->wrFlag = (u8)wrFlag;
+  sqlite3_mutex_enter(pBt->pLatch);
   pCur->pNext = pBt->pCursor;
   if( pCur->pNext ){
     pCur->pNext->pPrev = pCur;
   }
   pBt->pCursor = pCur;
+  sqlite3_mutex_leave(pBt->pLatch);
   pCur->eState = CURSOR_INVALID;
   pCur->cachedRowid = 0;
   return SQLITE_OK;
@@ -3553,6 +4264,7 @@ int sqlite3BtreeCloseCursor(BtCursor *pCur){
     BtShared *pBt = pCur->pBt;
     sqlite3BtreeEnter(pBtree);
     sqlite3BtreeClearCursor(pCur);
+    sqlite3_mutex_enter(pBt->pLatch);
     if( pCur->pPrev ){
       pCur->pPrev->pNext = pCur->pNext;
     }else{
@@ -3561,6 +4273,7 @@ int sqlite3BtreeCloseCursor(BtCursor *pCur){
     if( pCur->pNext ){
       pCur->pNext->pPrev = pCur->pPrev;
     }
+    sqlite3_mutex_leave(pBt->pLatch);
     for(i=0; i<=pCur->iPage; i++){
       releasePage(pCur->apPage[i]);
     }
@@ -3705,7 +4418,7 @@ static int getOverflowPage(
   MemPage *pPage = 0;
   int rc = SQLITE_OK;
 
-  assert( sqlite3_mutex_held(pBt->mutex) );
+  assert( btreeMutexHeld(pBt) );
   assert(pPgnoNext);
 
 #ifndef SQLITE_OMIT_AUTOVACUUM
@@ -3842,6 +4555,17 @@ static int accessPayload(
     return SQLITE_CORRUPT_BKPT;
   }
 
+  if( pCur->info.nShared ){
+    /* The record shares part of its body with the page prefix. Such
+    ** cells only occur on index pages, which are never written through
+    ** a cursor. */
+    if( NEVER(eOp) || pCur->info.nShared>pPage->nPrefix ){
+      return SQLITE_CORRUPT_BKPT;
+    }
+    return copySharedPayload(aPayload, pCur->info.nLocal, pagePrefix(pPage),
+                             pCur->info.nShared, offset, amt, pBuf);
+  }
+
   /* Check if data must be read/written to/from the btree page itself. */
   if( offset<pCur->info.nLocal ){
     int a = amt;
@@ -3921,7 +4645,9 @@ static int accessPayload(
         */
         DbPage *pDbPage;
         int a = amt;
+        sqlite3_mutex_enter(pBt->pLatch);
         rc = sqlite3PagerGet(pBt->pPager, nextPage, &pDbPage);
+        sqlite3_mutex_leave(pBt->pLatch);
         if( rc==SQLITE_OK ){
           aPayload = sqlite3PagerGetData(pDbPage);
           nextPage = get4byte(aPayload);
@@ -3929,7 +4655,9 @@ static int accessPayload(
             a = ovflSize - offset;
           }
           rc = copyPayload(&aPayload[offset+4], pBuf, a, eOp, pDbPage);
+          sqlite3_mutex_enter(pBt->pLatch);
           sqlite3PagerUnref(pDbPage);
+          sqlite3_mutex_leave(pBt->pLatch);
           offset = 0;
           amt -= a;
           pBuf += a;
@@ -4044,6 +4772,13 @@ static const unsigned char *fetchPayload(
   }else{
     nLocal = pCur->info.nLocal;
     assert( nLocal<=nKey );
+    if( pCur->info.nShared ){
+      /* Only the record header is stored contiguously. The rest of the
+      ** record must be read using accessPayload(). */
+      u32 nHdr = 0;
+      if( nLocal>0 ) getVarint32(aPayload, nHdr);
+      if( nHdr<nLocal ) nLocal = nHdr;
+    }
   }
   *pAmt = nLocal;
   return aPayload;
@@ -4113,7 +4848,9 @@ static int moveToChild(BtCursor *pCur, u32 newPgno){
 
   pCur->info.nSize = 0;
   pCur->validNKey = 0;
-  if( pNewPage->nCell<1 || pNewPage->intKey!=pCur->apPage[i]->intKey ){
+  if( pNewPage->nCell<1 || pNewPage->intKey!=pCur->apPage[i]->intKey
+   || pNewPage->hasPrefix!=pCur->apPage[i]->hasPrefix
+  ){
     return SQLITE_CORRUPT_BKPT;
   }
   return SQLITE_OK;
@@ -4404,6 +5141,7 @@ int sqlite3BtreeMovetoUnpacked(
   int *pRes                /* Write search results here */
 ){
   int rc;
+  u8 *aKey = 0;            /* Space to reassemble prefix page records */
 
   assert( cursorHoldsMutex(pCur) );
   assert( sqlite3_mutex_held(pCur->pBtree->db->mutex) );
@@ -4492,7 +5230,39 @@ int sqlite3BtreeMovetoUnpacked(
         ** 2 bytes of the cell.
         */
         int nCell = pCell[0];
-        if( !(nCell & 0x80) && nCell<=pPage->maxLocal ){
+        if( pPage->hasPrefix ){
+          /* Cells on prefix pages have an nShared field following the
+          ** record size, and the record may share part of its body with
+          ** the page prefix. Unless the record is stored contiguously on
+          ** the page, it is reassembled before being compared. Shared
+          ** records never use overflow pages, so buffer aKey[] is large
+          ** enough for any of them. */
+          btreeParseCellPtr(pPage, pCell - pPage->childPtrSize, &pCur->info);
+          nCell = (int)pCur->info.nKey;
+          if( pCur->info.nShared==0 && pCur->info.nLocal==nCell ){
+            c = sqlite3VdbeRecordCompare(nCell,
+                (void*)&pCell[pCur->info.nHeader - pPage->childPtrSize],
+                pIdxKey);
+          }else{
+            u8 *pCellKey;
+            if( pCur->info.nShared ){
+              if( aKey==0 ) aKey = sqlite3Malloc(pCur->pBt->pageSize);
+              pCellKey = aKey;
+            }else{
+              pCellKey = sqlite3Malloc(nCell);
+            }
+            if( pCellKey==0 ){
+              rc = SQLITE_NOMEM;
+              goto moveto_finish;
+            }
+            rc = accessPayload(pCur, 0, nCell, pCellKey, 0);
+            if( rc==SQLITE_OK ){
+              c = sqlite3VdbeRecordCompare(nCell, (void*)pCellKey, pIdxKey);
+            }
+            if( pCellKey!=aKey ) sqlite3_free(pCellKey);
+            if( rc ) goto moveto_finish;
+          }
+        }else if( !(nCell & 0x80) && nCell<=pPage->maxLocal ){
           /* This branch runs if the record-size field of the cell is a
           ** single byte varint and the record fits entirely on the main
           ** b-tree page.  */
@@ -4569,6 +5339,7 @@ int sqlite3BtreeMovetoUnpacked(
     if( rc ) goto moveto_finish;
   }
 moveto_finish:
+  sqlite3_free(aKey);
   return rc;
 }
 
@@ -4717,6 +5488,884 @@ int sqlite3BtreePrevious(BtCursor *pCur, int *pRes){
   return rc;
 }
 
+/*
+** Return the distance between pages A and B.
+*/
+#define FREEMAP_DIST(A,B) ((A)>(B) ? (A)-(B) : (B)-(A))
+
+/*
+** Make sure there is space for at least one more entry in the 
+** BtShared.aFreeTrunk[] array. Return SQLITE_NOMEM if a memory 
+** allocation fails, or SQLITE_OK otherwise.
+*/
+static int freeMapGrow(BtShared *pBt){
+  if( pBt->nFreeTrunk>=pBt->nFreeTrunkAlloc ){
+    int nNew = pBt->nFreeTrunkAlloc*2 + 16;
+    FreeTrunk *aNew;
+    aNew = sqlite3_realloc(pBt->aFreeTrunk, nNew*sizeof(FreeTrunk));
+    if( aNew==0 ){
+      return SQLITE_NOMEM;
+    }
+    pBt->aFreeTrunk = aNew;
+    pBt->nFreeTrunkAlloc = nNew;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Insert an entry for trunk page iTrunk into the free-page map at 
+** index i. Space for the new entry must have been reserved by a prior
+** call to freeMapGrow().
+*/
+static void freeMapInsert(
+  BtShared *pBt,                  /* The btree */
+  int i,                          /* Index of the new entry */
+  Pgno iTrunk,                    /* Page number of the trunk page */
+  Pgno iKey,                      /* Lower bound of the trunk's range */
+  u32 nLeaf                       /* Number of leaves on the trunk */
+){
+  FreeTrunk *p = &pBt->aFreeTrunk[i];
+  assert( pBt->nFreeTrunk<pBt->nFreeTrunkAlloc );
+  assert( i>=0 && i<=pBt->nFreeTrunk );
+  memmove(&p[1], p, (pBt->nFreeTrunk-i)*sizeof(FreeTrunk));
+  p->iTrunk = iTrunk;
+  p->iKey = iKey;
+  p->nLeaf = nLeaf;
+  pBt->nFreeTrunk++;
+}
+
+/*
+** Return the index of the entry in the free-page map whose range of
+** pages contains page iPg. If iPg is less than the lower bound of the
+** first range, return 0.
+*/
+static int freeMapSearch(BtShared *pBt, Pgno iPg){
+  int iLo = 0;
+  int iHi = pBt->nFreeTrunk-1;
+  assert( pBt->nFreeTrunk>0 );
+  while( iLo<iHi ){
+    int iMid = (iLo+iHi+1)/2;
+    if( pBt->aFreeTrunk[iMid].iKey<=iPg ){
+      iLo = iMid;
+    }else{
+      iHi = iMid-1;
+    }
+  }
+  return iLo;
+}
+
+/*
+** Return the index of the first of the nLeaf sorted page numbers in
+** aLeaf[] that is greater than or equal to iPg. Or nLeaf if there is
+** no such page.
+*/
+static u32 freeLeafSearch(const u8 *aLeaf, u32 nLeaf, Pgno iPg){
+  u32 iLo = 0;
+  u32 iHi = nLeaf;
+  while( iLo<iHi ){
+    u32 iMid = (iLo+iHi)/2;
+    if( get4byte(&aLeaf[iMid*4])<iPg ){
+      iLo = iMid+1;
+    }else{
+      iHi = iMid;
+    }
+  }
+  return iLo;
+}
+
+/*
+** Rewrite the free-list so that it is sorted as described above the
+** FreeTrunk structure in btreeInt.h, and rebuild the free-page map to
+** match. On entry, the free-page map holds an entry for each trunk of
+** the existing free-list.
+**
+** A bitmap of the free pages is built from the existing free-list. The
+** free pages are then divided, in ascending order, into groups that
+** fill each trunk to three quarters of its capacity, leaving space for
+** pages freed later to be inserted at their sorted positions. The first
+** page of each group is its trunk.
+*/
+static int freeMapSort(BtShared *pBt){
+  MemPage *pPage1 = pBt->pPage1;
+  Pgno mxPage = btreePagecount(pBt);
+  u32 nMax = ((pBt->usableSize/4 - 8)*3)/4;
+  MemPage *pTrunk = 0;
+  FreeTrunk *p;
+  u8 *aMap;
+  Pgno iPg;
+  int i;
+  int rc = SQLITE_OK;
+
+  aMap = (u8*)sqlite3MallocZero(mxPage/8 + 1);
+  if( aMap==0 ){
+    return SQLITE_NOMEM;
+  }
+
+  /* Set a bit in aMap[] for each free page. The current trunk pages may
+  ** become leaves, so record that their content must be journalled if
+  ** they are reused by this transaction.
+  */
+  for(i=0; i<pBt->nFreeTrunk; i++){
+    u32 j;
+    p = &pBt->aFreeTrunk[i];
+    rc = btreeGetPage(pBt, p->iTrunk, &pTrunk, 0);
+    if( rc!=SQLITE_OK ){
+      pTrunk = 0;
+      goto sort_out;
+    }
+    for(j=0; j<=p->nLeaf; j++){
+      iPg = (j==0) ? p->iTrunk : get4byte(&pTrunk->aData[4+j*4]);
+      if( aMap[iPg/8] & (1<<(iPg&7)) ){
+        rc = SQLITE_CORRUPT_BKPT;
+        goto sort_out;
+      }
+      aMap[iPg/8] |= (1<<(iPg&7));
+    }
+    releasePage(pTrunk);
+    pTrunk = 0;
+    rc = btreeSetHasContent(pBt, p->iTrunk);
+    if( rc!=SQLITE_OK ) goto sort_out;
+  }
+
+  /* Write the new free-list, in ascending order of page number. */
+  rc = sqlite3PagerWrite(pPage1->pDbPage);
+  if( rc!=SQLITE_OK ) goto sort_out;
+  pBt->nFreeTrunk = 0;
+  for(iPg=2; iPg<=mxPage; iPg++){
+    if( (aMap[iPg/8] & (1<<(iPg&7)))==0 ) continue;
+    p = pTrunk ? &pBt->aFreeTrunk[pBt->nFreeTrunk-1] : 0;
+    if( p==0 || p->nLeaf>=nMax ){
+      MemPage *pNew = 0;
+      rc = freeMapGrow(pBt);
+      if( rc==SQLITE_OK ){
+        rc = btreeGetPage(pBt, iPg, &pNew, 0);
+      }
+      if( rc==SQLITE_OK ){
+        rc = sqlite3PagerWrite(pNew->pDbPage);
+        if( rc!=SQLITE_OK ) releasePage(pNew);
+      }
+      if( rc!=SQLITE_OK ) goto sort_out;
+      put4byte(&pNew->aData[0], 0);
+      put4byte(&pNew->aData[4], 0);
+      if( pTrunk ){
+        put4byte(&pTrunk->aData[0], iPg);
+        releasePage(pTrunk);
+      }else{
+        put4byte(&pPage1->aData[32], iPg);
+      }
+      pTrunk = pNew;
+      freeMapInsert(pBt, pBt->nFreeTrunk, iPg, iPg, 0);
+    }else{
+      put4byte(&pTrunk->aData[8+p->nLeaf*4], iPg);
+      p->nLeaf++;
+      put4byte(&pTrunk->aData[4], p->nLeaf);
+    }
+  }
+  TRACE(("FREE-MAP: free-list sorted into %d trunks\n", pBt->nFreeTrunk));
+
+sort_out:
+  releasePage(pTrunk);
+  sqlite3_free(aMap);
+  return rc;
+}
+
+/*
+** Make sure that the free-page map describes the current free-list. 
+** If it does not, the map is rebuilt by reading each trunk page of the
+** free-list. If the free-list is not sorted, it is sorted.
+**
+** This must be called before the free-page count in page 1 is modified
+** by the current operation.
+*/
+static int freeMapLoad(BtShared *pBt){
+  MemPage *pPage1 = pBt->pPage1;
+  u32 nFree = get4byte(&pPage1->aData[36]);
+  Pgno iTrunk = get4byte(&pPage1->aData[32]);
+  Pgno mxPage = btreePagecount(pBt);
+  u32 nTotal = 0;           /* Number of free pages seen so far */
+  Pgno iPrevMax = 0;        /* Largest page on the previous trunk */
+  int isSorted = 1;         /* False if the free-list must be sorted */
+  int rc;
+
+  if( pBt->freeMapOk
+   && pBt->iFreeMapVersion==sqlite3PagerDataVersion(pBt->pPager)
+   && pBt->nFreeMapPage==nFree
+   && (pBt->nFreeTrunk ? pBt->aFreeTrunk[0].iTrunk : 0)==iTrunk
+  ){
+    return SQLITE_OK;
+  }
+
+  pBt->freeMapOk = 0;
+  pBt->nFreeTrunk = 0;
+  while( iTrunk ){
+    MemPage *pTrunk;
+    Pgno iKey = iTrunk;     /* Smallest page on this trunk */
+    Pgno iMax = iTrunk;     /* Largest page on this trunk */
+    u32 nLeaf;
+    u32 j;
+
+    if( iTrunk>mxPage || iTrunk<2 || nTotal>=nFree ){
+      return SQLITE_CORRUPT_BKPT;
+    }
+    rc = freeMapGrow(pBt);
+    if( rc==SQLITE_OK ){
+      rc = btreeGetPage(pBt, iTrunk, &pTrunk, 0);
+    }
+    if( rc!=SQLITE_OK ){
+      return rc;
+    }
+    nLeaf = get4byte(&pTrunk->aData[4]);
+    if( nLeaf>(u32)pBt->usableSize/4 - 2 || nLeaf>=nFree-nTotal ){
+      releasePage(pTrunk);
+      return SQLITE_CORRUPT_BKPT;
+    }
+    if( nLeaf>(u32)pBt->usableSize/4 - 8 ){
+      isSorted = 0;
+    }
+    for(j=0; j<nLeaf; j++){
+      Pgno iLeaf = get4byte(&pTrunk->aData[8+j*4]);
+      if( iLeaf>mxPage || iLeaf<2 ){
+        releasePage(pTrunk);
+        return SQLITE_CORRUPT_BKPT;
+      }
+      if( j>0 && iLeaf<=get4byte(&pTrunk->aData[4+j*4]) ) isSorted = 0;
+      if( iLeaf<iKey ) iKey = iLeaf;
+      if( iLeaf>iMax ) iMax = iLeaf;
+    }
+    if( iKey<=iPrevMax ) isSorted = 0;
+    iPrevMax = iMax;
+    freeMapInsert(pBt, pBt->nFreeTrunk, iTrunk, iKey, nLeaf);
+    nTotal += nLeaf+1;
+    iTrunk = get4byte(&pTrunk->aData[0]);
+    releasePage(pTrunk);
+  }
+  if( nTotal!=nFree ){
+    return SQLITE_CORRUPT_BKPT;
+  }
+  if( !isSorted ){
+    rc = freeMapSort(pBt);
+    if( rc!=SQLITE_OK ){
+      return rc;
+    }
+  }
+
+  pBt->nFreeMapPage = nFree;
+  pBt->iFreeMapVersion = sqlite3PagerDataVersion(pBt->pPager);
+  pBt->freeMapOk = 1;
+  return SQLITE_OK;
+}
+
+/*
+** Find the free page held by trunk aFreeTrunk[i] that is closest to 
+** page iPg. Set *piPg to its page number and *piLeaf to its index on
+** the trunk. If the trunk has no leaves, the trunk page itself is the
+** only candidate, and *piLeaf is set to -1.
+*/
+static int freeMapNearest(
+  BtShared *pBt,                  /* The btree */
+  int i,                          /* Index of trunk in the free-page map */
+  Pgno iPg,                       /* Find a free page close to this one */
+  Pgno *piPg,                     /* OUT: The free page */
+  int *piLeaf                     /* OUT: Index of *piPg on the trunk */
+){
+  FreeTrunk *p = &pBt->aFreeTrunk[i];
+  MemPage *pTrunk;
+  u32 j;
+  int rc;
+
+  if( p->nLeaf==0 ){
+    *piPg = p->iTrunk;
+    *piLeaf = -1;
+    return SQLITE_OK;
+  }
+  rc = btreeGetPage(pBt, p->iTrunk, &pTrunk, 0);
+  if( rc!=SQLITE_OK ){
+    return rc;
+  }
+  j = freeLeafSearch(&pTrunk->aData[8], p->nLeaf, iPg);
+  if( j==p->nLeaf || (j>0 && iPg-get4byte(&pTrunk->aData[4+j*4])
+                             < get4byte(&pTrunk->aData[8+j*4])-iPg) ){
+    j--;
+  }
+  *piPg = get4byte(&pTrunk->aData[8+j*4]);
+  *piLeaf = (int)j;
+  releasePage(pTrunk);
+  return SQLITE_OK;
+}
+
+/*
+** Find the free page closest to page nearby using the free-page map.
+** Set *piPg to its page number, *pi to the index of the trunk that holds
+** it in the free-page map, and *piLeaf to its index among the leaves of
+** that trunk, or to -1 if it is the trunk page itself.
+*/
+static int freeMapFind(
+  BtShared *pBt,                  /* The btree */
+  Pgno nearby,                    /* Search for a page close to this one */
+  int *pi,                        /* OUT: Index of trunk in free-page map */
+  Pgno *piPg,                     /* OUT: The free page */
+  int *piLeaf                     /* OUT: Index of *piPg on the trunk */
+){
+  int i = freeMapSearch(pBt, nearby);
+  Pgno iDist;
+  Pgno iPg2;
+  int iLeaf2;
+  int rc;
+
+  /* Find the closest free page on the trunk whose range contains 
+  ** nearby. If a page on one of the adjacent trunks might be closer,
+  ** check those too.
+  */
+  *pi = i;
+  rc = freeMapNearest(pBt, i, nearby, piPg, piLeaf);
+  if( rc!=SQLITE_OK ) return rc;
+  iDist = FREEMAP_DIST(*piPg, nearby);
+  if( i+1<pBt->nFreeTrunk && pBt->aFreeTrunk[i+1].iKey-nearby<iDist ){
+    rc = freeMapNearest(pBt, i+1, nearby, &iPg2, &iLeaf2);
+    if( rc!=SQLITE_OK ) return rc;
+    if( FREEMAP_DIST(iPg2, nearby)<iDist ){
+      *pi = i+1;
+      *piPg = iPg2;
+      *piLeaf = iLeaf2;
+      iDist = FREEMAP_DIST(iPg2, nearby);
+    }
+  }
+  if( i>0 && nearby-pBt->aFreeTrunk[i].iKey<iDist ){
+    rc = freeMapNearest(pBt, i-1, nearby, &iPg2, &iLeaf2);
+    if( rc!=SQLITE_OK ) return rc;
+    if( FREEMAP_DIST(iPg2, nearby)<iDist ){
+      *pi = i-1;
+      *piPg = iPg2;
+      *piLeaf = iLeaf2;
+    }
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Set *pbFree to true if page iPg is on the free-list, according to the
+** free-page map, or to false otherwise.
+*/
+static int freeMapContains(BtShared *pBt, Pgno iPg, int *pbFree){
+  FreeTrunk *p;
+  MemPage *pTrunk;
+  u32 j;
+  int rc;
+
+  *pbFree = 0;
+  if( pBt->nFreeTrunk==0 ) return SQLITE_OK;
+  p = &pBt->aFreeTrunk[freeMapSearch(pBt, iPg)];
+  if( p->iTrunk==iPg ){
+    *pbFree = 1;
+    return SQLITE_OK;
+  }
+  if( p->nLeaf==0 || iPg<p->iKey ) return SQLITE_OK;
+  rc = btreeGetPage(pBt, p->iTrunk, &pTrunk, 0);
+  if( rc!=SQLITE_OK ) return rc;
+  j = freeLeafSearch(&pTrunk->aData[8], p->nLeaf, iPg);
+  *pbFree = (j<p->nLeaf && get4byte(&pTrunk->aData[8+j*4])==iPg);
+  releasePage(pTrunk);
+  return SQLITE_OK;
+}
+
+/*
+** Remove a page from the free-list using the free-page map, and return
+** it in *ppPage and *pPgno. The free page closest to page nearby is
+** chosen. Or, if exact is true, page nearby is known to be on the 
+** free-list and is the page removed.
+**
+** The caller has already loaded the free-page map, made page 1 
+** writable and decremented the free-page count stored on it.
+*/
+static int freeMapAllocate(
+  BtShared *pBt,                  /* The btree */
+  MemPage **ppPage,               /* OUT: The allocated page */
+  Pgno *pPgno,                    /* OUT: Page number of *ppPage */
+  Pgno nearby,                    /* Search for a page close to this one */
+  u8 exact                        /* Page nearby is the page to allocate */
+){
+  MemPage *pPage1 = pBt->pPage1;
+  MemPage *pTrunk = 0;            /* Trunk holding the allocated page */
+  MemPage *pPrev = 0;             /* Trunk before pTrunk on the free-list */
+  FreeTrunk *p;                   /* Free-page map entry for pTrunk */
+  Pgno iPg;                       /* The page to allocate */
+  int iLeaf;                      /* Index of iPg on its trunk, or -1 */
+  int i;                          /* Index of p in the free-page map */
+  int rc;
+
+  assert( pBt->freeMapOk && pBt->nFreeTrunk>0 );
+  if( nearby==0 ) nearby = 1;
+
+  if( exact ){
+    i = freeMapSearch(pBt, nearby);
+    p = &pBt->aFreeTrunk[i];
+    iPg = nearby;
+    iLeaf = -1;
+    if( p->iTrunk!=nearby ){
+      rc = btreeGetPage(pBt, p->iTrunk, &pTrunk, 0);
+      if( rc!=SQLITE_OK ){
+        pTrunk = 0;
+        goto allocate_out;
+      }
+      iLeaf = (int)freeLeafSearch(&pTrunk->aData[8], p->nLeaf, nearby);
+      if( iLeaf==(int)p->nLeaf || get4byte(&pTrunk->aData[8+iLeaf*4])!=iPg ){
+        rc = SQLITE_CORRUPT_BKPT;
+        goto allocate_out;
+      }
+    }
+  }else{
+    rc = freeMapFind(pBt, nearby, &i, &iPg, &iLeaf);
+    if( rc!=SQLITE_OK ) goto allocate_out;
+    p = &pBt->aFreeTrunk[i];
+  }
+
+  if( pTrunk==0 ){
+    rc = btreeGetPage(pBt, p->iTrunk, &pTrunk, 0);
+    if( rc!=SQLITE_OK ){
+      pTrunk = 0;
+      goto allocate_out;
+    }
+  }
+  rc = sqlite3PagerWrite(pTrunk->pDbPage);
+  if( rc!=SQLITE_OK ) goto allocate_out;
+
+  if( iLeaf>=0 ){
+    /* Extract a leaf from the trunk. */
+    u8 *aData = pTrunk->aData;
+    int noContent;
+    memmove(&aData[8+iLeaf*4], &aData[12+iLeaf*4], (p->nLeaf-iLeaf-1)*4);
+    p->nLeaf--;
+    put4byte(&aData[4], p->nLeaf);
+    TRACE(("ALLOCATE: %d was leaf %d on trunk %d (free-page map)\n",
+           iPg, iLeaf+1, p->iTrunk));
+    noContent = !btreeGetHasContent(pBt, iPg);
+    rc = btreeGetPage(pBt, iPg, ppPage, noContent);
+    if( rc==SQLITE_OK ){
+      rc = sqlite3PagerWrite((*ppPage)->pDbPage);
+      if( rc!=SQLITE_OK ){
+        releasePage(*ppPage);
+      }
+    }
+  }else{
+    /* The trunk page itself is allocated. Unlink it from the free-list,
+    ** or, if it has leaves, replace it with its first leaf. */
+    u8 *aNext = &pPage1->aData[32];
+    assert( sqlite3PagerIswriteable(pPage1->pDbPage) );
+    if( i>0 ){
+      rc = btreeGetPage(pBt, pBt->aFreeTrunk[i-1].iTrunk, &pPrev, 0);
+      if( rc!=SQLITE_OK ){
+        pPrev = 0;
+        goto allocate_out;
+      }
+      rc = sqlite3PagerWrite(pPrev->pDbPage);
+      if( rc!=SQLITE_OK ) goto allocate_out;
+      aNext = pPrev->aData;
+    }
+    if( p->nLeaf==0 ){
+      memcpy(aNext, &pTrunk->aData[0], 4);
+      pBt->nFreeTrunk--;
+      memmove(p, &p[1], (pBt->nFreeTrunk-i)*sizeof(FreeTrunk));
+    }else{
+      MemPage *pNewTrunk = 0;
+      Pgno iNewTrunk = get4byte(&pTrunk->aData[8]);
+      rc = btreeGetPage(pBt, iNewTrunk, &pNewTrunk, 0);
+      if( rc==SQLITE_OK ){
+        rc = sqlite3PagerWrite(pNewTrunk->pDbPage);
+        if( rc!=SQLITE_OK ) releasePage(pNewTrunk);
+      }
+      if( rc!=SQLITE_OK ) goto allocate_out;
+      memcpy(&pNewTrunk->aData[0], &pTrunk->aData[0], 4);
+      put4byte(&pNewTrunk->aData[4], p->nLeaf-1);
+      memcpy(&pNewTrunk->aData[8], &pTrunk->aData[12], (p->nLeaf-1)*4);
+      releasePage(pNewTrunk);
+      put4byte(aNext, iNewTrunk);
+      p->iTrunk = iNewTrunk;
+      p->nLeaf--;
+    }
+    TRACE(("ALLOCATE: %d trunk (free-page map)\n", iPg));
+    *ppPage = pTrunk;
+    pTrunk = 0;
+  }
+
+allocate_out:
+  releasePage(pTrunk);
+  releasePage(pPrev);
+  if( rc==SQLITE_OK ){
+    *pPgno = iPg;
+    pBt->nFreeMapPage--;
+  }else{
+    pBt->freeMapOk = 0;
+  }
+  return rc;
+}
+
+/*
+** Add page iPage to the free-list at its sorted position, using the 
+** free-page map to find the trunk whose range contains iPage. If that
+** trunk is full, iPage becomes a new trunk and takes a share of its
+** leaves.
+**
+** *ppPage is the page object for iPage, or NULL if the caller does not
+** have one. If this function needs the page object, it is stored in
+** *ppPage, and the caller is responsible for releasing it.
+**
+** The caller has already loaded the free-page map, made page 1 
+** writable and incremented the free-page count stored on it.
+*/
+static int freeMapFree(BtShared *pBt, MemPage **ppPage, Pgno iPage){
+  MemPage *pPage1 = pBt->pPage1;
+  MemPage *pTrunk = 0;            /* Trunk whose range contains iPage */
+  MemPage *pPrev = 0;             /* Trunk before pTrunk on the free-list */
+  u32 nMax = pBt->usableSize/4 - 8;
+  FreeTrunk *p = 0;               /* Free-page map entry for pTrunk */
+  u8 *aData = 0;                  /* Content of pTrunk */
+  u8 *aNew;                       /* Content of iPage, if it becomes a trunk */
+  Pgno iKey;                      /* Lower bound of the range for iPage */
+  Pgno iMid;                      /* Middle leaf of a full trunk */
+  u32 j;                          /* Index into the leaves of pTrunk */
+  int i = 0;                      /* Index of p in the free-page map */
+  int rc;
+
+  assert( pBt->freeMapOk );
+  assert( sqlite3PagerIswriteable(pPage1->pDbPage) );
+  rc = freeMapGrow(pBt);
+  if( rc!=SQLITE_OK ) goto free_out;
+
+  if( pBt->nFreeTrunk>0 ){
+    i = freeMapSearch(pBt, iPage);
+    p = &pBt->aFreeTrunk[i];
+    rc = btreeGetPage(pBt, p->iTrunk, &pTrunk, 0);
+    if( rc!=SQLITE_OK ){
+      pTrunk = 0;
+      goto free_out;
+    }
+    rc = sqlite3PagerWrite(pTrunk->pDbPage);
+    if( rc!=SQLITE_OK ) goto free_out;
+    aData = pTrunk->aData;
+    if( p->nLeaf<nMax ){
+      /* There is space on the trunk to insert iPage as a new leaf. */
+      j = freeLeafSearch(&aData[8], p->nLeaf, iPage);
+      memmove(&aData[12+j*4], &aData[8+j*4], (p->nLeaf-j)*4);
+      put4byte(&aData[8+j*4], iPage);
+      p->nLeaf++;
+      put4byte(&aData[4], p->nLeaf);
+      if( iPage<p->iKey ) p->iKey = iPage;
+      if( *ppPage && !pBt->secureDelete ){
+        sqlite3PagerDontWrite((*ppPage)->pDbPage);
+      }
+      rc = btreeSetHasContent(pBt, iPage);
+      TRACE(("FREE-PAGE: %d leaf on trunk page %d (free-page map)\n",
+             iPage, p->iTrunk));
+      goto free_out;
+    }
+    if( iPage<p->iTrunk ){
+      if( i>0 ){
+        rc = btreeGetPage(pBt, pBt->aFreeTrunk[i-1].iTrunk, &pPrev, 0);
+        if( rc!=SQLITE_OK ){
+          pPrev = 0;
+          goto free_out;
+        }
+        rc = sqlite3PagerWrite(pPrev->pDbPage);
+        if( rc!=SQLITE_OK ) goto free_out;
+      }
+    }
+  }
+
+  /* Page iPage becomes a new trunk page. */
+  if( *ppPage==0 && SQLITE_OK!=(rc = btreeGetPage(pBt, iPage, ppPage, 0)) ){
+    goto free_out;
+  }
+  rc = sqlite3PagerWrite((*ppPage)->pDbPage);
+  if( rc!=SQLITE_OK ) goto free_out;
+  aNew = (*ppPage)->aData;
+
+  if( pBt->nFreeTrunk==0 ){
+    put4byte(&aNew[0], 0);
+    put4byte(&aNew[4], 0);
+    put4byte(&pPage1->aData[32], iPage);
+    freeMapInsert(pBt, 0, iPage, iPage, 0);
+  }else if( iPage>p->iTrunk ){
+    /* The new trunk follows pTrunk on the free-list. Its range starts
+    ** after page pTrunk->pgno, and it takes the leaves of pTrunk that
+    ** are in that range. */
+    iMid = get4byte(&aData[8+(p->nLeaf/2)*4]);
+    iKey = (iMid<iPage) ? iMid : iPage;
+    if( iKey<=p->iTrunk ) iKey = p->iTrunk+1;
+    j = freeLeafSearch(&aData[8], p->nLeaf, iKey);
+    memcpy(&aNew[0], &aData[0], 4);
+    put4byte(&aNew[4], p->nLeaf-j);
+    memcpy(&aNew[8], &aData[8+j*4], (p->nLeaf-j)*4);
+    put4byte(&aData[0], iPage);
+    put4byte(&aData[4], j);
+    freeMapInsert(pBt, i+1, iPage, iKey, p->nLeaf-j);
+    pBt->aFreeTrunk[i].nLeaf = j;
+  }else{
+    /* The new trunk precedes pTrunk on the free-list. The range of 
+    ** pTrunk now starts at or before page pTrunk->pgno, and the new
+    ** trunk takes the leaves of pTrunk that are below that range. */
+    Pgno iOldKey = (p->iKey<iPage) ? p->iKey : iPage;
+    iMid = get4byte(&aData[8+(p->nLeaf/2)*4]);
+    iKey = (iMid>iPage) ? iMid : iPage+1;
+    if( iKey>p->iTrunk ) iKey = p->iTrunk;
+    j = freeLeafSearch(&aData[8], p->nLeaf, iKey);
+    put4byte(&aNew[0], p->iTrunk);
+    put4byte(&aNew[4], j);
+    memcpy(&aNew[8], &aData[8], j*4);
+    memmove(&aData[8], &aData[8+j*4], (p->nLeaf-j)*4);
+    put4byte(&aData[4], p->nLeaf-j);
+    put4byte(pPrev ? pPrev->aData : &pPage1->aData[32], iPage);
+    p->nLeaf -= j;
+    p->iKey = iKey;
+    freeMapInsert(pBt, i, iPage, iOldKey, j);
+  }
+  TRACE(("FREE-PAGE: %d new trunk page (free-page map)\n", iPage));
+
+free_out:
+  releasePage(pTrunk);
+  releasePage(pPrev);
+  if( rc==SQLITE_OK ){
+    pBt->nFreeMapPage++;
+  }else{
+    pBt->freeMapOk = 0;
+  }
+  return rc;
+}
+
+/*
+** Add a new page to the end of the database file, and return it in
+** *ppPage and *pPgno. The new page is writable. This is used when there
+** are no suitable pages on the free-list.
+*/
+static int allocateEndPage(BtShared *pBt, MemPage **ppPage, Pgno *pPgno){
+  int rc;
+
+  rc = sqlite3PagerWrite(pBt->pPage1->pDbPage);
+  if( rc ) return rc;
+  pBt->nPage++;
+  if( pBt->nPage==PENDING_BYTE_PAGE(pBt) ) pBt->nPage++;
+
+#ifndef SQLITE_OMIT_AUTOVACUUM
+  if( pBt->autoVacuum && PTRMAP_ISPAGE(pBt, pBt->nPage) ){
+    /* If *pPgno refers to a pointer-map page, allocate two new pages
+    ** at the end of the file instead of one. The first allocated page
+    ** becomes a new pointer-map page, the second is used by the caller.
+    */
+    MemPage *pPg = 0;
+    TRACE(("ALLOCATE: %d from end of file (pointer-map page)\n", pBt->nPage));
+    assert( pBt->nPage!=PENDING_BYTE_PAGE(pBt) );
+    rc = btreeGetPage(pBt, pBt->nPage, &pPg, 1);
+    if( rc==SQLITE_OK ){
+      rc = sqlite3PagerWrite(pPg->pDbPage);
+      releasePage(pPg);
+    }
+    if( rc ) return rc;
+    pBt->nPage++;
+    if( pBt->nPage==PENDING_BYTE_PAGE(pBt) ){ pBt->nPage++; }
+  }
+#endif
+  put4byte(28 + (u8*)pBt->pPage1->aData, pBt->nPage);
+  *pPgno = pBt->nPage;
+
+  assert( *pPgno!=PENDING_BYTE_PAGE(pBt) );
+  rc = btreeGetPage(pBt, *pPgno, ppPage, 1);
+  if( rc ) return rc;
+  rc = sqlite3PagerWrite((*ppPage)->pDbPage);
+  if( rc!=SQLITE_OK ){
+    releasePage(*ppPage);
+  }
+  TRACE(("ALLOCATE: %d from end of file\n", *pPgno));
+  return rc;
+}
+
+/*
+** Return the extent reserved for the b-tree with root page iRoot, or 
+** NULL if there is no such extent.
+*/
+static BtExtent *extentFind(BtShared *pBt, Pgno iRoot){
+  int i;
+  for(i=0; i<BTREE_MAX_EXTENT; i++){
+    if( pBt->aExtent[i].iRoot==iRoot ) return &pBt->aExtent[i];
+  }
+  return 0;
+}
+
+/*
+** Return true if page iPg is part of an extent reserved for a b-tree
+** other than the one with root page iRoot.
+*/
+static int extentReserved(BtShared *pBt, Pgno iRoot, Pgno iPg){
+  int i;
+  for(i=0; i<BTREE_MAX_EXTENT; i++){
+    BtExtent *p = &pBt->aExtent[i];
+    if( p->iRoot && p->iRoot!=iRoot && iPg>=p->iNext && iPg<p->iEnd ){
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+** Reserve pages iFirst to iEnd-1 for the b-tree with root page iRoot,
+** replacing any extent already reserved for it. If there is none, the
+** least recently reserved extent is forgotten to make room.
+*/
+static void extentReserve(BtShared *pBt, Pgno iRoot, Pgno iFirst, Pgno iEnd){
+  BtExtent *p = extentFind(pBt, iRoot);
+  if( p==0 ){
+    p = &pBt->aExtent[pBt->iExtent];
+    pBt->iExtent = (pBt->iExtent+1) % BTREE_MAX_EXTENT;
+  }
+  p->iRoot = iRoot;
+  p->iNext = iFirst;
+  p->iEnd = iEnd;
+  TRACE(("EXTENT: pages %d..%d reserved for root %d\n", iFirst, iEnd-1, iRoot));
+}
+
+/*
+** Search the free-list for a run of nRun consecutive free leaves that
+** are not reserved for another b-tree. If one is found, set *piFirst to
+** its first page. Otherwise set *piFirst to 0. 
+**
+** The search starts at the trunk whose range contains page nearby and 
+** proceeds in ascending order, wrapping around to the start of the 
+** free-list. To bound the cost, at most 32 trunks are examined.
+*/
+static int freeMapFindRun(
+  BtShared *pBt,                  /* The btree */
+  Pgno nearby,                    /* Start the search here */
+  u32 nRun,                       /* Number of consecutive pages required */
+  Pgno *piFirst                   /* OUT: First page of the run, or 0 */
+){
+  int nTrunk = pBt->nFreeTrunk;
+  int iStart;
+  int k;
+
+  *piFirst = 0;
+  if( nTrunk==0 || nRun<2 ) return SQLITE_OK;
+  iStart = freeMapSearch(pBt, nearby);
+  for(k=0; k<nTrunk && k<32; k++){
+    FreeTrunk *p = &pBt->aFreeTrunk[(iStart+k)%nTrunk];
+    MemPage *pTrunk;
+    u8 *aLeaf;
+    u32 j;
+    int rc;
+    if( p->nLeaf<nRun ) continue;
+    rc = btreeGetPage(pBt, p->iTrunk, &pTrunk, 0);
+    if( rc!=SQLITE_OK ) return rc;
+    aLeaf = &pTrunk->aData[8];
+    for(j=0; j+nRun<=p->nLeaf; j++){
+      Pgno iFirst = get4byte(&aLeaf[j*4]);
+      if( get4byte(&aLeaf[(j+nRun-1)*4])-iFirst==nRun-1
+       && !extentReserved(pBt, pBt->iAllocRoot, iFirst)
+       && !extentReserved(pBt, pBt->iAllocRoot, iFirst+nRun-1)
+      ){
+        *piFirst = iFirst;
+        break;
+      }
+    }
+    releasePage(pTrunk);
+    if( *piFirst ) break;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Allocate a page for the b-tree with root page BtShared.iAllocRoot. 
+** This is used by allocateBtreePage() while the free-page map and 
+** extents are both in use. In order of preference, the page is:
+**
+**   1. The next free page of the extent reserved for the b-tree.
+**
+**   2. The free page closest to page nearby, if it is not reserved for
+**      another b-tree and is less than one extent away. The distance is
+**      not limited if more than an eighth of the database is free, so
+**      that pages freed far from any growing b-tree are still reused.
+**
+**   3. The first page of a run of free pages the size of an extent,
+**      which becomes the b-tree's new extent.
+**
+**   4. The first page of a new extent added to the end of the file.
+**      The rest of the new extent is added to the free-list.
+*/
+static int extentAllocate(
+  BtShared *pBt,                  /* The btree */
+  MemPage **ppPage,               /* OUT: The allocated page */
+  Pgno *pPgno,                    /* OUT: Page number of *ppPage */
+  Pgno nearby                     /* Search for a page close to this one */
+){
+  MemPage *pPage1 = pBt->pPage1;
+  Pgno iRoot = pBt->iAllocRoot;
+  u32 nExtent = pBt->nExtentSize;
+  u32 nFree = get4byte(&pPage1->aData[36]);
+  BtExtent *pExt = extentFind(pBt, iRoot);
+  Pgno iPg = 0;
+  Pgno iFirst;
+  Pgno mxPgno;
+  int rc = SQLITE_OK;
+
+  assert( iRoot>0 && nExtent>1 && pBt->freePageMap );
+  if( nFree>0 ){
+    rc = freeMapLoad(pBt);
+    while( rc==SQLITE_OK && iPg==0 && pExt && pExt->iNext<pExt->iEnd ){
+      int bFree;
+      rc = freeMapContains(pBt, pExt->iNext, &bFree);
+      if( bFree ) iPg = pExt->iNext;
+      pExt->iNext++;
+    }
+    if( nearby==0 && pExt ){
+      nearby = pExt->iNext-1;
+    }
+    if( rc==SQLITE_OK && iPg==0 ){
+      Pgno iCand;
+      int i, iLeaf;
+      rc = freeMapFind(pBt, nearby ? nearby : 1, &i, &iCand, &iLeaf);
+      if( rc==SQLITE_OK && !extentReserved(pBt, iRoot, iCand)
+       && ((nearby && FREEMAP_DIST(iCand, nearby)<nExtent)
+           || nFree>btreePagecount(pBt)/8)
+      ){
+        iPg = iCand;
+      }
+    }
+    if( rc==SQLITE_OK && iPg==0 ){
+      rc = freeMapFindRun(pBt, nearby, nExtent, &iPg);
+      if( iPg ){
+        extentReserve(pBt, iRoot, iPg+1, iPg+nExtent);
+      }
+    }
+    if( rc!=SQLITE_OK ) return rc;
+    if( iPg ){
+      rc = sqlite3PagerWrite(pPage1->pDbPage);
+      if( rc ) return rc;
+      put4byte(&pPage1->aData[36], nFree-1);
+      return freeMapAllocate(pBt, ppPage, pPgno, iPg, 1);
+    }
+  }
+
+  /* Add a new extent to the end of the file. The pages that follow the 
+  ** one returned to the caller are added to the free-list, stopping 
+  ** short of the max_page_count limit.
+  */
+  rc = allocateEndPage(pBt, ppPage, pPgno);
+  if( rc ) return rc;
+  iFirst = *pPgno + 1;
+  mxPgno = sqlite3PagerMaxPageCount(pBt->pPager, 0);
+  while( pBt->nPage<*pPgno+nExtent-1 && pBt->nPage+3<=mxPgno ){
+    MemPage *pPg;
+    Pgno iNew;
+    rc = allocateEndPage(pBt, &pPg, &iNew);
+    if( rc==SQLITE_OK ){
+      rc = freePage2(pBt, pPg, iNew);
+      releasePage(pPg);
+    }
+    if( rc!=SQLITE_OK ){
+      releasePage(*ppPage);
+      return rc;
+    }
+  }
+  extentReserve(pBt, iRoot, iFirst, pBt->nPage+1);
+  return SQLITE_OK;
+}
+
 /*
 ** Allocate a new page from the database file.
 **
@@ -4761,7 +6410,17 @@ static int allocateBtreePage(
   if( n>=mxPage ){
     return SQLITE_CORRUPT_BKPT;
   }
-  if( n>0 ){
+  if( n==0 && !pBt->inReclaim && get4byte(&pPage1->aData[68]) ){
+    /* The free-list is empty. Before extending the file, return some of
+    ** the pages of detached b-trees to the free-list. */
+    rc = reclaimDetached(pBt, BTREE_RECLAIM_STEP, 0);
+    if( rc ) return rc;
+    n = get4byte(&pPage1->aData[36]);
+  }
+  if( pBt->freePageMap && pBt->nExtentSize>1 && pBt->iAllocRoot && !exact ){
+    /* Allocate from the extent reserved for the b-tree being written. */
+    rc = extentAllocate(pBt, ppPage, pPgno, nearby);
+  }else if( n>0 ){
     /* There are pages on the freelist.  Reuse one of those pages. */
     Pgno iTrunk;
     u8 searchList = 0; /* If the free-list must be searched for 'nearby' */
@@ -4784,6 +6443,11 @@ static int allocateBtreePage(
     }
 #endif
 
+    if( pBt->freePageMap ){
+      rc = freeMapLoad(pBt);
+      if( rc ) return rc;
+    }
+
     /* Decrement the free-list count by 1. Set iTrunk to the index of the
     ** first free-list trunk page. iPrevTrunk is initially 1.
     */
@@ -4791,6 +6455,11 @@ static int allocateBtreePage(
     if( rc ) return rc;
     put4byte(&pPage1->aData[36], n-1);
 
+    if( pBt->freePageMap ){
+      rc = freeMapAllocate(pBt, ppPage, pPgno, nearby, searchList);
+      goto end_allocate_page;
+    }
+
     /* The code within this loop is run only once if the 'searchList' variable
     ** is not true. Otherwise, it runs once for each trunk-page on the
     ** free-list until the page 'nearby' is located.
@@ -4955,44 +6624,10 @@ static int allocateBtreePage(
   }else{
     /* There are no pages on the freelist, so create a new page at the
     ** end of the file */
-    rc = sqlite3PagerWrite(pBt->pPage1->pDbPage);
-    if( rc ) return rc;
-    pBt->nPage++;
-    if( pBt->nPage==PENDING_BYTE_PAGE(pBt) ) pBt->nPage++;
-
-#ifndef SQLITE_OMIT_AUTOVACUUM
-    if( pBt->autoVacuum && PTRMAP_ISPAGE(pBt, pBt->nPage) ){
-      /* If *pPgno refers to a pointer-map page, allocate two new pages
-      ** at the end of the file instead of one. The first allocated page
-      ** becomes a new pointer-map page, the second is used by the caller.
-      */
-      MemPage *pPg = 0;
-      TRACE(("ALLOCATE: %d from end of file (pointer-map page)\n", pBt->nPage));
-      assert( pBt->nPage!=PENDING_BYTE_PAGE(pBt) );
-      rc = btreeGetPage(pBt, pBt->nPage, &pPg, 1);
-      if( rc==SQLITE_OK ){
-        rc = sqlite3PagerWrite(pPg->pDbPage);
-        releasePage(pPg);
-      }
-      if( rc ) return rc;
-      pBt->nPage++;
-      if( pBt->nPage==PENDING_BYTE_PAGE(pBt) ){ pBt->nPage++; }
-    }
-#endif
-    put4byte(28 + (u8*)pBt->pPage1->aData, pBt->nPage);
-    *pPgno = pBt->nPage;
-
-    assert( *pPgno!=PENDING_BYTE_PAGE(pBt) );
-    rc = btreeGetPage(pBt, *pPgno, ppPage, 1);
-    if( rc ) return rc;
-    rc = sqlite3PagerWrite((*ppPage)->pDbPage);
-    if( rc!=SQLITE_OK ){
-      releasePage(*ppPage);
-    }
-    TRACE(("ALLOCATE: %d from end of file\n", *pPgno));
+    rc = allocateEndPage(pBt, ppPage, pPgno);
   }
 
-  assert( *pPgno!=PENDING_BYTE_PAGE(pBt) );
+  assert( rc!=SQLITE_OK || *pPgno!=PENDING_BYTE_PAGE(pBt) );
 
 end_allocate_page:
   releasePage(pTrunk);
@@ -5040,6 +6675,11 @@ static int freePage2(BtShared *pBt, MemPage *pMemPage, Pgno iPage){
     pPage = btreePageLookup(pBt, iPage);
   }
 
+  if( pBt->freePageMap ){
+    rc = freeMapLoad(pBt);
+    if( rc ) goto freepage_out;
+  }
+
   /* Increment the free page count on pPage1 */
   rc = sqlite3PagerWrite(pPage1->pDbPage);
   if( rc ) goto freepage_out;
@@ -5066,6 +6706,14 @@ static int freePage2(BtShared *pBt, MemPage *pMemPage, Pgno iPage){
     if( rc ) goto freepage_out;
   }
 
+  /* If the free-page map is in use, add the page to the free-list at
+  ** its sorted position.
+  */
+  if( pBt->freePageMap ){
+    rc = freeMapFree(pBt, &pPage, iPage);
+    goto freepage_out;
+  }
+
   /* Now manipulate the actual database free-list structure. There are two
   ** possibilities. If the free-list is currently empty, or if the first
   ** trunk page in the free-list is full, then this page will become a
@@ -5262,6 +6910,9 @@ static int fillInCell(
     nData = nZero = 0;
   }
   nHeader += putVarint(&pCell[nHeader], *(u64*)&nKey);
+  if( pPage->hasPrefix ){
+    pCell[nHeader++] = 0;   /* nShared. See compressCell() */
+  }
   btreeParseCellPtr(pPage, pCell, &info);
   assert( info.nHeader==nHeader );
   assert( info.nKey==nKey );
@@ -5522,6 +7173,10 @@ static void insertCell(
 /*
 ** Add a list of cells to a page.  The page should be initially empty.
 ** The cells are guaranteed to fit on the page.
+**
+** If pPage has a prefix, it must already have been set by setPagePrefix().
+** The cells in apCell[] are then in expanded form and aSize[] holds their
+** expanded sizes. Each is encoded against the page prefix as it is copied.
 */
 static void assemblePage(
   MemPage *pPage,   /* The page to be assemblied */
@@ -5534,7 +7189,7 @@ static void assemblePage(
   int cellbody;     /* Address of next cell body */
   u8 * const data = pPage->aData;             /* Pointer to data for pPage */
   const int hdr = pPage->hdrOffset;           /* Offset of header on pPage */
-  const int nUsable = pPage->pBt->usableSize; /* Usable size of page */
+  const int nUsable = contentEnd(pPage);      /* Usable size of page */
 
   assert( pPage->nOverflow==0 );
   assert( sqlite3_mutex_held(pPage->pBt->mutex) );
@@ -5549,9 +7204,16 @@ static void assemblePage(
   cellbody = nUsable;
   for(i=nCell-1; i>=0; i--){
     pCellptr -= 2;
-    cellbody -= aSize[i];
+    if( pPage->nPrefix ){
+      const u8 *aPrefix = pagePrefix(pPage);
+      int nShared = cellShare(pPage, apCell[i], aPrefix, pPage->nPrefix);
+      cellbody -= sharedCellSize(aSize[i], nShared);
+      compressCell(pPage, apCell[i], aSize[i], aPrefix, nShared, &data[cellbody]);
+    }else{
+      cellbody -= aSize[i];
+      memcpy(&data[cellbody], apCell[i], aSize[i]);
+    }
     put2byte(pCellptr, cellbody);
-    memcpy(&data[cellbody], apCell[i], aSize[i]);
   }
   put2byte(&data[hdr+3], nCell);
   put2byte(&data[hdr+5], cellbody);
@@ -5780,6 +7442,108 @@ static void copyNodeContent(MemPage *pFrom, MemPage *pTo, int *pRC){
   }
 }
 
+/*
+** Return the length of the longest prefix shared by the record bodies of
+** all cells in apCell[] that are candidates for compression on prefix
+** page pPage, and set *pzPrefix to point to the first such body. Cells
+** with overflow pages are ignored. Zero is returned if there are no
+** candidate cells.
+*/
+static int cellsCommonPrefix(
+  MemPage *pPage,         /* Prefix page that the cells are for */
+  u8 **apCell,            /* Cells, in expanded form */
+  int nCell,              /* Number of entries in apCell[] */
+  const u8 **pzPrefix     /* OUT: Pointer to the common prefix */
+){
+  const u8 *zPrefix = 0;
+  int nPrefix = 0;
+  int i;
+  for(i=0; i<nCell; i++){
+    int nBody;
+    u8 *pBody = cellRecordBody(pPage, apCell[i], &nBody);
+    if( pBody==0 ) continue;
+    if( zPrefix==0 ){
+      zPrefix = pBody;
+      nPrefix = nBody;
+    }else{
+      int j;
+      if( nBody<nPrefix ) nPrefix = nBody;
+      for(j=0; j<nPrefix && pBody[j]==zPrefix[j]; j++);
+      nPrefix = j;
+    }
+    if( nPrefix==0 ) break;
+  }
+  *pzPrefix = zPrefix;
+  return nPrefix;
+}
+
+/*
+** When the cells of a tree made of prefix pages are redistributed by
+** balance_nonroot(), each sibling page is given whichever of a small set
+** of candidate prefixes makes its cells smallest. The candidates are no
+** prefix at all, the prefixes of the original siblings and the longest
+** prefix common to all cells. An instance of the following structure
+** holds the candidates along with, for each candidate, running totals of
+** the space used by the cells when they are encoded against it.
+*/
+typedef struct PrefixPlan PrefixPlan;
+struct PrefixPlan {
+  int nCand;                  /* Number of candidate prefixes */
+  int nStride;                /* Number of aSum[] entries per candidate */
+  const u8 *azPrefix[NB+2];   /* Candidate prefixes. azPrefix[0] is empty */
+  int anPrefix[NB+2];         /* Sizes of the candidate prefixes in bytes */
+  int *aSum;                  /* See below */
+};
+
+/*
+** For candidate c, aSum[c*nStride+i] is the total number of bytes taken
+** on a page by cells 0 to i-1 of the apCell[] array, including their cell
+** pointers, when they are encoded against azPrefix[c].
+**
+** Populate PrefixPlan.aSum[]. The caller has already set the other fields.
+*/
+static void prefixPlanInit(
+  PrefixPlan *p,          /* The plan to populate */
+  MemPage *pPage,         /* Prefix page that the cells are for */
+  u8 **apCell,            /* Cells, in expanded form */
+  u16 *szCell,            /* Sizes of the apCell[] entries */
+  int nCell               /* Number of entries in apCell[] */
+){
+  int c, i;
+  assert( p->nStride>nCell );
+  for(c=0; c<p->nCand; c++){
+    int *aSum = &p->aSum[c*p->nStride];
+    aSum[0] = 0;
+    for(i=0; i<nCell; i++){
+      int nShared = cellShare(pPage, apCell[i], p->azPrefix[c], p->anPrefix[c]);
+      aSum[i+1] = aSum[i] + sharedCellSize(szCell[i], nShared) + 2;
+    }
+  }
+}
+
+/*
+** Return the number of bytes required to store cells iFirst to iLast-1
+** of the apCell[] array used to populate PrefixPlan p, along with the
+** page prefix, on a single page. If piCand is not NULL, set *piCand to
+** the index of the candidate prefix that achieves this.
+*/
+static int prefixPlanSize(PrefixPlan *p, int iFirst, int iLast, int *piCand){
+  int iBest = 0;
+  int szBest = p->aSum[iLast] - p->aSum[iFirst];
+  int c;
+  assert( iFirst<=iLast && iLast<p->nStride );
+  for(c=1; c<p->nCand; c++){
+    int *aSum = &p->aSum[c*p->nStride];
+    int sz = aSum[iLast] - aSum[iFirst] + p->anPrefix[c];
+    if( sz<szBest ){
+      szBest = sz;
+      iBest = c;
+    }
+  }
+  if( piCand ) *piCand = iBest;
+  return szBest;
+}
+
 /*
 ** This routine redistributes cells on the iParentIdx'th child of pParent
 ** (hereafter "the page") and up to 2 siblings so that all pages have about the
@@ -5819,12 +7583,20 @@ static void copyNodeContent(MemPage *pFrom, MemPage *pTo, int *pRC){
 **
 ** If aOvflSpace is set to a null pointer, this function returns 
 ** SQLITE_NOMEM.
+**
+** On prefix pages (see decodeFlags()) the cells are expanded before they
+** are redistributed, and each new sibling is given the page prefix that
+** best suits the cells that end up on it. As a cell may grow when it is
+** moved away from the prefix it was encoded against, an overfull page of
+** a prefix tree (isOverfull is true) is split on its own, without taking
+** cells from its siblings, unless the parent page is itself overfull.
 */
 static int balance_nonroot(
   MemPage *pParent,               /* Parent page of siblings being balanced */
   int iParentIdx,                 /* Index of "the page" in pParent */
   u8 *aOvflSpace,                 /* page-size bytes of space for parent ovfl */
-  int isRoot                      /* True if pParent is a root-page */
+  int isRoot,                     /* True if pParent is a root-page */
+  int isOverfull                  /* True if "the page" is overfull */
 ){
   BtShared *pBt;               /* The whole database */
   int nCell = 0;               /* Number of cells in apCell[] */
@@ -5853,6 +7625,13 @@ static int balance_nonroot(
   u16 *szCell;                 /* Local size of all cells in apCell[] */
   u8 *aSpace1;                 /* Space for copies of dividers cells */
   Pgno pgno;                   /* Temp var to store a page number in */
+  PrefixPlan plan;             /* Candidate page prefixes, for prefix pages */
+  PrefixPlan *pPlan = 0;       /* &plan, if the siblings are prefix pages */
+  const u8 *azNewPrefix[NB+2]; /* Prefix for each page in apNew[] */
+  int anNewPrefix[NB+2];       /* Sizes of the azNewPrefix[] entries */
+  u8 *aExpand = 0;             /* Space for expanded copies of cells */
+  int nExpand = 0;             /* Size of aExpand[] in bytes */
+  int iExpand = 0;             /* First unused byte of aExpand[] */
 
   pBt = pParent->pBt;
   assert( sqlite3_mutex_held(pBt->mutex) );
@@ -5886,7 +7665,11 @@ static int balance_nonroot(
   ** have already been removed.
   */
   i = pParent->nOverflow + pParent->nCell;
-  if( i<2 ){
+  if( pParent->hasPrefix && isOverfull && pParent->nOverflow==0 ){
+    nxDiv = iParentIdx;
+    nOld = 1;
+    i = 0;
+  }else if( i<2 ){
     nxDiv = 0;
     nOld = i+1;
   }else{
@@ -5956,6 +7739,30 @@ static int balance_nonroot(
   ** alignment */
   nMaxCells = (nMaxCells + 3)&~3;
 
+  /* If the siblings are prefix pages, figure out how much space is needed
+  ** for expanded copies of the cells that share bytes with a page prefix.
+  ** Each sibling must be of the same type as the parent. */
+  if( pParent->hasPrefix ){
+    for(i=0; i<nOld; i++){
+      MemPage *pOld = apOld[i];
+      if( pOld->hasPrefix==0 ){
+        rc = SQLITE_CORRUPT_BKPT;
+        goto balance_cleanup;
+      }
+      for(j=0; j<pOld->nCell+pOld->nOverflow; j++){
+        CellInfo info;
+        btreeParseCellPtr(pOld, findOverflowCell(pOld, j), &info);
+        if( info.nShared ){
+          nExpand += info.nSize + info.nShared;
+        }
+      }
+    }
+    pPlan = &plan;
+  }else if( apOld[0]->hasPrefix ){
+    rc = SQLITE_CORRUPT_BKPT;
+    goto balance_cleanup;
+  }
+
   /*
   ** Allocate space for memory structures
   */
@@ -5965,6 +7772,11 @@ static int balance_nonroot(
      + nMaxCells*sizeof(u16)                       /* szCell */
      + pBt->pageSize                               /* aSpace1 */
      + k*nOld;                                     /* Page copies (apCopy) */
+  if( pPlan ){
+    szScratch +=
+       (NB+2)*(nMaxCells+1)*sizeof(int)            /* plan.aSum */
+     + nExpand;                                    /* aExpand */
+  }
   apCell = sqlite3ScratchMalloc( szScratch ); 
   if( apCell==0 ){
     rc = SQLITE_NOMEM;
@@ -5973,6 +7785,11 @@ static int balance_nonroot(
   szCell = (u16*)&apCell[nMaxCells];
   aSpace1 = (u8*)&szCell[nMaxCells];
   assert( EIGHT_BYTE_ALIGNMENT(aSpace1) );
+  if( pPlan ){
+    pPlan->nStride = nMaxCells+1;
+    pPlan->aSum = (int*)&aSpace1[pBt->pageSize + k*nOld];
+    aExpand = (u8*)&pPlan->aSum[(NB+2)*pPlan->nStride];
+  }
 
   /*
   ** Load pointers to all cells on sibling pages and the divider cells
@@ -6009,18 +7826,35 @@ static int balance_nonroot(
       assert( nCell<nMaxCells );
       apCell[nCell] = findOverflowCell(pOld, j);
       szCell[nCell] = cellSizePtr(pOld, apCell[nCell]);
+      if( pOld->hasPrefix ){
+        CellInfo info;
+        btreeParseCellPtr(pOld, apCell[nCell], &info);
+        if( info.nShared ){
+          u8 *pTemp = &aExpand[iExpand];
+          rc = expandCell(pOld, apCell[nCell], pTemp, &szCell[nCell]);
+          if( rc ) goto balance_cleanup;
+          apCell[nCell] = pTemp;
+          iExpand += szCell[nCell];
+          assert( iExpand<=nExpand );
+        }
+      }
       nCell++;
     }
     if( i<nOld-1 && !leafData){
       u16 sz = (u16)szNew[i];
       u8 *pTemp;
       assert( nCell<nMaxCells );
-      szCell[nCell] = sz;
       pTemp = &aSpace1[iSpace1];
+      if( pParent->hasPrefix ){
+        rc = expandCell(pParent, apDiv[i], pTemp, &sz);
+        if( rc ) goto balance_cleanup;
+      }else{
+        memcpy(pTemp, apDiv[i], sz);
+      }
+      szCell[nCell] = sz;
       iSpace1 += sz;
       assert( sz<=pBt->maxLocal+23 );
       assert( iSpace1<=pBt->pageSize );
-      memcpy(pTemp, apDiv[i], sz);
       apCell[nCell] = pTemp+leafCorrection;
       assert( leafCorrection==0 || leafCorrection==4 );
       szCell[nCell] = szCell[nCell] - leafCorrection;
@@ -6058,21 +7892,57 @@ static int balance_nonroot(
   ** 
   */
   usableSpace = pBt->usableSize - 12 + leafCorrection;
-  for(subtotal=k=i=0; i<nCell; i++){
-    assert( i<nMaxCells );
-    subtotal += szCell[i] + 2;
-    if( subtotal > usableSpace ){
-      szNew[k] = subtotal - szCell[i];
-      cntNew[k] = i;
-      if( leafData ){ i--; }
-      subtotal = 0;
-      k++;
-      if( k>NB+1 ){ rc = SQLITE_CORRUPT_BKPT; goto balance_cleanup; }
-    }
-  }
-  szNew[k] = subtotal;
-  cntNew[k] = nCell;
-  k++;
+  if( pPlan ){
+    /* Sizes on prefix pages depend on the prefix, so are obtained from
+    ** prefixPlanSize(). szNew[] includes the prefix itself, and
+    ** usableSpace excludes the 2 bytes that store its size. */
+    int iFirst = 0;
+    usableSpace -= 2;
+    pPlan->nCand = 1;
+    pPlan->azPrefix[0] = 0;
+    pPlan->anPrefix[0] = 0;
+    for(i=0; i<nOld; i++){
+      MemPage *pOld = apCopy[i];
+      if( pOld->nPrefix ){
+        pPlan->azPrefix[pPlan->nCand] = pagePrefix(pOld);
+        pPlan->anPrefix[pPlan->nCand++] = pOld->nPrefix;
+      }
+    }
+    j = cellsCommonPrefix(apCopy[0], apCell, nCell, &pPlan->azPrefix[pPlan->nCand]);
+    if( j>0 ){
+      pPlan->anPrefix[pPlan->nCand++] = j;
+    }
+    prefixPlanInit(pPlan, apCopy[0], apCell, szCell, nCell);
+
+    for(k=i=0; i<nCell; i++){
+      if( prefixPlanSize(pPlan, iFirst, i+1, 0) > usableSpace ){
+        szNew[k] = prefixPlanSize(pPlan, iFirst, i, 0);
+        cntNew[k] = i;
+        iFirst = i+1;
+        k++;
+        if( k>NB+1 ){ rc = SQLITE_CORRUPT_BKPT; goto balance_cleanup; }
+      }
+    }
+    szNew[k] = prefixPlanSize(pPlan, iFirst, nCell, 0);
+    cntNew[k] = nCell;
+    k++;
+  }else{
+    for(subtotal=k=i=0; i<nCell; i++){
+      assert( i<nMaxCells );
+      subtotal += szCell[i] + 2;
+      if( subtotal > usableSpace ){
+        szNew[k] = subtotal - szCell[i];
+        cntNew[k] = i;
+        if( leafData ){ i--; }
+        subtotal = 0;
+        k++;
+        if( k>NB+1 ){ rc = SQLITE_CORRUPT_BKPT; goto balance_cleanup; }
+      }
+    }
+    szNew[k] = subtotal;
+    cntNew[k] = nCell;
+    k++;
+  }
 
   /*
   ** The packing computed by the previous block is biased toward the siblings
@@ -6090,6 +7960,23 @@ static int balance_nonroot(
     int r;              /* Index of right-most cell in left sibling */
     int d;              /* Index of first cell to the left of right sibling */
 
+    if( pPlan ){
+      /* Move the divider one cell to the left for as long as this does
+      ** not make the right sibling larger than the left. */
+      int iLeft = (i>1 ? cntNew[i-2]+1 : 0);
+      while( cntNew[i-1]-1>iLeft ){
+        int szR = prefixPlanSize(pPlan, cntNew[i-1], cntNew[i], 0);
+        int szL = prefixPlanSize(pPlan, iLeft, cntNew[i-1]-1, 0);
+        if( szRight!=0 && szR>szL ) break;
+        szRight = szR;
+        szLeft = szL;
+        cntNew[i-1]--;
+      }
+      szNew[i] = szRight;
+      szNew[i-1] = szLeft;
+      continue;
+    }
+
     r = cntNew[i-1] - 1;
     d = r + 1 - leafData;
     assert( d<nMaxCells );
@@ -6105,6 +7992,35 @@ static int balance_nonroot(
     szNew[i-1] = szLeft;
   }
 
+  /* Choose a prefix for each new prefix page. This is the best of the
+  ** candidate prefixes for the cells on the page, unless the longest
+  ** prefix common to those cells does better still.  */
+  if( pPlan ){
+    for(i=0; i<k; i++){
+      int iFirst = (i>0 ? cntNew[i-1]+1 : 0);
+      const u8 *zPrefix;
+      int c;
+      int nPrefix;
+      prefixPlanSize(pPlan, iFirst, cntNew[i], &c);
+      azNewPrefix[i] = pPlan->azPrefix[c];
+      anNewPrefix[i] = pPlan->anPrefix[c];
+      nPrefix = cellsCommonPrefix(apCopy[0], &apCell[iFirst], cntNew[i]-iFirst,
+                                  &zPrefix);
+      if( nPrefix>anNewPrefix[i] ){
+        int sz = nPrefix;
+        for(j=iFirst; j<cntNew[i]; j++){
+          int nShared = cellShare(apCopy[0], apCell[j], zPrefix, nPrefix);
+          sz += sharedCellSize(szCell[j], nShared) + 2;
+        }
+        if( sz<szNew[i] ){
+          szNew[i] = sz;
+          azNewPrefix[i] = zPrefix;
+          anNewPrefix[i] = nPrefix;
+        }
+      }
+    }
+  }
+
   /* Either we found one or more cells (cntnew[0])>0) or pPage is
   ** a virtual root page.  A virtual root page is when the real root
   ** page is page 1 and we are the only child of that page.
@@ -6212,6 +8128,9 @@ static int balance_nonroot(
     MemPage *pNew = apNew[i];
     assert( j<nMaxCells );
     zeroPage(pNew, pageFlags);
+    if( pPlan ){
+      setPagePrefix(pNew, azNewPrefix[i], anNewPrefix[i]);
+    }
     assemblePage(pNew, cntNew[i]-j, &apCell[j], &szCell[j]);
     assert( pNew->nCell>0 || (nNew==1 && cntNew[0]==0) );
     assert( pNew->nOverflow==0 );
@@ -6263,6 +8182,16 @@ static int balance_nonroot(
           sz = cellSizePtr(pParent, pCell);
         }
       }
+      if( pParent->nPrefix ){
+        /* Encode the new divider cell against the prefix of pParent. The
+        ** first 4 bytes of pCell are not read, as on a leaf they are not
+        ** part of the cell. insertCell() overwrites them in any case. */
+        memcpy(&pTemp[4], &pCell[4], sz-4);
+        sz = compressCell(pParent, pTemp, sz, pagePrefix(pParent),
+                          pParent->nPrefix, pTemp);
+        pCell = pTemp;
+        pTemp = 0;
+      }
       iOvflSpace += sz;
       assert( sz<=pBt->maxLocal+23 );
       assert( iOvflSpace<=pBt->pageSize );
@@ -6510,6 +8439,8 @@ static int balance(BtCursor *pCur){
   TESTONLY( int balance_quick_called = 0 );
   TESTONLY( int balance_deeper_called = 0 );
 
+  /* Pages allocated while balancing belong to the b-tree of pCur. */
+  pCur->pBt->iAllocRoot = pCur->pgnoRoot;
   do {
     int iPage = pCur->iPage;
     MemPage *pPage = pCur->apPage[iPage];
@@ -6583,7 +8514,8 @@ static int balance(BtCursor *pCur){
           ** pSpace buffer passed to the latter call to balance_nonroot().
           */
           u8 *pSpace = sqlite3PageMalloc(pCur->pBt->pageSize);
-          rc = balance_nonroot(pParent, iIdx, pSpace, iPage==1);
+          rc = balance_nonroot(pParent, iIdx, pSpace, iPage==1,
+                               pPage->nOverflow>0);
           if( pFree ){
             /* If pFree is not NULL, it points to the pSpace buffer used 
             ** by a previous call to balance_nonroot(). Its contents are
@@ -6606,6 +8538,7 @@ static int balance(BtCursor *pCur){
       pCur->iPage--;
     }
   }while( rc==SQLITE_OK );
+  pCur->pBt->iAllocRoot = 0;
 
   if( pFree ){
     sqlite3PageFree(pFree);
@@ -6707,8 +8640,14 @@ int sqlite3BtreeInsert(
   allocateTempSpace(pBt);
   newCell = pBt->pTmpSpace;
   if( newCell==0 ) return SQLITE_NOMEM;
+  pBt->iAllocRoot = pCur->pgnoRoot;
   rc = fillInCell(pPage, newCell, pKey, nKey, pData, nData, nZero, &szNew);
+  pBt->iAllocRoot = 0;
   if( rc ) goto end_insert;
+  if( pPage->nPrefix ){
+    szNew = compressCell(pPage, newCell, szNew, 
+                         pagePrefix(pPage), pPage->nPrefix, newCell);
+  }
   assert( szNew==cellSizePtr(pPage, newCell) );
   assert( szNew<=MX_CELL_SIZE(pBt) );
   idx = pCur->aiIdx[pCur->iPage];
@@ -6856,8 +8795,21 @@ int sqlite3BtreeDelete(BtCursor *pCur){
     pTmp = pBt->pTmpSpace;
 
     rc = sqlite3PagerWrite(pLeaf->pDbPage);
-    insertCell(pPage, iCellIdx, pCell-4, nCell+4, pTmp, n, &rc);
-    dropCell(pLeaf, pLeaf->nCell-1, nCell, &rc);
+    if( pPage->hasPrefix && rc==SQLITE_OK ){
+      /* The cell is encoded against the prefix of the leaf page. Expand
+      ** it and re-encode it against the prefix of the internal node. */
+      u16 szCell;
+      int szLeaf = nCell;
+      rc = expandCell(pLeaf, pCell, &pTmp[4], &szCell);
+      if( rc ) return rc;
+      nCell = compressCell(pPage, pTmp, szCell+4, 
+                           pagePrefix(pPage), pPage->nPrefix, pTmp) - 4;
+      insertCell(pPage, iCellIdx, pTmp, nCell+4, 0, n, &rc);
+      dropCell(pLeaf, pLeaf->nCell-1, szLeaf, &rc);
+    }else{
+      insertCell(pPage, iCellIdx, pCell-4, nCell+4, pTmp, n, &rc);
+      dropCell(pLeaf, pLeaf->nCell-1, nCell, &rc);
+    }
     if( rc ) return rc;
   }
 
@@ -7029,6 +8981,14 @@ static int btreeCreateTable(Btree *p, int *piTable, int createTabFlags){
     ptfFlags = PTF_INTKEY | PTF_LEAFDATA | PTF_LEAF;
   }else{
     ptfFlags = PTF_ZERODATA | PTF_LEAF;
+    if( pBt->prefixKeys ){
+      rc = btreeSetExtended(pBt);
+      if( rc ){
+        releasePage(pRoot);
+        return rc;
+      }
+      ptfFlags |= PTF_PREFIX;
+    }
   }
   zeroPage(pRoot, ptfFlags);
   sqlite3PagerUnref(pRoot->pDbPage);
@@ -7093,6 +9053,226 @@ cleardatabasepage_out:
   return rc;
 }
 
+/*
+** Return the number of overflow pages used by the cell pCell on page
+** pPage.
+*/
+static int cellOverflowPages(MemPage *pPage, unsigned char *pCell){
+  CellInfo info;
+  u32 ovflPageSize = pPage->pBt->usableSize - 4;
+  btreeParseCellPtr(pPage, pCell, &info);
+  if( info.iOverflow==0 ) return 0;
+  return (int)((info.nPayload - info.nLocal + ovflPageSize - 1)/ovflPageSize);
+}
+
+/*
+** Return some of the pages of the detached b-tree rooted at page pgno
+** to the free-list, starting with its rightmost leaf. Pages are freed
+** until the whole b-tree has been freed or *pnBudget pages have been
+** freed, whichever comes first. *pnBudget is decremented by the number of
+** pages freed, including overflow pages. If the root page itself is freed,
+** set *pbDone to true.
+**
+** Freeing the rightmost child of an interior page makes the child of the
+** last cell on that page the new rightmost child, so the b-tree remains
+** well-formed between calls.
+*/
+static int reclaimTree(
+  BtShared *pBt,           /* The BTree that contains the detached b-tree */
+  Pgno pgno,               /* Root page of the b-tree or sub-tree */
+  int iDepth,              /* Depth of pgno below the detached root */
+  int *pnBudget,           /* IN/OUT: Number of pages that may be freed */
+  int *pbDone              /* OUT: Set to true if pgno is freed */
+){
+  MemPage *pPage;
+  int rc;
+  int i;
+
+  *pbDone = 0;
+  if( pgno<2 || pgno>btreePagecount(pBt) || iDepth>=BTCURSOR_MAX_DEPTH ){
+    return SQLITE_CORRUPT_BKPT;
+  }
+  rc = getAndInitPage(pBt, pgno, &pPage);
+  if( rc ) return rc;
+
+  if( pPage->leaf ){
+    for(i=0; rc==SQLITE_OK && i<pPage->nCell; i++){
+      unsigned char *pCell = findCell(pPage, i);
+      *pnBudget -= cellOverflowPages(pPage, pCell);
+      rc = clearCell(pPage, pCell);
+    }
+  }else{
+    /* Free sub-trees from the right until the budget is used up. The
+    ** page itself is freed once its last child has been freed. */
+    int bChild = 0;
+    for(;;){
+      unsigned char *pCell;
+      rc = reclaimTree(pBt, get4byte(&pPage->aData[pPage->hdrOffset+8]),
+                       iDepth+1, pnBudget, &bChild);
+      if( rc || !bChild || pPage->nCell==0 ) break;
+      rc = sqlite3PagerWrite(pPage->pDbPage);
+      if( rc ) break;
+      pCell = findCell(pPage, pPage->nCell-1);
+      memcpy(&pPage->aData[pPage->hdrOffset+8], pCell, 4);
+      *pnBudget -= cellOverflowPages(pPage, pCell);
+      rc = clearCell(pPage, pCell);
+      dropCell(pPage, pPage->nCell-1, cellSizePtr(pPage, pCell), &rc);
+      if( rc || *pnBudget<=0 ){
+        bChild = 0;
+        break;
+      }
+    }
+    if( rc || !bChild ){
+      releasePage(pPage);
+      return rc;
+    }
+  }
+  freePage(pPage, &rc);
+  releasePage(pPage);
+  if( rc==SQLITE_OK ){
+    (*pnBudget)--;
+    *pbDone = 1;
+  }
+  return rc;
+}
+
+/*
+** Return up to nPage pages of detached b-trees to the free-list, and
+** the detached b-tree list pages that become empty. If pnDone is not
+** NULL, set *pnDone to the number of pages freed. Fewer than nPage pages
+** are freed only if the detached b-tree list is then empty.
+*/
+static int reclaimDetached(BtShared *pBt, int nPage, int *pnDone){
+  MemPage *pPage1 = pBt->pPage1;
+  int nBudget = nPage;
+  int rc = SQLITE_OK;
+
+  assert( sqlite3_mutex_held(pBt->mutex) );
+  assert( pBt->inReclaim==0 );
+  pBt->inReclaim = 1;
+  while( rc==SQLITE_OK && nBudget>0 ){
+    Pgno iList = get4byte(&pPage1->aData[68]);
+    MemPage *pList = 0;
+    u32 n;
+    if( iList==0 ) break;
+    if( iList>btreePagecount(pBt) ){
+      rc = SQLITE_CORRUPT_BKPT;
+      break;
+    }
+    rc = btreeGetPage(pBt, iList, &pList, 0);
+    if( rc ) break;
+    n = get4byte(&pList->aData[4]);
+    if( n>pBt->usableSize/4-2 ){
+      rc = SQLITE_CORRUPT_BKPT;
+    }else if( n==0 ){
+      /* Unlink and free the empty list page. */
+      rc = sqlite3PagerWrite(pPage1->pDbPage);
+      if( rc==SQLITE_OK ){
+        memcpy(&pPage1->aData[68], pList->aData, 4);
+        if( get4byte(&pPage1->aData[68])==0 ){
+          /* The list is now empty. Restore the write version. */
+          pPage1->aData[18] = pPage1->aData[19];
+        }
+        freePage(pList, &rc);
+        nBudget--;
+      }
+    }else{
+      int bDone = 0;
+      Pgno iRoot = get4byte(&pList->aData[8+(n-1)*4]);
+      rc = reclaimTree(pBt, iRoot, 0, &nBudget, &bDone);
+      if( rc==SQLITE_OK && bDone ){
+        rc = sqlite3PagerWrite(pList->pDbPage);
+        if( rc==SQLITE_OK ) put4byte(&pList->aData[4], n-1);
+      }
+    }
+    releasePage(pList);
+  }
+  pBt->inReclaim = 0;
+  if( pnDone ) *pnDone = nPage - (nBudget>0 ? nBudget : 0);
+  return rc;
+}
+
+/*
+** Add page iRoot to the detached b-tree list. A new list page is
+** allocated if the first list page is full.
+*/
+static int detachedListAdd(BtShared *pBt, Pgno iRoot){
+  MemPage *pPage1 = pBt->pPage1;
+  MemPage *pList = 0;
+  Pgno iList = get4byte(&pPage1->aData[68]);
+  u32 n = 0;
+  int rc = SQLITE_OK;
+
+  if( iList ){
+    if( iList>btreePagecount(pBt) ) return SQLITE_CORRUPT_BKPT;
+    rc = btreeGetPage(pBt, iList, &pList, 0);
+    if( rc ) return rc;
+    n = get4byte(&pList->aData[4]);
+    if( n>pBt->usableSize/4-2 ){
+      releasePage(pList);
+      return SQLITE_CORRUPT_BKPT;
+    }
+    if( n==pBt->usableSize/4-2 ){
+      releasePage(pList);
+      pList = 0;
+    }
+  }
+  if( pList==0 ){
+    Pgno iNew;
+    rc = allocateBtreePage(pBt, &pList, &iNew, 0, 0);
+    if( rc ) return rc;
+    rc = sqlite3PagerWrite(pPage1->pDbPage);
+    if( rc==SQLITE_OK ){
+      put4byte(pList->aData, iList);
+      put4byte(&pPage1->aData[68], iNew);
+      n = 0;
+      if( iList==0 ){
+        /* Earlier versions of SQLite may read, but not write, a database
+        ** with detached b-trees. */
+        pPage1->aData[18] = BTREE_EXT_VERSION(pPage1->aData[18]);
+      }
+    }
+  }else{
+    rc = sqlite3PagerWrite(pList->pDbPage);
+  }
+  if( rc==SQLITE_OK ){
+    put4byte(&pList->aData[4], n+1);
+    put4byte(&pList->aData[8+n*4], iRoot);
+  }
+  releasePage(pList);
+  return rc;
+}
+
+/*
+** Empty the b-tree with root page iTable by moving the content of its
+** root page to a newly allocated page and adding that page to the
+** detached b-tree list. The root page becomes an empty leaf. The
+** other pages of the b-tree are not visited.
+*/
+static int detachTable(BtShared *pBt, MemPage *pRoot){
+  MemPage *pNew = 0;
+  Pgno pgnoNew;
+  int rc;
+
+  assert( sqlite3_mutex_held(pBt->mutex) );
+  assert( pRoot->pgno>1 && !pRoot->leaf );
+  pBt->inReclaim = 1;
+  rc = sqlite3PagerWrite(pRoot->pDbPage);
+  if( rc==SQLITE_OK ){
+    rc = allocateBtreePage(pBt, &pNew, &pgnoNew, pRoot->pgno, 0);
+  }
+  if( rc==SQLITE_OK ){
+    copyNodeContent(pRoot, pNew, &rc);
+    if( rc==SQLITE_OK ){
+      zeroPage(pRoot, pRoot->aData[0] | PTF_LEAF);
+      rc = detachedListAdd(pBt, pgnoNew);
+    }
+    releasePage(pNew);
+  }
+  pBt->inReclaim = 0;
+  return rc;
+}
+
 /*
 ** Delete all information from a single table in the database.  iTable is
 ** the page number of the root of the table.  After this routine returns,
@@ -7105,6 +9285,12 @@ cleardatabasepage_out:
 ** If pnChange is not NULL, then table iTable must be an intkey table. The
 ** integer value pointed to by pnChange is incremented by the number of
 ** entries in the table.
+**
+** If the lazyClear flag is set and the table has more than one page, the
+** table is detached instead (see detachTable()) and its pages are freed
+** later. In that case *pnChange is not incremented. Counting the entries
+** would mean reading every page of the table, which is the cost that
+** detaching the table avoids.
 */
 int sqlite3BtreeClearTable(Btree *p, int iTable, int *pnChange){
   int rc;
@@ -7118,6 +9304,21 @@ int sqlite3BtreeClearTable(Btree *p, int iTable, int *pnChange){
   invalidateIncrblobCursors(p, 0, 1);
 
   rc = saveAllCursors(pBt, (Pgno)iTable, 0);
+  if( SQLITE_OK==rc && pBt->lazyClear && !pBt->secureDelete && !ISAUTOVACUUM
+   && iTable>1 && (Pgno)iTable<=btreePagecount(pBt)
+  ){
+    MemPage *pRoot;
+    rc = getAndInitPage(pBt, (Pgno)iTable, &pRoot);
+    if( rc==SQLITE_OK ){
+      if( !pRoot->leaf ){
+        rc = detachTable(pBt, pRoot);
+        releasePage(pRoot);
+        sqlite3BtreeLeave(p);
+        return rc;
+      }
+      releasePage(pRoot);
+    }
+  }
   if( SQLITE_OK==rc ){
     rc = clearDatabasePage(pBt, (Pgno)iTable, 0, pnChange);
   }
@@ -7125,6 +9326,222 @@ int sqlite3BtreeClearTable(Btree *p, int iTable, int *pnChange){
   return rc;
 }
 
+/*
+** Return up to nStep pages of detached b-trees to the free-list. Set
+** *pnDone to the number of pages freed. Fewer than nStep pages are freed
+** only if no detached b-trees remain.
+*/
+int sqlite3BtreeReclaim(Btree *p, int nStep, int *pnDone){
+  int rc;
+  BtShared *pBt = p->pBt;
+  sqlite3BtreeEnter(p);
+  assert( pBt->inTransaction==TRANS_WRITE && p->inTrans==TRANS_WRITE );
+  rc = reclaimDetached(pBt, nStep, pnDone);
+  sqlite3BtreeLeave(p);
+  return rc;
+}
+
+/*
+** Return the integer key of cell iCell on intkey page pPage.
+*/
+static i64 cellIntKey(MemPage *pPage, int iCell){
+  CellInfo info;
+  assert( pPage->intKey );
+  btreeParseCell(pPage, iCell, &info);
+  return info.nKey;
+}
+
+/*
+** This is a helper routine for sqlite3BtreeDeleteRange(). Cursor pCur
+** points to the first entry of an intkey table that is greater than or
+** equal to the first key being deleted, and the key of that entry is
+** no greater than iLast. Delete some of the entries between the cursor
+** and iLast, inclusive, and rebalance the tree.
+**
+** The pages on the path from the root to the cursor are searched, starting
+** at the root, for a run of child pages whose sub-trees lie entirely
+** within the range being deleted. A sub-tree lies within the range if all
+** of its keys are no greater than iLast and, since the cursor points to
+** the first entry in the range, if it is to the right of the cursor or
+** the cursor points to its leftmost entry. The first such run found is
+** removed from its parent page and its pages freed by clearDatabasePage().
+** If there is no such run, the entries from the cursor to iLast are
+** removed from the leaf page the cursor points to.
+*/
+static int deleteRangeStep(BtCursor *pCur, i64 iLast, int *pnChange){
+  BtShared *pBt = pCur->pBt;
+  i64 aUpper[BTCURSOR_MAX_DEPTH];  /* Upper bound on keys in apPage[i] */
+  u8 abUpper[BTCURSOR_MAX_DEPTH];  /* True if aUpper[i] is valid */
+  int iDepth;                      /* Depth of page cells are removed from */
+  int iLeft = 0;                   /* First cell or child to remove */
+  int iRight = -1;                 /* Last cell or child to remove */
+  MemPage *pPage = 0;              /* Page cells are removed from */
+  int i;
+  int rc;
+
+  assert( pCur->eState==CURSOR_VALID );
+  aUpper[0] = 0;
+  abUpper[0] = 0;
+  for(iDepth=0; iDepth<pCur->iPage; iDepth++){
+    pPage = pCur->apPage[iDepth];
+    i = pCur->aiIdx[iDepth];
+    if( i<pPage->nCell ){
+      aUpper[iDepth+1] = cellIntKey(pPage, i);
+      abUpper[iDepth+1] = 1;
+    }else{
+      aUpper[iDepth+1] = aUpper[iDepth];
+      abUpper[iDepth+1] = abUpper[iDepth];
+    }
+  }
+
+  for(iDepth=0; iDepth<pCur->iPage; iDepth++){
+    int bLeftmost = 1;
+    pPage = pCur->apPage[iDepth];
+    for(i=iDepth+1; i<=pCur->iPage; i++){
+      if( pCur->aiIdx[i]!=0 ) bLeftmost = 0;
+    }
+    iLeft = pCur->aiIdx[iDepth] + (bLeftmost ? 0 : 1);
+    for(iRight=iLeft-1; iRight+1<pPage->nCell; iRight++){
+      if( cellIntKey(pPage, iRight+1)>iLast ) break;
+    }
+    if( iRight==pPage->nCell-1 && iLeft<=pPage->nCell
+     && (abUpper[iDepth] ? aUpper[iDepth]<=iLast : iLast==LARGEST_INT64)
+    ){
+      /* The right-child of pPage lies within the range too */
+      iRight = pPage->nCell;
+    }
+    if( iRight>=iLeft ) break;
+  }
+
+  if( iDepth==pCur->iPage ){
+    /* Remove entries from the leaf page the cursor points to. */
+    pPage = pCur->apPage[iDepth];
+    iLeft = pCur->aiIdx[iDepth];
+    for(iRight=iLeft; iRight+1<pPage->nCell; iRight++){
+      if( cellIntKey(pPage, iRight+1)>iLast ) break;
+    }
+    rc = sqlite3PagerWrite(pPage->pDbPage);
+    for(i=iLeft; rc==SQLITE_OK && i<=iRight; i++){
+      unsigned char *pCell = findCell(pPage, iLeft);
+      rc = clearCell(pPage, pCell);
+      dropCell(pPage, iLeft, cellSizePtr(pPage, pCell), &rc);
+    }
+    if( rc ) return rc;
+    if( pnChange ) *pnChange += iRight - iLeft + 1;
+    return balance(pCur);
+  }
+
+  /* Remove children iLeft to iRight of interior page pPage. Release the
+  ** cursor's references to the pages below pPage first, as some of them
+  ** are about to be freed.  */
+  while( pCur->iPage>iDepth ){
+    releasePage(pCur->apPage[pCur->iPage--]);
+  }
+  if( iDepth==0 && iLeft==0 && iRight==pPage->nCell ){
+    /* Every entry in the table is being deleted. */
+    return clearDatabasePage(pBt, pPage->pgno, 0, pnChange);
+  }
+  rc = sqlite3PagerWrite(pPage->pDbPage);
+  for(i=iLeft; rc==SQLITE_OK && i<=iRight; i++){
+    Pgno iChild;
+    if( i<pPage->nCell ){
+      iChild = get4byte(findCell(pPage, i));
+    }else{
+      iChild = get4byte(&pPage->aData[pPage->hdrOffset+8]);
+    }
+    rc = clearDatabasePage(pBt, iChild, 1, pnChange);
+  }
+  if( rc ) return rc;
+  if( iRight==pPage->nCell ){
+    /* The right-child was removed. The child of the cell to the left of
+    ** the run becomes the new right-child. */
+    if( iLeft==0 ) return SQLITE_CORRUPT_BKPT;
+    iLeft--;
+    put4byte(&pPage->aData[pPage->hdrOffset+8], 
+             get4byte(findCell(pPage, iLeft)));
+    iRight--;
+  }
+  for(i=iLeft; rc==SQLITE_OK && i<=iRight; i++){
+    dropCell(pPage, iLeft, cellSizePtr(pPage, findCell(pPage, iLeft)), &rc);
+  }
+  if( rc ) return rc;
+
+  if( iDepth>0 ){
+    return balance(pCur);
+  }
+  if( pPage->nCell==0 ){
+    /* The root page has no cells left, only a right-child. Copy the 
+    ** content of the child into the root, as balance_nonroot() does,
+    ** if there is room for it.  */
+    MemPage *pChild;
+    rc = getAndInitPage(pBt, get4byte(&pPage->aData[pPage->hdrOffset+8]),
+                        &pChild);
+    if( rc ) return rc;
+    if( pPage->hdrOffset<=pChild->nFree ){
+      copyNodeContent(pChild, pPage, &rc);
+      freePage(pChild, &rc);
+    }
+    releasePage(pChild);
+  }
+  return rc;
+}
+
+/*
+** Delete all entries with keys between iFirst and iLast, inclusive,
+** from the intkey table that cursor pCur is open on. If pnChange is
+** not NULL, it is incremented by the number of entries deleted. The
+** cursor is left pointing at an arbitrary location.
+**
+** This has the same effect as deleting the entries one at a time with
+** sqlite3BtreeDelete(), but sub-trees that lie entirely within the range
+** are unlinked from their parent and freed in bulk by clearDatabasePage().
+** Only the pages on the paths to the first and last entries of the range
+** are modified one entry at a time, and the tree is rebalanced once for
+** each run of sub-trees removed instead of once for each entry.
+*/
+int sqlite3BtreeDeleteRange(
+  BtCursor *pCur,          /* Write cursor open on an intkey table */
+  i64 iFirst,              /* First key to delete */
+  i64 iLast,               /* Last key to delete */
+  int *pnChange            /* Add number of entries deleted to this */
+){
+  Btree *p = pCur->pBtree;
+  BtShared *pBt = p->pBt;
+  int rc;
+  int res;
+
+  assert( cursorHoldsMutex(pCur) );
+  assert( pBt->inTransaction==TRANS_WRITE );
+  assert( !pBt->readOnly );
+  assert( pCur->wrFlag );
+  assert( pCur->pKeyInfo==0 );
+  assert( hasSharedCacheTableLock(p, pCur->pgnoRoot, 0, 2) );
+  assert( !hasReadConflicts(p, pCur->pgnoRoot) );
+
+  if( iFirst>iLast ) return SQLITE_OK;
+  invalidateIncrblobRange(p, pCur->pgnoRoot, iFirst, iLast);
+  rc = saveAllCursors(pBt, pCur->pgnoRoot, pCur);
+
+  while( rc==SQLITE_OK ){
+    rc = sqlite3BtreeMovetoUnpacked(pCur, 0, iFirst, 0, &res);
+    if( rc==SQLITE_OK && res<0 ){
+      rc = sqlite3BtreeNext(pCur, &res);
+    }
+    if( rc || pCur->eState!=CURSOR_VALID ) break;
+    if( NEVER(!pCur->apPage[0]->intKey) ){
+      rc = SQLITE_CORRUPT_BKPT;
+      break;
+    }
+    getCellInfo(pCur);
+    if( pCur->info.nKey>iLast ) break;
+    rc = deleteRangeStep(pCur, iLast, pnChange);
+    if( rc==SQLITE_OK ){
+      moveToRoot(pCur);
+    }
+  }
+  return rc;
+}
+
 /*
 ** Erase all information in a table and add the root of the table to
 ** the freelist.  Except, the root of the principle table (the one on
@@ -7640,7 +10057,7 @@ static int checkTreePage(
       nMaxKey = info.nKey;
     }
     assert( sz==info.nPayload );
-    if( (sz>info.nLocal) 
+    if( (sz>info.nLocal+info.nShared) 
      && (&pCell[info.iOverflow]<=&pPage->aData[pBt->usableSize])
     ){
       int nPage = (sz - info.nLocal + usableSize - 5)/(usableSize - 4);
@@ -7730,6 +10147,11 @@ static int checkTreePage(
     assert( contentOffset<=usableSize );  /* Enforced by btreeInitPage() */
     memset(hit+contentOffset, 0, usableSize-contentOffset);
     memset(hit, 1, contentOffset);
+    if( pPage->hasPrefix ){
+      /* The page prefix and its size follow the cell content area */
+      int iEnd = contentEnd(pPage);
+      memset(&hit[iEnd], 1, usableSize-iEnd);
+    }
     nCell = get2byte(&data[hdr+3]);
     cellStart = hdr + 12 - 4*pPage->leaf;
     for(i=0; i<nCell; i++){
@@ -7779,6 +10201,38 @@ static int checkTreePage(
 }
 #endif /* SQLITE_OMIT_INTEGRITY_CHECK */
 
+#ifndef SQLITE_OMIT_INTEGRITY_CHECK
+/*
+** Check the pages of the detached b-tree list that starts at page iPage,
+** and the detached b-trees it refers to.
+*/
+static void checkDetached(IntegrityCk *pCheck, int iPage){
+  char *zContext = "Detached b-tree list: ";
+  while( iPage!=0 && pCheck->mxErr ){
+    DbPage *pListPage;
+    unsigned char *pListData;
+    int i, n;
+    if( checkRef(pCheck, iPage, zContext) ) break;
+    if( sqlite3PagerGet(pCheck->pPager, (Pgno)iPage, &pListPage) ){
+      checkAppendMsg(pCheck, zContext, "failed to get page %d", iPage);
+      break;
+    }
+    pListData = (unsigned char *)sqlite3PagerGetData(pListPage);
+    n = get4byte(&pListData[4]);
+    if( n>(int)pCheck->pBt->usableSize/4-2 ){
+      checkAppendMsg(pCheck, zContext,
+         "detached b-tree count too big on page %d", iPage);
+      n = 0;
+    }
+    for(i=0; i<n && pCheck->mxErr; i++){
+      checkTreePage(pCheck, get4byte(&pListData[8+i*4]), zContext, 0, 0);
+    }
+    iPage = get4byte(pListData);
+    sqlite3PagerUnref(pListPage);
+  }
+}
+#endif /* SQLITE_OMIT_INTEGRITY_CHECK */
+
 #ifndef SQLITE_OMIT_INTEGRITY_CHECK
 /*
 ** This routine does a complete check of the given BTree file.  aRoot[] is
@@ -7839,6 +10293,10 @@ char *sqlite3BtreeIntegrityCheck(
   checkList(&sCheck, 1, get4byte(&pBt->pPage1->aData[32]),
             get4byte(&pBt->pPage1->aData[36]), "Main freelist: ");
 
+  /* Check the detached b-trees
+  */
+  checkDetached(&sCheck, get4byte(&pBt->pPage1->aData[68]));
+
   /* Check all the tables.
   */
   for(i=0; (int)i<nRoot && sCheck.mxErr; i++){
@@ -8106,7 +10564,9 @@ void sqlite3BtreeCacheOverflow(BtCursor *pCur){
 /*
 ** Set both the "read version" (single byte at byte offset 18) and 
 ** "write version" (single byte at byte offset 19) fields in the database
-** header to iVersion.
+** header to iVersion. Either field that is currently set to its extended
+** form (see btreeSetExtended()) is set to the extended form of iVersion
+** instead.
 */
 int sqlite3BtreeSetVersion(Btree *pBtree, int iVersion){
   BtShared *pBt = pBtree->pBt;
@@ -8123,13 +10583,17 @@ int sqlite3BtreeSetVersion(Btree *pBtree, int iVersion){
   rc = sqlite3BtreeBeginTrans(pBtree, 0);
   if( rc==SQLITE_OK ){
     u8 *aData = pBt->pPage1->aData;
-    if( aData[18]!=(u8)iVersion || aData[19]!=(u8)iVersion ){
+    u8 iWrite = (u8)iVersion;
+    u8 iRead = (u8)iVersion;
+    if( aData[18]>=BTREE_VERSION_EXT ) iWrite = BTREE_EXT_VERSION(iWrite);
+    if( aData[19]>=BTREE_VERSION_EXT ) iRead = BTREE_EXT_VERSION(iRead);
+    if( aData[18]!=iWrite || aData[19]!=iRead ){
       rc = sqlite3BtreeBeginTrans(pBtree, 2);
       if( rc==SQLITE_OK ){
         rc = sqlite3PagerWrite(pBt->pPage1->pDbPage);
         if( rc==SQLITE_OK ){
-          aData[18] = (u8)iVersion;
-          aData[19] = (u8)iVersion;
+          aData[18] = iWrite;
+          aData[19] = iRead;
         }
       }
     }
@@ -82,6 +82,10 @@ int sqlite3BtreeGetPageSize(Btree*);
 int sqlite3BtreeMaxPageCount(Btree*,int);
 u32 sqlite3BtreeLastPage(Btree*);
 int sqlite3BtreeSecureDelete(Btree*,int);
+int sqlite3BtreePrefixKeys(Btree*,int);
+int sqlite3BtreeFreePageMap(Btree*,int);
+int sqlite3BtreeExtentSize(Btree*,int);
+int sqlite3BtreeLazyClear(Btree*,int);
 int sqlite3BtreeGetReserve(Btree*);
 int sqlite3BtreeSetAutoVacuum(Btree *, int);
 int sqlite3BtreeGetAutoVacuum(Btree *);
@@ -105,6 +109,8 @@ const char *sqlite3BtreeGetJournalname(Btree *);
 int sqlite3BtreeCopyFile(Btree *, Btree *);
 
 int sqlite3BtreeIncrVacuum(Btree *);
+int sqlite3BtreeDefragment(Btree *, int, int *);
+int sqlite3BtreeReclaim(Btree *, int, int *);
 
 /* The flags parameter to sqlite3BtreeCreateTable can be the bitwise OR
 ** of the flags shown below.
@@ -167,6 +173,7 @@ int sqlite3BtreeMovetoUnpacked(
 );
 int sqlite3BtreeCursorHasMoved(BtCursor*, int*);
 int sqlite3BtreeDelete(BtCursor*);
+int sqlite3BtreeDeleteRange(BtCursor*, i64, i64, int*);
 int sqlite3BtreeInsert(BtCursor*, const void *pKey, i64 nKey,
                                   const void *pData, int nData,
                                   int nZero, int bias, int seekResult);
@@ -229,6 +236,8 @@ void sqlite3BtreeCursorList(Btree*);
   void sqlite3BtreeLeaveCursor(BtCursor*);
   void sqlite3BtreeLeaveAll(sqlite3*);
   void sqlite3BtreeMutexArrayEnter(BtreeMutexArray*);
+  void sqlite3BtreeMutexArrayEnterRead(BtreeMutexArray*, int);
+  void sqlite3BtreeMutexArrayDowngrade(BtreeMutexArray*);
   void sqlite3BtreeMutexArrayLeave(BtreeMutexArray*);
   void sqlite3BtreeMutexArrayInsert(BtreeMutexArray*, Btree*);
 #ifndef NDEBUG
@@ -243,6 +252,8 @@ void sqlite3BtreeCursorList(Btree*);
 # define sqlite3BtreeLeaveCursor(X)
 # define sqlite3BtreeLeaveAll(X)
 # define sqlite3BtreeMutexArrayEnter(X)
+# define sqlite3BtreeMutexArrayEnterRead(X,Y)
+# define sqlite3BtreeMutexArrayDowngrade(X)
 # define sqlite3BtreeMutexArrayLeave(X)
 # define sqlite3BtreeMutexArrayInsert(X,Y)
 
@@ -76,12 +76,19 @@
 **     56       4     1=UTF-8 2=UTF16le 3=UTF16be
 **     60       4     User version
 **     64       4     Incremental vacuum mode
-**     68       4     unused
+**     68       4     First page of the detached b-tree list
 **     72       4     unused
 **     76       4     unused
 **
 ** All of the integer values are big-endian (most significant byte first).
 **
+** The read and write versions are 1 for a rollback journal database and
+** 2 for a WAL database. A database that has PTF_PREFIX pages, which
+** earlier versions of SQLite cannot read, has read and write versions 3
+** or 4 instead, so that those versions refuse to open it. While the
+** detached b-tree list is not empty, the write version alone is 3 or 4,
+** so that those versions open the database read-only.
+**
 ** The file change counter is incremented when the database is changed
 ** This counter allows other processes to know when the file has changed
 ** and thus when they need to flush their cache.
@@ -125,7 +132,8 @@
 ** The page headers looks like this:
 **
 **   OFFSET   SIZE     DESCRIPTION
-**      0       1      Flags. 1: intkey, 2: zerodata, 4: leafdata, 8: leaf
+**      0       1      Flags. 1: intkey, 2: zerodata, 4: leafdata, 8: leaf,
+**                     16: prefix
 **      1       2      byte offset to the first freeblock
 **      3       2      number of cells on this page
 **      5       2      first byte of the cell content area
@@ -194,6 +202,26 @@
 **      *     Payload
 **      4     First page of the overflow chain.  Omitted if no overflow
 **
+** Index pages (zerodata pages) may also have the prefix flag set.  All pages
+** of a b-tree have the prefix flag set or none of them do.  The last two
+** usable bytes of such a page hold the size of the page prefix, a string of
+** up to maxLocal bytes that is stored immediately before them, outside of
+** the cell content area.  Each cell on a prefix page has an extra varint
+** following the number of bytes of key: the number of bytes (nShared) of the
+** page prefix that the key shares.  If nShared is zero, the cell is stored
+** as usual.  Otherwise the payload is stored in full on the page, less the
+** nShared bytes that follow the record header:
+**
+**    SIZE    DESCRIPTION
+**      4     Page number of the left child. Omitted if leaf flag is set.
+**     var    Number of bytes of key.
+**     var    nShared. Number of bytes of the page prefix used.
+**      *     Record header (the first varint of which is its size)
+**      *     Remainder of the record, less its first nShared bytes
+**
+** Because each cell is encoded against the page prefix and not against
+** the cells before it, cells may still be located by binary search.
+**
 ** Overflow pages form a linked list.  Each page except the last is completely
 ** filled with data (pagesize - 4 bytes).  The last page can have as little
 ** as 1 byte of data.
@@ -211,6 +239,17 @@
 **      4     Page number of next trunk page
 **      4     Number of leaf pointers on this page
 **      *     zero or more pages numbers of leaves
+**
+** A detached b-tree is a b-tree that is no longer part of the database
+** but whose pages have not yet been returned to the freelist.  The file
+** header points to the first in a linked list of detached b-tree list
+** pages, each of which holds the root page numbers of detached b-trees
+** in the same format as a freelist trunk page:
+**
+**    SIZE    DESCRIPTION
+**      4     Page number of next detached b-tree list page
+**      4     Number of root page numbers on this page
+**      *     zero or more root page numbers
 */
 #include "sqliteInt.h"
 
@@ -227,9 +266,29 @@
 */
 #define MX_CELL(pBt) ((pBt->pageSize-8)/6)
 
+/*
+** The maximum number of extents remembered by a BtShared object. See the
+** BtExtent structure below.
+*/
+#define BTREE_MAX_EXTENT 8
+
+/*
+** The largest extent size, in pages, that may be set using "PRAGMA 
+** extent_size".
+*/
+#define BTREE_MAX_EXTENT_SIZE 4096
+
+/*
+** The number of pages of detached b-trees returned to the free-list when
+** a page is needed and the free-list is empty.
+*/
+#define BTREE_RECLAIM_STEP 32
+
 /* Forward declarations */
 typedef struct MemPage MemPage;
 typedef struct BtLock BtLock;
+typedef struct FreeTrunk FreeTrunk;
+typedef struct BtExtent BtExtent;
 
 /*
 ** This is a magic string that appears at the beginning of every
@@ -255,6 +314,16 @@ typedef struct BtLock BtLock;
 #define PTF_ZERODATA  0x02
 #define PTF_LEAFDATA  0x04
 #define PTF_LEAF      0x08
+#define PTF_PREFIX    0x10
+
+/*
+** The read and write version of a rollback journal database that uses
+** extended b-tree features. The WAL form is one greater.
+** BTREE_EXT_VERSION() returns the extended form of version v.
+*/
+#define BTREE_VERSION_EXT 3
+#define BTREE_EXT_VERSION(v) \
+  ((u8)((v)<BTREE_VERSION_EXT ? (v)+BTREE_VERSION_EXT-1 : (v)))
 
 /*
 ** As each page of the file is loaded into memory, an instance of the following
@@ -277,12 +346,14 @@ struct MemPage {
   u8 hasData;          /* True if this page stores data */
   u8 hdrOffset;        /* 100 for page 1.  0 otherwise */
   u8 childPtrSize;     /* 0 if leaf==1.  4 if leaf==0 */
+  u8 hasPrefix;        /* True if the PTF_PREFIX flag is set */
   u16 maxLocal;        /* Copy of BtShared.maxLocal or BtShared.maxLeaf */
   u16 minLocal;        /* Copy of BtShared.minLocal or BtShared.minLeaf */
   u16 cellOffset;      /* Index in aData of first cell pointer */
   u16 nFree;           /* Number of free bytes on the page */
   u16 nCell;           /* Number of cells on this page, local and ovfl */
   u16 maskPage;        /* Mask for page offset */
+  u16 nPrefix;         /* Size of the page prefix if hasPrefix is true */
   struct _OvflCell {   /* Cells that will not fit on aData[] */
     u8 *pCell;          /* Pointers to the body of the overflow cell */
     u16 idx;            /* Insert this cell before idx-th non-overflow cell */
@@ -345,6 +416,7 @@ struct Btree {
   u8 inTrans;        /* TRANS_NONE, TRANS_READ or TRANS_WRITE */
   u8 sharable;       /* True if we can share pBt with another db */
   u8 locked;         /* True if db currently has pBt locked */
+  u8 shareLock;      /* True if the lock held is a shared (read) lock */
   int wantToLock;    /* Number of nested calls to sqlite3BtreeEnter() */
   int nBackup;       /* Number of backup operations reading this btree */
   Btree *pNext;      /* List of other sharable Btrees from the same db */
@@ -365,6 +437,24 @@ struct Btree {
 #define TRANS_READ  1
 #define TRANS_WRITE 2
 
+/*
+** While both the free-page map and extents are in use (see "PRAGMA
+** extent_size"), the pages that a b-tree grows into are reserved for it
+** in runs of BtShared.nExtentSize pages, so that the pages of each 
+** b-tree stay physically contiguous when several b-trees grow at once.
+**
+** An extent is a range of free pages reserved for the b-tree with root
+** page iRoot. Reserved pages remain on the free-list until they are 
+** used, so an extent is only a hint: pages are checked against the 
+** free-page map before they are taken. Only the BTREE_MAX_EXTENT most
+** recently reserved extents are remembered.
+*/
+struct BtExtent {
+  Pgno iRoot;           /* Root page of the b-tree. 0 for an unused slot */
+  Pgno iNext;           /* Next page of the extent to use */
+  Pgno iEnd;            /* One more than the last page of the extent */
+};
+
 /*
 ** An instance of this object represents a single database file.
 ** 
@@ -382,6 +472,17 @@ struct Btree {
 ** The pSchema field may be set once under BtShared.mutex and
 ** thereafter is unchanged as long as nRef>0.
 **
+** A read-only statement may hold a shared lock on a BtShared instead
+** of BtShared.mutex (see btmutex.c). Any number of connections may hold
+** shared locks at once, but only while no write transaction is open.
+** The holders of shared locks do not modify the fields of this
+** structure, except that calls into the pager and changes to the
+** pCursor list are made while holding the pLatch mutex, and nReader
+** is only accessed while holding pLatch. A thread holding the mutex
+** may open and close read transactions and table locks alongside them
+** (changes to the pLock list are also made under pLatch), but must wait
+** for all shared locks to be released before making any other change.
+**
 ** isPending:
 **
 **   If a BtShared client fails to obtain a write-lock on a database
@@ -408,6 +509,11 @@ struct BtShared {
   u8 readOnly;          /* True if the underlying file is readonly */
   u8 pageSizeFixed;     /* True if the page size can no longer be changed */
   u8 secureDelete;      /* True if secure_delete is enabled */
+  u8 prefixKeys;        /* True if new indexes use PTF_PREFIX pages */
+  u8 freePageMap;       /* True if the free-page map is in use */
+  u8 freeMapOk;         /* True if aFreeTrunk[] describes the free-list */
+  u8 lazyClear;         /* True if cleared b-trees are detached */
+  u8 inReclaim;         /* True while detached b-trees are being modified */
   u8 initiallyEmpty;    /* Database is empty at start of transaction */
   u8 openFlags;         /* Flags to sqlite3BtreeOpen() */
 #ifndef SQLITE_OMIT_AUTOVACUUM
@@ -427,6 +533,8 @@ struct BtShared {
   void *pSchema;        /* Pointer to space allocated by sqlite3BtreeSchema() */
   void (*xFreeSchema)(void*);  /* Destructor for BtShared.pSchema */
   sqlite3_mutex *mutex; /* Non-recursive mutex required to access this struct */
+  sqlite3_mutex *pLatch;  /* Guards the pager and pCursor for shared locks */
+  int nReader;          /* Number of Btrees holding a shared lock */
   Bitvec *pHasContent;  /* Set of pages moved to free-list this transaction */
 #ifndef SQLITE_OMIT_SHARED_CACHE
   int nRef;             /* Number of references to this structure */
@@ -437,6 +545,42 @@ struct BtShared {
   u8 isPending;         /* If waiting for read-locks to clear */
 #endif
   u8 *pTmpSpace;        /* BtShared.pageSize bytes of space for tmp use */
+  FreeTrunk *aFreeTrunk;  /* The free-page map. One entry per trunk page */
+  int nFreeTrunk;         /* Number of entries in aFreeTrunk[] */
+  int nFreeTrunkAlloc;    /* Allocated size of aFreeTrunk[] */
+  u32 nFreeMapPage;       /* Number of free pages described by aFreeTrunk[] */
+  u32 iFreeMapVersion;    /* Pager data version when aFreeTrunk[] was built */
+  u32 nExtentSize;        /* Pages per extent. 0 if extents are not used */
+  Pgno iAllocRoot;        /* Root of b-tree pages are allocated for, or 0 */
+  int iExtent;            /* Slot in aExtent[] to reuse next */
+  BtExtent aExtent[BTREE_MAX_EXTENT];  /* Extents reserved for b-trees */
+};
+
+/*
+** While the free-page map is in use (see "PRAGMA free_page_map"), the
+** free-list is kept in a form that allows a free page close to any
+** given page to be found quickly:
+**
+**   *  The leaves of each trunk page are stored in ascending order.
+**
+**   *  Each trunk page and its leaves hold the free pages in a range
+**      of page numbers, and the ranges of successive trunks on the
+**      list are disjoint and ascending.
+**
+** This is a valid free-list in the usual file format, so a database
+** may be used by versions of SQLite that know nothing of the map. If
+** such a version leaves the free-list unsorted, it is sorted again the
+** next time a page is allocated or freed with the map in use.
+**
+** The BtShared.aFreeTrunk[] array has one entry for each trunk page,
+** in free-list order. No free page held by trunk aFreeTrunk[i] is less
+** than aFreeTrunk[i].iKey, or greater than or equal to 
+** aFreeTrunk[i+1].iKey.
+*/
+struct FreeTrunk {
+  Pgno iTrunk;          /* Page number of the trunk page */
+  Pgno iKey;            /* Lower bound of the range of pages on the trunk */
+  u32 nLeaf;            /* Number of leaves on the trunk page */
 };
 
 /*
@@ -454,6 +598,7 @@ struct CellInfo {
   u16 nLocal;    /* Amount of payload held locally */
   u16 iOverflow; /* Offset to overflow page number.  Zero if no overflow */
   u16 nSize;     /* Size of the cell content on the main b-tree page */
+  u16 nShared;   /* Bytes of the key taken from the page prefix */
 };
 
 /*
@@ -182,6 +182,7 @@ void sqlite3FinishCoding(Parse *pParse){
 
       /* Finally, jump back to the beginning of the executable code. */
       sqlite3VdbeAddOp2(v, OP_Goto, 0, pParse->cookieGoto);
+      sqlite3VdbeChangeP5(v, 1);
     }
   }
 
@@ -261,6 +262,9 @@ void sqlite3NestedParse(Parse *pParse, const char *zFormat, ...){
 ** names is done.)  The search order is TEMP first, then MAIN, then any
 ** auxiliary databases added using the ATTACH command.
 **
+** If lazy schema loading is enabled and the table has not yet been
+** parsed, it is parsed by this routine.
+**
 ** See also sqlite3LocateTable().
 */
 Table *sqlite3FindTable(sqlite3 *db, const char *zName, const char *zDatabase){
@@ -271,8 +275,12 @@ Table *sqlite3FindTable(sqlite3 *db, const char *zName, const char *zDatabase){
   nName = sqlite3Strlen30(zName);
   for(i=OMIT_TEMPDB; i<db->nDb; i++){
     int j = (i<2) ? i^1 : i;   /* Search TEMP before MAIN */
+    Hash *pHash = &db->aDb[j].pSchema->tblHash;
     if( zDatabase!=0 && sqlite3StrICmp(zDatabase, db->aDb[j].zName) ) continue;
-    p = sqlite3HashFind(&db->aDb[j].pSchema->tblHash, zName, nName);
+    p = sqlite3HashFind(pHash, zName, nName);
+    if( p==0 && sqlite3LazyLoadTable(db, j, zName) ){
+      p = sqlite3HashFind(pHash, zName, nName);
+    }
     if( p ) break;
   }
   return p;
@@ -337,6 +345,9 @@ Index *sqlite3FindIndex(sqlite3 *db, const char *zName, const char *zDb){
     assert( pSchema );
     if( zDb && sqlite3StrICmp(zDb, db->aDb[j].zName) ) continue;
     p = sqlite3HashFind(&pSchema->idxHash, zName, nName);
+    if( p==0 && sqlite3LazyLoadObject(db, j, LAZY_INDEX, zName) ){
+      p = sqlite3HashFind(&pSchema->idxHash, zName, nName);
+    }
     if( p ) break;
   }
   return p;
@@ -1851,6 +1862,15 @@ void sqlite3RootPageMoved(Db *pDb, int iFrom, int iTo){
       pIdx->tnum = iTo;
     }
   }
+  pHash = &pDb->pSchema->lazyHash;
+  for(pElem=sqliteHashFirst(pHash); pElem; pElem=sqliteHashNext(pElem)){
+    LazyObj *p;
+    for(p=sqliteHashData(pElem); p; p=p->pNext){
+      if( p->iRoot==iFrom ){
+        p->iRoot = iTo;
+      }
+    }
+  }
 }
 #endif
 
@@ -3308,13 +3328,13 @@ void sqlite3BeginTransaction(Parse *pParse, int type){
   }
   v = sqlite3GetVdbe(pParse);
   if( !v ) return;
-  if( type!=TK_DEFERRED ){
+  if( type!=TK_DEFERRED && type!=TK_CONCURRENT ){
     for(i=0; i<db->nDb; i++){
       sqlite3VdbeAddOp2(v, OP_Transaction, i, (type==TK_EXCLUSIVE)+1);
       sqlite3VdbeUsesBtree(v, i);
     }
   }
-  sqlite3VdbeAddOp2(v, OP_AutoCommit, 0, 0);
+  sqlite3VdbeAddOp3(v, OP_AutoCommit, 0, 0, type==TK_CONCURRENT);
 }
 
 /*
@@ -3576,6 +3596,7 @@ static void reindexDatabases(Parse *pParse, char const *zColl){
 
   for(iDb=0, pDb=db->aDb; iDb<db->nDb; iDb++, pDb++){
     assert( pDb!=0 );
+    sqlite3LazyLoadAll(db, iDb);
     for(k=sqliteHashFirst(&pDb->pSchema->tblHash);  k; k=sqliteHashNext(k)){
       pTab = (Table*)sqliteHashData(k);
       reindexTable(pParse, pTab, zColl);
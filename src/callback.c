@@ -426,6 +426,7 @@ void sqlite3SchemaFree(void *p){
   }
   sqlite3HashClear(&temp1);
   sqlite3HashClear(&pSchema->fkeyHash);
+  sqlite3LazyFree(pSchema);
   pSchema->pSeqTab = 0;
   pSchema->flags &= ~DB_SchemaLoaded;
 }
@@ -448,6 +449,9 @@ Schema *sqlite3SchemaGet(sqlite3 *db, Btree *pBt){
     sqlite3HashInit(&p->idxHash);
     sqlite3HashInit(&p->trigHash);
     sqlite3HashInit(&p->fkeyHash);
+    sqlite3HashInit(&p->lazyHash);
+    sqlite3HashInit(&p->lazyIdxHash);
+    sqlite3HashInit(&p->lazyTrigHash);
     p->enc = SQLITE_UTF8;
   }
   return p;
@@ -0,0 +1,1671 @@
+/*
+** 2011 February 10
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file implements the "compress" VFS. It is a shim that sits in
+** between the pager and a real VFS and stores the content of main
+** database files in compressed form, so that they take less space on
+** disk and in the operating system cache. Journal files, WAL files and
+** temporary files are passed through unchanged. See
+** sqlite3_compress_initialize() for the interface.
+**
+** The content of a database file as seen by the pager is divided into
+** blocks of COMPRESS_BLOCK bytes. Each block is compressed separately
+** and stored wherever there is room for it in the real file, which is
+** laid out as follows:
+**
+**     bytes 0..4095     header slot 0
+**     bytes 4096..8191  header slot 1
+**     bytes 8192..      blocks, map pages and the directory
+**
+** The map has one 8-byte big-endian entry for each block. The upper 48
+** bits are the offset of the stored block and the lower 16 its size. A
+** size of zero means the block has never been written and reads as
+** zeros. A size of COMPRESS_BLOCK means the block did not compress and
+** is stored as is. The map is divided into map pages of COMPRESS_NENTRY
+** entries, each stored in the real file like a block. The directory has
+** one 12-byte entry for each map page: its 8-byte offset followed by a
+** 4-byte checksum of its content. Each header slot contains:
+**
+**     bytes 0..15    "SQLite compress" and a nul terminator
+**     bytes 16..23   generation number
+**     bytes 24..31   size of the database file in bytes
+**     bytes 32..39   offset of the directory
+**     bytes 40..43   number of map pages
+**     bytes 44..47   checksum of the directory
+**     bytes 48..51   block size
+**     bytes 52..55   allocation unit
+**     bytes 56..59   checksum of bytes 0..55
+**
+** The valid slot with the larger generation number is current.
+**
+** Space is allocated in whole allocation units, each aligned to the
+** start of a unit. The allocation unit is the sector size of the device
+** when the file is created, so that a write to free space never shares
+** a sector with data that is in use and cannot damage it if power is
+** lost part way through. The header slots are in separate sectors for
+** the same reason.
+**
+** Nothing that the current header refers to is ever overwritten. A
+** block written by the pager is stored in free space and the map in
+** memory updated. The space used by the previous copy of the block
+** becomes free once the new map has been committed. A commit writes the
+** modified map pages and a new directory to free space, syncs the real
+** file, then writes a header with the next generation number into the
+** other slot and syncs again. A crash therefore leaves the file as of
+** either the old or the new header. After each commit the real file is
+** truncated to the end of the last space in use, so that it shrinks as
+** the database does.
+**
+** A commit happens whenever the pager syncs the database file, and
+** before the lock on it is released or it is closed. So that a database
+** with synchronous=OFF is never left without changes that the pager
+** believes are in the database file, a commit also happens before a
+** journal or WAL file belonging to it is deleted, truncated or has its
+** header overwritten.
+**
+** Other connections see a commit when they next take a SHARED lock. The
+** shim provides no shared-memory methods for compressed files, because
+** a connection reading a database in WAL mode without a lock could see
+** space reused by a checkpoint. WAL mode is therefore only available
+** with locking_mode=EXCLUSIVE. A database file created by another VFS is
+** read and written without compression.
+*/
+#include "sqliteInt.h"
+
+#ifndef SQLITE_OMIT_COMPRESS
+
+/* Size of each block of database content, and of each map page */
+#define COMPRESS_BLOCK 4096
+
+/* Number of map entries on each map page */
+#define COMPRESS_NENTRY (COMPRESS_BLOCK/8)
+
+/* Size of each header slot, and the offset of the first block */
+#define COMPRESS_HDRSIZE 4096
+#define COMPRESS_DATA    (2*COMPRESS_HDRSIZE)
+
+/* Number of bytes of each header slot that are used */
+#define COMPRESS_HDRUSED 60
+
+/* Size of each directory entry */
+#define COMPRESS_DIRENTRY 12
+
+/* Files are compacted only if at least this many bytes are free */
+#define COMPRESS_COMPACT_MIN (8*COMPRESS_BLOCK)
+
+/* The first 16 bytes of each valid header slot */
+#define COMPRESS_MAGIC "SQLite compress"
+
+/* The first 16 bytes of a database file created by another VFS */
+#define COMPRESS_FILE_HEADER "SQLite format 3"
+
+/* Matches shorter than this many bytes are not used */
+#define COMPRESS_MINMATCH 4
+
+/* Number of entries in the compressor hash table (log2) */
+#define COMPRESS_HASH_BITS 12
+
+/*
+** Values for compressFile.eType.
+*/
+#define COMPRESS_PASS     0       /* Pass all methods through */
+#define COMPRESS_DB       1       /* Compressed main database file */
+#define COMPRESS_JOURNAL  2       /* Journal or WAL file of a database */
+
+/************************ Object Definitions ******************************/
+
+typedef struct compressFile compressFile;
+typedef struct CompressMap CompressMap;
+typedef struct CompressExtent CompressExtent;
+
+/*
+** A range of bytes within the real file.
+*/
+struct CompressExtent {
+  i64 iOff;                       /* Offset of first byte */
+  i64 nByte;                      /* Number of bytes */
+};
+
+/*
+** One page of the map.
+**
+** Bit i of aNew[] is set if block i of the page has been written since
+** the last commit. The space used by such a block is not referred to by
+** the current header, so may be reused at once if the block is written
+** again.
+*/
+struct CompressMap {
+  i64 iOff;                       /* Offset of the last copy written, or 0 */
+  u32 cksum;                      /* Checksum of the last copy written */
+  int bDirty;                     /* True if changed since it was written */
+  u8 aNew[COMPRESS_NENTRY/8];     /* Blocks written since the last commit */
+  u8 aEntry[COMPRESS_BLOCK];      /* Map entries */
+};
+
+/*
+** An open file. If eType is not COMPRESS_DB, most methods pass straight
+** through to the real file.
+*/
+struct compressFile {
+  sqlite3_file base;              /* Base class - must be first */
+  sqlite3_file *pReal;            /* The real underlying file */
+  const char *zName;              /* Name passed to xOpen() */
+  int eType;                      /* COMPRESS_PASS, COMPRESS_DB, ... */
+  int nDbName;                    /* Length of database name for journals */
+  compressFile *pNext;            /* Next compressed file in gCompress.pList */
+
+  /* The remaining fields are used by compressed database files only. */
+  int eLock;                      /* Lock held on the real file */
+  int szUnit;                     /* Allocation unit */
+  int bLoaded;                    /* True once the map has been read */
+  int bDirty;                     /* True if there are uncommitted changes */
+  i64 iGen;                       /* Generation of the current header */
+  i64 iSize;                      /* Size of the database file */
+  i64 iDirOff;                    /* Offset of the last directory written */
+  int nDirMap;                    /* Map pages in the last directory written */
+  int nMap;                       /* Number of entries in apMap[] */
+  CompressMap **apMap;            /* The map */
+
+  /* Free space. All space before iEnd that is not in use by the current
+  ** header or the uncommitted changes is either in aFree[] or, if it
+  ** becomes free when the changes are committed, in aPend[]. */
+  int bFreeValid;                 /* True once aFree[] has been built */
+  i64 iEnd;                       /* End of the last space in use */
+  i64 iPhys;                      /* Size of the real file */
+  int nFree, nFreeAlloc;          /* Size of aFree[] and allocated size */
+  CompressExtent *aFree;          /* Free space, in order of offset */
+  int nPend, nPendAlloc;          /* Size of aPend[] and allocated size */
+  CompressExtent *aPend;          /* Space to free at the next commit */
+
+  /* Buffers of COMPRESS_BLOCK bytes each. aBuf[0] holds the content of
+  ** block iCache, or garbage if iCache is negative. aBuf[1] holds the
+  ** stored form of a block as it is read or written. Writes of part of
+  ** a block are made to the cached copy, which is stored when another
+  ** block is cached or the changes are committed, so that the pages of
+  ** a block written one after another are compressed and stored once. */
+  u8 *aBuf;                       /* Two buffers */
+  i64 iCache;                     /* Block cached in the first buffer */
+  int bCacheDirty;                /* True if the cached block must be stored */
+};
+
+/************************* Global Variables **********************************/
+/*
+** All global variables used by this file are contained within the following
+** gCompress structure.
+*/
+static struct {
+  /* The pOrigVfs is the real, original underlying VFS implementation.
+  ** Most operations pass-through to the real VFS.  This value is read-only
+  ** during operation.  It is only modified at start-time and thus does not
+  ** require a mutex.
+  */
+  sqlite3_vfs *pOrigVfs;
+
+  /* The sThisVfs is the VFS structure used by this shim.  It is initialized
+  ** at start-time and thus does not require a mutex
+  */
+  sqlite3_vfs sThisVfs;
+
+  /* The sIoMethods defines the methods used by sqlite3_file objects
+  ** associated with this shim. Compressed database files use the version
+  ** 1 methods. Other files use the version 1 or 2 methods depending on
+  ** the version of the real file.
+  */
+  sqlite3_io_methods sIoMethodsV1;
+  sqlite3_io_methods sIoMethodsV2;
+
+  /* True when this shim has been initialized.
+  */
+  int isInitialized;
+
+  /* List of open compressed database files, and the mutex protecting it.
+  ** Changes may be committed while the mutex is held.
+  */
+  sqlite3_mutex *pMutex;
+  compressFile *pList;
+
+  /* Mutex protecting the statistics below.
+  */
+  sqlite3_mutex *pStatMutex;
+
+  /* Number of bytes of blocks written to database files, and the number
+  ** of bytes used to store them.
+  */
+  i64 nIn;
+  i64 nOut;
+} gCompress;
+
+/************************* Utility Routines *********************************/
+
+/*
+** Read and write big-endian integers.
+*/
+static int compressGet16(const u8 *a){
+  return (a[0]<<8) | a[1];
+}
+static void compressPut16(u8 *a, int v){
+  a[0] = (u8)(v>>8);
+  a[1] = (u8)v;
+}
+static u32 compressGet32(const u8 *a){
+  return ((u32)a[0]<<24) | ((u32)a[1]<<16) | ((u32)a[2]<<8) | a[3];
+}
+static void compressPut32(u8 *a, u32 v){
+  a[0] = (u8)(v>>24);
+  a[1] = (u8)(v>>16);
+  a[2] = (u8)(v>>8);
+  a[3] = (u8)v;
+}
+static i64 compressGet48(const u8 *a){
+  return ((i64)compressGet16(a)<<32) | compressGet32(&a[2]);
+}
+static void compressPut48(u8 *a, i64 v){
+  compressPut16(a, (int)(v>>32));
+  compressPut32(&a[2], (u32)v);
+}
+static i64 compressGet64(const u8 *a){
+  return ((i64)compressGet32(a)<<32) | compressGet32(&a[4]);
+}
+static void compressPut64(u8 *a, i64 v){
+  compressPut32(a, (u32)(v>>32));
+  compressPut32(&a[4], (u32)v);
+}
+
+/*
+** Return a checksum of the n bytes at a[].
+*/
+static u32 compressChecksum(const u8 *a, int n){
+  u32 h = 2166136261u;
+  int i;
+  for(i=0; i<n; i++){
+    h = (h ^ a[i]) * 16777619u;
+  }
+  return h;
+}
+
+/*
+** Append length value n (the part of a literal or match length that did
+** not fit in the token) to the output. Return a pointer to the byte
+** following the encoded value, or NULL if there is no room.
+*/
+static u8 *compressPutLength(u8 *pOut, u8 *pEnd, int n){
+  while( n>=255 ){
+    if( pOut>=pEnd ) return 0;
+    *(pOut++) = 255;
+    n -= 255;
+  }
+  if( pOut>=pEnd ) return 0;
+  *(pOut++) = (u8)n;
+  return pOut;
+}
+
+/*
+** Append a sequence to the output: nLit literal bytes copied from aLit,
+** followed by a match of nMatch bytes at distance iDist. If nMatch is
+** zero, this is the final sequence and has no match part. Return a
+** pointer to the byte following the sequence, or NULL if there is no
+** room.
+*/
+static u8 *compressPutSequence(
+  u8 *pOut, u8 *pEnd,             /* Output buffer */
+  const u8 *aLit, int nLit,       /* Literal bytes */
+  int iDist, int nMatch           /* Match, or nMatch==0 for none */
+){
+  u8 *pToken = pOut++;
+  int mlen = nMatch ? nMatch-COMPRESS_MINMATCH : 0;
+  if( pToken>=pEnd ) return 0;
+  *pToken = (u8)(((nLit<15 ? nLit : 15)<<4) | (mlen<15 ? mlen : 15));
+  if( nLit>=15 ){
+    pOut = compressPutLength(pOut, pEnd, nLit-15);
+    if( pOut==0 ) return 0;
+  }
+  if( pEnd-pOut<nLit ) return 0;
+  memcpy(pOut, aLit, nLit);
+  pOut += nLit;
+  if( nMatch ){
+    if( pEnd-pOut<2 ) return 0;
+    pOut[0] = (u8)iDist;
+    pOut[1] = (u8)(iDist>>8);
+    pOut += 2;
+    if( mlen>=15 ){
+      pOut = compressPutLength(pOut, pEnd, mlen-15);
+    }
+  }
+  return pOut;
+}
+
+/*
+** Compress the nIn bytes of aIn[] into aOut[], which is nOut bytes in
+** size. Return the number of bytes of compressed data, or 0 if the
+** compressed data does not fit in aOut[]. nIn may be no larger than
+** 65536.
+**
+** The compression algorithm is a simple LZ77 variant in the style of
+** LZ4. It is fast, needs no external library and uses no memory beyond
+** a small hash table on the stack.
+*/
+static int compressBlock(const u8 *aIn, int nIn, u8 *aOut, int nOut){
+  u16 aHash[1<<COMPRESS_HASH_BITS];   /* Most recent offset for each hash */
+  u8 *pOut = aOut;
+  u8 *pEnd = &aOut[nOut];
+  int iLit = 0;                       /* Start of pending literals */
+  int i = 0;
+
+  assert( nIn<=65536 );
+  memset(aHash, 0, sizeof(aHash));
+  while( i+COMPRESS_MINMATCH<=nIn ){
+    u32 v = compressGet32(&aIn[i]);
+    int h = (int)((v*2654435761u) >> (32-COMPRESS_HASH_BITS));
+    int iRef = aHash[h];
+    aHash[h] = (u16)i;
+    if( iRef<i && i-iRef<=0xffff && compressGet32(&aIn[iRef])==v ){
+      int nMatch = COMPRESS_MINMATCH;
+      while( i+nMatch<nIn && aIn[iRef+nMatch]==aIn[i+nMatch] ) nMatch++;
+      pOut = compressPutSequence(pOut, pEnd, &aIn[iLit], i-iLit, i-iRef, nMatch);
+      if( pOut==0 ) return 0;
+      i += nMatch;
+      iLit = i;
+    }else{
+      i++;
+    }
+  }
+  pOut = compressPutSequence(pOut, pEnd, &aIn[iLit], nIn-iLit, 0, 0);
+  if( pOut==0 ) return 0;
+  return (int)(pOut - aOut);
+}
+
+/*
+** Uncompress the nIn bytes of compressed data in aIn[] into aOut[],
+** which is nOut bytes in size. Return the number of bytes written to
+** aOut[], or -1 if the compressed data is malformed.
+*/
+static int uncompressBlock(const u8 *aIn, int nIn, u8 *aOut, int nOut){
+  const u8 *pIn = aIn;
+  const u8 *pInEnd = &aIn[nIn];
+  u8 *pOut = aOut;
+  u8 *pOutEnd = &aOut[nOut];
+
+  while( pIn<pInEnd ){
+    int nLit = *pIn>>4;
+    int nMatch = *pIn & 0x0f;
+    int iDist;
+    pIn++;
+    if( nLit==15 ){
+      int c;
+      do{
+        if( pIn>=pInEnd ) return -1;
+        c = *(pIn++);
+        nLit += c;
+      }while( c==255 );
+    }
+    if( pInEnd-pIn<nLit || pOutEnd-pOut<nLit ) return -1;
+    memcpy(pOut, pIn, nLit);
+    pIn += nLit;
+    pOut += nLit;
+    if( pIn==pInEnd ) break;
+
+    if( pInEnd-pIn<2 ) return -1;
+    iDist = pIn[0] | (pIn[1]<<8);
+    pIn += 2;
+    if( nMatch==15 ){
+      int c;
+      do{
+        if( pIn>=pInEnd ) return -1;
+        c = *(pIn++);
+        nMatch += c;
+      }while( c==255 );
+    }
+    nMatch += COMPRESS_MINMATCH;
+    if( iDist==0 || iDist>pOut-aOut || pOutEnd-pOut<nMatch ) return -1;
+    while( nMatch-- ){
+      *pOut = pOut[-iDist];
+      pOut++;
+    }
+  }
+  return (int)(pOut - aOut);
+}
+
+/************************* Free Space Management *****************************/
+
+/*
+** Round nByte up to a whole number of allocation units.
+*/
+static i64 compressRound(compressFile *p, i64 nByte){
+  return (nByte + p->szUnit - 1) & ~(i64)(p->szUnit - 1);
+}
+
+/*
+** Make sure there is room for at least one more entry in the extent
+** array *paExtent, which has *pnAlloc entries allocated, nUsed of which
+** are in use. Return SQLITE_OK or SQLITE_NOMEM.
+*/
+static int compressExtentGrow(
+  CompressExtent **paExtent,
+  int *pnAlloc,
+  int nUsed
+){
+  if( nUsed>=*pnAlloc ){
+    int nNew = *pnAlloc ? *pnAlloc*2 : 64;
+    CompressExtent *aNew;
+    aNew = sqlite3_realloc(*paExtent, nNew*sizeof(CompressExtent));
+    if( aNew==0 ) return SQLITE_NOMEM;
+    *paExtent = aNew;
+    *pnAlloc = nNew;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Sort the n extents in a[] in order of offset. aTmp[] is scratch space
+** of the same size.
+*/
+static void compressExtentSort(CompressExtent *a, CompressExtent *aTmp, int n){
+  int i, j, k;
+  int m = n/2;
+  if( n<2 ) return;
+  compressExtentSort(a, aTmp, m);
+  compressExtentSort(&a[m], aTmp, n-m);
+  i = 0;
+  j = m;
+  k = 0;
+  while( i<m && j<n ){
+    if( a[j].iOff<a[i].iOff ){
+      aTmp[k++] = a[j++];
+    }else{
+      aTmp[k++] = a[i++];
+    }
+  }
+  while( i<m ) aTmp[k++] = a[i++];
+  while( j<n ) aTmp[k++] = a[j++];
+  memcpy(a, aTmp, n*sizeof(CompressExtent));
+}
+
+/*
+** Add the nByte bytes at offset iOff to the free space. If that leaves
+** free space at the end of the space in use, move the end back.
+*/
+static int compressFree(compressFile *p, i64 iOff, i64 nByte){
+  CompressExtent *a = p->aFree;
+  int lo = 0;
+  int hi = p->nFree;
+
+  assert( iOff>=COMPRESS_DATA && iOff+nByte<=p->iEnd );
+  while( lo<hi ){
+    int mid = (lo+hi)/2;
+    if( a[mid].iOff<iOff ){
+      lo = mid+1;
+    }else{
+      hi = mid;
+    }
+  }
+  if( lo>0 && a[lo-1].iOff+a[lo-1].nByte==iOff ){
+    lo--;
+    a[lo].nByte += nByte;
+    if( lo+1<p->nFree && iOff+nByte==a[lo+1].iOff ){
+      a[lo].nByte += a[lo+1].nByte;
+      p->nFree--;
+      memmove(&a[lo+1], &a[lo+2], (p->nFree-lo-1)*sizeof(CompressExtent));
+    }
+  }else if( lo<p->nFree && iOff+nByte==a[lo].iOff ){
+    a[lo].iOff = iOff;
+    a[lo].nByte += nByte;
+  }else{
+    int rc = compressExtentGrow(&p->aFree, &p->nFreeAlloc, p->nFree);
+    if( rc!=SQLITE_OK ) return rc;
+    a = p->aFree;
+    memmove(&a[lo+1], &a[lo], (p->nFree-lo)*sizeof(CompressExtent));
+    a[lo].iOff = iOff;
+    a[lo].nByte = nByte;
+    p->nFree++;
+  }
+  if( lo==p->nFree-1 && a[lo].iOff+a[lo].nByte==p->iEnd ){
+    p->iEnd = a[lo].iOff;
+    p->nFree--;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Arrange for the nByte bytes at offset iOff, which are in use by the
+** current header, to become free at the next commit.
+*/
+static int compressFreeLater(compressFile *p, i64 iOff, i64 nByte){
+  int rc = compressExtentGrow(&p->aPend, &p->nPendAlloc, p->nPend);
+  if( rc==SQLITE_OK ){
+    p->aPend[p->nPend].iOff = iOff;
+    p->aPend[p->nPend].nByte = nByte;
+    p->nPend++;
+  }
+  return rc;
+}
+
+/*
+** Allocate nByte bytes of space and return its offset. The first free
+** extent large enough is used, so that the file tends to be filled from
+** the start. If there is none, the space is taken from the end.
+*/
+static i64 compressAlloc(compressFile *p, i64 nByte){
+  i64 iOff;
+  int i;
+  nByte = compressRound(p, nByte);
+  for(i=0; i<p->nFree; i++){
+    CompressExtent *pExt = &p->aFree[i];
+    if( pExt->nByte>=nByte ){
+      iOff = pExt->iOff;
+      pExt->iOff += nByte;
+      pExt->nByte -= nByte;
+      if( pExt->nByte==0 ){
+        p->nFree--;
+        memmove(pExt, &pExt[1], (p->nFree-i)*sizeof(CompressExtent));
+      }
+      return iOff;
+    }
+  }
+  iOff = p->iEnd;
+  p->iEnd += nByte;
+  return iOff;
+}
+
+/*
+** Build the list of free space, if it has not been built since the map
+** was last read, by finding the space in use by the current header and
+** treating the rest as free.
+*/
+static int compressFreeBuild(compressFile *p){
+  CompressExtent *aUsed;
+  int nUsed = 0;
+  int nAlloc;
+  i64 iEnd = COMPRESS_DATA;
+  int rc = SQLITE_OK;
+  int i, j;
+
+  if( p->bFreeValid ) return SQLITE_OK;
+  assert( p->bLoaded && p->bDirty==0 && p->nPend==0 );
+
+  nAlloc = p->nMap*(COMPRESS_NENTRY+1) + 1;
+  aUsed = (CompressExtent*)sqlite3Malloc(nAlloc*2*sizeof(CompressExtent));
+  if( aUsed==0 ) return SQLITE_NOMEM;
+  for(i=0; i<p->nMap; i++){
+    CompressMap *pMap = p->apMap[i];
+    for(j=0; j<COMPRESS_NENTRY; j++){
+      const u8 *aEntry = &pMap->aEntry[j*8];
+      int nStored = compressGet16(&aEntry[6]);
+      if( nStored ){
+        aUsed[nUsed].iOff = compressGet48(aEntry);
+        aUsed[nUsed].nByte = compressRound(p, nStored);
+        nUsed++;
+      }
+    }
+    aUsed[nUsed].iOff = pMap->iOff;
+    aUsed[nUsed].nByte = COMPRESS_BLOCK;
+    nUsed++;
+  }
+  if( p->nDirMap ){
+    aUsed[nUsed].iOff = p->iDirOff;
+    aUsed[nUsed].nByte = compressRound(p, p->nDirMap*COMPRESS_DIRENTRY);
+    nUsed++;
+  }
+  compressExtentSort(aUsed, &aUsed[nAlloc], nUsed);
+
+  p->nFree = 0;
+  for(i=0; rc==SQLITE_OK && i<nUsed; i++){
+    if( aUsed[i].iOff<iEnd || (aUsed[i].iOff & (p->szUnit-1))!=0 ){
+      rc = SQLITE_CORRUPT_BKPT;
+    }else if( aUsed[i].iOff>iEnd ){
+      rc = compressExtentGrow(&p->aFree, &p->nFreeAlloc, p->nFree);
+      if( rc==SQLITE_OK ){
+        p->aFree[p->nFree].iOff = iEnd;
+        p->aFree[p->nFree].nByte = aUsed[i].iOff - iEnd;
+        p->nFree++;
+      }
+    }
+    iEnd = aUsed[i].iOff + aUsed[i].nByte;
+  }
+  sqlite3_free(aUsed);
+  if( rc==SQLITE_OK ){
+    p->iEnd = iEnd;
+    p->bFreeValid = 1;
+  }
+  return rc;
+}
+
+/************************** The Map ******************************************/
+
+/*
+** Free the map pages from iFirst onwards.
+*/
+static void compressMapTruncate(compressFile *p, int iFirst){
+  int i;
+  for(i=iFirst; i<p->nMap; i++){
+    sqlite3_free(p->apMap[i]);
+  }
+  if( iFirst<p->nMap ) p->nMap = iFirst;
+}
+
+/*
+** Make sure the map has at least nMap pages. Return SQLITE_OK or
+** SQLITE_NOMEM.
+*/
+static int compressMapGrow(compressFile *p, int nMap){
+  if( nMap>p->nMap ){
+    CompressMap **apNew;
+    apNew = sqlite3_realloc(p->apMap, nMap*sizeof(CompressMap*));
+    if( apNew==0 ) return SQLITE_NOMEM;
+    p->apMap = apNew;
+    while( p->nMap<nMap ){
+      CompressMap *pMap = (CompressMap*)sqlite3MallocZero(sizeof(CompressMap));
+      if( pMap==0 ) return SQLITE_NOMEM;
+      pMap->bDirty = 1;
+      p->apMap[p->nMap++] = pMap;
+    }
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Read from or write to the real file.
+*/
+static int compressRealRead(compressFile *p, void *aBuf, int nByte, i64 iOff){
+  int rc = p->pReal->pMethods->xRead(p->pReal, aBuf, nByte, iOff);
+  if( rc==SQLITE_IOERR_SHORT_READ ) rc = SQLITE_CORRUPT_BKPT;
+  return rc;
+}
+static int compressRealWrite(
+  compressFile *p,
+  const void *aBuf,
+  int nByte,
+  i64 iOff
+){
+  int rc = p->pReal->pMethods->xWrite(p->pReal, aBuf, nByte, iOff);
+  if( rc==SQLITE_OK && iOff+nByte>p->iPhys ) p->iPhys = iOff+nByte;
+  return rc;
+}
+
+/*
+** Read the current header and bring the map in memory up to date with
+** it. Map pages that have not changed since they were last read are
+** not read again.
+*/
+static int compressLoad(compressFile *p){
+  u8 aHdr[2][COMPRESS_HDRUSED];
+  const u8 *aCur = 0;
+  i64 iGen = 0;
+  i64 iSize = 0;
+  i64 iDirOff = 0;
+  int nDirMap = 0;
+  int szUnit;
+  u8 *aDir = 0;
+  int rc;
+  int i;
+
+  /* Changes that could not be committed before the lock was released
+  ** are abandoned. The map pages they touched are read again. */
+  if( p->bDirty ){
+    p->bDirty = 0;
+    p->bLoaded = 0;
+    p->nPend = 0;
+    p->bCacheDirty = 0;
+  }
+
+  for(i=0; i<2; i++){
+    const u8 *a = aHdr[i];
+    rc = p->pReal->pMethods->xRead(p->pReal, aHdr[i], COMPRESS_HDRUSED,
+                                   i*COMPRESS_HDRSIZE);
+    if( rc!=SQLITE_OK && rc!=SQLITE_IOERR_SHORT_READ ) return rc;
+    rc = SQLITE_OK;
+    if( memcmp(a, COMPRESS_MAGIC, 16)==0
+     && compressGet32(&a[56])==compressChecksum(a, 56)
+     && (aCur==0 || compressGet64(&a[16])>iGen)
+    ){
+      aCur = a;
+      iGen = compressGet64(&a[16]);
+    }
+  }
+  if( p->bLoaded && iGen==p->iGen ) return SQLITE_OK;
+
+  p->bLoaded = 0;
+  if( aCur ){
+    iSize = compressGet64(&aCur[24]);
+    iDirOff = compressGet64(&aCur[32]);
+    nDirMap = (int)compressGet32(&aCur[40]);
+    szUnit = (int)compressGet32(&aCur[52]);
+    if( compressGet32(&aCur[48])!=COMPRESS_BLOCK
+     || szUnit<512 || szUnit>COMPRESS_BLOCK || (szUnit&(szUnit-1))!=0
+     || iSize<0 || nDirMap<0 || nDirMap>0x7fffffff/COMPRESS_DIRENTRY
+     || nDirMap>(iSize+(i64)COMPRESS_BLOCK*COMPRESS_NENTRY-1)
+                  / ((i64)COMPRESS_BLOCK*COMPRESS_NENTRY)
+    ){
+      return SQLITE_CORRUPT_BKPT;
+    }
+  }else{
+    /* A new file. Devices with sectors larger than a block are treated
+    ** as if they had sectors of one block. */
+    int szSector = p->pReal->pMethods->xSectorSize(p->pReal);
+    szUnit = 512;
+    while( szUnit<szSector && szUnit<COMPRESS_BLOCK ) szUnit *= 2;
+  }
+
+  if( nDirMap>0 ){
+    aDir = (u8*)sqlite3Malloc(nDirMap*COMPRESS_DIRENTRY);
+    if( aDir==0 ) return SQLITE_NOMEM;
+    rc = compressRealRead(p, aDir, nDirMap*COMPRESS_DIRENTRY, iDirOff);
+    if( rc==SQLITE_OK
+     && compressGet32(&aCur[44])!=compressChecksum(aDir,
+                                               nDirMap*COMPRESS_DIRENTRY)
+    ){
+      rc = SQLITE_CORRUPT_BKPT;
+    }
+  }
+  compressMapTruncate(p, nDirMap);
+  if( rc==SQLITE_OK ) rc = compressMapGrow(p, nDirMap);
+  for(i=0; rc==SQLITE_OK && i<nDirMap; i++){
+    CompressMap *pMap = p->apMap[i];
+    i64 iOff = compressGet64(&aDir[i*COMPRESS_DIRENTRY]);
+    u32 cksum = compressGet32(&aDir[i*COMPRESS_DIRENTRY+8]);
+    if( pMap->bDirty || pMap->iOff!=iOff || pMap->cksum!=cksum ){
+      pMap->iOff = 0;
+      rc = compressRealRead(p, pMap->aEntry, COMPRESS_BLOCK, iOff);
+      if( rc==SQLITE_OK ){
+        if( compressChecksum(pMap->aEntry, COMPRESS_BLOCK)!=cksum ){
+          rc = SQLITE_CORRUPT_BKPT;
+        }else{
+          pMap->iOff = iOff;
+          pMap->cksum = cksum;
+          pMap->bDirty = 0;
+        }
+      }
+    }
+    memset(pMap->aNew, 0, sizeof(pMap->aNew));
+  }
+  sqlite3_free(aDir);
+
+  if( rc==SQLITE_OK ){
+    rc = p->pReal->pMethods->xFileSize(p->pReal, &p->iPhys);
+  }
+  if( rc==SQLITE_OK ){
+    p->bLoaded = 1;
+    p->iGen = iGen;
+    p->iSize = iSize;
+    p->iDirOff = iDirOff;
+    p->nDirMap = nDirMap;
+    p->szUnit = szUnit;
+    p->bFreeValid = 0;
+    p->nFree = 0;
+    p->nPend = 0;
+    p->iCache = -1;
+  }
+  return rc;
+}
+
+/*
+** Make sure the map has been read and the buffers allocated.
+*/
+static int compressPrepare(compressFile *p){
+  if( p->aBuf==0 ){
+    p->aBuf = (u8*)sqlite3Malloc(COMPRESS_BLOCK*2);
+    if( p->aBuf==0 ) return SQLITE_NOMEM;
+    p->iCache = -1;
+  }
+  if( !p->bLoaded ){
+    return compressLoad(p);
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Arrange for the space used by entry iEntry of map page pMap to be
+** freed, and clear the entry.
+*/
+static int compressRelease(compressFile *p, CompressMap *pMap, int iEntry){
+  u8 *aEntry = &pMap->aEntry[iEntry*8];
+  int nStored = compressGet16(&aEntry[6]);
+  int rc = SQLITE_OK;
+  if( nStored ){
+    i64 iOff = compressGet48(aEntry);
+    if( pMap->aNew[iEntry/8] & (1<<(iEntry%8)) ){
+      rc = compressFree(p, iOff, compressRound(p, nStored));
+    }else{
+      rc = compressFreeLater(p, iOff, compressRound(p, nStored));
+    }
+    memset(aEntry, 0, 8);
+    pMap->bDirty = 1;
+  }
+  return rc;
+}
+
+/*
+** Read block iBlk into aOut[], which is COMPRESS_BLOCK bytes in size
+** and is not the second buffer at p->aBuf.
+*/
+static int compressFetch(compressFile *p, i64 iBlk, u8 *aOut){
+  int iMap = (int)(iBlk/COMPRESS_NENTRY);
+  const u8 *aEntry;
+  int nStored;
+  i64 iOff;
+  int rc;
+
+  if( iMap>=p->nMap ){
+    memset(aOut, 0, COMPRESS_BLOCK);
+    return SQLITE_OK;
+  }
+  aEntry = &p->apMap[iMap]->aEntry[(iBlk%COMPRESS_NENTRY)*8];
+  nStored = compressGet16(&aEntry[6]);
+  iOff = compressGet48(aEntry);
+  if( nStored==0 ){
+    memset(aOut, 0, COMPRESS_BLOCK);
+    rc = SQLITE_OK;
+  }else if( nStored==COMPRESS_BLOCK ){
+    rc = compressRealRead(p, aOut, COMPRESS_BLOCK, iOff);
+  }else if( nStored>COMPRESS_BLOCK ){
+    rc = SQLITE_CORRUPT_BKPT;
+  }else{
+    u8 *aTmp = &p->aBuf[COMPRESS_BLOCK];
+    rc = compressRealRead(p, aTmp, nStored, iOff);
+    if( rc==SQLITE_OK
+     && uncompressBlock(aTmp, nStored, aOut, COMPRESS_BLOCK)!=COMPRESS_BLOCK
+    ){
+      rc = SQLITE_CORRUPT_BKPT;
+    }
+  }
+  return rc;
+}
+
+/*
+** Store aData[], which is COMPRESS_BLOCK bytes in size, as block iBlk.
+*/
+static int compressStore(compressFile *p, i64 iBlk, const u8 *aData){
+  int iMap = (int)(iBlk/COMPRESS_NENTRY);
+  int iEntry = (int)(iBlk%COMPRESS_NENTRY);
+  u8 *aOut = &p->aBuf[COMPRESS_BLOCK];
+  CompressMap *pMap;
+  int nStored;
+  i64 iOff;
+  int rc;
+
+  rc = compressMapGrow(p, iMap+1);
+  if( rc!=SQLITE_OK ) return rc;
+  pMap = p->apMap[iMap];
+  rc = compressRelease(p, pMap, iEntry);
+  if( rc!=SQLITE_OK ) return rc;
+
+  nStored = compressBlock(aData, COMPRESS_BLOCK, aOut, COMPRESS_BLOCK-1);
+  if( nStored==0 ){
+    aOut = (u8*)aData;
+    nStored = COMPRESS_BLOCK;
+  }
+  iOff = compressAlloc(p, nStored);
+  rc = compressRealWrite(p, aOut, nStored, iOff);
+  if( rc!=SQLITE_OK ){
+    compressFree(p, iOff, compressRound(p, nStored));
+    return rc;
+  }
+  compressPut48(&pMap->aEntry[iEntry*8], iOff);
+  compressPut16(&pMap->aEntry[iEntry*8+6], nStored);
+  pMap->aNew[iEntry/8] |= (1<<(iEntry%8));
+  pMap->bDirty = 1;
+  p->bDirty = 1;
+  if( p->iCache==iBlk && aData!=p->aBuf ) p->iCache = -1;
+
+  sqlite3_mutex_enter(gCompress.pStatMutex);
+  gCompress.nIn += COMPRESS_BLOCK;
+  gCompress.nOut += nStored;
+  sqlite3_mutex_leave(gCompress.pStatMutex);
+  return SQLITE_OK;
+}
+
+/*
+** Store the cached block if it has been written to.
+*/
+static int compressFlush(compressFile *p){
+  int rc = SQLITE_OK;
+  if( p->bCacheDirty ){
+    rc = compressStore(p, p->iCache, p->aBuf);
+    if( rc==SQLITE_OK ) p->bCacheDirty = 0;
+  }
+  return rc;
+}
+
+/*
+** Make sure the first buffer at p->aBuf holds block iBlk.
+*/
+static int compressFetchCache(compressFile *p, i64 iBlk){
+  int rc = SQLITE_OK;
+  if( p->iCache!=iBlk ){
+    rc = compressFlush(p);
+    if( rc==SQLITE_OK ){
+      p->iCache = -1;
+      rc = compressFetch(p, iBlk, p->aBuf);
+      if( rc==SQLITE_OK ) p->iCache = iBlk;
+    }
+  }
+  return rc;
+}
+
+/*
+** Commit the changes made since the last commit. If syncFlags is not
+** zero, sync the real file with those flags before and after writing
+** the header.
+*/
+static int compressCommitOne(compressFile *p, int syncFlags){
+  sqlite3_file *pReal = p->pReal;
+  u8 aHdr[COMPRESS_HDRUSED];
+  u8 *aDir = 0;
+  int nDir = p->nMap*COMPRESS_DIRENTRY;
+  i64 iGen = p->iGen+1;
+  u32 dirCksum = 0;
+  int rc = SQLITE_OK;
+  int i;
+
+  if( !p->bDirty ) return SQLITE_OK;
+  assert( p->bLoaded && p->bFreeValid );
+  rc = compressFlush(p);
+
+  /* Write the modified map pages. */
+  for(i=0; rc==SQLITE_OK && i<p->nMap; i++){
+    CompressMap *pMap = p->apMap[i];
+    if( pMap->bDirty ){
+      i64 iOff = compressAlloc(p, COMPRESS_BLOCK);
+      rc = compressRealWrite(p, pMap->aEntry, COMPRESS_BLOCK, iOff);
+      if( rc==SQLITE_OK && pMap->iOff ){
+        rc = compressFreeLater(p, pMap->iOff, COMPRESS_BLOCK);
+      }
+      if( rc==SQLITE_OK ){
+        pMap->iOff = iOff;
+        pMap->cksum = compressChecksum(pMap->aEntry, COMPRESS_BLOCK);
+        pMap->bDirty = 0;
+      }
+    }
+  }
+
+  /* Write the new directory. */
+  if( rc==SQLITE_OK && p->nDirMap ){
+    rc = compressFreeLater(p, p->iDirOff,
+                           compressRound(p, p->nDirMap*COMPRESS_DIRENTRY));
+  }
+  if( rc==SQLITE_OK ){
+    p->iDirOff = 0;
+    p->nDirMap = 0;
+    if( nDir ){
+      aDir = (u8*)sqlite3Malloc(nDir);
+      if( aDir==0 ){
+        rc = SQLITE_NOMEM;
+      }else{
+        for(i=0; i<p->nMap; i++){
+          compressPut64(&aDir[i*COMPRESS_DIRENTRY], p->apMap[i]->iOff);
+          compressPut32(&aDir[i*COMPRESS_DIRENTRY+8], p->apMap[i]->cksum);
+        }
+        dirCksum = compressChecksum(aDir, nDir);
+        p->iDirOff = compressAlloc(p, nDir);
+        p->nDirMap = p->nMap;
+        rc = compressRealWrite(p, aDir, nDir, p->iDirOff);
+        sqlite3_free(aDir);
+      }
+    }
+  }
+
+  /* Sync, write the header into the slot not used by the current header,
+  ** and sync again. */
+  if( rc==SQLITE_OK && syncFlags ){
+    rc = pReal->pMethods->xSync(pReal, syncFlags);
+  }
+  if( rc==SQLITE_OK ){
+    memset(aHdr, 0, sizeof(aHdr));
+    memcpy(aHdr, COMPRESS_MAGIC, 16);
+    compressPut64(&aHdr[16], iGen);
+    compressPut64(&aHdr[24], p->iSize);
+    compressPut64(&aHdr[32], p->iDirOff);
+    compressPut32(&aHdr[40], (u32)p->nDirMap);
+    compressPut32(&aHdr[44], dirCksum);
+    compressPut32(&aHdr[48], COMPRESS_BLOCK);
+    compressPut32(&aHdr[52], (u32)p->szUnit);
+    compressPut32(&aHdr[56], compressChecksum(aHdr, 56));
+    rc = compressRealWrite(p, aHdr, COMPRESS_HDRUSED,
+                           (iGen&1)*COMPRESS_HDRSIZE);
+  }
+  if( rc==SQLITE_OK && syncFlags ){
+    rc = pReal->pMethods->xSync(pReal, syncFlags);
+  }
+  if( rc!=SQLITE_OK ) return rc;
+
+  /* The space used by the previous header is now free. */
+  p->iGen = iGen;
+  p->bDirty = 0;
+  for(i=0; i<p->nMap; i++){
+    memset(p->apMap[i]->aNew, 0, sizeof(p->apMap[i]->aNew));
+  }
+  for(i=0; rc==SQLITE_OK && i<p->nPend; i++){
+    rc = compressFree(p, p->aPend[i].iOff, p->aPend[i].nByte);
+  }
+  p->nPend = 0;
+  if( rc!=SQLITE_OK ){
+    /* Space that could not be added to aFree[] is lost until the list
+    ** is next built. */
+    p->bFreeValid = 0;
+    p->nFree = 0;
+    return rc;
+  }
+
+  /* Give the space at the end of the file back to the file system. */
+  if( p->iPhys>p->iEnd ){
+    rc = pReal->pMethods->xTruncate(pReal, p->iEnd);
+    if( rc==SQLITE_OK ) p->iPhys = p->iEnd;
+  }
+  return rc;
+}
+
+/*
+** If more than a quarter of the space in use is free, move the blocks
+** stored nearest the end of the file into free space nearer the start,
+** so that the file may be truncated at the next commit. The blocks are
+** copied as they are stored, without being uncompressed.
+**
+** This is called just after a commit, when all space is either in use
+** by the current header or free.
+*/
+static int compressCompact(compressFile *p){
+  CompressExtent *aSlot;          /* Offset and block number of each block */
+  u8 *aTmp = &p->aBuf[COMPRESS_BLOCK];
+  i64 nFree = 0;
+  int nSlot = 0;
+  int rc = SQLITE_OK;
+  int i, j;
+
+  assert( p->bDirty==0 && p->nPend==0 && p->bFreeValid );
+  for(i=0; i<p->nFree; i++) nFree += p->aFree[i].nByte;
+  if( p->nMap==0 || nFree<COMPRESS_COMPACT_MIN
+   || nFree*4<p->iEnd-COMPRESS_DATA
+  ){
+    return SQLITE_OK;
+  }
+
+  /* The nByte field of each slot holds the block number. */
+  aSlot = (CompressExtent*)sqlite3Malloc(
+      p->nMap*COMPRESS_NENTRY*2*sizeof(CompressExtent)
+  );
+  if( aSlot==0 ) return SQLITE_NOMEM;
+  for(i=0; i<p->nMap; i++){
+    for(j=0; j<COMPRESS_NENTRY; j++){
+      const u8 *aEntry = &p->apMap[i]->aEntry[j*8];
+      if( compressGet16(&aEntry[6]) ){
+        aSlot[nSlot].iOff = compressGet48(aEntry);
+        aSlot[nSlot].nByte = (i64)i*COMPRESS_NENTRY + j;
+        nSlot++;
+      }
+    }
+  }
+  compressExtentSort(aSlot, &aSlot[p->nMap*COMPRESS_NENTRY], nSlot);
+
+  for(i=nSlot-1; rc==SQLITE_OK && i>=0; i--){
+    i64 iBlk = aSlot[i].nByte;
+    CompressMap *pMap = p->apMap[iBlk/COMPRESS_NENTRY];
+    int iEntry = (int)(iBlk%COMPRESS_NENTRY);
+    u8 *aEntry = &pMap->aEntry[iEntry*8];
+    int nStored = compressGet16(&aEntry[6]);
+    i64 nByte = compressRound(p, nStored);
+    i64 iOff;
+
+    if( p->nFree==0 || p->aFree[0].iOff>aSlot[i].iOff ) break;
+    for(j=0; j<p->nFree && p->aFree[j].nByte<nByte; j++);
+    if( j==p->nFree || p->aFree[j].iOff>aSlot[i].iOff ) continue;
+
+    rc = compressRealRead(p, aTmp, nStored, aSlot[i].iOff);
+    if( rc==SQLITE_OK ){
+      iOff = compressAlloc(p, nStored);
+      rc = compressRealWrite(p, aTmp, nStored, iOff);
+      if( rc==SQLITE_OK ){
+        rc = compressFreeLater(p, aSlot[i].iOff, nByte);
+      }else{
+        compressFree(p, iOff, nByte);
+      }
+    }
+    if( rc==SQLITE_OK ){
+      compressPut48(aEntry, iOff);
+      pMap->aNew[iEntry/8] |= (1<<(iEntry%8));
+      p->bDirty = 1;
+    }
+  }
+  sqlite3_free(aSlot);
+
+  /* Map pages are written to the first free space at the next commit, so
+  ** marking them all dirty moves them too. */
+  if( p->bDirty ){
+    for(i=0; i<p->nMap; i++) p->apMap[i]->bDirty = 1;
+  }
+  return rc;
+}
+
+/*
+** Commit the changes made since the last commit, as for
+** compressCommitOne(). If that leaves much of the file free, compact it
+** and commit again.
+*/
+static int compressCommit(compressFile *p, int syncFlags){
+  int rc;
+  if( !p->bDirty ) return SQLITE_OK;
+  rc = compressCommitOne(p, syncFlags);
+  if( rc==SQLITE_OK ) rc = compressCompact(p);
+  if( rc==SQLITE_OK ) rc = compressCommitOne(p, syncFlags);
+  return rc;
+}
+
+/*
+** If the name of a journal or WAL file is zName, return the length of
+** the name of its database file. Otherwise return 0.
+*/
+static int compressDbName(const char *zName){
+  static const char *azSuffix[] = { "-journal", "-wal" };
+  int nName = zName ? sqlite3Strlen30(zName) : 0;
+  int i;
+  for(i=0; i<ArraySize(azSuffix); i++){
+    int nSuffix = sqlite3Strlen30(azSuffix[i]);
+    if( nName>nSuffix
+     && memcmp(&zName[nName-nSuffix], azSuffix[i], nSuffix)==0
+    ){
+      return nName-nSuffix;
+    }
+  }
+  return 0;
+}
+
+/*
+** Commit the changes to open database files with the name formed by the
+** first nName bytes of zName. This is called before the journal or WAL
+** file of the database is finalized.
+*/
+static int compressCommitDb(const char *zName, int nName){
+  compressFile *pDb;
+  int rc = SQLITE_OK;
+  sqlite3_mutex_enter(gCompress.pMutex);
+  for(pDb=gCompress.pList; rc==SQLITE_OK && pDb; pDb=pDb->pNext){
+    if( pDb->bDirty
+     && memcmp(pDb->zName, zName, nName)==0 && pDb->zName[nName]=='\0'
+    ){
+      rc = compressCommit(pDb, 0);
+    }
+  }
+  sqlite3_mutex_leave(gCompress.pMutex);
+  return rc;
+}
+
+/************************* VFS Method Wrappers *****************************/
+
+/*
+** This is the xOpen method used for the "compress" VFS.
+**
+** The real file is opened by the underlying VFS. A main database file
+** is compressed unless it was created by another VFS.
+*/
+static int compressOpen(
+  sqlite3_vfs *pVfs,         /* The compress VFS */
+  const char *zName,         /* Name of file to be opened */
+  sqlite3_file *pConn,       /* Fill in this file descriptor */
+  int flags,                 /* Flags to control the opening */
+  int *pOutFlags             /* Flags showing results of opening */
+){
+  compressFile *p = (compressFile*)pConn;
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  int rc;
+
+  UNUSED_PARAMETER(pVfs);
+  memset(p, 0, sizeof(compressFile));
+  p->pReal = (sqlite3_file*)&p[1];
+  p->zName = zName;
+  rc = pOrigVfs->xOpen(pOrigVfs, zName, p->pReal, flags, pOutFlags);
+  if( p->pReal->pMethods==0 ) return rc;
+
+  if( rc==SQLITE_OK && zName && (flags & SQLITE_OPEN_MAIN_DB) ){
+    u8 aMagic[16];
+    int rc2;
+    memset(aMagic, 0, sizeof(aMagic));
+    rc2 = p->pReal->pMethods->xRead(p->pReal, aMagic, sizeof(aMagic), 0);
+    if( (rc2==SQLITE_OK || rc2==SQLITE_IOERR_SHORT_READ)
+     && memcmp(aMagic, COMPRESS_FILE_HEADER, 16)!=0
+    ){
+      p->eType = COMPRESS_DB;
+    }
+  }else if( flags & (SQLITE_OPEN_MAIN_JOURNAL|SQLITE_OPEN_WAL) ){
+    p->nDbName = compressDbName(zName);
+    if( p->nDbName ) p->eType = COMPRESS_JOURNAL;
+  }
+
+  if( p->eType==COMPRESS_DB ){
+    sqlite3_mutex_enter(gCompress.pMutex);
+    p->pNext = gCompress.pList;
+    gCompress.pList = p;
+    sqlite3_mutex_leave(gCompress.pMutex);
+    p->base.pMethods = &gCompress.sIoMethodsV1;
+  }else if( p->pReal->pMethods->iVersion==1 ){
+    p->base.pMethods = &gCompress.sIoMethodsV1;
+  }else{
+    p->base.pMethods = &gCompress.sIoMethodsV2;
+  }
+  return rc;
+}
+
+/*
+** Commit any uncommitted changes to a database before its journal or
+** WAL file is deleted.
+*/
+static int compressDelete(sqlite3_vfs *pVfs, const char *zName, int dirSync){
+  sqlite3_vfs *pOrigVfs = gCompress.pOrigVfs;
+  int nDbName = compressDbName(zName);
+  UNUSED_PARAMETER(pVfs);
+  if( nDbName ){
+    int rc = compressCommitDb(zName, nDbName);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  return pOrigVfs->xDelete(pOrigVfs, zName, dirSync);
+}
+
+/************************ I/O Method Wrappers *******************************/
+
+/* Commit any uncommitted changes, close the real file and free the map.
+*/
+static int compressClose(sqlite3_file *pConn){
+  compressFile *p = (compressFile*)pConn;
+  int rc = SQLITE_OK;
+  int rc2;
+  if( p->eType==COMPRESS_DB ){
+    compressFile **pp;
+    rc = compressCommit(p, 0);
+    sqlite3_mutex_enter(gCompress.pMutex);
+    for(pp=&gCompress.pList; *pp!=p; pp=&(*pp)->pNext);
+    *pp = p->pNext;
+    sqlite3_mutex_leave(gCompress.pMutex);
+    compressMapTruncate(p, 0);
+    sqlite3_free(p->apMap);
+    sqlite3_free(p->aFree);
+    sqlite3_free(p->aPend);
+    sqlite3_free(p->aBuf);
+  }
+  rc2 = p->pReal->pMethods->xClose(p->pReal);
+  return rc==SQLITE_OK ? rc2 : rc;
+}
+
+/* Read part of a database file. Whole blocks are uncompressed straight
+** into the caller's buffer. Other reads, such as those of the database
+** header or of pages smaller than a block, go through the block cache.
+*/
+static int compressRead(
+  sqlite3_file *pConn,
+  void *pBuf,
+  int iAmt,
+  sqlite3_int64 iOfst
+){
+  compressFile *p = (compressFile*)pConn;
+  u8 *aOut = (u8*)pBuf;
+  int rc;
+
+  if( p->eType!=COMPRESS_DB ){
+    return p->pReal->pMethods->xRead(p->pReal, pBuf, iAmt, iOfst);
+  }
+  rc = compressPrepare(p);
+  if( rc==SQLITE_CORRUPT && p->eLock==NO_LOCK ){
+    /* The pager reads the database header before it takes a lock, at
+    ** which time another connection may be half way through a commit.
+    ** Report an empty file. The map is read again once a lock is held. */
+    memset(pBuf, 0, iAmt);
+    return SQLITE_IOERR_SHORT_READ;
+  }
+  while( rc==SQLITE_OK && iAmt>0 ){
+    i64 iBlk = iOfst/COMPRESS_BLOCK;
+    int iOff = (int)(iOfst%COMPRESS_BLOCK);
+    int n = COMPRESS_BLOCK - iOff;
+    if( n>iAmt ) n = iAmt;
+    if( iOfst+n>p->iSize ){
+      memset(aOut, 0, iAmt);
+      if( iOfst<p->iSize ){
+        rc = compressFetchCache(p, iBlk);
+        if( rc==SQLITE_OK ){
+          memcpy(aOut, &p->aBuf[iOff], (int)(p->iSize-iOfst));
+        }
+      }
+      if( rc==SQLITE_OK ) rc = SQLITE_IOERR_SHORT_READ;
+      break;
+    }
+    if( n==COMPRESS_BLOCK && iBlk!=p->iCache ){
+      rc = compressFetch(p, iBlk, aOut);
+    }else{
+      rc = compressFetchCache(p, iBlk);
+      if( rc==SQLITE_OK ) memcpy(aOut, &p->aBuf[iOff], n);
+    }
+    aOut += n;
+    iOfst += n;
+    iAmt -= n;
+  }
+  return rc;
+}
+
+/* Write part of the file. Whole blocks of a database file are compressed
+** and stored. Writes of part of a block are made to the cached copy of
+** the block.
+**
+** A write to the start of a journal or WAL file means that the pager
+** is finishing with its previous content, so the changes to the database
+** file are committed first.
+*/
+static int compressWrite(
+  sqlite3_file *pConn,
+  const void *pBuf,
+  int iAmt,
+  sqlite3_int64 iOfst
+){
+  compressFile *p = (compressFile*)pConn;
+  const u8 *aIn = (const u8*)pBuf;
+  int rc;
+
+  if( p->eType!=COMPRESS_DB ){
+    if( p->eType==COMPRESS_JOURNAL && iOfst==0 ){
+      rc = compressCommitDb(p->zName, p->nDbName);
+      if( rc!=SQLITE_OK ) return rc;
+    }
+    return p->pReal->pMethods->xWrite(p->pReal, pBuf, iAmt, iOfst);
+  }
+  rc = compressPrepare(p);
+  if( rc==SQLITE_OK ) rc = compressFreeBuild(p);
+  while( rc==SQLITE_OK && iAmt>0 ){
+    i64 iBlk = iOfst/COMPRESS_BLOCK;
+    int iOff = (int)(iOfst%COMPRESS_BLOCK);
+    int n = COMPRESS_BLOCK - iOff;
+    if( n>iAmt ) n = iAmt;
+    if( n==COMPRESS_BLOCK ){
+      if( p->iCache==iBlk ){
+        p->iCache = -1;
+        p->bCacheDirty = 0;
+      }
+      rc = compressStore(p, iBlk, aIn);
+    }else{
+      rc = compressFetchCache(p, iBlk);
+      if( rc==SQLITE_OK ){
+        memcpy(&p->aBuf[iOff], aIn, n);
+        p->bCacheDirty = 1;
+        p->bDirty = 1;
+      }
+    }
+    aIn += n;
+    iOfst += n;
+    iAmt -= n;
+    if( rc==SQLITE_OK && iOfst>p->iSize ){
+      p->iSize = iOfst;
+    }
+  }
+  return rc;
+}
+
+/* Truncate the file. For a database file, free the blocks past the new
+** end and zero the part of the last block past the end, so that it
+** reads as zeros if the file is extended again.
+*/
+static int compressTruncate(sqlite3_file *pConn, sqlite3_int64 size){
+  compressFile *p = (compressFile*)pConn;
+  i64 nBlk;
+  int nMap;
+  int rc;
+  int i;
+
+  if( p->eType!=COMPRESS_DB ){
+    if( p->eType==COMPRESS_JOURNAL ){
+      rc = compressCommitDb(p->zName, p->nDbName);
+      if( rc!=SQLITE_OK ) return rc;
+    }
+    return p->pReal->pMethods->xTruncate(p->pReal, size);
+  }
+  rc = compressPrepare(p);
+  if( rc==SQLITE_OK ) rc = compressFreeBuild(p);
+  if( rc==SQLITE_OK ) rc = compressFlush(p);
+  if( rc!=SQLITE_OK || size>=p->iSize ){
+    if( rc==SQLITE_OK && size>p->iSize ){
+      p->iSize = size;
+      p->bDirty = 1;
+    }
+    return rc;
+  }
+
+  nBlk = (size+COMPRESS_BLOCK-1)/COMPRESS_BLOCK;
+  nMap = (int)((nBlk+COMPRESS_NENTRY-1)/COMPRESS_NENTRY);
+  for(i=(int)(nBlk/COMPRESS_NENTRY); rc==SQLITE_OK && i<p->nMap; i++){
+    CompressMap *pMap = p->apMap[i];
+    int j = (i==nBlk/COMPRESS_NENTRY) ? (int)(nBlk%COMPRESS_NENTRY) : 0;
+    for(; rc==SQLITE_OK && j<COMPRESS_NENTRY; j++){
+      rc = compressRelease(p, pMap, j);
+    }
+    if( rc==SQLITE_OK && i>=nMap && pMap->iOff ){
+      rc = compressFreeLater(p, pMap->iOff, COMPRESS_BLOCK);
+      pMap->iOff = 0;
+    }
+  }
+  if( rc==SQLITE_OK ){
+    compressMapTruncate(p, nMap);
+    p->iCache = -1;
+    if( size%COMPRESS_BLOCK ){
+      int iOff = (int)(size%COMPRESS_BLOCK);
+      rc = compressFetchCache(p, nBlk-1);
+      if( rc==SQLITE_OK ){
+        memset(&p->aBuf[iOff], 0, COMPRESS_BLOCK-iOff);
+        rc = compressStore(p, nBlk-1, p->aBuf);
+      }
+    }
+  }
+  if( rc==SQLITE_OK ){
+    p->iSize = size;
+    p->bDirty = 1;
+  }
+  return rc;
+}
+
+/* Commit the changes to a database file, syncing the real file twice.
+** Other files are simply synced.
+*/
+static int compressSync(sqlite3_file *pConn, int flags){
+  compressFile *p = (compressFile*)pConn;
+  if( p->eType==COMPRESS_DB && p->bDirty ){
+    /* The file may have grown, so its size must be synced as well. */
+    return compressCommit(p, flags & ~SQLITE_SYNC_DATAONLY);
+  }
+  return p->pReal->pMethods->xSync(p->pReal, flags);
+}
+
+/* Return the size of the database file as seen by the pager.
+*/
+static int compressFileSize(sqlite3_file *pConn, sqlite3_int64 *pSize){
+  compressFile *p = (compressFile*)pConn;
+  int rc;
+  if( p->eType!=COMPRESS_DB ){
+    return p->pReal->pMethods->xFileSize(p->pReal, pSize);
+  }
+  rc = compressPrepare(p);
+  *pSize = p->iSize;
+  return rc;
+}
+
+/* Take a lock. When a database file is first locked, read the map again
+** if another connection has committed changes since it was last read.
+*/
+static int compressLock(sqlite3_file *pConn, int lock){
+  compressFile *p = (compressFile*)pConn;
+  int rc = p->pReal->pMethods->xLock(p->pReal, lock);
+  if( rc==SQLITE_OK && p->eType==COMPRESS_DB ){
+    if( p->eLock==NO_LOCK ){
+      rc = compressPrepare(p);
+      if( rc==SQLITE_OK ) rc = compressLoad(p);
+      if( rc!=SQLITE_OK ){
+        p->pReal->pMethods->xUnlock(p->pReal, NO_LOCK);
+        return rc;
+      }
+    }
+    p->eLock = lock;
+  }
+  return rc;
+}
+
+/* Release a lock, first committing any changes to a database file so
+** that the connection that next takes the lock sees them.
+*/
+static int compressUnlock(sqlite3_file *pConn, int lock){
+  compressFile *p = (compressFile*)pConn;
+  int rc = SQLITE_OK;
+  int rc2;
+  if( p->eType==COMPRESS_DB ){
+    if( lock<=SHARED_LOCK ) rc = compressCommit(p, 0);
+    p->eLock = lock;
+  }
+  rc2 = p->pReal->pMethods->xUnlock(p->pReal, lock);
+  return rc==SQLITE_OK ? rc2 : rc;
+}
+
+/* The size of a compressed database file has little to do with the size
+** of the real file, so size hints are ignored. Other file-controls are
+** passed through.
+*/
+static int compressFileControl(sqlite3_file *pConn, int op, void *pArg){
+  compressFile *p = (compressFile*)pConn;
+  if( p->eType==COMPRESS_DB
+   && (op==SQLITE_FCNTL_SIZE_HINT || op==SQLITE_FCNTL_CHUNK_SIZE)
+  ){
+    return SQLITE_OK;
+  }
+  return p->pReal->pMethods->xFileControl(p->pReal, op, pArg);
+}
+
+/* Pass other requests through to the original VFS.
+*/
+static int compressCheckReservedLock(sqlite3_file *pConn, int *pResOut){
+  compressFile *p = (compressFile*)pConn;
+  return p->pReal->pMethods->xCheckReservedLock(p->pReal, pResOut);
+}
+static int compressSectorSize(sqlite3_file *pConn){
+  compressFile *p = (compressFile*)pConn;
+  return p->pReal->pMethods->xSectorSize(p->pReal);
+}
+static int compressDeviceCharacteristics(sqlite3_file *pConn){
+  compressFile *p = (compressFile*)pConn;
+  return p->pReal->pMethods->xDeviceCharacteristics(p->pReal);
+}
+static int compressShmMap(
+  sqlite3_file *pConn,            /* Handle open on database file */
+  int iRegion,                    /* Region to retrieve */
+  int szRegion,                   /* Size of regions */
+  int bExtend,                    /* True to extend file if necessary */
+  void volatile **pp              /* OUT: Mapped memory */
+){
+  compressFile *p = (compressFile*)pConn;
+  return p->pReal->pMethods->xShmMap(p->pReal, iRegion, szRegion, bExtend, pp);
+}
+static int compressShmLock(sqlite3_file *pConn, int ofst, int n, int flags){
+  compressFile *p = (compressFile*)pConn;
+  return p->pReal->pMethods->xShmLock(p->pReal, ofst, n, flags);
+}
+static void compressShmBarrier(sqlite3_file *pConn){
+  compressFile *p = (compressFile*)pConn;
+  p->pReal->pMethods->xShmBarrier(p->pReal);
+}
+static int compressShmUnmap(sqlite3_file *pConn, int deleteFlag){
+  compressFile *p = (compressFile*)pConn;
+  return p->pReal->pMethods->xShmUnmap(p->pReal, deleteFlag);
+}
+
+/************************** Public Interfaces *****************************/
+/*
+** Initialize the compress VFS.  Use the VFS named zOrigVfsName as the
+** VFS that does the actual work.  Use the default if zOrigVfsName==NULL.
+**
+** The compress VFS is named "compress".  It will become the default
+** VFS if makeDefault is non-zero.
+**
+** THIS ROUTINE IS NOT THREADSAFE.  Call this routine exactly once
+** during start-up.
+*/
+int sqlite3_compress_initialize(const char *zOrigVfsName, int makeDefault){
+  sqlite3_vfs *pOrigVfs;
+  if( gCompress.isInitialized ) return SQLITE_MISUSE;
+  pOrigVfs = sqlite3_vfs_find(zOrigVfsName);
+  if( pOrigVfs==0 ) return SQLITE_ERROR;
+  assert( pOrigVfs!=&gCompress.sThisVfs );
+  gCompress.pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
+  gCompress.pStatMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
+  if( !gCompress.pMutex || !gCompress.pStatMutex ){
+    sqlite3_mutex_free(gCompress.pMutex);
+    sqlite3_mutex_free(gCompress.pStatMutex);
+    return SQLITE_NOMEM;
+  }
+  gCompress.isInitialized = 1;
+  gCompress.pOrigVfs = pOrigVfs;
+  gCompress.pList = 0;
+  gCompress.nIn = 0;
+  gCompress.nOut = 0;
+  gCompress.sThisVfs = *pOrigVfs;
+  gCompress.sThisVfs.szOsFile = sizeof(compressFile) + pOrigVfs->szOsFile;
+  gCompress.sThisVfs.zName = "compress";
+  gCompress.sThisVfs.xOpen = compressOpen;
+  gCompress.sThisVfs.xDelete = compressDelete;
+
+  gCompress.sIoMethodsV1.iVersion = 1;
+  gCompress.sIoMethodsV1.xClose = compressClose;
+  gCompress.sIoMethodsV1.xRead = compressRead;
+  gCompress.sIoMethodsV1.xWrite = compressWrite;
+  gCompress.sIoMethodsV1.xTruncate = compressTruncate;
+  gCompress.sIoMethodsV1.xSync = compressSync;
+  gCompress.sIoMethodsV1.xFileSize = compressFileSize;
+  gCompress.sIoMethodsV1.xLock = compressLock;
+  gCompress.sIoMethodsV1.xUnlock = compressUnlock;
+  gCompress.sIoMethodsV1.xCheckReservedLock = compressCheckReservedLock;
+  gCompress.sIoMethodsV1.xFileControl = compressFileControl;
+  gCompress.sIoMethodsV1.xSectorSize = compressSectorSize;
+  gCompress.sIoMethodsV1.xDeviceCharacteristics = compressDeviceCharacteristics;
+  gCompress.sIoMethodsV2 = gCompress.sIoMethodsV1;
+  gCompress.sIoMethodsV2.iVersion = 2;
+  gCompress.sIoMethodsV2.xShmMap = compressShmMap;
+  gCompress.sIoMethodsV2.xShmLock = compressShmLock;
+  gCompress.sIoMethodsV2.xShmBarrier = compressShmBarrier;
+  gCompress.sIoMethodsV2.xShmUnmap = compressShmUnmap;
+  sqlite3_vfs_register(&gCompress.sThisVfs, makeDefault);
+  return SQLITE_OK;
+}
+
+/*
+** Shutdown the compress VFS.
+**
+** All SQLite database connections must be closed before calling this
+** routine.
+*/
+int sqlite3_compress_shutdown(void){
+  if( gCompress.isInitialized==0 ) return SQLITE_MISUSE;
+  sqlite3_vfs_unregister(&gCompress.sThisVfs);
+  sqlite3_mutex_free(gCompress.pMutex);
+  sqlite3_mutex_free(gCompress.pStatMutex);
+  memset(&gCompress, 0, sizeof(gCompress));
+  return SQLITE_OK;
+}
+
+/*
+** Set *pnIn to the number of bytes of database blocks written through
+** the compress VFS and *pnOut to the number of bytes used to store
+** them. If resetFlag is true, both counters are then reset to zero.
+*/
+int sqlite3_compress_stats(
+  sqlite3_int64 *pnIn,
+  sqlite3_int64 *pnOut,
+  int resetFlag
+){
+  if( !gCompress.isInitialized ) return SQLITE_MISUSE;
+  sqlite3_mutex_enter(gCompress.pStatMutex);
+  *pnIn = gCompress.nIn;
+  *pnOut = gCompress.nOut;
+  if( resetFlag ){
+    gCompress.nIn = 0;
+    gCompress.nOut = 0;
+  }
+  sqlite3_mutex_leave(gCompress.pStatMutex);
+  return SQLITE_OK;
+}
+
+#endif /* SQLITE_OMIT_COMPRESS */
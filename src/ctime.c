@@ -203,6 +203,9 @@ static const char * const azCompileOpt[] = {
 #ifdef SQLITE_OMIT_COMPLETE
   "OMIT_COMPLETE",
 #endif
+#ifdef SQLITE_OMIT_COMPRESS
+  "OMIT_COMPRESS",
+#endif
 #ifdef SQLITE_OMIT_COMPOUND_SELECT
   "OMIT_COMPOUND_SELECT",
 #endif
@@ -275,6 +278,9 @@ static const char * const azCompileOpt[] = {
 #ifdef SQLITE_OMIT_SCHEMA_PRAGMAS
   "OMIT_SCHEMA_PRAGMAS",
 #endif
+#ifdef SQLITE_OMIT_SCHEMA_SNAPSHOT
+  "OMIT_SCHEMA_SNAPSHOT",
+#endif
 #ifdef SQLITE_OMIT_SCHEMA_VERSION_PRAGMAS
   "OMIT_SCHEMA_VERSION_PRAGMAS",
 #endif
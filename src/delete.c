@@ -204,6 +204,175 @@ limit_where_cleanup_2:
 }
 #endif /* defined(SQLITE_ENABLE_UPDATE_DELETE_LIMIT) && !defined(SQLITE_OMIT_SUBQUERY) */
 
+/*
+** Check whether WHERE clause expression pExpr of a DELETE statement on
+** the table open on cursor iCur consists only of comparisons between the
+** rowid and expressions that do not depend on the row, such as "rowid<?"
+** or "rowid BETWEEN ? AND ?", with at most one lower and one upper bound.
+** If so, return 1. The bound expressions are stored in apBound[0] and
+** apBound[1], and bit 0x01 (for the lower bound) or 0x02 (for the upper
+** bound) of *pFlags is set if the bound is exclusive. apBound[] and
+** *pFlags must be zeroed before the first call. Otherwise, return 0.
+*/
+static int findRowidRange(Expr *pExpr, int iCur, Expr **apBound, u8 *pFlags){
+  Expr *pRowid;          /* The rowid side of the comparison */
+  Expr *pVal;            /* The other side */
+  int op;
+  int i;                 /* 0 for a lower bound, 1 for an upper bound */
+
+  if( pExpr==0 ) return 0;
+  op = pExpr->op;
+  if( op==TK_AND ){
+    return findRowidRange(pExpr->pLeft, iCur, apBound, pFlags)
+        && findRowidRange(pExpr->pRight, iCur, apBound, pFlags);
+  }
+  if( op==TK_BETWEEN ){
+    ExprList *pList;
+    pRowid = pExpr->pLeft;
+    if( pRowid->op!=TK_COLUMN || pRowid->iTable!=iCur || pRowid->iColumn>=0
+     || apBound[0] || apBound[1]
+    ){
+      return 0;
+    }
+    assert( !ExprHasProperty(pExpr, EP_xIsSelect) );
+    pList = pExpr->x.pList;
+    assert( pList->nExpr==2 );
+    apBound[0] = pList->a[0].pExpr;
+    apBound[1] = pList->a[1].pExpr;
+    return sqlite3ExprIsConstant(apBound[0]) 
+        && sqlite3ExprIsConstant(apBound[1]);
+  }
+  if( op!=TK_LT && op!=TK_LE && op!=TK_GT && op!=TK_GE ) return 0;
+
+  pRowid = pExpr->pLeft;
+  pVal = pExpr->pRight;
+  if( pRowid->op!=TK_COLUMN || pRowid->iTable!=iCur || pRowid->iColumn>=0 ){
+    /* Try "<expr> OP rowid" */
+    pRowid = pExpr->pRight;
+    pVal = pExpr->pLeft;
+    if( pRowid->op!=TK_COLUMN || pRowid->iTable!=iCur || pRowid->iColumn>=0 ){
+      return 0;
+    }
+    switch( op ){
+      case TK_LT:  op = TK_GT;  break;
+      case TK_LE:  op = TK_GE;  break;
+      case TK_GT:  op = TK_LT;  break;
+      default:     op = TK_LE;  break;
+    }
+  }
+  i = (op==TK_LT || op==TK_LE);
+  if( apBound[i] || !sqlite3ExprIsConstant(pVal) ) return 0;
+  apBound[i] = pVal;
+  if( op==TK_LT || op==TK_GT ){
+    *pFlags |= (u8)(1<<i);
+  }
+  return 1;
+}
+
+/*
+** Generate code for a DELETE statement on table pTab, open on cursor
+** iCur, whose WHERE clause selects a range of rowids as identified by
+** findRowidRange(). The rows are removed from the table by a single
+** OP_DeleteRange, which frees whole sub-trees of the table at a time.
+**
+** If the table has indices, the range of rows is first scanned to find
+** the index entries to delete. The keys for each index are sorted in an
+** ephemeral index, then deleted in order, so that each index is updated
+** by a single pass from left to right instead of by one random seek for
+** each row.
+**
+** If memCnt is greater than zero, it is a register incremented by the
+** number of rows deleted.
+*/
+static void deleteRowidRange(
+  Parse *pParse,         /* The parser context */
+  Table *pTab,           /* The table from which rows are deleted */
+  int iCur,              /* VDBE cursor number for pTab */
+  Expr **apBound,        /* Lower and upper bounds, either may be NULL */
+  u8 flags,              /* Exclusive bounds, as set by findRowidRange() */
+  int memCnt             /* Memory cell used for change counting */
+){
+  Vdbe *v = pParse->pVdbe;
+  sqlite3 *db = pParse->db;
+  int regBound;          /* Registers holding the lower and upper bounds */
+  Index *pIdx;           /* For looping over indices of the table */
+  int i;
+
+  regBound = pParse->nMem+1;
+  pParse->nMem += 2;
+  for(i=0; i<2; i++){
+    if( apBound[i] ){
+      sqlite3ExprCode(pParse, apBound[i], regBound+i);
+    }else{
+      i64 *pI64 = sqlite3DbMallocRaw(db, sizeof(i64));
+      if( pI64 ){
+        *pI64 = (i==0 ? SMALLEST_INT64 : LARGEST_INT64);
+      }
+      sqlite3VdbeAddOp4(v, OP_Int64, 0, regBound+i, 0, (char*)pI64,P4_INT64);
+    }
+  }
+  sqlite3OpenTableAndIndices(pParse, pTab, iCur, OP_OpenWrite);
+
+  if( pTab->pIndex ){
+    int iEph = pParse->nTab;          /* First ephemeral index cursor */
+    int regRowid = ++pParse->nMem;    /* Rowid of the current row */
+    int regRec = ++pParse->nMem;      /* Index key of the current row */
+    int addrTop;                      /* Top of the scan loop */
+    int addrEnd;                      /* End of the scan loop */
+
+    for(i=0, pIdx=pTab->pIndex; pIdx; i++, pIdx=pIdx->pNext){
+      KeyInfo *pKey = sqlite3IndexKeyinfo(pParse, pIdx);
+      pParse->nTab++;
+      sqlite3VdbeAddOp4(v, OP_OpenEphemeral, iEph+i, pIdx->nColumn+1, 0,
+                        (char*)pKey, P4_KEYINFO_HANDOFF);
+    }
+
+    /* Scan the rows in the range and collect their index keys. */
+    addrEnd = sqlite3VdbeMakeLabel(v);
+    sqlite3VdbeAddOp3(v, (flags&0x01) ? OP_SeekGt : OP_SeekGe, 
+                      iCur, addrEnd, regBound);
+    addrTop = sqlite3VdbeAddOp2(v, OP_Rowid, iCur, regRowid);
+    sqlite3VdbeAddOp3(v, (flags&0x02) ? OP_Ge : OP_Gt, 
+                      regBound+1, addrEnd, regRowid);
+    sqlite3VdbeChangeP5(v, SQLITE_AFF_NUMERIC|SQLITE_JUMPIFNULL);
+    for(i=0, pIdx=pTab->pIndex; pIdx; i++, pIdx=pIdx->pNext){
+      sqlite3GenerateIndexKey(pParse, pIdx, iCur, regRec, 1);
+      sqlite3VdbeAddOp2(v, OP_IdxInsert, iEph+i, regRec);
+    }
+    sqlite3VdbeAddOp2(v, OP_Next, iCur, addrTop);
+    sqlite3VdbeResolveLabel(v, addrEnd);
+
+    /* Delete the keys from each index in sorted order. */
+    for(i=0, pIdx=pTab->pIndex; pIdx; i++, pIdx=pIdx->pNext){
+      int nCol = pIdx->nColumn+1;
+      int regKey = sqlite3GetTempRange(pParse, nCol);
+      int j;
+      addrEnd = sqlite3VdbeAddOp1(v, OP_Rewind, iEph+i);
+      for(j=0; j<nCol; j++){
+        sqlite3VdbeAddOp3(v, OP_Column, iEph+i, j, regKey+j);
+      }
+      sqlite3VdbeAddOp3(v, OP_IdxDelete, iCur+i+1, regKey, nCol);
+      sqlite3VdbeAddOp2(v, OP_Next, iEph+i, addrEnd+1);
+      sqlite3VdbeJumpHere(v, addrEnd);
+      sqlite3VdbeAddOp1(v, OP_Close, iEph+i);
+      sqlite3ReleaseTempRange(pParse, regKey, nCol);
+    }
+  }
+
+  /* Delete the rows from the table. */
+  sqlite3VdbeAddOp3(v, OP_DeleteRange, iCur, regBound, 
+                    (pParse->nested ? 0 : memCnt));
+  if( !pParse->nested ){
+    sqlite3VdbeChangeP4(v, -1, pTab->zName, P4_STATIC);
+  }
+  sqlite3VdbeChangeP5(v, flags);
+
+  for(i=1, pIdx=pTab->pIndex; pIdx; i++, pIdx=pIdx->pNext){
+    sqlite3VdbeAddOp2(v, OP_Close, iCur + i, pIdx->tnum);
+  }
+  sqlite3VdbeAddOp1(v, OP_Close, iCur);
+}
+
 /*
 ** Generate code for a DELETE FROM statement.
 **
@@ -230,6 +399,8 @@ void sqlite3DeleteFrom(
   int iDb;               /* Database number */
   int memCnt = -1;       /* Memory cell used for change counting */
   int rcauth;            /* Value returned by authorization callback */
+  Expr *apBound[2];      /* Bounds of a rowid range, if any */
+  u8 rangeFlags = 0;     /* Exclusive bounds of the rowid range */
 
 #ifndef SQLITE_OMIT_TRIGGER
   int isView;                  /* True if attempting to delete from a view */
@@ -237,6 +408,7 @@ void sqlite3DeleteFrom(
 #endif
 
   memset(&sContext, 0, sizeof(sContext));
+  apBound[0] = apBound[1] = 0;
   db = pParse->db;
   if( pParse->nErr || db->mallocFailed ){
     goto delete_from_cleanup;
@@ -351,6 +523,15 @@ void sqlite3DeleteFrom(
     }
   }else
 #endif /* SQLITE_OMIT_TRUNCATE_OPTIMIZATION */
+  /* Special case: The WHERE clause selects a range of rowids, as in
+  ** "DELETE FROM t1 WHERE rowid<?". The rows are deleted a sub-tree at a
+  ** time instead of one at a time.  */
+  if( rcauth==SQLITE_OK && !pTrigger && !isView && !IsVirtual(pTab)
+   && 0==sqlite3FkRequired(pParse, pTab, 0, 0)
+   && findRowidRange(pWhere, iCur, apBound, &rangeFlags)
+  ){
+    deleteRowidRange(pParse, pTab, iCur, apBound, rangeFlags, memCnt);
+  }else
   /* The usual case: There is a WHERE clause so we have to scan through
   ** the table and pick which records to delete.
   */
@@ -317,6 +317,99 @@ void sqlite3AutoincrementEnd(Parse *pParse){
 #endif /* SQLITE_OMIT_AUTOINCREMENT */
 
 
+/*
+** Append the expression list pRow to the ValueList.  Create a new ValueList
+** if need be.
+**
+** A new ValueList is returned, or NULL if malloc() fails.  pRow is always
+** either added to the list or deleted.
+*/
+ValueList *sqlite3ValueListAppend(sqlite3 *db, ValueList *p, ExprList *pRow){
+  int i;
+  if( p==0 ){
+    p = sqlite3DbMallocZero(db, sizeof(ValueList));
+    if( p==0 ){
+      sqlite3ExprListDelete(db, pRow);
+      return 0;
+    }
+  }
+  p->a = sqlite3ArrayAllocate(
+      db,
+      p->a,
+      sizeof(p->a[0]),
+      4,
+      &p->nRow,
+      &p->nAlloc,
+      &i
+  );
+  if( i<0 ){
+    sqlite3ExprListDelete(db, pRow);
+    sqlite3ValueListDelete(db, p);
+    return 0;
+  }
+  p->a[i] = pRow;
+  return p;
+}
+
+/*
+** Delete a ValueList and all of the expression lists it contains.
+*/
+void sqlite3ValueListDelete(sqlite3 *db, ValueList *p){
+  int i;
+  if( p==0 ) return;
+  for(i=0; i<p->nRow; i++){
+    sqlite3ExprListDelete(db, p->a[i]);
+  }
+  sqlite3DbFree(db, p->a);
+  sqlite3DbFree(db, p);
+}
+
+/*
+** Generate the body of a co-routine that delivers the rows of the
+** multi-row VALUES clause pValues.  On each invocation the co-routine
+** evaluates the expressions of one row into registers
+** pDest->iMem..pDest->iMem+pDest->nMem-1 and then yields.  Every row is
+** coded as a straight sequence of register loads, so the cost of the
+** statement grows only with the number of values it contains.
+**
+** Return the number of errors.
+*/
+static int valuesCoroutine(
+  Parse *pParse,        /* Parser context */
+  ValueList *pValues,   /* The rows of the VALUES clause */
+  SelectDest *pDest     /* Co-routine destination.  iMem and nMem are set */
+){
+  Vdbe *v = pParse->pVdbe;
+  int nExpr = pValues->a[0]->nExpr;
+  NameContext sNC;
+  int i, j;
+
+  memset(&sNC, 0, sizeof(sNC));
+  sNC.pParse = pParse;
+  for(i=0; i<pValues->nRow; i++){
+    ExprList *pRow = pValues->a[i];
+    if( pRow->nExpr!=nExpr ){
+      sqlite3ErrorMsg(pParse, "all VALUES must have the same number of terms");
+      return 1;
+    }
+    for(j=0; j<nExpr; j++){
+      if( sqlite3ResolveExprNames(&sNC, pRow->a[j].pExpr) ) return 1;
+    }
+  }
+
+  pDest->iMem = pParse->nMem+1;
+  pDest->nMem = nExpr;
+  pParse->nMem += nExpr;
+  for(i=0; i<pValues->nRow; i++){
+    ExprList *pRow = pValues->a[i];
+    for(j=0; j<nExpr; j++){
+      sqlite3ExprCode(pParse, pRow->a[j].pExpr, pDest->iMem+j);
+    }
+    sqlite3VdbeAddOp1(v, OP_Yield, pDest->iParm);
+  }
+  return pParse->nErr;
+}
+
 /* Forward declaration */
 static int xferOptimization(
   Parse *pParse,        /* Parser context */
@@ -329,17 +422,18 @@ static int xferOptimization(
 /*
 ** This routine is call to handle SQL of the following forms:
 **
-**    insert into TABLE (IDLIST) values(EXPRLIST)
+**    insert into TABLE (IDLIST) values(EXPRLIST),(EXPRLIST),...
 **    insert into TABLE (IDLIST) select
 **
 ** The IDLIST following the table name is always optional.  If omitted,
 ** then a list of all columns for the table is substituted.  The IDLIST
 ** appears in the pColumn parameter.  pColumn is NULL if IDLIST is omitted.
 **
-** The pList parameter holds EXPRLIST in the first form of the INSERT
-** statement above, and pSelect is NULL.  For the second form, pList is
-** NULL and pSelect is a pointer to the select statement used to generate
-** data for the insert.
+** For the first form of the INSERT statement above, the rows of the
+** VALUES clause are passed either in pValues, or, if there is only a
+** single row, as the EXPRLIST in pList.  pSelect is NULL.  For the second
+** form, pList and pValues are NULL and pSelect is a pointer to the select
+** statement used to generate data for the insert.
 **
 ** The code generated follows one of four templates.  For a simple
 ** select with data coming from a VALUES clause, the code executes
@@ -355,6 +449,10 @@ static int xferOptimization(
 **
 **   INSERT INTO <table> SELECT ...
 **
+** A VALUES clause with more than one row uses the 3rd or 4th template,
+** with a co-routine that loads each row in turn in place of the SELECT.
+** See valuesCoroutine() for details.
+**
 ** If the SELECT clause is of the restricted form "SELECT * FROM <table2>" -
 ** in other words if the SELECT pulls all columns from a single table
 ** and there is no WHERE or LIMIT or GROUP BY or ORDER BY clauses, and
@@ -433,6 +531,7 @@ void sqlite3Insert(
   SrcList *pTabList,    /* Name of table into which we are inserting */
   ExprList *pList,      /* List of values to be inserted */
   Select *pSelect,      /* A SELECT statement to use as the data source */
+  ValueList *pValues,   /* Rows of a VALUES clause */
   IdList *pColumn,      /* Column names corresponding to IDLIST. */
   int onError           /* How to handle constraint errors */
 ){
@@ -481,6 +580,16 @@ void sqlite3Insert(
     goto insert_cleanup;
   }
 
+  /* A VALUES clause with a single row is coded using the 1st template.
+  */
+  if( pValues && pValues->nRow==1 ){
+    assert( pList==0 && pSelect==0 );
+    pList = pValues->a[0];
+    pValues->nRow = 0;
+    sqlite3ValueListDelete(db, pValues);
+    pValues = 0;
+  }
+
   /* Locate the table into which we will be inserting new information.
   */
   assert( pTabList->nSrc==1 );
@@ -536,7 +645,7 @@ void sqlite3Insert(
   v = sqlite3GetVdbe(pParse);
   if( v==0 ) goto insert_cleanup;
   if( pParse->nested==0 ) sqlite3VdbeCountChanges(v);
-  sqlite3BeginWriteOperation(pParse, pSelect || pTrigger, iDb);
+  sqlite3BeginWriteOperation(pParse, pSelect || pValues || pTrigger, iDb);
 
 #ifndef SQLITE_OMIT_XFER_OPT
   /* If the statement is of the form
@@ -561,14 +670,15 @@ void sqlite3Insert(
   regAutoinc = autoIncBegin(pParse, iDb, pTab);
 
   /* Figure out how many columns of data are supplied.  If the data
-  ** is coming from a SELECT statement, then generate a co-routine that
-  ** produces a single row of the SELECT on each invocation.  The
-  ** co-routine is the common header to the 3rd and 4th templates.
+  ** is coming from a SELECT statement or a multi-row VALUES clause, then
+  ** generate a co-routine that produces a single row of the SELECT on
+  ** each invocation.  The co-routine is the common header to the 3rd and
+  ** 4th templates.
   */
-  if( pSelect ){
-    /* Data is coming from a SELECT.  Generate code to implement that SELECT
-    ** as a co-routine.  The code is common to both the 3rd and 4th
-    ** templates:
+  if( pSelect || pValues ){
+    /* Data is coming from a SELECT or a multi-row VALUES clause.  Generate
+    ** code to implement that SELECT or VALUES clause as a co-routine.  The
+    ** code is common to both the 3rd and 4th templates:
     **
     **         EOF <- 0
     **         X <- A
@@ -599,8 +709,13 @@ void sqlite3Insert(
     j1 = sqlite3VdbeAddOp2(v, OP_Goto, 0, 0);
     VdbeComment((v, "Jump over SELECT coroutine"));
 
-    /* Resolve the expressions in the SELECT statement and execute it. */
-    rc = sqlite3Select(pParse, pSelect, &dest);
+    /* Resolve the expressions in the SELECT statement or VALUES clause
+    ** and code the body of the co-routine. */
+    if( pSelect ){
+      rc = sqlite3Select(pParse, pSelect, &dest);
+    }else{
+      rc = valuesCoroutine(pParse, pValues, &dest);
+    }
     assert( pParse->nErr==0 || rc );
     if( rc || NEVER(pParse->nErr) || db->mallocFailed ){
       goto insert_cleanup;
@@ -612,9 +727,8 @@ void sqlite3Insert(
     sqlite3VdbeJumpHere(v, j1);                          /* label B: */
 
     regFromSelect = dest.iMem;
-    assert( pSelect->pEList );
-    nColumn = pSelect->pEList->nExpr;
-    assert( dest.nMem==nColumn );
+    nColumn = dest.nMem;
+    assert( pSelect==0 || nColumn==pSelect->pEList->nExpr );
 
     /* Set useTempTable to TRUE if the result of the SELECT statement
     ** should be written into a temporary table (template 4).  Set to
@@ -777,7 +891,7 @@ void sqlite3Insert(
     */
     addrInsTop = sqlite3VdbeAddOp1(v, OP_Rewind, srcTab);
     addrCont = sqlite3VdbeCurrentAddr(v);
-  }else if( pSelect ){
+  }else if( pSelect || pValues ){
     /* This block codes the top of loop only.  The complete loop is the
     ** following pseudocode (template 3):
     **
@@ -822,7 +936,7 @@ void sqlite3Insert(
       if( useTempTable ){
         sqlite3VdbeAddOp3(v, OP_Column, srcTab, keyColumn, regCols);
       }else{
-        assert( pSelect==0 );  /* Otherwise useTempTable is true */
+        assert( pSelect==0 && pValues==0 ); /* Else useTempTable is true */
         sqlite3ExprCode(pParse, pList->a[keyColumn].pExpr, regCols);
       }
       j1 = sqlite3VdbeAddOp1(v, OP_NotNull, regCols);
@@ -851,7 +965,7 @@ void sqlite3Insert(
       }else if( useTempTable ){
         sqlite3VdbeAddOp3(v, OP_Column, srcTab, j, regCols+i+1); 
       }else{
-        assert( pSelect==0 ); /* Otherwise useTempTable is true */
+        assert( pSelect==0 && pValues==0 ); /* Else useTempTable is true */
         sqlite3ExprCodeAndCache(pParse, pList->a[j].pExpr, regCols+i+1);
       }
     }
@@ -886,7 +1000,7 @@ void sqlite3Insert(
     if( keyColumn>=0 ){
       if( useTempTable ){
         sqlite3VdbeAddOp3(v, OP_Column, srcTab, keyColumn, regRowid);
-      }else if( pSelect ){
+      }else if( pSelect || pValues ){
         sqlite3VdbeAddOp2(v, OP_SCopy, regFromSelect+keyColumn, regRowid);
       }else{
         VdbeOp *pOp;
@@ -954,7 +1068,7 @@ void sqlite3Insert(
         sqlite3ExprCode(pParse, pTab->aCol[i].pDflt, iRegStore);
       }else if( useTempTable ){
         sqlite3VdbeAddOp3(v, OP_Column, srcTab, j, iRegStore); 
-      }else if( pSelect ){
+      }else if( pSelect || pValues ){
         sqlite3VdbeAddOp2(v, OP_SCopy, regFromSelect+j, iRegStore);
       }else{
         sqlite3ExprCode(pParse, pList->a[j].pExpr, iRegStore);
@@ -997,14 +1111,14 @@ void sqlite3Insert(
   }
 
   /* The bottom of the main insertion loop, if the data source
-  ** is a SELECT statement.
+  ** is a SELECT statement or a multi-row VALUES clause.
   */
   sqlite3VdbeResolveLabel(v, endOfLoop);
   if( useTempTable ){
     sqlite3VdbeAddOp2(v, OP_Next, srcTab, addrCont);
     sqlite3VdbeJumpHere(v, addrInsTop);
     sqlite3VdbeAddOp1(v, OP_Close, srcTab);
-  }else if( pSelect ){
+  }else if( pSelect || pValues ){
     sqlite3VdbeAddOp2(v, OP_Goto, 0, addrCont);
     sqlite3VdbeJumpHere(v, addrInsTop);
   }
@@ -1041,6 +1155,7 @@ insert_cleanup:
   sqlite3SrcListDelete(db, pTabList);
   sqlite3ExprListDelete(db, pList);
   sqlite3SelectDelete(db, pSelect);
+  sqlite3ValueListDelete(db, pValues);
   sqlite3IdListDelete(db, pColumn);
   sqlite3DbFree(db, aRegIdx);
 }
@@ -79,6 +79,8 @@
 # define sqlite3_create_module 0
 # define sqlite3_create_module_v2 0
 # define sqlite3_declare_vtab 0
+# define sqlite3_tvp_create 0
+# define sqlite3_tvp_bind 0
 #endif
 
 #ifdef SQLITE_OMIT_SHARED_CACHE
@@ -367,6 +369,10 @@ static const sqlite3_api_routines sqlite3Apis = {
   0,
   0,
 #endif
+  sqlite3_bind_array,
+  sqlite3_step_array,
+  sqlite3_tvp_create,
+  sqlite3_tvp_bind,
 };
 
 /*
@@ -772,6 +772,7 @@ void sqlite3RollbackAll(sqlite3 *db){
   int inTrans = 0;
   assert( sqlite3_mutex_held(db->mutex) );
   sqlite3BeginBenignMalloc();
+  sqlite3VdbeCloseParkedCursors(db);
   for(i=0; i<db->nDb; i++){
     if( db->aDb[i].pBt ){
       if( sqlite3BtreeIsInTrans(db->aDb[i].pBt) ){
@@ -845,12 +846,18 @@ const char *sqlite3ErrStr(int rc){
 ** again until a timeout value is reached.  The timeout value is
 ** an integer number of milliseconds passed in as the first
 ** argument.
+**
+** Where possible, the sleep ends early as soon as another connection
+** in the same process releases a lock (see sqlite3LockWait()).  Because
+** of this, the time already spent waiting is measured using the clock
+** instead of being computed from the number of calls.
 */
 static int sqliteDefaultBusyCallback(
  void *ptr,               /* Database connection */
  int count                /* Number of times table has been busy */
 ){
-#if SQLITE_OS_WIN || (defined(HAVE_USLEEP) && HAVE_USLEEP)
+#if SQLITE_OS_WIN || (defined(HAVE_USLEEP) && HAVE_USLEEP) \
+ || defined(SQLITE_MUTEX_PTHREADS)
   static const u8 delays[] =
      { 1, 2, 5, 10, 15, 20, 25, 25,  25,  50,  50, 100 };
   static const u8 totals[] =
@@ -859,6 +866,7 @@ static int sqliteDefaultBusyCallback(
   sqlite3 *db = (sqlite3 *)ptr;
   int timeout = db->busyTimeout;
   int delay, prior;
+  sqlite3_int64 now;
 
   assert( count>=0 );
   if( count < NDELAY ){
@@ -868,11 +876,20 @@ static int sqliteDefaultBusyCallback(
     delay = delays[NDELAY-1];
     prior = totals[NDELAY-1] + delay*(count-(NDELAY-1));
   }
+  if( sqlite3OsCurrentTimeInt64(db->pVfs, &now)==SQLITE_OK ){
+    /* Count each call as at least 1ms, so that the loop still ends if
+    ** the clock does not advance. */
+    if( count==0 ) db->busyStart = now;
+    prior = (int)(now - db->busyStart);
+    if( prior<count ) prior = count;
+  }
   if( prior + delay > timeout ){
     delay = timeout - prior;
     if( delay<=0 ) return 0;
   }
-  sqlite3OsSleep(db->pVfs, delay*1000);
+  if( sqlite3LockWait(delay)==0 ){
+    sqlite3OsSleep(db->pVfs, delay*1000);
+  }
   return 1;
 #else
   sqlite3 *db = (sqlite3 *)ptr;
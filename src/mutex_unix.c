@@ -23,6 +23,7 @@
 #ifdef SQLITE_MUTEX_PTHREADS
 
 #include <pthread.h>
+#include <time.h>
 
 /*
 ** The sqlite3_mutex.id, sqlite3_mutex.nRef, and sqlite3_mutex.owner fields
@@ -348,4 +349,73 @@ sqlite3_mutex_methods const *sqlite3DefaultMutex(void){
   return &sMutex;
 }
 
+/*
+** The following implements a process-wide queue of threads waiting for
+** a database lock held by another connection in the same process.
+** Whenever a connection releases a lock on a database file or a WAL
+** file, it calls sqlite3LockWakeup(), which wakes every thread waiting
+** in sqlite3LockWait() so that it can retry its lock at once, rather
+** than at the end of a fixed sleep.
+**
+** Lock releases by other processes are not reported, so sqlite3LockWait()
+** always returns after at most the requested number of milliseconds.  A
+** release that occurs after a lock attempt has failed but before the
+** thread enters sqlite3LockWait() is also missed, with the same result.
+*/
+static pthread_mutex_t lockWaitMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t lockWaitCond = PTHREAD_COND_INITIALIZER;
+static volatile int nLockWaiter = 0;   /* Threads in sqlite3LockWait() */
+static unsigned int iLockWaitGen = 0;  /* Incremented by each wakeup */
+
+/*
+** The number of calls to sqlite3LockWait() that ended early because a
+** lock was released.  Used for testing only.
+*/
+#ifdef SQLITE_TEST
+int sqlite3_lockwait_wakeup_count = 0;
+#endif
+
+/*
+** Wake all threads waiting in sqlite3LockWait().  This is called often,
+** so the mutex is not taken unless there is at least one waiter.
+*/
+void sqlite3LockWakeup(void){
+  if( nLockWaiter>0 ){
+    pthread_mutex_lock(&lockWaitMutex);
+    iLockWaitGen++;
+    pthread_cond_broadcast(&lockWaitCond);
+    pthread_mutex_unlock(&lockWaitMutex);
+  }
+}
+
+/*
+** Block until another connection in this process releases a lock, or
+** until ms milliseconds have elapsed.  Return non-zero to indicate that
+** the wait took place.
+*/
+int sqlite3LockWait(int ms){
+  struct timespec ts;
+  unsigned int iGen;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += ms/1000;
+  ts.tv_nsec += (ms%1000)*1000000;
+  if( ts.tv_nsec>=1000000000 ){
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+  pthread_mutex_lock(&lockWaitMutex);
+  nLockWaiter++;
+  iGen = iLockWaitGen;
+  while( iGen==iLockWaitGen ){
+    if( pthread_cond_timedwait(&lockWaitCond, &lockWaitMutex, &ts) ) break;
+  }
+#ifdef SQLITE_TEST
+  if( iGen!=iLockWaitGen ) sqlite3_lockwait_wakeup_count++;
+#endif
+  nLockWaiter--;
+  pthread_mutex_unlock(&lockWaitMutex);
+  return 1;
+}
+
 #endif /* SQLITE_MUTEX_PTHREAD */
@@ -119,9 +119,23 @@
 #include <time.h>
 #include <sys/time.h>
 #include <errno.h>
-#ifndef SQLITE_OMIT_WAL
+#if !defined(SQLITE_OMIT_WAL) || (defined(HAVE_IO_URING) && HAVE_IO_URING)
 #include <sys/mman.h>
 #endif
+#if defined(HAVE_IO_URING) && HAVE_IO_URING
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+/*
+** Direct I/O (the "unix-direct" VFS) is available wherever the open()
+** flag O_DIRECT is, unless it is omitted at compile time.
+*/
+#if defined(O_DIRECT) && !defined(SQLITE_OMIT_DIRECT_IO)
+# define SQLITE_DIRECT_IO 1
+#else
+# define SQLITE_DIRECT_IO 0
+#endif
 
 #if SQLITE_ENABLE_LOCKING_STYLE
 # include <sys/ioctl.h>
@@ -181,6 +195,8 @@
 typedef struct unixShm unixShm;               /* Connection shared memory */
 typedef struct unixShmNode unixShmNode;       /* Shared memory instance */
 typedef struct unixInodeInfo unixInodeInfo;   /* An i-node */
+typedef struct unixUring unixUring;           /* An io_uring (Linux only) */
+typedef struct unixDirect unixDirect;         /* Buffers for O_DIRECT I/O */
 typedef struct UnixUnusedFd UnixUnusedFd;     /* An unused file descriptor */
 
 /*
@@ -213,6 +229,13 @@ struct unixFile {
   const char *zPath;                  /* Name of the file */
   unixShm *pShm;                      /* Shared memory segment information */
   int szChunk;                        /* Configured by FCNTL_CHUNK_SIZE */
+  i64 nAlloc;                         /* Bytes allocated, if szChunk>0 */
+#if defined(HAVE_IO_URING) && HAVE_IO_URING
+  unixUring *pUring;                  /* Batched I/O state ("unix-uring") */
+#endif
+#if SQLITE_DIRECT_IO
+  unixDirect *pDirect;                /* O_DIRECT state ("unix-direct") */
+#endif
 #if SQLITE_ENABLE_LOCKING_STYLE
   int openFlags;                      /* The flags specified at open() */
 #endif
@@ -247,6 +270,7 @@ struct unixFile {
 ** The following macros define bits in unixFile.fileFlags
 */
 #define SQLITE_WHOLE_FILE_LOCKING  0x0001   /* Use whole-file locking */
+#define SQLITE_URING_FAILED        0x0002   /* io_uring could not be set up */
 
 /*
 ** Include code that is common to all os_*.c files
@@ -2713,6 +2737,22 @@ static int seekAndWrite(unixFile *id, i64 offset, const void *pBuf, int cnt){
 }
 
 
+static int fcntlSizeHint(unixFile *pFile, i64 nByte);
+
+/*
+** If a chunk-size has been configured for file pFile, and a write that
+** ends at offset iEnd would take the file past the space allocated to it
+** so far, allocate another chunk (or more) first. Appends to a journal or
+** WAL file then only change its size once per chunk, so syncing it does
+** not usually require the file-system metadata to be written too.
+*/
+static int unixAllocateChunk(unixFile *pFile, i64 iEnd){
+  if( pFile->szChunk && iEnd>pFile->nAlloc ){
+    return fcntlSizeHint(pFile, iEnd);
+  }
+  return SQLITE_OK;
+}
+
 /*
 ** Write data from a buffer into a file.  Return SQLITE_OK on success
 ** or some other error code on failure.
@@ -2759,6 +2799,10 @@ static int unixWrite(
   }
 #endif
 
+  if( unixAllocateChunk(pFile, offset+amt)!=SQLITE_OK ){
+    /* Not fatal. Try to write the data anyway. */
+    pFile->lastErrno = 0;
+  }
   while( amt>0 && (wrote = seekAndWrite(pFile, offset, pBuf, amt))>0 ){
     amt -= wrote;
     offset += wrote;
@@ -2787,6 +2831,12 @@ static int unixWrite(
 */
 int sqlite3_sync_count = 0;
 int sqlite3_fullsync_count = 0;
+
+/*
+** The number of write() or pwrite() calls made on files opened with
+** O_DIRECT by the "unix-direct" VFS.
+*/
+int sqlite3_direct_write_count = 0;
 #endif
 
 /*
@@ -2903,6 +2953,46 @@ static int full_fsync(int fd, int fullSync, int dataOnly){
   return rc;
 }
 
+/*
+** If the directory containing file pFile has not yet been synced since
+** the file was created, sync it now and close the directory file
+** descriptor.  See unixSync() for why this is necessary.
+*/
+static int unixSyncDirectory(unixFile *pFile, int isFullsync){
+  int rc = SQLITE_OK;
+  if( pFile->dirfd>=0 ){
+    int err;
+    OSTRACE(("DIRSYNC %-3d (have_fullfsync=%d fullsync=%d)\n", pFile->dirfd,
+            HAVE_FULLFSYNC, isFullsync));
+#ifndef SQLITE_DISABLE_DIRSYNC
+    /* The directory sync is only attempted if full_fsync is
+    ** turned off or unavailable.  If a full_fsync occurred above,
+    ** then the directory sync is superfluous.
+    */
+    if( (!HAVE_FULLFSYNC || !isFullsync) && full_fsync(pFile->dirfd,0,0) ){
+       /*
+       ** We have received multiple reports of fsync() returning
+       ** errors when applied to directories on certain file systems.
+       ** A failed directory sync is not a big deal.  So it seems
+       ** better to ignore the error.  Ticket #1657
+       */
+       /* pFile->lastErrno = errno; */
+       /* return SQLITE_IOERR; */
+    }
+#else
+    UNUSED_PARAMETER(isFullsync);
+#endif
+    err = close(pFile->dirfd); /* Only need to sync once, so close the */
+    if( err==0 ){              /* directory when we are done */
+      pFile->dirfd = -1;
+    }else{
+      pFile->lastErrno = errno;
+      rc = SQLITE_IOERR_DIR_CLOSE;
+    }
+  }
+  return rc;
+}
+
 /*
 ** Make sure all writes to a particular file are committed to disk.
 **
@@ -2943,35 +3033,7 @@ static int unixSync(sqlite3_file *id, int flags){
     pFile->lastErrno = errno;
     return SQLITE_IOERR_FSYNC;
   }
-  if( pFile->dirfd>=0 ){
-    int err;
-    OSTRACE(("DIRSYNC %-3d (have_fullfsync=%d fullsync=%d)\n", pFile->dirfd,
-            HAVE_FULLFSYNC, isFullsync));
-#ifndef SQLITE_DISABLE_DIRSYNC
-    /* The directory sync is only attempted if full_fsync is
-    ** turned off or unavailable.  If a full_fsync occurred above,
-    ** then the directory sync is superfluous.
-    */
-    if( (!HAVE_FULLFSYNC || !isFullsync) && full_fsync(pFile->dirfd,0,0) ){
-       /*
-       ** We have received multiple reports of fsync() returning
-       ** errors when applied to directories on certain file systems.
-       ** A failed directory sync is not a big deal.  So it seems
-       ** better to ignore the error.  Ticket #1657
-       */
-       /* pFile->lastErrno = errno; */
-       /* return SQLITE_IOERR; */
-    }
-#endif
-    err = close(pFile->dirfd); /* Only need to sync once, so close the */
-    if( err==0 ){              /* directory when we are done */
-      pFile->dirfd = -1;
-    }else{
-      pFile->lastErrno = errno;
-      rc = SQLITE_IOERR_DIR_CLOSE;
-    }
-  }
-  return rc;
+  return unixSyncDirectory(pFile, isFullsync);
 }
 
 /*
@@ -2997,6 +3059,7 @@ static int unixTruncate(sqlite3_file *id, i64 nByte){
     pFile->lastErrno = errno;
     return SQLITE_IOERR_TRUNCATE;
   }else{
+    pFile->nAlloc = nByte;
 #ifndef NDEBUG
     /* If we are doing a normal write to a database file (as opposed to
     ** doing a hot-journal rollback or a write to some file other than a
@@ -3056,43 +3119,64 @@ static int proxyFileControl(sqlite3_file*,int,void*);
 ** If the user has configured a chunk-size for this file, it could be
 ** that the file needs to be extended at this point. Otherwise, the
 ** SQLITE_FCNTL_SIZE_HINT operation is a no-op for Unix.
+**
+** On Linux, the file is extended using fallocate(), which allocates real
+** blocks to it without writing them. Elsewhere, or if the file-system
+** does not support fallocate(), posix_fallocate() is used if available,
+** or failing that, blocks are allocated by writing a byte to each.
 */
 static int fcntlSizeHint(unixFile *pFile, i64 nByte){
   if( pFile->szChunk ){
     i64 nSize;                    /* Required file size */
     struct stat buf;              /* Used to hold return values of fstat() */
+    int bDone = 0;                /* True once the file has been extended */
    
     if( fstat(pFile->h, &buf) ) return SQLITE_IOERR_FSTAT;
 
     nSize = ((nByte+pFile->szChunk-1) / pFile->szChunk) * pFile->szChunk;
     if( nSize>(i64)buf.st_size ){
-#if defined(HAVE_POSIX_FALLOCATE) && HAVE_POSIX_FALLOCATE
-      if( posix_fallocate(pFile->h, buf.st_size, nSize-buf.st_size) ){
-        return SQLITE_IOERR_WRITE;
-      }
-#else
-      /* If the OS does not have posix_fallocate(), fake it. First use
-      ** ftruncate() to set the file size, then write a single byte to
-      ** the last byte in each block within the extended region. This
-      ** is the same technique used by glibc to implement posix_fallocate()
-      ** on systems that do not have a real fallocate() system call.
-      */
-      int nBlk = buf.st_blksize;  /* File-system block size */
-      i64 iWrite;                 /* Next offset to write to */
-      int nWrite;                 /* Return value from seekAndWrite() */
-
-      if( ftruncate(pFile->h, nSize) ){
+#if defined(FALLOC_FL_KEEP_SIZE)
+      int err;
+      do{
+        err = fallocate(pFile->h, 0, buf.st_size, nSize-buf.st_size);
+      }while( err && errno==EINTR );
+      if( err==0 ){
+        bDone = 1;
+      }else if( errno!=EOPNOTSUPP && errno!=ENOSYS ){
         pFile->lastErrno = errno;
-        return SQLITE_IOERR_TRUNCATE;
+        return (errno==ENOSPC ? SQLITE_FULL : SQLITE_IOERR_WRITE);
       }
-      iWrite = ((buf.st_size + 2*nBlk - 1)/nBlk)*nBlk-1;
-      do {
-        nWrite = seekAndWrite(pFile, iWrite, "", 1);
-        iWrite += nBlk;
-      } while( nWrite==1 && iWrite<nSize );
-      if( nWrite!=1 ) return SQLITE_IOERR_WRITE;
 #endif
+      if( !bDone ){
+#if defined(HAVE_POSIX_FALLOCATE) && HAVE_POSIX_FALLOCATE
+        if( posix_fallocate(pFile->h, buf.st_size, nSize-buf.st_size) ){
+          return SQLITE_IOERR_WRITE;
+        }
+#else
+        /* If the OS does not have posix_fallocate(), fake it. First use
+        ** ftruncate() to set the file size, then write a single byte to
+        ** the last byte in each block within the extended region. This
+        ** is the same technique used by glibc to implement posix_fallocate()
+        ** on systems that do not have a real fallocate() system call.
+        */
+        int nBlk = buf.st_blksize;  /* File-system block size */
+        i64 iWrite;                 /* Next offset to write to */
+        int nWrite;                 /* Return value from seekAndWrite() */
+
+        if( ftruncate(pFile->h, nSize) ){
+          pFile->lastErrno = errno;
+          return SQLITE_IOERR_TRUNCATE;
+        }
+        iWrite = ((buf.st_size + 2*nBlk - 1)/nBlk)*nBlk-1;
+        do {
+          nWrite = seekAndWrite(pFile, iWrite, "", 1);
+          iWrite += nBlk;
+        } while( nWrite==1 && iWrite<nSize );
+        if( nWrite!=1 ) return SQLITE_IOERR_WRITE;
+#endif
+      }
     }
+    pFile->nAlloc = (nSize>(i64)buf.st_size ? nSize : (i64)buf.st_size);
   }
 
   return SQLITE_OK;
@@ -3164,6 +3248,40 @@ static int unixDeviceCharacteristics(sqlite3_file *NotUsed){
 
 #ifndef SQLITE_OMIT_WAL
 
+/*
+** Where the system supports it, the regions of a wal-index are mapped at
+** consecutive addresses within a single range of address space, which
+** is reserved without being backed by memory or swap when the first
+** region is mapped. The kernel can then describe the whole wal-index with
+** a single mapping, and the WAL module can find a region by arithmetic
+** instead of by looking it up.
+**
+** SQLITE_SHM_RESERVE is the number of bytes of address space reserved
+** for each wal-index. Regions that do not fit, or all regions if the
+** reservation cannot be made, are mapped separately. Compile with
+** -DSQLITE_SHM_RESERVE=0 to always map regions separately.
+**
+** If SQLITE_ENABLE_SHM_HUGEPAGE is defined on a system that supports
+** madvise(MADV_HUGEPAGE), the reserved range is aligned to a huge page
+** boundary and the kernel is advised to back it with huge pages. This 
+** only has an effect if the shared-memory file is on a file-system that
+** supports huge pages, such as a tmpfs mount (see SQLITE_SHM_DIRECTORY).
+*/
+#if !defined(MAP_NORESERVE) || !defined(MAP_ANONYMOUS)
+# undef SQLITE_SHM_RESERVE
+# define SQLITE_SHM_RESERVE 0
+#elif !defined(SQLITE_SHM_RESERVE)
+# if defined(__LP64__) || defined(_LP64)
+#  define SQLITE_SHM_RESERVE (1<<28)
+# else
+#  define SQLITE_SHM_RESERVE (1<<23)
+# endif
+#endif
+#if defined(SQLITE_ENABLE_SHM_HUGEPAGE) && defined(MADV_HUGEPAGE)
+# define UNIX_SHM_HUGEPAGE_SZ (2*1024*1024)
+#else
+# define UNIX_SHM_HUGEPAGE_SZ 0
+#endif
 
 /*
 ** Object used to represent an shared memory buffer.  
@@ -3202,6 +3320,9 @@ struct unixShmNode {
   int szRegion;              /* Size of shared-memory regions */
   int nRegion;               /* Size of array apRegion */
   char **apRegion;           /* Array of mapped shared-memory regions */
+  char *pReserve;            /* Reserved address space, or NULL */
+  size_t szReserve;          /* Size of pReserve in bytes */
+  int nReserveRegion;        /* Regions that may be mapped in pReserve */
   int nRef;                  /* Number of unixShm objects pointing to this */
   unixShm *pFirst;           /* All unixShm objects pointing to this */
 #ifdef SQLITE_DEBUG
@@ -3328,7 +3449,12 @@ static void unixShmPurge(unixFile *pFd){
     assert( p->pInode==pFd->pInode );
     if( p->mutex ) sqlite3_mutex_free(p->mutex);
     for(i=0; i<p->nRegion; i++){
-      munmap(p->apRegion[i], p->szRegion);
+      if( p->pReserve==0 || i>=p->nReserveRegion ){
+        munmap(p->apRegion[i], p->szRegion);
+      }
+    }
+    if( p->pReserve ){
+      munmap(p->pReserve, p->szReserve);
     }
     sqlite3_free(p->apRegion);
     if( p->h>=0 ) close(p->h);
@@ -3478,6 +3604,40 @@ shm_open_err:
   return rc;
 }
 
+/*
+** Reserve SQLITE_SHM_RESERVE bytes of address space in which to map the
+** regions of shared-memory node pShmNode, each of which is szRegion bytes
+** in size. If the reservation cannot be made, leave pShmNode->pReserve
+** set to NULL. The regions are then mapped separately.
+*/
+static void unixShmReserve(unixShmNode *pShmNode, int szRegion){
+#if SQLITE_SHM_RESERVE>0
+  const size_t szAlign = UNIX_SHM_HUGEPAGE_SZ;
+  size_t nByte = (size_t)SQLITE_SHM_RESERVE;
+  char *p;
+
+  assert( pShmNode->pReserve==0 && pShmNode->nRegion==0 );
+  nByte -= nByte % szRegion;
+  if( nByte==0 ) return;
+  p = (char*)mmap(0, nByte+szAlign, PROT_NONE, 
+      MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0
+  );
+  if( p==MAP_FAILED ) return;
+  if( szAlign ){
+    char *pAligned = (char*)(((size_t)p + szAlign-1) & ~(szAlign-1));
+    if( pAligned>p ) munmap(p, pAligned-p);
+    if( pAligned<p+szAlign ) munmap(pAligned+nByte, p+szAlign-pAligned);
+    p = pAligned;
+  }
+  pShmNode->pReserve = p;
+  pShmNode->szReserve = nByte;
+  pShmNode->nReserveRegion = (int)(nByte/szRegion);
+#else
+  UNUSED_PARAMETER(pShmNode);
+  UNUSED_PARAMETER(szRegion);
+#endif
+}
+
 /*
 ** This function is called to obtain a pointer to region iRegion of the 
 ** shared-memory associated with the database file fd. Shared-memory regions 
@@ -3559,6 +3719,43 @@ static int unixShmMap(
       goto shmpage_out;
     }
     pShmNode->apRegion = apNew;
+    if( pShmNode->pReserve==0 && pShmNode->nRegion==0 ){
+      unixShmReserve(pShmNode, szRegion);
+    }
+
+    /* Map as many of the new regions as fit in the reserved address space
+    ** with a single call, directly after the regions already mapped. If
+    ** this fails, the part of the reservation it was to use may have been
+    ** unmapped. Reserve it again, and map this and any later regions
+    ** separately instead.
+    */
+    if( pShmNode->nRegion<pShmNode->nReserveRegion ){
+      int iLast = iRegion;
+      char *pStart = &pShmNode->pReserve[pShmNode->nRegion*szRegion];
+      size_t nByte;
+      void *pMem;
+      if( iLast>=pShmNode->nReserveRegion ) iLast = pShmNode->nReserveRegion-1;
+      nByte = (iLast+1-pShmNode->nRegion)*(size_t)szRegion;
+      pMem = mmap(pStart, nByte, PROT_READ|PROT_WRITE, 
+          MAP_SHARED|MAP_FIXED, pShmNode->h, pShmNode->nRegion*szRegion
+      );
+      if( pMem==MAP_FAILED ){
+        mmap(pStart, nByte, PROT_NONE, 
+            MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_FIXED, -1, 0
+        );
+        pShmNode->nReserveRegion = pShmNode->nRegion;
+      }else{
+#if UNIX_SHM_HUGEPAGE_SZ>0
+        madvise(pMem, nByte, MADV_HUGEPAGE);
+#endif
+        while(pShmNode->nRegion<=iLast){
+          pShmNode->apRegion[pShmNode->nRegion] = &pShmNode->pReserve[
+            pShmNode->nRegion*szRegion
+          ];
+          pShmNode->nRegion++;
+        }
+      }
+    }
     while(pShmNode->nRegion<=iRegion){
       void *pMem = mmap(0, szRegion, PROT_READ|PROT_WRITE, 
           MAP_SHARED, pShmNode->h, pShmNode->nRegion*szRegion
@@ -3765,146 +3962,1323 @@ static int unixShmUnmap(
 # define unixShmUnmap   0
 #endif /* #ifndef SQLITE_OMIT_WAL */
 
-/*
-** Here ends the implementation of all sqlite3_file methods.
-**
-********************** End sqlite3_file Methods *******************************
-******************************************************************************/
-
-/*
-** This division contains definitions of sqlite3_io_methods objects that
-** implement various file locking strategies.  It also contains definitions
-** of "finder" functions.  A finder-function is used to locate the appropriate
-** sqlite3_io_methods object for a particular database file.  The pAppData
-** field of the sqlite3_vfs VFS objects are initialized to be pointers to
-** the correct finder-function for that VFS.
-**
-** Most finder functions return a pointer to a fixed sqlite3_io_methods
-** object.  The only interesting finder-function is autolockIoFinder, which
-** looks at the filesystem type and tries to guess the best locking
-** strategy from that.
-**
-** For finder-funtion F, two objects are created:
-**
-**    (1) The real finder-function named "FImpt()".
-**
-**    (2) A constant pointer to this function named just "F".
-**
+#if defined(HAVE_IO_URING) && HAVE_IO_URING
+/******************************************************************************
+*************************** io_uring Batched I/O ******************************
 **
-** A pointer to the F pointer is used as the pAppData value for VFS
-** objects.  We have to do this instead of letting pAppData point
-** directly at the finder-function since C90 rules prevent a void*
-** from be cast into a function pointer.
+** The "unix-uring" VFS locks files in the same way as the default "unix"
+** VFS, but issues writes, syncs and large reads through a Linux io_uring
+** instead of making one pwrite() or pread() call at a time.
 **
+** SQLite brackets the writes it makes as a group - the dirty pages of a
+** commit, the frames appended to a write-ahead log and the pages copied
+** back by a checkpoint - with the SQLITE_FCNTL_BEGIN_BATCH and
+** SQLITE_FCNTL_END_BATCH file-controls. Inside a bracket, each write is
+** copied into a staging buffer and queued on the submission ring. An
+** xSync call queues an fsync behind the writes, flagged IOSQE_IO_DRAIN
+** so that it does not start until they have all completed, and then
+** submits everything with a single io_uring_enter() call. The writes
+** themselves are not ordered with respect to each other, so the kernel
+** may keep many of them in flight at once.
 **
-** Each instance of this macro generates two objects:
+** Every queued operation has completed by the time xSync, xRead or the
+** outermost SQLITE_FCNTL_END_BATCH returns. So the order in which writes
+** to different files reach the disk, which crash recovery depends on, is
+** the same as for the synchronous VFS.
 **
-**   *  A constant sqlite3_io_methods object call METHOD that has locking
-**      methods CLOSE, LOCK, UNLOCK, CKRESLOCK.
+** Reads larger than URING_READ_CHUNK bytes, such as those made by
+** sqlite3PagerReadRun(), are split into chunks and read concurrently.
 **
-**   *  An I/O method finder function called FINDER that returns a pointer
-**      to the METHOD object in the previous bullet.
+** The ring is created the first time it is needed. If it cannot be
+** created, for example because the kernel does not support io_uring, the
+** file quietly uses the synchronous routines above instead.
 */
-#define IOMETHODS(FINDER, METHOD, VERSION, CLOSE, LOCK, UNLOCK, CKLOCK)      \
-static const sqlite3_io_methods METHOD = {                                   \
-   VERSION,                    /* iVersion */                                \
-   CLOSE,                      /* xClose */                                  \
-   unixRead,                   /* xRead */                                   \
-   unixWrite,                  /* xWrite */                                  \
-   unixTruncate,               /* xTruncate */                               \
-   unixSync,                   /* xSync */                                   \
-   unixFileSize,               /* xFileSize */                               \
-   LOCK,                       /* xLock */                                   \
-   UNLOCK,                     /* xUnlock */                                 \
-   CKLOCK,                     /* xCheckReservedLock */                      \
-   unixFileControl,            /* xFileControl */                            \
-   unixSectorSize,             /* xSectorSize */                             \
-   unixDeviceCharacteristics,  /* xDeviceCapabilities */                     \
-   unixShmMap,                 /* xShmMap */                                 \
-   unixShmLock,                /* xShmLock */                                \
-   unixShmBarrier,             /* xShmBarrier */                             \
-   unixShmUnmap                /* xShmUnmap */                               \
-};                                                                           \
-static const sqlite3_io_methods *FINDER##Impl(const char *z, unixFile *p){   \
-  UNUSED_PARAMETER(z); UNUSED_PARAMETER(p);                                  \
-  return &METHOD;                                                            \
-}                                                                            \
-static const sqlite3_io_methods *(*const FINDER)(const char*,unixFile *p)    \
-    = FINDER##Impl;
 
 /*
-** Here are all of the sqlite3_io_methods objects for each of the
-** locking strategies.  Functions that return pointers to these methods
-** are also created.
+** Size of the submission ring. No more than this many operations are
+** ever outstanding at once.
 */
-IOMETHODS(
-  posixIoFinder,            /* Finder function name */
-  posixIoMethods,           /* sqlite3_io_methods object name */
-  2,                        /* shared memory is enabled */
-  unixClose,                /* xClose method */
-  unixLock,                 /* xLock method */
-  unixUnlock,               /* xUnlock method */
-  unixCheckReservedLock     /* xCheckReservedLock method */
-)
-IOMETHODS(
-  nolockIoFinder,           /* Finder function name */
-  nolockIoMethods,          /* sqlite3_io_methods object name */
-  1,                        /* shared memory is disabled */
-  nolockClose,              /* xClose method */
-  nolockLock,               /* xLock method */
-  nolockUnlock,             /* xUnlock method */
-  nolockCheckReservedLock   /* xCheckReservedLock method */
-)
-IOMETHODS(
-  dotlockIoFinder,          /* Finder function name */
-  dotlockIoMethods,         /* sqlite3_io_methods object name */
-  1,                        /* shared memory is disabled */
-  dotlockClose,             /* xClose method */
-  dotlockLock,              /* xLock method */
-  dotlockUnlock,            /* xUnlock method */
-  dotlockCheckReservedLock  /* xCheckReservedLock method */
-)
+#define URING_NENTRY 64
 
-#if SQLITE_ENABLE_LOCKING_STYLE && !OS_VXWORKS
-IOMETHODS(
-  flockIoFinder,            /* Finder function name */
-  flockIoMethods,           /* sqlite3_io_methods object name */
-  1,                        /* shared memory is disabled */
-  flockClose,               /* xClose method */
-  flockLock,                /* xLock method */
-  flockUnlock,              /* xUnlock method */
-  flockCheckReservedLock    /* xCheckReservedLock method */
-)
-#endif
+/*
+** The staging buffer starts out URING_MIN_STAGE bytes in size, and is
+** doubled each time it fills up, to a maximum of URING_MAX_STAGE bytes.
+*/
+#define URING_MIN_STAGE (64*1024)
+#define URING_MAX_STAGE (1024*1024)
 
-#if OS_VXWORKS
-IOMETHODS(
-  semIoFinder,              /* Finder function name */
-  semIoMethods,             /* sqlite3_io_methods object name */
-  1,                        /* shared memory is disabled */
-  semClose,                 /* xClose method */
-  semLock,                  /* xLock method */
-  semUnlock,                /* xUnlock method */
-  semCheckReservedLock      /* xCheckReservedLock method */
-)
-#endif
+/*
+** Reads larger than this are split into chunks of about this size.
+*/
+#define URING_READ_CHUNK (64*1024)
 
-#if defined(__APPLE__) && SQLITE_ENABLE_LOCKING_STYLE
-IOMETHODS(
-  afpIoFinder,              /* Finder function name */
-  afpIoMethods,             /* sqlite3_io_methods object name */
-  1,                        /* shared memory is disabled */
-  afpClose,                 /* xClose method */
-  afpLock,                  /* xLock method */
-  afpUnlock,                /* xUnlock method */
-  afpCheckReservedLock      /* xCheckReservedLock method */
-)
+#ifdef SQLITE_TEST
+/*
+** The number of io_uring_enter() calls made and the number of operations
+** submitted by them. Used by tests to check that I/O is being batched.
+*/
+int sqlite3_uring_enter_count = 0;
+int sqlite3_uring_op_count = 0;
 #endif
 
 /*
-** The proxy locking method is a "super-method" in the sense that it
-** opens secondary file descriptors for the conch and lock files and
-** it uses proxy, dot-file, AFP, and flock() locking methods on those
+** One operation queued on an io_uring.
+*/
+typedef struct UringOp UringOp;
+struct UringOp {
+  int eOp;                        /* IORING_OP_WRITE, _READ or _FSYNC */
+  int nByte;                      /* Bytes to write or read */
+  i64 iOff;                       /* Offset within the file */
+  char *aBuf;                     /* Buffer to write from or read into */
+  int res;                        /* Result from the completion entry */
+};
+
+/*
+** An instance of the following structure is allocated for each file
+** opened by the "unix-uring" VFS the first time that it is needed.
+**
+** Operations aOp[0..nOp-1] have been queued on the ring since it was
+** last idle. Of those, the first nSubmit have been passed to the kernel
+** and the completions of the first nDone have been reaped.
+*/
+struct unixUring {
+  int fd;                         /* Returned by io_uring_setup() */
+  unsigned *sqTail;               /* Tail of the submission ring */
+  unsigned sqMask;                /* Mask to apply to submission indexes */
+  unsigned *sqArray;              /* Array of SQE indexes */
+  struct io_uring_sqe *aSqe;      /* Submission queue entries */
+  unsigned *cqHead;               /* Head of the completion ring */
+  unsigned *cqTail;               /* Tail of the completion ring */
+  unsigned cqMask;                /* Mask to apply to completion indexes */
+  struct io_uring_cqe *aCqe;      /* Completion queue entries */
+  void *pSqMap;                   /* Mapping of the submission ring */
+  size_t szSqMap;                 /* Size of pSqMap in bytes */
+  void *pCqMap;                   /* Mapping of the completion ring */
+  size_t szCqMap;                 /* Size of pCqMap in bytes */
+  size_t szSqeMap;                /* Size of the mapping of aSqe[] */
+  int nBatch;                     /* Depth of nested BEGIN_BATCH calls */
+  int nOp;                        /* Operations queued since ring was idle */
+  int nSubmit;                    /* Operations passed to the kernel */
+  int nDone;                      /* Operations that have completed */
+  i64 iEnd;                       /* Largest iOff+nByte of queued writes */
+  char *aStage;                   /* Copies of data for queued writes */
+  int nStage;                     /* Size of aStage[] in bytes */
+  int iStage;                     /* Bytes of aStage[] in use */
+  UringOp aOp[URING_NENTRY];      /* Operations queued */
+};
+
+/*
+** Release all resources held by io_uring p.
+*/
+static void uringFree(unixUring *p){
+  if( p->aSqe ) munmap(p->aSqe, p->szSqeMap);
+  if( p->pCqMap && p->pCqMap!=p->pSqMap ) munmap(p->pCqMap, p->szCqMap);
+  if( p->pSqMap ) munmap(p->pSqMap, p->szSqMap);
+  if( p->fd>=0 ) close(p->fd);
+  sqlite3_free(p->aStage);
+  sqlite3_free(p);
+}
+
+/*
+** Map the region of io_uring fd at offset iOff into memory. Return a
+** pointer to the mapping, or NULL if it fails.
+*/
+static void *uringMap(int fd, size_t nByte, i64 iOff){
+  void *p = mmap(0, nByte, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                 fd, (off_t)iOff);
+  return (p==MAP_FAILED ? 0 : p);
+}
+
+/*
+** Make sure that file pFile has an io_uring. Return SQLITE_OK if it does,
+** or an error code if one cannot be created. The SQLITE_URING_FAILED flag
+** is set if the kernel refuses to create one, so that it is not asked
+** again.
+*/
+static int uringOpen(unixFile *pFile){
+  struct io_uring_params prm;
+  unixUring *p;
+  char *aStage;
+
+  if( pFile->pUring ) return SQLITE_OK;
+  if( pFile->fileFlags & SQLITE_URING_FAILED ) return SQLITE_ERROR;
+
+  sqlite3BeginBenignMalloc();
+  p = (unixUring*)sqlite3_malloc(sizeof(unixUring));
+  aStage = (char*)sqlite3_malloc(URING_MIN_STAGE);
+  sqlite3EndBenignMalloc();
+  if( p==0 || aStage==0 ){
+    sqlite3_free(p);
+    sqlite3_free(aStage);
+    return SQLITE_NOMEM;
+  }
+  memset(p, 0, sizeof(unixUring));
+  p->aStage = aStage;
+  p->nStage = URING_MIN_STAGE;
+
+  memset(&prm, 0, sizeof(prm));
+  p->fd = (int)syscall(__NR_io_uring_setup, URING_NENTRY, &prm);
+  if( p->fd>=0 ){
+    p->szSqMap = prm.sq_off.array + prm.sq_entries*sizeof(unsigned);
+    p->szCqMap = prm.cq_off.cqes + prm.cq_entries*sizeof(struct io_uring_cqe);
+    if( prm.features & IORING_FEAT_SINGLE_MMAP ){
+      if( p->szCqMap>p->szSqMap ) p->szSqMap = p->szCqMap;
+      p->pSqMap = p->pCqMap = uringMap(p->fd, p->szSqMap, IORING_OFF_SQ_RING);
+    }else{
+      p->pSqMap = uringMap(p->fd, p->szSqMap, IORING_OFF_SQ_RING);
+      p->pCqMap = uringMap(p->fd, p->szCqMap, IORING_OFF_CQ_RING);
+    }
+    p->szSqeMap = prm.sq_entries*sizeof(struct io_uring_sqe);
+    p->aSqe = (struct io_uring_sqe*)uringMap(
+        p->fd, p->szSqeMap, IORING_OFF_SQES
+    );
+  }
+  if( p->fd<0 || p->pSqMap==0 || p->pCqMap==0 || p->aSqe==0
+   || prm.sq_entries<URING_NENTRY || prm.cq_entries<URING_NENTRY
+  ){
+    pFile->fileFlags |= SQLITE_URING_FAILED;
+    uringFree(p);
+    return SQLITE_ERROR;
+  }
+
+  p->sqTail = (unsigned*)((char*)p->pSqMap + prm.sq_off.tail);
+  p->sqMask = *(unsigned*)((char*)p->pSqMap + prm.sq_off.ring_mask);
+  p->sqArray = (unsigned*)((char*)p->pSqMap + prm.sq_off.array);
+  p->cqHead = (unsigned*)((char*)p->pCqMap + prm.cq_off.head);
+  p->cqTail = (unsigned*)((char*)p->pCqMap + prm.cq_off.tail);
+  p->cqMask = *(unsigned*)((char*)p->pCqMap + prm.cq_off.ring_mask);
+  p->aCqe = (struct io_uring_cqe*)((char*)p->pCqMap + prm.cq_off.cqes);
+  pFile->pUring = p;
+  return SQLITE_OK;
+}
+
+/*
+** Add an operation to the submission ring of io_uring p. The caller must
+** make sure that there is room for it.
+*/
+static void uringQueue(
+  unixUring *p,                   /* io_uring to queue operation on */
+  int h,                          /* File descriptor to operate on */
+  int eOp,                        /* IORING_OP_WRITE, _READ or _FSYNC */
+  int flags,                      /* IOSQE_* flags */
+  char *aBuf,                     /* Buffer to write from or read into */
+  int nByte,                      /* Bytes to write or read */
+  i64 iOff                        /* File offset */
+){
+  unsigned iTail = *p->sqTail;
+  unsigned iSqe = iTail & p->sqMask;
+  struct io_uring_sqe *pSqe = &p->aSqe[iSqe];
+  UringOp *pOp = &p->aOp[p->nOp];
+
+  assert( p->nOp<URING_NENTRY );
+  memset(pSqe, 0, sizeof(*pSqe));
+  pSqe->opcode = (u8)eOp;
+  pSqe->flags = (u8)flags;
+  pSqe->fd = h;
+  if( eOp==IORING_OP_FSYNC ){
+    pSqe->fsync_flags = IORING_FSYNC_DATASYNC;
+  }else{
+    pSqe->off = (u64)iOff;
+    pSqe->addr = (u64)(size_t)aBuf;
+    pSqe->len = (u32)nByte;
+  }
+  pSqe->user_data = (u64)p->nOp;
+  p->sqArray[iSqe] = iSqe;
+  __atomic_store_n(p->sqTail, iTail+1, __ATOMIC_RELEASE);
+
+  pOp->eOp = eOp;
+  pOp->nByte = nByte;
+  pOp->iOff = iOff;
+  pOp->aBuf = aBuf;
+  pOp->res = -ECANCELED;
+  p->nOp++;
+}
+
+/*
+** Pass the operations queued on the ring of pFile to the kernel. If
+** bWait is true, also wait until all of them have completed.
+**
+** If the kernel rejects operations that have been queued, they are
+** withdrawn from the ring and left with a result of -ECANCELED, so that
+** uringWait() completes them synchronously.
+*/
+static void uringEnter(unixFile *pFile, int bWait){
+  unixUring *p = pFile->pUring;
+  while( p->nSubmit<p->nOp || (bWait && p->nDone<p->nOp) ){
+    unsigned nSubmit = (unsigned)(p->nOp - p->nSubmit);
+    unsigned nMin = bWait ? (unsigned)(p->nOp - p->nDone) : 0;
+    unsigned iHead;
+    unsigned iTail;
+    int n;
+
+    n = (int)syscall(__NR_io_uring_enter, p->fd, nSubmit, nMin,
+                     (bWait ? IORING_ENTER_GETEVENTS : 0), 0, 0);
+#ifdef SQLITE_TEST
+    sqlite3_uring_enter_count++;
+    if( n>0 ) sqlite3_uring_op_count += n;
+#endif
+    if( n<0 ){
+      if( errno==EINTR || errno==EAGAIN || errno==EBUSY ) continue;
+      if( nSubmit>0 ){
+        /* The kernel did not consume any of the new entries. Withdraw
+        ** them, leaving res set to -ECANCELED. */
+        __atomic_store_n(p->sqTail, *p->sqTail - nSubmit, __ATOMIC_RELEASE);
+        p->nSubmit += nSubmit;
+        p->nDone += nSubmit;
+        continue;
+      }
+      /* Waiting for completions failed. This should never happen. */
+      pFile->lastErrno = errno;
+      break;
+    }
+    p->nSubmit += n;
+
+    /* Reap any completions. */
+    iHead = *p->cqHead;
+    iTail = __atomic_load_n(p->cqTail, __ATOMIC_ACQUIRE);
+    while( iHead!=iTail ){
+      struct io_uring_cqe *pCqe = &p->aCqe[iHead & p->cqMask];
+      assert( pCqe->user_data<(u64)URING_NENTRY );
+      p->aOp[pCqe->user_data].res = pCqe->res;
+      p->nDone++;
+      iHead++;
+    }
+    __atomic_store_n(p->cqHead, iHead, __ATOMIC_RELEASE);
+  }
+}
+
+/*
+** Called by uringWait() for each write once the kernel has finished with
+** it. If only part of the data was written, or none of it, write the rest
+** synchronously and set *pbResync. Return SQLITE_OK if all of the data
+** has been written, or an error code otherwise.
+*/
+static int uringFinishWrite(unixFile *pFile, UringOp *pOp, int *pbResync){
+  int nDone = pOp->res;           /* Bytes written by the kernel */
+  int wrote = 0;                  /* Return value from seekAndWrite() */
+
+  if( nDone==pOp->nByte ) return SQLITE_OK;
+  if( nDone<0 && nDone!=-ECANCELED ){
+    pFile->lastErrno = -nDone;
+    return (nDone==-ENOSPC ? SQLITE_FULL : SQLITE_IOERR_WRITE);
+  }
+  if( nDone<0 ) nDone = 0;
+  *pbResync = 1;
+  while( nDone<pOp->nByte && (wrote = seekAndWrite(pFile, pOp->iOff+nDone,
+             &pOp->aBuf[nDone], pOp->nByte-nDone))>0 ){
+    nDone += wrote;
+  }
+  if( nDone<pOp->nByte ){
+    if( wrote<0 ){
+      /* lastErrno set by seekAndWrite */
+      return SQLITE_IOERR_WRITE;
+    }
+    pFile->lastErrno = 0; /* not a system error */
+    return SQLITE_FULL;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Mark the io_uring p as idle, with no operations queued.
+*/
+static void uringReset(unixUring *p){
+  p->nOp = p->nSubmit = p->nDone = 0;
+  p->iStage = 0;
+  p->iEnd = 0;
+}
+
+/*
+** Submit any writes and syncs queued on the io_uring of file pFile and
+** wait for all of them to complete. Return SQLITE_OK if they all
+** succeeded, or an error code otherwise. All of the writes are attempted
+** even if an error occurs.
+*/
+static int uringWait(unixFile *pFile){
+  unixUring *p = pFile->pUring;
+  int rc = SQLITE_OK;
+  int bResync = 0;                /* True if a write was finished by hand */
+  int i;
+
+  if( p==0 || p->nOp==0 ) return SQLITE_OK;
+  uringEnter(pFile, 1);
+  for(i=0; i<p->nOp; i++){
+    UringOp *pOp = &p->aOp[i];
+    int rc2 = SQLITE_OK;
+    assert( pOp->eOp!=IORING_OP_READ );
+    if( pOp->eOp==IORING_OP_WRITE ){
+      rc2 = uringFinishWrite(pFile, pOp, &bResync);
+    }else{
+      /* If the kernel did not run the sync, or if some of the writes that
+      ** precede it were finished synchronously, sync the file now. */
+      if( pOp->res==-ECANCELED || (pOp->res==0 && bResync) ){
+        pOp->res = fdatasync(pFile->h) ? -errno : 0;
+      }
+      if( pOp->res<0 ){
+        pFile->lastErrno = -pOp->res;
+        rc2 = SQLITE_IOERR_FSYNC;
+      }
+    }
+    if( rc==SQLITE_OK ) rc = rc2;
+  }
+  uringReset(p);
+  return rc;
+}
+
+/*
+** Write data to a file opened by the "unix-uring" VFS.
+**
+** Outside of a batch this is the same as unixWrite(). Inside one, the
+** data is copied into the staging buffer and the write is queued. It is
+** submitted to the kernel along with the writes that follow it.
+*/
+static int uringWrite(
+  sqlite3_file *id,
+  const void *pBuf,
+  int amt,
+  sqlite3_int64 offset
+){
+  unixFile *pFile = (unixFile*)id;
+  unixUring *p = pFile->pUring;
+  int bSync = 0;                  /* True to write synchronously */
+  int rc;
+  int i;
+
+  assert( amt>0 );
+  if( p==0 || p->nBatch==0 ){
+    return unixWrite(id, pBuf, amt, offset);
+  }
+
+#ifndef NDEBUG
+  /* A write that may change the transaction counter is made synchronously
+  ** so that unixWrite() can check whether or not it did. */
+  bSync = (pFile->inNormalWrite && offset<=24 && offset+amt>=27);
+#endif
+  if( bSync || amt>URING_MAX_STAGE ){
+    rc = uringWait(pFile);
+    if( rc==SQLITE_OK ){
+      rc = unixWrite(id, pBuf, amt, offset);
+    }
+    return rc;
+  }
+
+  /* Queued writes may complete in any order, so if this one overlaps a
+  ** write that is already queued, wait for that one to finish first. Also
+  ** wait if the ring or the staging buffer is full. In the latter case,
+  ** try to make the staging buffer larger.
+  */
+  for(i=0; i<p->nOp; i++){
+    UringOp *pOp = &p->aOp[i];
+    if( offset<pOp->iOff+pOp->nByte && pOp->iOff<offset+amt ) break;
+  }
+  if( i<p->nOp || p->nOp==URING_NENTRY || p->iStage+amt>p->nStage ){
+    int bFull = (p->iStage+amt>p->nStage);
+    rc = uringWait(pFile);
+    if( rc!=SQLITE_OK ) return rc;
+    while( bFull && p->nStage<URING_MAX_STAGE ){
+      char *aNew;
+      sqlite3BeginBenignMalloc();
+      aNew = (char*)sqlite3_realloc(p->aStage, p->nStage*2);
+      sqlite3EndBenignMalloc();
+      if( aNew==0 ) break;
+      p->aStage = aNew;
+      p->nStage = p->nStage*2;
+      bFull = (amt>p->nStage);
+    }
+    if( amt>p->nStage ){
+      return unixWrite(id, pBuf, amt, offset);
+    }
+  }
+
+  SimulateIOError( return SQLITE_IOERR_WRITE );
+  SimulateDiskfullError( return SQLITE_FULL );
+
+  /* As in unixWrite(), a failure to allocate space is not fatal. */
+  if( unixAllocateChunk(pFile, offset+amt)!=SQLITE_OK ){
+    pFile->lastErrno = 0;
+  }
+  memcpy(&p->aStage[p->iStage], pBuf, amt);
+  uringQueue(p, pFile->h, IORING_OP_WRITE, 0, &p->aStage[p->iStage],
+             amt, offset);
+  p->iStage += amt;
+  if( offset+amt>p->iEnd ) p->iEnd = offset+amt;
+#ifndef NDEBUG
+  if( pFile->inNormalWrite ){
+    pFile->dbUpdate = 1;  /* The database has been modified */
+  }
+#endif
+
+  /* Once a quarter of the ring has been queued, start the kernel working
+  ** on it while the rest of the batch is prepared. */
+  if( p->nOp-p->nSubmit>=URING_NENTRY/4 ){
+    uringEnter(pFile, 0);
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Read data from a file opened by the "unix-uring" VFS. Any queued writes
+** are finished first. Reads larger than URING_READ_CHUNK bytes are split
+** into chunks that are read concurrently. Smaller reads are passed to
+** unixRead().
+*/
+static int uringRead(
+  sqlite3_file *id,
+  void *pBuf,
+  int amt,
+  sqlite3_int64 offset
+){
+  unixFile *pFile = (unixFile*)id;
+  unixUring *p;
+  int szChunk;                    /* Bytes read by each operation */
+  int iOff;                       /* Offset of a chunk within pBuf */
+  int rc;
+  int i;
+
+  rc = uringWait(pFile);
+  if( rc!=SQLITE_OK ) return rc;
+  if( amt<=URING_READ_CHUNK || uringOpen(pFile)!=SQLITE_OK ){
+    return unixRead(id, pBuf, amt, offset);
+  }
+  SimulateIOError( return SQLITE_IOERR_READ );
+
+  p = pFile->pUring;
+  szChunk = (amt+URING_NENTRY-1)/URING_NENTRY;
+  if( szChunk<URING_READ_CHUNK ) szChunk = URING_READ_CHUNK;
+  szChunk = (szChunk+4095) & ~4095;
+  for(iOff=0; iOff<amt; iOff+=szChunk){
+    int nByte = (amt-iOff<szChunk ? amt-iOff : szChunk);
+    uringQueue(p, pFile->h, IORING_OP_READ, 0, &((char*)pBuf)[iOff],
+               nByte, offset+iOff);
+  }
+  uringEnter(pFile, 1);
+
+  for(i=0; i<p->nOp; i++){
+    UringOp *pOp = &p->aOp[i];
+    int rc2 = SQLITE_OK;
+    if( pOp->res<0 && pOp->res!=-ECANCELED ){
+      pFile->lastErrno = -pOp->res;
+      rc2 = SQLITE_IOERR_READ;
+    }else if( pOp->res!=pOp->nByte ){
+      /* Read the rest of the chunk synchronously. If it lies beyond the
+      ** end of the file, this also zeroes it. */
+      int nDone = (pOp->res<0 ? 0 : pOp->res);
+      rc2 = unixRead(id, &pOp->aBuf[nDone], pOp->nByte-nDone, pOp->iOff+nDone);
+    }
+    if( rc2!=SQLITE_OK && (rc==SQLITE_OK || rc==SQLITE_IOERR_SHORT_READ) ){
+      rc = rc2;
+    }
+  }
+  uringReset(p);
+  return rc;
+}
+
+/*
+** Sync a file opened by the "unix-uring" VFS. If there are writes queued,
+** an fsync is queued behind them and submitted along with them.
+*/
+static int uringSync(sqlite3_file *id, int flags){
+  unixFile *pFile = (unixFile*)id;
+  unixUring *p = pFile->pUring;
+  int isFullsync = (flags&0x0F)==SQLITE_SYNC_FULL;
+  int rc;
+
+  if( p==0 || p->nOp==0 ){
+    return unixSync(id, flags);
+  }
+
+  /* Check that one of SQLITE_SYNC_NORMAL or FULL was passed */
+  assert((flags&0x0F)==SQLITE_SYNC_NORMAL
+      || (flags&0x0F)==SQLITE_SYNC_FULL
+  );
+  SimulateDiskfullError( return SQLITE_FULL );
+  OSTRACE(("SYNC    %-3d\n", pFile->h));
+
+#ifdef SQLITE_TEST
+  if( isFullsync ) sqlite3_fullsync_count++;
+  sqlite3_sync_count++;
+#endif
+#ifndef SQLITE_NO_SYNC
+  if( p->nOp==URING_NENTRY ){
+    rc = uringWait(pFile);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  uringQueue(p, pFile->h, IORING_OP_FSYNC, IOSQE_IO_DRAIN, 0, 0, 0);
+#endif
+  rc = uringWait(pFile);
+  SimulateIOError( rc=SQLITE_IOERR_FSYNC );
+  if( rc!=SQLITE_OK ){
+    return rc;
+  }
+  return unixSyncDirectory(pFile, isFullsync);
+}
+
+/*
+** Truncate a file opened by the "unix-uring" VFS. Queued writes that
+** extend past the new end of the file are finished first.
+*/
+static int uringTruncate(sqlite3_file *id, i64 nByte){
+  unixFile *pFile = (unixFile*)id;
+  if( pFile->pUring && pFile->pUring->iEnd>nByte ){
+    int rc = uringWait(pFile);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  return unixTruncate(id, nByte);
+}
+
+/*
+** Determine the size of a file opened by the "unix-uring" VFS, including
+** any writes that are queued but not yet complete.
+*/
+static int uringFileSize(sqlite3_file *id, i64 *pSize){
+  unixUring *p = ((unixFile*)id)->pUring;
+  int rc = unixFileSize(id, pSize);
+  if( rc==SQLITE_OK && p && p->iEnd>*pSize ){
+    *pSize = p->iEnd;
+  }
+  return rc;
+}
+
+/*
+** Information and control of a file opened by the "unix-uring" VFS.
+** Queued writes are finished before any file-control other than the
+** ones that only report on the state of the file handle.
+*/
+static int uringFileControl(sqlite3_file *id, int op, void *pArg){
+  unixFile *pFile = (unixFile*)id;
+  switch( op ){
+    case SQLITE_FCNTL_BEGIN_BATCH: {
+      int rc = uringOpen(pFile);
+      if( rc==SQLITE_OK ){
+        pFile->pUring->nBatch++;
+      }
+      return rc;
+    }
+    case SQLITE_FCNTL_END_BATCH: {
+      unixUring *p = pFile->pUring;
+      assert( p && p->nBatch>0 );
+      p->nBatch--;
+      return (p->nBatch ? SQLITE_OK : uringWait(pFile));
+    }
+    case SQLITE_FCNTL_LOCKSTATE:
+    case SQLITE_LAST_ERRNO: {
+      break;
+    }
+    default: {
+      int rc = uringWait(pFile);
+      if( rc!=SQLITE_OK ) return rc;
+      break;
+    }
+  }
+  return unixFileControl(id, op, pArg);
+}
+
+/*
+** Finish any queued writes and release the io_uring of file pFile, if
+** it has one.
+*/
+static void uringRelease(unixFile *pFile){
+  if( pFile->pUring ){
+    uringWait(pFile);
+    uringFree(pFile->pUring);
+    pFile->pUring = 0;
+  }
+}
+
+/*
+** Close a file opened by the "unix-uring" VFS.
+*/
+static int uringClose(sqlite3_file *id){
+  if( id ) uringRelease((unixFile*)id);
+  return unixClose(id);
+}
+static int uringNolockClose(sqlite3_file *id){
+  uringRelease((unixFile*)id);
+  return nolockClose(id);
+}
+
+/******************** End of the io_uring batched I/O ************************
+******************************************************************************/
+#endif /* defined(HAVE_IO_URING) && HAVE_IO_URING */
+
+#if SQLITE_DIRECT_IO
+/******************************************************************************
+****************************** O_DIRECT I/O ***********************************
+**
+** The "unix-direct" VFS locks files in the same way as the default "unix"
+** VFS, but opens database and WAL files with O_DIRECT, so that their
+** contents are not also held in the operating system page cache. Memory
+** is then spent once, in the SQLite page cache, and it is SQLite that
+** decides what to evict. Since the kernel no longer caches these files,
+** the page cache should be made large enough to hold the working set,
+** using "PRAGMA cache_size" or SQLITE_DEFAULT_CACHE_SIZE. Journal files
+** are still written through the operating system cache.
+**
+** With O_DIRECT, file offsets, transfer sizes and buffer addresses must
+** all be multiples of the device block size. DIRECT_ALIGN bytes is a
+** safe value for all common devices and file-systems. Each file has an
+** aligned buffer of DIRECT_BUFFER bytes. Reads that are not aligned -
+** which includes reads into pages allocated by sqlite3PageMalloc() unless
+** the application supplies an aligned SQLITE_CONFIG_PAGECACHE buffer with
+** a slot size that is a multiple of DIRECT_ALIGN - are made into this
+** buffer and copied out of it.
+**
+** Writes made between SQLITE_FCNTL_BEGIN_BATCH and the matching
+** SQLITE_FCNTL_END_BATCH file-control are accumulated in the buffer for
+** as long as each starts where the previous one ended, and written out
+** as whole aligned blocks. This is what happens to the frames appended
+** to a WAL file by a transaction, which are not themselves aligned, and
+** to runs of consecutive pages written to a database file. Only when the
+** buffer is flushed, by the end of the batch, a sync, a read or a write
+** that does not follow on, is a partially filled final block read from
+** the file and merged. If that block extends past the end of the file,
+** the file is truncated back to its proper size afterwards.
+**
+** If the file-system does not support O_DIRECT, the file is quietly
+** accessed using the ordinary routines above instead.
+*/
+
+/*
+** Alignment required of direct I/O, and the size of the buffer used for
+** unaligned reads and to accumulate writes.
+*/
+#define DIRECT_ALIGN  4096
+#define DIRECT_BUFFER (256*1024)
+
+/*
+** Direct I/O state of a file opened by the "unix-direct" VFS. Allocated
+** in a single block, along with the buffer.
+**
+** While nData is greater than zero, aBuf[] holds the nData bytes of the
+** file starting at offset iBuf, which is aligned. These bytes have not
+** yet been written to the file. aBlk[] is a single aligned block used to
+** merge a partially filled final block with the contents of the file.
+*/
+struct unixDirect {
+  int nBatch;                     /* Depth of nested BEGIN_BATCH calls */
+  i64 iBuf;                       /* File offset of aBuf[0] */
+  int nData;                      /* Bytes of unwritten data in aBuf[] */
+  char *aBuf;                     /* DIRECT_BUFFER byte aligned buffer */
+  char *aBlk;                     /* DIRECT_ALIGN byte aligned block */
+};
+
+/*
+** True if X is a multiple of DIRECT_ALIGN.
+*/
+#define DIRECT_ALIGNED(X)  (((X)&(DIRECT_ALIGN-1))==0)
+
+/*
+** Round X down to a multiple of DIRECT_ALIGN.
+*/
+#define DIRECT_ROUNDDOWN(X) ((X)&~(i64)(DIRECT_ALIGN-1))
+
+/*
+** Allocate the direct I/O state for a file.
+*/
+static unixDirect *directAlloc(void){
+  unixDirect *p;
+  char *z;
+  p = (unixDirect*)sqlite3_malloc(
+      sizeof(unixDirect) + DIRECT_BUFFER + 2*DIRECT_ALIGN
+  );
+  if( p ){
+    memset(p, 0, sizeof(unixDirect));
+    z = (char*)&p[1];
+    p->aBuf = &z[DIRECT_ALIGN - ((z - (char*)0) & (DIRECT_ALIGN-1))];
+    p->aBlk = &p->aBuf[DIRECT_BUFFER];
+  }
+  return p;
+}
+
+/*
+** Turn the O_DIRECT flag of file descriptor h on or off. Return zero if
+** successful, or non-zero if the file-system does not support it.
+*/
+static int directSetFlag(int h, int bOn){
+  int flags = fcntl(h, F_GETFL);
+  if( flags<0 ) return 1;
+  flags = (bOn ? (flags|O_DIRECT) : (flags&~O_DIRECT));
+  return fcntl(h, F_SETFL, flags);
+}
+
+/*
+** Write nByte bytes from aligned buffer a[] to file pFile at aligned
+** offset iOff. Return SQLITE_OK if successful, or an error code otherwise.
+*/
+static int directWriteAligned(unixFile *pFile, const char *a, int nByte, i64 iOff){
+  int wrote = 0;
+  while( nByte>0 && (wrote = seekAndWrite(pFile, iOff, a, nByte))>0 ){
+#ifdef SQLITE_TEST
+    sqlite3_direct_write_count++;
+#endif
+    nByte -= wrote;
+    iOff += wrote;
+    a += wrote;
+  }
+  if( nByte>0 ){
+    if( wrote<0 ){
+      /* lastErrno set by seekAndWrite */
+      return SQLITE_IOERR_WRITE;
+    }
+    pFile->lastErrno = 0; /* not a system error */
+    return SQLITE_FULL;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Write the data accumulated in the buffer of file pFile to the file.
+**
+** If bAll is false, only whole blocks are written, and any partially
+** filled final block is moved to the start of the buffer. Otherwise, the
+** final block is merged with the contents of the file and written too,
+** leaving the buffer empty.
+*/
+static int directFlush(unixFile *pFile, int bAll){
+  unixDirect *p = pFile->pDirect;
+  int nWhole = (int)DIRECT_ROUNDDOWN(p->nData);
+  int nWrite = nWhole;
+  i64 iTruncate = 0;              /* If non-zero, truncate to this size */
+  int rc;
+
+  if( p->nData==0 ) return SQLITE_OK;
+  if( bAll && nWhole<p->nData ){
+    int nTail = p->nData - nWhole;
+    int got = seekAndRead(pFile, p->iBuf+nWhole, p->aBlk, DIRECT_ALIGN);
+    if( got<0 ){
+      p->nData = 0;
+      return SQLITE_IOERR_READ;
+    }
+    if( got<DIRECT_ALIGN ){
+      /* The file ends within the final block. Writing the whole block
+      ** makes it longer, so truncate it afterwards. */
+      memset(&p->aBlk[got], 0, DIRECT_ALIGN-got);
+      iTruncate = p->iBuf + nWhole + (got>nTail ? got : nTail);
+    }
+    memcpy(&p->aBuf[p->nData], &p->aBlk[nTail], DIRECT_ALIGN-nTail);
+    nWrite += DIRECT_ALIGN;
+  }
+
+  rc = directWriteAligned(pFile, p->aBuf, nWrite, p->iBuf);
+  if( rc==SQLITE_OK && iTruncate ){
+    if( ftruncate(pFile->h, (off_t)iTruncate) ){
+      pFile->lastErrno = errno;
+      rc = SQLITE_IOERR_TRUNCATE;
+    }
+  }
+  if( rc!=SQLITE_OK || bAll ){
+    p->nData = 0;
+  }else{
+    p->nData -= nWhole;
+    p->iBuf += nWhole;
+    memmove(p->aBuf, &p->aBuf[nWhole], p->nData);
+  }
+  return rc;
+}
+
+/*
+** Read data from a file opened by the "unix-direct" VFS. Unwritten data
+** in the buffer is flushed first.
+*/
+static int directRead(
+  sqlite3_file *id,
+  void *pBuf,
+  int amt,
+  sqlite3_int64 offset
+){
+  unixFile *pFile = (unixFile*)id;
+  unixDirect *p = pFile->pDirect;
+  char *zOut = (char*)pBuf;
+  int rc;
+
+  if( p==0 ){
+    return unixRead(id, pBuf, amt, offset);
+  }
+  rc = directFlush(pFile, 1);
+  if( rc!=SQLITE_OK ) return rc;
+  if( DIRECT_ALIGNED((zOut - (char*)0) | amt | offset) ){
+    return unixRead(id, pBuf, amt, offset);
+  }
+
+  /* Read each DIRECT_BUFFER byte (or smaller) aligned range that overlaps
+  ** the requested bytes into the buffer and copy them out. */
+  while( amt>0 ){
+    i64 iRead = DIRECT_ROUNDDOWN(offset);
+    int iSkip = (int)(offset - iRead);
+    int nRead = (int)DIRECT_ROUNDDOWN(iSkip + amt + DIRECT_ALIGN - 1);
+    int nCopy;
+    int got;
+
+    if( nRead>DIRECT_BUFFER ) nRead = DIRECT_BUFFER;
+    nCopy = nRead - iSkip;
+    if( nCopy>amt ) nCopy = amt;
+    got = seekAndRead(pFile, iRead, p->aBuf, nRead);
+    if( got<0 ){
+      /* lastErrno set by seekAndRead */
+      return SQLITE_IOERR_READ;
+    }
+    if( got<iSkip+nCopy ){
+      int nGot = (got>iSkip ? got-iSkip : 0);
+      memcpy(zOut, &p->aBuf[iSkip], nGot);
+      pFile->lastErrno = 0; /* not a system error */
+      /* Unread parts of the buffer must be zero-filled */
+      memset(&zOut[nGot], 0, amt-nGot);
+      return SQLITE_IOERR_SHORT_READ;
+    }
+    memcpy(zOut, &p->aBuf[iSkip], nCopy);
+    zOut += nCopy;
+    amt -= nCopy;
+    offset += nCopy;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Write data to a file opened by the "unix-direct" VFS.
+**
+** The data is copied into the buffer, after any unwritten data already
+** there if it follows on from it. Outside of a batch, or once the buffer
+** is full, the buffer is written to the file.
+*/
+static int directWrite(
+  sqlite3_file *id,
+  const void *pBuf,
+  int amt,
+  sqlite3_int64 offset
+){
+  unixFile *pFile = (unixFile*)id;
+  unixDirect *p = pFile->pDirect;
+  const char *zIn = (const char*)pBuf;
+  int rc;
+
+  assert( amt>0 );
+  if( p==0 ){
+    return unixWrite(id, pBuf, amt, offset);
+  }
+
+#ifndef NDEBUG
+  /* See the comments in unixWrite() */
+  if( pFile->inNormalWrite ){
+    pFile->dbUpdate = 1;  /* The database has been modified */
+    if( offset<=24 && offset+amt>=27 ){
+      char oldCntr[4];
+      SimulateIOErrorBenign(1);
+      rc = directRead(id, oldCntr, 4, 24);
+      SimulateIOErrorBenign(0);
+      if( rc!=SQLITE_OK || memcmp(oldCntr, &zIn[24-offset], 4)!=0 ){
+        pFile->transCntrChng = 1;  /* The transaction counter has changed */
+      }
+    }
+  }
+#endif
+
+  SimulateIOError( return SQLITE_IOERR_WRITE );
+  SimulateDiskfullError( return SQLITE_FULL );
+
+  /* As in unixWrite(), a failure to allocate space is not fatal. */
+  if( unixAllocateChunk(pFile, offset+amt)!=SQLITE_OK ){
+    pFile->lastErrno = 0;
+  }
+  if( p->nData>0 && offset!=p->iBuf+p->nData ){
+    rc = directFlush(pFile, 1);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  if( p->nData==0 ){
+    /* Outside of a batch, an aligned write is made directly from the
+    ** callers buffer. */
+    if( p->nBatch==0 && DIRECT_ALIGNED((zIn - (char*)0) | amt | offset) ){
+      return directWriteAligned(pFile, zIn, amt, offset);
+    }
+
+    /* Start the buffer at the block containing offset. If offset is not
+    ** the start of that block, load the bytes that precede it. */
+    p->iBuf = DIRECT_ROUNDDOWN(offset);
+    p->nData = (int)(offset - p->iBuf);
+    if( p->nData>0 ){
+      int got = seekAndRead(pFile, p->iBuf, p->aBuf, DIRECT_ALIGN);
+      if( got<0 ){
+        p->nData = 0;
+        return SQLITE_IOERR_READ;
+      }
+      if( got<p->nData ){
+        memset(&p->aBuf[got], 0, p->nData-got);
+      }
+    }
+  }
+
+  while( amt>0 ){
+    int nCopy = DIRECT_BUFFER - p->nData;
+    if( nCopy>amt ) nCopy = amt;
+    memcpy(&p->aBuf[p->nData], zIn, nCopy);
+    p->nData += nCopy;
+    zIn += nCopy;
+    amt -= nCopy;
+    if( p->nData==DIRECT_BUFFER ){
+      rc = directFlush(pFile, 0);
+      if( rc!=SQLITE_OK ) return rc;
+    }
+  }
+
+  if( p->nBatch==0 ){
+    return directFlush(pFile, 1);
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Sync a file opened by the "unix-direct" VFS.
+*/
+static int directSync(sqlite3_file *id, int flags){
+  unixFile *pFile = (unixFile*)id;
+  if( pFile->pDirect ){
+    int rc = directFlush(pFile, 1);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  return unixSync(id, flags);
+}
+
+/*
+** Truncate a file opened by the "unix-direct" VFS.
+*/
+static int directTruncate(sqlite3_file *id, i64 nByte){
+  unixFile *pFile = (unixFile*)id;
+  if( pFile->pDirect ){
+    int rc = directFlush(pFile, 1);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  return unixTruncate(id, nByte);
+}
+
+/*
+** Determine the size of a file opened by the "unix-direct" VFS, including
+** any data in the buffer that has not yet been written.
+*/
+static int directFileSize(sqlite3_file *id, i64 *pSize){
+  unixDirect *p = ((unixFile*)id)->pDirect;
+  int rc = unixFileSize(id, pSize);
+  if( rc==SQLITE_OK && p && p->nData>0 && p->iBuf+p->nData>*pSize ){
+    *pSize = p->iBuf+p->nData;
+  }
+  return rc;
+}
+
+/*
+** Information and control of a file opened by the "unix-direct" VFS.
+** Buffered data is written before any file-control other than the ones
+** that only report on the state of the file handle.
+*/
+static int directFileControl(sqlite3_file *id, int op, void *pArg){
+  unixFile *pFile = (unixFile*)id;
+  unixDirect *p = pFile->pDirect;
+  int rc;
+  if( p==0 ){
+    return unixFileControl(id, op, pArg);
+  }
+  switch( op ){
+    case SQLITE_FCNTL_BEGIN_BATCH: {
+      p->nBatch++;
+      return SQLITE_OK;
+    }
+    case SQLITE_FCNTL_END_BATCH: {
+      assert( p->nBatch>0 );
+      p->nBatch--;
+      return (p->nBatch ? SQLITE_OK : directFlush(pFile, 1));
+    }
+    case SQLITE_FCNTL_LOCKSTATE:
+    case SQLITE_LAST_ERRNO: {
+      break;
+    }
+    case SQLITE_FCNTL_SIZE_HINT: {
+      /* Where neither fallocate() nor posix_fallocate() is available,
+      ** fcntlSizeHint() extends the file by writing single bytes to it.
+      ** Do so with O_DIRECT off. */
+      rc = directFlush(pFile, 1);
+      if( rc==SQLITE_OK ){
+        directSetFlag(pFile->h, 0);
+        rc = unixFileControl(id, op, pArg);
+        directSetFlag(pFile->h, 1);
+      }
+      return rc;
+    }
+    default: {
+      rc = directFlush(pFile, 1);
+      if( rc!=SQLITE_OK ) return rc;
+      break;
+    }
+  }
+  return unixFileControl(id, op, pArg);
+}
+
+/*
+** Write any buffered data to file pFile, free its direct I/O state and
+** turn O_DIRECT off, so that the file descriptor may be reused by a file
+** opened using some other VFS.
+*/
+static void directRelease(unixFile *pFile){
+  if( pFile->pDirect ){
+    directFlush(pFile, 1);
+    sqlite3_free(pFile->pDirect);
+    pFile->pDirect = 0;
+    directSetFlag(pFile->h, 0);
+  }
+}
+
+/*
+** Close a file opened by the "unix-direct" VFS.
+*/
+static int directClose(sqlite3_file *id){
+  if( id ) directRelease((unixFile*)id);
+  return unixClose(id);
+}
+static int directNolockClose(sqlite3_file *id){
+  directRelease((unixFile*)id);
+  return nolockClose(id);
+}
+
+/*********************** End of the O_DIRECT I/O *****************************
+******************************************************************************/
+#endif /* SQLITE_DIRECT_IO */
+
+/*
+** Here ends the implementation of all sqlite3_file methods.
+**
+********************** End sqlite3_file Methods *******************************
+******************************************************************************/
+
+/*
+** This division contains definitions of sqlite3_io_methods objects that
+** implement various file locking strategies.  It also contains definitions
+** of "finder" functions.  A finder-function is used to locate the appropriate
+** sqlite3_io_methods object for a particular database file.  The pAppData
+** field of the sqlite3_vfs VFS objects are initialized to be pointers to
+** the correct finder-function for that VFS.
+**
+** Most finder functions return a pointer to a fixed sqlite3_io_methods
+** object.  The only interesting finder-function is autolockIoFinder, which
+** looks at the filesystem type and tries to guess the best locking
+** strategy from that.
+**
+** For finder-funtion F, two objects are created:
+**
+**    (1) The real finder-function named "FImpt()".
+**
+**    (2) A constant pointer to this function named just "F".
+**
+**
+** A pointer to the F pointer is used as the pAppData value for VFS
+** objects.  We have to do this instead of letting pAppData point
+** directly at the finder-function since C90 rules prevent a void*
+** from be cast into a function pointer.
+**
+**
+** Each instance of this macro generates two objects:
+**
+**   *  A constant sqlite3_io_methods object call METHOD that has locking
+**      methods CLOSE, LOCK, UNLOCK, CKRESLOCK.
+**
+**   *  An I/O method finder function called FINDER that returns a pointer
+**      to the METHOD object in the previous bullet.
+*/
+#define IOMETHODS(FINDER, METHOD, VERSION, CLOSE, LOCK, UNLOCK, CKLOCK)      \
+static const sqlite3_io_methods METHOD = {                                   \
+   VERSION,                    /* iVersion */                                \
+   CLOSE,                      /* xClose */                                  \
+   unixRead,                   /* xRead */                                   \
+   unixWrite,                  /* xWrite */                                  \
+   unixTruncate,               /* xTruncate */                               \
+   unixSync,                   /* xSync */                                   \
+   unixFileSize,               /* xFileSize */                               \
+   LOCK,                       /* xLock */                                   \
+   UNLOCK,                     /* xUnlock */                                 \
+   CKLOCK,                     /* xCheckReservedLock */                      \
+   unixFileControl,            /* xFileControl */                            \
+   unixSectorSize,             /* xSectorSize */                             \
+   unixDeviceCharacteristics,  /* xDeviceCapabilities */                     \
+   unixShmMap,                 /* xShmMap */                                 \
+   unixShmLock,                /* xShmLock */                                \
+   unixShmBarrier,             /* xShmBarrier */                             \
+   unixShmUnmap                /* xShmUnmap */                               \
+};                                                                           \
+static const sqlite3_io_methods *FINDER##Impl(const char *z, unixFile *p){   \
+  UNUSED_PARAMETER(z); UNUSED_PARAMETER(p);                                  \
+  return &METHOD;                                                            \
+}                                                                            \
+static const sqlite3_io_methods *(*const FINDER)(const char*,unixFile *p)    \
+    = FINDER##Impl;
+
+/*
+** Here are all of the sqlite3_io_methods objects for each of the
+** locking strategies.  Functions that return pointers to these methods
+** are also created.
+*/
+IOMETHODS(
+  posixIoFinder,            /* Finder function name */
+  posixIoMethods,           /* sqlite3_io_methods object name */
+  2,                        /* shared memory is enabled */
+  unixClose,                /* xClose method */
+  unixLock,                 /* xLock method */
+  unixUnlock,               /* xUnlock method */
+  unixCheckReservedLock     /* xCheckReservedLock method */
+)
+IOMETHODS(
+  nolockIoFinder,           /* Finder function name */
+  nolockIoMethods,          /* sqlite3_io_methods object name */
+  1,                        /* shared memory is disabled */
+  nolockClose,              /* xClose method */
+  nolockLock,               /* xLock method */
+  nolockUnlock,             /* xUnlock method */
+  nolockCheckReservedLock   /* xCheckReservedLock method */
+)
+IOMETHODS(
+  dotlockIoFinder,          /* Finder function name */
+  dotlockIoMethods,         /* sqlite3_io_methods object name */
+  1,                        /* shared memory is disabled */
+  dotlockClose,             /* xClose method */
+  dotlockLock,              /* xLock method */
+  dotlockUnlock,            /* xUnlock method */
+  dotlockCheckReservedLock  /* xCheckReservedLock method */
+)
+
+#if SQLITE_ENABLE_LOCKING_STYLE && !OS_VXWORKS
+IOMETHODS(
+  flockIoFinder,            /* Finder function name */
+  flockIoMethods,           /* sqlite3_io_methods object name */
+  1,                        /* shared memory is disabled */
+  flockClose,               /* xClose method */
+  flockLock,                /* xLock method */
+  flockUnlock,              /* xUnlock method */
+  flockCheckReservedLock    /* xCheckReservedLock method */
+)
+#endif
+
+#if OS_VXWORKS
+IOMETHODS(
+  semIoFinder,              /* Finder function name */
+  semIoMethods,             /* sqlite3_io_methods object name */
+  1,                        /* shared memory is disabled */
+  semClose,                 /* xClose method */
+  semLock,                  /* xLock method */
+  semUnlock,                /* xUnlock method */
+  semCheckReservedLock      /* xCheckReservedLock method */
+)
+#endif
+
+#if defined(__APPLE__) && SQLITE_ENABLE_LOCKING_STYLE
+IOMETHODS(
+  afpIoFinder,              /* Finder function name */
+  afpIoMethods,             /* sqlite3_io_methods object name */
+  1,                        /* shared memory is disabled */
+  afpClose,                 /* xClose method */
+  afpLock,                  /* xLock method */
+  afpUnlock,                /* xUnlock method */
+  afpCheckReservedLock      /* xCheckReservedLock method */
+)
+#endif
+
+#if defined(HAVE_IO_URING) && HAVE_IO_URING
+/*
+** The "unix-uring" VFS locks database files using posix advisory locks
+** and journal and WAL files not at all, as the "unix" VFS does, but uses
+** the io_uring routines for I/O. Define the sqlite3_io_methods objects
+** for both, and a finder function for the former.
+*/
+#define URINGIOMETHODS(METHOD, VERSION, CLOSE, LOCK, UNLOCK, CKLOCK)        \
+static const sqlite3_io_methods METHOD = {                                   \
+   VERSION,                    /* iVersion */                                \
+   CLOSE,                      /* xClose */                                  \
+   uringRead,                  /* xRead */                                   \
+   uringWrite,                 /* xWrite */                                  \
+   uringTruncate,              /* xTruncate */                               \
+   uringSync,                  /* xSync */                                   \
+   uringFileSize,              /* xFileSize */                               \
+   LOCK,                       /* xLock */                                   \
+   UNLOCK,                     /* xUnlock */                                 \
+   CKLOCK,                     /* xCheckReservedLock */                      \
+   uringFileControl,           /* xFileControl */                            \
+   unixSectorSize,             /* xSectorSize */                             \
+   unixDeviceCharacteristics,  /* xDeviceCapabilities */                     \
+   unixShmMap,                 /* xShmMap */                                 \
+   unixShmLock,                /* xShmLock */                                \
+   unixShmBarrier,             /* xShmBarrier */                             \
+   unixShmUnmap                /* xShmUnmap */                               \
+};
+URINGIOMETHODS(
+  uringIoMethods,           /* sqlite3_io_methods object name */
+  2,                        /* shared memory is enabled */
+  uringClose,               /* xClose method */
+  unixLock,                 /* xLock method */
+  unixUnlock,               /* xUnlock method */
+  unixCheckReservedLock     /* xCheckReservedLock method */
+)
+URINGIOMETHODS(
+  uringNolockIoMethods,     /* sqlite3_io_methods object name */
+  1,                        /* shared memory is disabled */
+  uringNolockClose,         /* xClose method */
+  nolockLock,               /* xLock method */
+  nolockUnlock,             /* xUnlock method */
+  nolockCheckReservedLock   /* xCheckReservedLock method */
+)
+static const sqlite3_io_methods *uringIoFinderImpl(const char *z, unixFile *p){
+  UNUSED_PARAMETER(z); UNUSED_PARAMETER(p);
+  return &uringIoMethods;
+}
+static const sqlite3_io_methods *(*const uringIoFinder)(const char*,unixFile*)
+    = uringIoFinderImpl;
+#endif /* defined(HAVE_IO_URING) && HAVE_IO_URING */
+
+#if SQLITE_DIRECT_IO
+/*
+** The "unix-direct" VFS locks files in the same way as the "unix" VFS,
+** but uses the O_DIRECT routines for I/O.
+*/
+#define DIRECTIOMETHODS(METHOD, VERSION, CLOSE, LOCK, UNLOCK, CKLOCK)       \
+static const sqlite3_io_methods METHOD = {                                   \
+   VERSION,                    /* iVersion */                                \
+   CLOSE,                      /* xClose */                                  \
+   directRead,                 /* xRead */                                   \
+   directWrite,                /* xWrite */                                  \
+   directTruncate,             /* xTruncate */                               \
+   directSync,                 /* xSync */                                   \
+   directFileSize,             /* xFileSize */                               \
+   LOCK,                       /* xLock */                                   \
+   UNLOCK,                     /* xUnlock */                                 \
+   CKLOCK,                     /* xCheckReservedLock */                      \
+   directFileControl,          /* xFileControl */                            \
+   unixSectorSize,             /* xSectorSize */                             \
+   unixDeviceCharacteristics,  /* xDeviceCapabilities */                     \
+   unixShmMap,                 /* xShmMap */                                 \
+   unixShmLock,                /* xShmLock */                                \
+   unixShmBarrier,             /* xShmBarrier */                             \
+   unixShmUnmap                /* xShmUnmap */                               \
+};
+DIRECTIOMETHODS(
+  directIoMethods,          /* sqlite3_io_methods object name */
+  2,                        /* shared memory is enabled */
+  directClose,              /* xClose method */
+  unixLock,                 /* xLock method */
+  unixUnlock,               /* xUnlock method */
+  unixCheckReservedLock     /* xCheckReservedLock method */
+)
+DIRECTIOMETHODS(
+  directNolockIoMethods,    /* sqlite3_io_methods object name */
+  1,                        /* shared memory is disabled */
+  directNolockClose,        /* xClose method */
+  nolockLock,               /* xLock method */
+  nolockUnlock,             /* xUnlock method */
+  nolockCheckReservedLock   /* xCheckReservedLock method */
+)
+static const sqlite3_io_methods *directIoFinderImpl(const char *z, unixFile *p){
+  UNUSED_PARAMETER(z); UNUSED_PARAMETER(p);
+  return &directIoMethods;
+}
+static const sqlite3_io_methods *(*const directIoFinder)(const char*,unixFile*)
+    = directIoFinderImpl;
+#endif /* SQLITE_DIRECT_IO */
+
+/*
+** The proxy locking method is a "super-method" in the sense that it
+** opens secondary file descriptors for the conch and lock files and
+** it uses proxy, dot-file, AFP, and flock() locking methods on those
 ** secondary files.  For this reason, the division that implements
 ** proxy locking is located much further down in the file.  But we need
 ** to go ahead and define the sqlite3_io_methods and finder function
@@ -4106,6 +5480,16 @@ static int fillInUnixFile(
 
   if( noLock ){
     pLockingStyle = &nolockIoMethods;
+#if defined(HAVE_IO_URING) && HAVE_IO_URING
+    if( pVfs->pAppData==(void*)&uringIoFinder ){
+      pLockingStyle = &uringNolockIoMethods;
+    }
+#endif
+#if SQLITE_DIRECT_IO
+    if( pVfs->pAppData==(void*)&directIoFinder ){
+      pLockingStyle = &directNolockIoMethods;
+    }
+#endif
   }else{
     pLockingStyle = (**(finder_type*)pVfs->pAppData)(zFilename, pNew);
 #if SQLITE_ENABLE_LOCKING_STYLE
@@ -4119,6 +5503,12 @@ static int fillInUnixFile(
   if( pLockingStyle == &posixIoMethods
 #if defined(__APPLE__) && SQLITE_ENABLE_LOCKING_STYLE
     || pLockingStyle == &nfsIoMethods
+#endif
+#if defined(HAVE_IO_URING) && HAVE_IO_URING
+    || pLockingStyle == &uringIoMethods
+#endif
+#if SQLITE_DIRECT_IO
+    || pLockingStyle == &directIoMethods
 #endif
   ){
     unixEnterMutex();
@@ -4716,6 +6106,23 @@ static int unixOpen(
 #endif
   
   rc = fillInUnixFile(pVfs, fd, dirfd, pFile, zPath, noLock, isDelete);
+#if SQLITE_DIRECT_IO
+  if( rc==SQLITE_OK && pVfs->pAppData==(void*)&directIoFinder
+   && (eType==SQLITE_OPEN_MAIN_DB || eType==SQLITE_OPEN_WAL)
+  ){
+    /* Database and WAL files opened by the "unix-direct" VFS use O_DIRECT,
+    ** if the file-system supports it. */
+    p->pDirect = directAlloc();
+    if( p->pDirect==0 ){
+      pFile->pMethods->xClose(pFile);
+      return SQLITE_NOMEM;
+    }
+    if( directSetFlag(p->h, 1) ){
+      sqlite3_free(p->pDirect);
+      p->pDirect = 0;
+    }
+  }
+#endif
 open_finished:
   if( rc!=SQLITE_OK ){
     sqlite3_free(p->pUnused);
@@ -6296,6 +7703,12 @@ int sqlite3_os_init(void){
 #endif
     UNIXVFS("unix-none",     nolockIoFinder ),
     UNIXVFS("unix-dotfile",  dotlockIoFinder ),
+#if defined(HAVE_IO_URING) && HAVE_IO_URING
+    UNIXVFS("unix-uring",    uringIoFinder ),
+#endif
+#if SQLITE_DIRECT_IO
+    UNIXVFS("unix-direct",   directIoFinder ),
+#endif
 #if OS_VXWORKS
     UNIXVFS("unix-namedsem", semIoFinder ),
 #endif
@@ -406,6 +406,21 @@ int sqlite3PagerTrace=1;  /* True to enable tracing */
 */
 #define UNKNOWN_LOCK                (EXCLUSIVE_LOCK+1)
 
+/*
+** Allowed values for the Pager.eTrack variable. PAGER_TRACK_NONE is used
+** for temporary and in-memory databases, which never have a
+** change-tracking file. Otherwise, Pager.eTrack records whether or not
+** the change-tracking file exists, so that xAccess() need not be called
+** to find out each time a page is written. It is set to
+** PAGER_TRACK_UNKNOWN when the pager is opened and whenever the cache is
+** reset because another connection has modified the database, which
+** includes another connection turning change tracking on or off.
+*/
+#define PAGER_TRACK_NONE            0
+#define PAGER_TRACK_OFF             1
+#define PAGER_TRACK_ON              2
+#define PAGER_TRACK_UNKNOWN         3
+
 /*
 ** A macro used for invoking the codec if there is one
 */
@@ -637,6 +652,8 @@ struct Pager {
   u8 doNotSpill;              /* Do not spill the cache when non-zero */
   u8 doNotSyncSpill;          /* Do not do a spill that requires jrnl sync */
   u8 subjInMemory;            /* True to use in-memory sub-journals */
+  u8 eTrack;                  /* One of the PAGER_TRACK_XXX values */
+  u8 trackCreated;            /* True if this transaction created -track */
   Pgno dbSize;                /* Number of pages in the database */
   Pgno dbOrigSize;            /* dbSize before the current transaction */
   Pgno dbFileSize;            /* Number of pages in the database file */
@@ -646,15 +663,18 @@ struct Pager {
   u32 cksumInit;              /* Quasi-random value added to every checksum */
   u32 nSubRec;                /* Number of records written to sub-journal */
   Bitvec *pInJournal;         /* One bit for each page in the database file */
+  Bitvec *pAllRead;           /* Pages read by a BEGIN CONCURRENT transaction */
   sqlite3_file *fd;           /* File descriptor for database */
   sqlite3_file *jfd;          /* File descriptor for main journal */
   sqlite3_file *sjfd;         /* File descriptor for sub-journal */
+  sqlite3_file *tfd;          /* File descriptor for change-tracking file */
   i64 journalOff;             /* Current write offset in the journal file */
   i64 journalHdr;             /* Byte offset to previous journal header */
   sqlite3_backup *pBackup;    /* Pointer to list of ongoing backup processes */
   PagerSavepoint *aSavepoint; /* Array of active savepoints */
   int nSavepoint;             /* Number of elements in aSavepoint[] */
   char dbFileVers[16];        /* Changes whenever database file changes */
+  u32 iDataVersion;           /* Incremented each time the cache is reset */
   /*
   ** End of the routinely-changing class members
   ***************************************************************************/
@@ -666,8 +686,10 @@ struct Pager {
   int pageSize;               /* Number of bytes in a page */
   Pgno mxPgno;                /* Maximum allowed size of the database */
   i64 journalSizeLimit;       /* Size limit for persistent journal files */
+  int szChunk;                /* Chunk size for db, journal and WAL files */
   char *zFilename;            /* Name of the database file */
   char *zJournal;             /* Name of the journal file */
+  char *zTrack;               /* Name of the change-tracking file */
   int (*xBusyHandler)(void*); /* Function to call when busy */
   void *pBusyHandlerArg;      /* Context argument for xBusyHandler */
 #ifdef SQLITE_TEST
@@ -744,6 +766,43 @@ static const unsigned char aJournalMagic[] = {
 */
 #define JOURNAL_HDR_SZ(pPager) (pPager->sectorSize)
 
+/*
+** In journal_mode=DOUBLEWRITE, the file that would otherwise be the
+** rollback journal holds a copy of the new content of the pages written
+** by the most recent transaction, instead of their original content.
+** Each commit writes and syncs this file, then writes the same pages to
+** the database file and syncs it. If a crash interrupts the writes to
+** the database file, the next connection to find the file hot copies
+** the pages into the database file again. Because the file has the
+** same name as a rollback journal, a connection finds it whatever
+** journal mode it uses, at no cost beyond the existing hot-journal test.
+**
+** The format of the file is:
+**
+**  (1)  8 byte prefix. A copy of aDoubleWriteMagic[].
+**  (2)  4 byte big-endian number of page records.
+**  (3)  4 byte big-endian page size.
+**  (4)  4 byte big-endian size of the database in pages after the commit.
+**  (5)  4 byte file change counter of the database before the commit.
+**  (6)  4 byte file change counter of the database after the commit.
+**  (7)  Two 4 byte big-endian checksum values, covering fields (1) to
+**       (6) and every page record.
+**  (8)  Page records, each of which is a 4 byte big-endian page number
+**       followed by the page content.
+**
+** The checksum covers every byte, so a file that was not completely
+** written before a crash is ignored, as is one that was left behind by a
+** transaction that finished: the header is zeroed when the transaction
+** ends, and the change counter of a database that has been written since
+** matches neither field (5) nor field (6). The header is zeroed without
+** a sync, so that a commit makes two syncs, where a rollback journal
+** needs three or four with synchronous=FULL.
+*/
+static const unsigned char aDoubleWriteMagic[] = {
+  0xd9, 0xd5, 0x05, 0xf9, 0x20, 0xa1, 0x63, 0xdb,
+};
+#define DOUBLEWRITE_HDR_SZ 36
+
 /*
 ** The macro MEMDB is true if we are dealing with an in-memory database.
 ** We do this as a macro so that if the SQLITE_OMIT_MEMORYDB macro is set,
@@ -887,6 +946,7 @@ static int assert_pager_state(Pager *p){
         assert( isOpen(p->jfd) 
              || p->journalMode==PAGER_JOURNALMODE_OFF 
              || p->journalMode==PAGER_JOURNALMODE_WAL 
+             || p->journalMode==PAGER_JOURNALMODE_DOUBLEWRITE 
         );
       }
       assert( pPager->dbOrigSize==pPager->dbFileSize );
@@ -901,6 +961,7 @@ static int assert_pager_state(Pager *p){
       assert( isOpen(p->jfd) 
            || p->journalMode==PAGER_JOURNALMODE_OFF 
            || p->journalMode==PAGER_JOURNALMODE_WAL 
+           || p->journalMode==PAGER_JOURNALMODE_DOUBLEWRITE 
       );
       assert( pPager->dbOrigSize<=pPager->dbHintSize );
       break;
@@ -970,7 +1031,9 @@ static char *print_pager_state(Pager *p){
         p->journalMode==PAGER_JOURNALMODE_DELETE   ? "delete" :
         p->journalMode==PAGER_JOURNALMODE_PERSIST  ? "persist" :
         p->journalMode==PAGER_JOURNALMODE_TRUNCATE ? "truncate" :
-        p->journalMode==PAGER_JOURNALMODE_WAL      ? "wal" : "?error?"
+        p->journalMode==PAGER_JOURNALMODE_WAL      ? "wal" :
+        p->journalMode==PAGER_JOURNALMODE_DOUBLEWRITE ? "doublewrite" :
+        "?error?"
       , (int)p->tempFile, (int)p->memDb, (int)p->useJournal
       , p->journalOff, p->journalHdr
       , (int)p->dbSize, (int)p->dbOrigSize, (int)p->dbFileSize
@@ -1062,6 +1125,7 @@ static int pagerUnlockDb(Pager *pPager, int eLock){
     if( pPager->eLock!=UNKNOWN_LOCK ){
       pPager->eLock = (u8)eLock;
     }
+    sqlite3LockWakeup();
     IOTRACE(("UNLOCK %p %d\n", pPager, eLock))
   }
   return rc;
@@ -1299,7 +1363,14 @@ static int zeroJournalHdr(Pager *pPager, int doTruncate){
       static const char zeroHdr[28] = {0};
       rc = sqlite3OsWrite(pPager->jfd, zeroHdr, sizeof(zeroHdr), 0);
     }
-    if( rc==SQLITE_OK && !pPager->noSync ){
+    /* A double-write file is not synced here. If the zeroed header is
+    ** lost in a crash, the file is either copied into the database again,
+    ** which changes nothing, or is recognized as stale by its change
+    ** counters.
+    */
+    if( rc==SQLITE_OK && !pPager->noSync 
+     && pPager->journalMode!=PAGER_JOURNALMODE_DOUBLEWRITE
+    ){
       rc = sqlite3OsSync(pPager->jfd, SQLITE_SYNC_DATAONLY|pPager->syncFlags);
     }
 
@@ -1591,6 +1662,7 @@ static int writeMasterJournal(Pager *pPager, const char *zMaster){
   if( !zMaster 
    || pPager->journalMode==PAGER_JOURNALMODE_MEMORY 
    || pPager->journalMode==PAGER_JOURNALMODE_OFF 
+   || pPager->journalMode==PAGER_JOURNALMODE_DOUBLEWRITE 
   ){
     return SQLITE_OK;
   }
@@ -1664,6 +1736,8 @@ static PgHdr *pager_lookup(Pager *pPager, Pgno pgno){
 static void pager_reset(Pager *pPager){
   sqlite3BackupRestart(pPager->pBackup);
   sqlite3PcacheClear(pPager->pPCache);
+  pPager->iDataVersion++;
+  if( pPager->eTrack!=PAGER_TRACK_NONE ) pPager->eTrack = PAGER_TRACK_UNKNOWN;
 }
 
 /*
@@ -1731,8 +1805,16 @@ static void pager_unlock(Pager *pPager){
 
   sqlite3BitvecDestroy(pPager->pInJournal);
   pPager->pInJournal = 0;
+  sqlite3BitvecDestroy(pPager->pAllRead);
+  pPager->pAllRead = 0;
   releaseAllSavepoints(pPager);
 
+  /* The change-tracking file is opened afresh by each transaction that
+  ** uses it, so that a file deleted by "PRAGMA change_tracking=OFF" on
+  ** some other connection is not written to after the lock is dropped.
+  */
+  sqlite3OsClose(pPager->tfd);
+
   if( pagerUseWal(pPager) ){
     assert( !isOpen(pPager->jfd) );
     sqlite3WalEndReadTransaction(pPager->pWal);
@@ -1861,6 +1943,10 @@ static int pager_error(Pager *pPager, int rc){
 **     the first journal header in the file, and hence the entire journal
 **     file. An invalid journal file cannot be rolled back.
 **
+**   journalMode==DOUBLEWRITE
+**     As for PERSIST, except that the journal file is not synced
+**     afterwards.
+**
 **   journalMode==DELETE
 **     The journal file is closed and deleted using sqlite3OsDelete().
 **
@@ -1922,6 +2008,7 @@ static int pager_end_transaction(Pager *pPager, int hasMaster){
       }
       pPager->journalOff = 0;
     }else if( pPager->journalMode==PAGER_JOURNALMODE_PERSIST
+      || pPager->journalMode==PAGER_JOURNALMODE_DOUBLEWRITE
       || (pPager->exclusiveMode && pPager->journalMode!=PAGER_JOURNALMODE_WAL)
     ){
       rc = zeroJournalHdr(pPager, hasMaster);
@@ -1956,6 +2043,8 @@ static int pager_end_transaction(Pager *pPager, int hasMaster){
 
   sqlite3BitvecDestroy(pPager->pInJournal);
   pPager->pInJournal = 0;
+  sqlite3BitvecDestroy(pPager->pAllRead);
+  pPager->pAllRead = 0;
   pPager->nRec = 0;
   sqlite3PcacheCleanAll(pPager->pPCache);
   sqlite3PcacheTruncate(pPager->pPCache, pPager->dbSize);
@@ -1976,6 +2065,7 @@ static int pager_end_transaction(Pager *pPager, int hasMaster){
   }
   pPager->eState = PAGER_READER;
   pPager->setMaster = 0;
+  pPager->trackCreated = 0;
 
   return (rc==SQLITE_OK?rc2:rc);
 }
@@ -2528,6 +2618,133 @@ static void setSectorSize(Pager *pPager){
   }
 }
 
+/*
+** Add the n bytes of buffer a[] to the double-write file checksum
+** stored in aCksum[]. n must be a multiple of 4.
+*/
+static void pagerDoubleWriteCksum(const u8 *a, int n, u32 *aCksum){
+  u32 s1 = aCksum[0];
+  u32 s2 = aCksum[1];
+  const u8 *aEnd = &a[n];
+
+  assert( (n&3)==0 );
+  while( a<aEnd ){
+    s1 += sqlite3Get4byte(a) + s2;
+    s2 += s1;
+    a += 4;
+  }
+  aCksum[0] = s1;
+  aCksum[1] = s2;
+}
+
+/*
+** This function is called by pager_playback() before it reads the
+** journal file, which is szJ bytes in size. If the journal file is a
+** double-write file (see the comment above aDoubleWriteMagic), set
+** *pbDoubleWrite to true. Otherwise, set it to false and return SQLITE_OK
+** without doing anything else.
+**
+** If the double-write file is complete and was written by the most
+** recent transaction on the database, copy the pages it contains into
+** the database file and set the size of the database file to the one it
+** records. Otherwise, leave the database file as it is. In either case
+** the double-write file is then finalized by pager_playback() in the
+** same way as a journal that has been rolled back.
+*/
+static int pagerPlaybackDoubleWrite(
+  Pager *pPager,                  /* Pager object */
+  int isHot,                      /* True if the journal is hot */
+  i64 szJ,                        /* Size of the journal file in bytes */
+  int *pbDoubleWrite              /* OUT: True for a double-write file */
+){
+  u8 aHdr[DOUBLEWRITE_HDR_SZ];    /* Double-write file header */
+  u8 aBuf[4];                     /* Page number or change counter */
+  u32 aCksum[2] = {0, 0};         /* Checksum of the file content */
+  u32 nRec;                       /* Number of page records */
+  u32 szPage;                     /* Page size */
+  Pgno nDb;                       /* Database size after the commit */
+  u32 u;                          /* Loop counter */
+  i64 iOff;                       /* Offset of the current page record */
+  int rc;                         /* Return code */
+
+  *pbDoubleWrite = 0;
+  if( szJ<DOUBLEWRITE_HDR_SZ ) return SQLITE_OK;
+  rc = sqlite3OsRead(pPager->jfd, aHdr, DOUBLEWRITE_HDR_SZ, 0);
+  if( rc!=SQLITE_OK || memcmp(aHdr, aDoubleWriteMagic, 8) ) return rc;
+  *pbDoubleWrite = 1;
+  pPager->journalOff = szJ;
+
+  nRec = sqlite3Get4byte(&aHdr[8]);
+  szPage = sqlite3Get4byte(&aHdr[12]);
+  nDb = sqlite3Get4byte(&aHdr[16]);
+  if( szPage<512 || szPage>SQLITE_MAX_PAGE_SIZE || ((szPage-1)&szPage)!=0
+   || szJ<DOUBLEWRITE_HDR_SZ + nRec*(i64)(szPage+4)
+  ){
+    return SQLITE_OK;
+  }
+  if( szPage!=(u32)pPager->pageSize ){
+    rc = sqlite3PagerSetPagesize(pPager, &szPage, -1);
+    if( rc!=SQLITE_OK || szPage!=(u32)pPager->pageSize ) return rc;
+  }
+
+  /* Check that the file was completely written before doing anything 
+  ** else. Unlike a rollback journal, none of it may be used otherwise.
+  */
+  iOff = DOUBLEWRITE_HDR_SZ;
+  for(u=0; rc==SQLITE_OK && u<nRec; u++){
+    rc = sqlite3OsRead(pPager->jfd, aBuf, 4, iOff);
+    if( rc==SQLITE_OK ){
+      rc = sqlite3OsRead(pPager->jfd, pPager->pTmpSpace, szPage, iOff+4);
+    }
+    pagerDoubleWriteCksum(aBuf, 4, aCksum);
+    pagerDoubleWriteCksum((u8*)pPager->pTmpSpace, szPage, aCksum);
+    iOff += szPage+4;
+  }
+  if( rc!=SQLITE_OK ) return rc;
+  pagerDoubleWriteCksum(aHdr, 28, aCksum);
+  if( aCksum[0]!=sqlite3Get4byte(&aHdr[28])
+   || aCksum[1]!=sqlite3Get4byte(&aHdr[32])
+  ){
+    return SQLITE_OK;
+  }
+
+  /* Check that no transaction has written to the database file since.
+  ** If the database file is empty, its change counter is read as zero.
+  */
+  rc = sqlite3OsRead(pPager->fd, aBuf, 4, 24);
+  if( rc==SQLITE_IOERR_SHORT_READ ){
+    rc = SQLITE_OK;
+  }
+  if( rc!=SQLITE_OK ) return rc;
+  if( memcmp(aBuf, &aHdr[20], 4) && memcmp(aBuf, &aHdr[24], 4) ){
+    return SQLITE_OK;
+  }
+
+  /* Copy the pages into the database file. */
+  if( isHot ){
+    pager_reset(pPager);
+  }
+  iOff = DOUBLEWRITE_HDR_SZ;
+  for(u=0; rc==SQLITE_OK && u<nRec; u++){
+    Pgno pgno;
+    rc = read32bits(pPager->jfd, iOff, &pgno);
+    if( rc==SQLITE_OK ){
+      rc = sqlite3OsRead(pPager->jfd, pPager->pTmpSpace, szPage, iOff+4);
+    }
+    if( rc==SQLITE_OK && pgno>0 ){
+      i64 ofst = (pgno-1)*(i64)szPage;
+      rc = sqlite3OsWrite(pPager->fd, pPager->pTmpSpace, szPage, ofst);
+      PAGERTRACE(("DOUBLEWRITE %d page %d\n", PAGERID(pPager), pgno));
+    }
+    iOff += szPage+4;
+  }
+  if( rc==SQLITE_OK ){
+    rc = pager_truncate(pPager, nDb - (nDb==PAGER_MJ_PGNO(pPager)));
+    pPager->dbSize = nDb;
+  }
+  return rc;
+}
+
 /*
 ** Playback the journal and thus restore the database file to
 ** the state it was in before we started making changes.  
@@ -2595,6 +2812,7 @@ static int pager_playback(Pager *pPager, int isHot){
   int res = 1;             /* Value returned by sqlite3OsAccess() */
   char *zMaster = 0;       /* Name of master journal file if any */
   int needPagerReset;      /* True to reset page prior to first page rollback */
+  int isDoubleWrite = 0;   /* True if the journal is a double-write file */
 
   /* Figure out how many records are in the journal.  Abort early if
   ** the journal is empty.
@@ -2605,6 +2823,14 @@ static int pager_playback(Pager *pPager, int isHot){
     goto end_playback;
   }
 
+  /* A double-write file is copied forward into the database file, not
+  ** rolled back.
+  */
+  rc = pagerPlaybackDoubleWrite(pPager, isHot, szJ, &isDoubleWrite);
+  if( rc!=SQLITE_OK || isDoubleWrite ){
+    goto end_playback;
+  }
+
   /* Read the master journal name from the journal, if it is present.
   ** If a master journal file name is specified, but the file is not
   ** present on disk, then the journal is not hot and does not need to be
@@ -2746,8 +2972,12 @@ end_playback:
 
   if( rc==SQLITE_OK ){
     zMaster = pPager->pTmpSpace;
-    rc = readMasterJournal(pPager->jfd, zMaster, pPager->pVfs->mxPathname+1);
-    testcase( rc!=SQLITE_OK );
+    if( isDoubleWrite ){
+      zMaster[0] = '\0';
+    }else{
+      rc = readMasterJournal(pPager->jfd, zMaster, pPager->pVfs->mxPathname+1);
+      testcase( rc!=SQLITE_OK );
+    }
   }
   if( rc==SQLITE_OK && !pPager->noSync 
    && (pPager->eState>=PAGER_WRITER_DBMOD || pPager->eState==PAGER_OPEN)
@@ -2845,10 +3075,292 @@ static int readDbPage(PgHdr *pPg){
   return rc;
 }
 
-#ifndef SQLITE_OMIT_WAL
+/*
+** Read nPage consecutive pages of the database, beginning with page
+** iFirst, into buffer aBuf[], which must be at least nPage times the
+** page-size in bytes. The caller must hold a read transaction.
+**
+** If the page cache cannot hold any dirty pages (the pager is in
+** PAGER_READER state), the pages are read straight from the database
+** file with a single call to xRead(), and then any pages that are in
+** the write-ahead log are read from the log. This bypasses the page cache
+** altogether. Otherwise, each page is copied out of the page cache.
+*/
+int sqlite3PagerReadRun(Pager *pPager, Pgno iFirst, int nPage, u8 *aBuf){
+  const int pgsz = pPager->pageSize;
+  int rc = SQLITE_OK;
+  int i;
+
+  assert( pPager->eState>=PAGER_READER );
+  assert( nPage>0 );
+  if( pPager->eState!=PAGER_READER || MEMDB || !isOpen(pPager->fd) ){
+    for(i=0; rc==SQLITE_OK && i<nPage; i++){
+      DbPage *pPg;
+      rc = sqlite3PagerGet(pPager, iFirst+i, &pPg);
+      if( rc==SQLITE_OK ){
+        memcpy(&aBuf[i*pgsz], pPg->pData, pgsz);
+        sqlite3PagerUnref(pPg);
+      }
+    }
+    return rc;
+  }
+
+  rc = sqlite3OsRead(pPager->fd, aBuf, nPage*pgsz, (iFirst-1)*(i64)pgsz);
+  if( rc==SQLITE_IOERR_SHORT_READ ){
+    rc = SQLITE_OK;
+  }
+  for(i=0; rc==SQLITE_OK && i<nPage; i++){
+    u8 *pData = &aBuf[i*pgsz];
+    if( pagerUseWal(pPager) ){
+      int isInWal = 0;
+      rc = sqlite3WalRead(pPager->pWal, iFirst+i, &isInWal, pgsz, pData);
+    }
+    CODEC1(pPager, pData, iFirst+i, 3, rc = SQLITE_NOMEM);
+    PAGER_INCR(sqlite3_pager_readdb_count);
+    PAGER_INCR(pPager->nRead);
+  }
+  return rc;
+}
+
+/*
+** The change-tracking file, if it exists, has the same name as the
+** database file with "-track" appended. It begins with a 12 byte header:
+**
+**   * A 4-byte magic number (PAGER_TRACK_MAGIC),
+**   * The current generation number, and
+**   * A random 4-byte salt, chosen when the file is created.
+**
+** The header is followed by one 4-byte big-endian entry for each page of
+** the database, the entry for page N at byte offset PAGER_TRACK_OFFSET(N).
+** The file is opened with the SQLITE_OPEN_MASTER_JOURNAL flag, as VFS
+** implementations expect a file opened as a main journal to be named and
+** structured like a rollback journal.
+** Each time a page is written to the database file or the write-ahead
+** log the entry for the page is set to the current generation number.
+** Entries for pages that have not been written since the file was
+** created, including those beyond the end of the file, are zero.
+**
+** The generation number is incremented by sqlite3PagerTrackNext(). This
+** allows an incremental backup to find all pages written since the
+** generation it was taken at. Generation numbers start again from 1 if
+** change tracking is turned off and on again, so the salt is used to
+** tell generations of the old file from those of the new.
+*/
+#define PAGER_TRACK_MAGIC     0x7b92c4e1
+#define PAGER_TRACK_HDRSZ     12
+#define PAGER_TRACK_OFFSET(pgno) (PAGER_TRACK_HDRSZ + ((i64)(pgno)-1)*4)
+
+/*
+** If the change-tracking file for pager pPager exists and is not already
+** open, open it. If it does not exist, the file handle Pager.tfd is left
+** closed and SQLITE_OK returned.
+**
+** xAccess() is only called if it is not known whether or not the file
+** exists (see PAGER_TRACK_UNKNOWN).
+*/
+static int pagerOpenTrack(Pager *pPager){
+  int rc = SQLITE_OK;
+  int eTrack = pPager->eTrack;
+  if( !isOpen(pPager->tfd) && eTrack>=PAGER_TRACK_ON ){
+    int bExists = 1;
+    if( eTrack==PAGER_TRACK_UNKNOWN ){
+      rc = sqlite3OsAccess(
+          pPager->pVfs, pPager->zTrack, SQLITE_ACCESS_EXISTS, &bExists
+      );
+    }
+    if( rc==SQLITE_OK && bExists ){
+      int f = SQLITE_OPEN_READWRITE|SQLITE_OPEN_MASTER_JOURNAL;
+      rc = sqlite3OsOpen(pPager->pVfs, pPager->zTrack, pPager->tfd, f, 0);
+      if( rc==SQLITE_CANTOPEN && eTrack==PAGER_TRACK_ON ){
+        /* The file may have been deleted by a connection that rolled
+        ** back the transaction that created it. */
+        rc = sqlite3OsAccess(
+            pPager->pVfs, pPager->zTrack, SQLITE_ACCESS_EXISTS, &bExists
+        );
+        if( rc==SQLITE_OK && bExists ) rc = SQLITE_CANTOPEN_BKPT;
+      }
+    }
+    if( rc==SQLITE_OK ){
+      pPager->eTrack = (bExists ? PAGER_TRACK_ON : PAGER_TRACK_OFF);
+    }
+  }
+  return rc;
+}
+
+/*
+** Read the current generation number and salt from the header of the
+** open change-tracking file into *piGen and *piSalt.
+*/
+static int pagerTrackGeneration(Pager *pPager, u32 *piGen, u32 *piSalt){
+  u8 aHdr[PAGER_TRACK_HDRSZ];
+  int rc;
+  assert( isOpen(pPager->tfd) );
+  rc = sqlite3OsRead(pPager->tfd, aHdr, PAGER_TRACK_HDRSZ, 0);
+  if( rc==SQLITE_IOERR_SHORT_READ
+   || (rc==SQLITE_OK && sqlite3Get4byte(aHdr)!=PAGER_TRACK_MAGIC)
+  ){
+    rc = SQLITE_CORRUPT_BKPT;
+  }
+  *piGen = sqlite3Get4byte(&aHdr[4]);
+  *piSalt = sqlite3Get4byte(&aHdr[8]);
+  return rc;
+}
+
+/*
+** Set the change-tracking entries for the pages in list pList to the
+** current generation. This is called before the pages are written to
+** the database file or log, with the write lock held. Unless the pager
+** is configured with synchronous=OFF, the entries are synced to disk
+** before returning, so that a page is never durably modified without
+** its change-tracking entry being updated too.
+**
+** If change tracking is not enabled for the database, this is a no-op.
+*/
+static int pagerTrackPages(Pager *pPager, PgHdr *pList){
+  u8 *aBuf = (u8*)pPager->pTmpSpace;
+  const int nMax = pPager->pageSize/4;
+  u32 iGen = 0;
+  u32 iSalt = 0;
+  int rc;
+
+  rc = pagerOpenTrack(pPager);
+  if( rc!=SQLITE_OK || !isOpen(pPager->tfd) ) return rc;
+  rc = pagerTrackGeneration(pPager, &iGen, &iSalt);
+
+  /* The list is sorted by page number, so entries for runs of consecutive
+  ** pages can be written with a single call to xWrite(). */
+  while( rc==SQLITE_OK && pList ){
+    const Pgno iFirst = pList->pgno;
+    int n = 0;
+    do{
+      put32bits(&aBuf[n*4], iGen);
+      n++;
+      pList = pList->pDirty;
+    }while( pList && n<nMax && pList->pgno==iFirst+n );
+    rc = sqlite3OsWrite(pPager->tfd, aBuf, n*4, PAGER_TRACK_OFFSET(iFirst));
+  }
+  if( rc==SQLITE_OK && !pPager->noSync ){
+    rc = sqlite3OsSync(pPager->tfd, pPager->syncFlags);
+  }
+  return rc;
+}
+
+/*
+** Enable (if eMode>0) or disable (if eMode==0) change tracking for the
+** database. If eMode is negative, the setting is not changed. Before
+** returning, set *piGen to the current generation number, or to zero if
+** change tracking is not enabled.
+**
+** Enabling change tracking creates the change-tracking file with a
+** generation number of 1 and a new salt, if it does not already exist.
+** Disabling it deletes the file. Either way, the caller must hold the
+** write lock. Page 1 is marked dirty, so that committing the transaction
+** changes the database and other connections check for the file again.
+*/
+int sqlite3PagerTrackChanges(Pager *pPager, int eMode, u32 *piGen){
+  int rc = SQLITE_OK;
+  u32 iSalt = 0;
+
+  *piGen = 0;
+  if( pPager->eTrack==PAGER_TRACK_NONE ) return SQLITE_OK;
+  if( eMode>=0 ){
+    DbPage *pPage1 = 0;
+    assert( pPager->eState>=PAGER_WRITER_LOCKED );
+    rc = sqlite3PagerGet(pPager, 1, &pPage1);
+    if( rc==SQLITE_OK ) rc = sqlite3PagerWrite(pPage1);
+    sqlite3PagerUnref(pPage1);
+  }
+
+  if( rc==SQLITE_OK && eMode==0 ){
+    sqlite3OsClose(pPager->tfd);
+    rc = sqlite3OsDelete(pPager->pVfs, pPager->zTrack, 0);
+    pPager->eTrack = (rc==SQLITE_OK ? PAGER_TRACK_OFF : PAGER_TRACK_UNKNOWN);
+    pPager->trackCreated = 0;
+    return rc;
+  }
+
+  if( rc==SQLITE_OK ) rc = pagerOpenTrack(pPager);
+  if( rc==SQLITE_OK && eMode>0 && !isOpen(pPager->tfd) ){
+    u8 aHdr[PAGER_TRACK_HDRSZ];
+    int f = SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE|SQLITE_OPEN_MASTER_JOURNAL;
+    rc = sqlite3OsOpen(pPager->pVfs, pPager->zTrack, pPager->tfd, f, 0);
+    if( rc==SQLITE_OK ){
+      pPager->eTrack = PAGER_TRACK_ON;
+      pPager->trackCreated = 1;
+      sqlite3_randomness(sizeof(iSalt), &iSalt);
+      put32bits(aHdr, PAGER_TRACK_MAGIC);
+      put32bits(&aHdr[4], 1);
+      put32bits(&aHdr[8], iSalt);
+      rc = sqlite3OsWrite(pPager->tfd, aHdr, PAGER_TRACK_HDRSZ, 0);
+    }
+    if( rc==SQLITE_OK && !pPager->noSync ){
+      rc = sqlite3OsSync(pPager->tfd, pPager->syncFlags);
+    }
+  }
+  if( rc==SQLITE_OK && isOpen(pPager->tfd) ){
+    rc = pagerTrackGeneration(pPager, piGen, &iSalt);
+  }
+
+  /* The file is reopened by the next transaction that needs it. */
+  sqlite3OsClose(pPager->tfd);
+  return rc;
+}
+
+/*
+** Increment the change-tracking generation number. Set *piGen to the
+** generation number before it was incremented, and *piSalt to the salt
+** stored in the change-tracking file. The caller must hold the write
+** lock, so that every transaction that set the change-tracking entries
+** of its pages to that generation number, or any earlier one, has been
+** committed.
+**
+** SQLITE_ERROR is returned if change tracking is not enabled.
+*/
+int sqlite3PagerTrackNext(Pager *pPager, u32 *piGen, u32 *piSalt){
+  u32 iGen = 0;
+  int rc;
+
+  assert( pPager->eState>=PAGER_WRITER_LOCKED );
+  *piSalt = 0;
+  rc = pagerOpenTrack(pPager);
+  if( rc==SQLITE_OK && !isOpen(pPager->tfd) ) rc = SQLITE_ERROR;
+  if( rc==SQLITE_OK ) rc = pagerTrackGeneration(pPager, &iGen, piSalt);
+  if( rc==SQLITE_OK ) rc = write32bits(pPager->tfd, 4, iGen+1);
+  if( rc==SQLITE_OK && !pPager->noSync ){
+    rc = sqlite3OsSync(pPager->tfd, pPager->syncFlags);
+  }
+  *piGen = iGen;
+  return rc;
+}
+
+/*
+** Read the change-tracking entries for the nPage pages starting with
+** page iFirst into array aGen[]. SQLITE_ERROR is returned if change
+** tracking is not enabled.
+*/
+int sqlite3PagerTrackRead(Pager *pPager, Pgno iFirst, int nPage, u32 *aGen){
+  int rc;
+  int i;
+
+  rc = pagerOpenTrack(pPager);
+  if( rc==SQLITE_OK && !isOpen(pPager->tfd) ) rc = SQLITE_ERROR;
+  if( rc==SQLITE_OK ){
+    rc = sqlite3OsRead(pPager->tfd, aGen, nPage*4, PAGER_TRACK_OFFSET(iFirst));
+    if( rc==SQLITE_IOERR_SHORT_READ ){
+      rc = SQLITE_OK;
+    }
+  }
+  for(i=0; rc==SQLITE_OK && i<nPage; i++){
+    aGen[i] = sqlite3Get4byte((u8*)&aGen[i]);
+  }
+  return rc;
+}
+
 /*
 ** This function is invoked once for each page that has already been 
-** written into the log file when a WAL transaction is rolled back.
+** written into the log file when a WAL transaction is rolled back, and
+** for each dirty page when a transaction that has not journalled any
+** pages (a WAL or doublewrite transaction) is rolled back.
 ** Parameter iPg is the page number of said page. The pCtx argument 
 ** is actually a pointer to the Pager structure.
 **
@@ -2889,12 +3401,42 @@ static int pagerUndoCallback(void *pCtx, Pgno iPg){
   return rc;
 }
 
+/*
+** Invoke pagerUndoCallback() for each page in the dirty list of pager
+** pPager, stopping if an error occurs. Return SQLITE_OK or the error
+** code returned by pagerUndoCallback().
+*/
+static int pagerUndoDirtyPages(Pager *pPager){
+  int rc = SQLITE_OK;             /* Return Code */
+  PgHdr *pList;                   /* List of dirty pages to revert */
+
+  pList = sqlite3PcacheDirtyList(pPager->pPCache);
+  while( pList && rc==SQLITE_OK ){
+    PgHdr *pNext = pList->pDirty;
+    rc = pagerUndoCallback((void *)pPager, pList->pgno);
+    pList = pNext;
+  }
+  return rc;
+}
+
+/*
+** This function is called to rollback a transaction in doublewrite mode
+** before the database file has been written. It is enough to revert the
+** dirty pages in the cache.
+*/
+static int pagerRollbackDoubleWrite(Pager *pPager){
+  assert( pPager->journalMode==PAGER_JOURNALMODE_DOUBLEWRITE );
+  assert( pPager->eState<PAGER_WRITER_DBMOD );
+  pPager->dbSize = pPager->dbOrigSize;
+  return pagerUndoDirtyPages(pPager);
+}
+
+#ifndef SQLITE_OMIT_WAL
 /*
 ** This function is called to rollback a transaction on a WAL database.
 */
 static int pagerRollbackWal(Pager *pPager){
   int rc;                         /* Return Code */
-  PgHdr *pList;                   /* List of dirty pages to revert */
 
   /* For all pages in the cache that are currently dirty or have already
   ** been written (but not committed) to the log file, do one of the 
@@ -2905,11 +3447,8 @@ static int pagerRollbackWal(Pager *pPager){
   */
   pPager->dbSize = pPager->dbOrigSize;
   rc = sqlite3WalUndo(pPager->pWal, pagerUndoCallback, (void *)pPager);
-  pList = sqlite3PcacheDirtyList(pPager->pPCache);
-  while( pList && rc==SQLITE_OK ){
-    PgHdr *pNext = pList->pDirty;
-    rc = pagerUndoCallback((void *)pPager, pList->pgno);
-    pList = pNext;
+  if( rc==SQLITE_OK ){
+    rc = pagerUndoDirtyPages(pPager);
   }
 
   return rc;
@@ -2918,8 +3457,8 @@ static int pagerRollbackWal(Pager *pPager){
 /*
 ** This function is a wrapper around sqlite3WalFrames(). As well as logging
 ** the contents of the list of pages headed by pList (connected by pDirty),
-** this function notifies any active backup processes that the pages have
-** changed. 
+** this function updates the change-tracking entries for the pages and
+** notifies any active backup processes that the pages have changed. 
 */ 
 static int pagerWalFrames(
   Pager *pPager,                  /* Pager object */
@@ -2931,9 +3470,12 @@ static int pagerWalFrames(
   int rc;                         /* Return code */
 
   assert( pPager->pWal );
-  rc = sqlite3WalFrames(pPager->pWal, 
-      pPager->pageSize, pList, nTruncate, isCommit, syncFlags
-  );
+  rc = pagerTrackPages(pPager, pList);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3WalFrames(pPager->pWal, 
+        pPager->pageSize, pList, nTruncate, isCommit, syncFlags
+    );
+  }
   if( rc==SQLITE_OK && pPager->pBackup ){
     PgHdr *p;
     for(p=pList; p; p=p->pDirty){
@@ -3717,6 +4259,7 @@ int sqlite3PagerClose(Pager *pPager){
   PAGERTRACE(("CLOSE %d\n", PAGERID(pPager)));
   IOTRACE(("CLOSE %p\n", pPager))
   sqlite3OsClose(pPager->jfd);
+  sqlite3OsClose(pPager->tfd);
   sqlite3OsClose(pPager->fd);
   sqlite3PageFree(pTmp);
   sqlite3PcacheClose(pPager->pPCache);
@@ -3928,6 +4471,7 @@ static int syncJournal(Pager *pPager, int newHdr){
 */
 static int pager_write_pagelist(Pager *pPager, PgHdr *pList){
   int rc = SQLITE_OK;                  /* Return code */
+  int bBatch = 0;                      /* True if the VFS is batching writes */
 
   /* This function is only called for rollback pagers in WRITER_DBMOD state. */
   assert( !pagerUseWal(pPager) );
@@ -3953,6 +4497,17 @@ static int pager_write_pagelist(Pager *pPager, PgHdr *pList){
     pPager->dbHintSize = pPager->dbSize;
   }
 
+  /* Update the change-tracking entries for the pages about to be written. */
+  if( rc==SQLITE_OK ){
+    rc = pagerTrackPages(pPager, pList);
+  }
+
+  /* Allow the VFS to issue the page writes together. */
+  if( rc==SQLITE_OK ){
+    bBatch = SQLITE_OK==
+        sqlite3OsFileControl(pPager->fd, SQLITE_FCNTL_BEGIN_BATCH, 0);
+  }
+
   while( rc==SQLITE_OK && pList ){
     Pgno pgno = pList->pgno;
 
@@ -3971,7 +4526,7 @@ static int pager_write_pagelist(Pager *pPager, PgHdr *pList){
       assert( (pList->flags&PGHDR_NEED_SYNC)==0 );
 
       /* Encode the database */
-      CODEC2(pPager, pList->pData, pgno, 6, return SQLITE_NOMEM, pData);
+      CODEC2(pPager, pList->pData, pgno, 6, rc = SQLITE_NOMEM; break, pData);
 
       /* Write out the page data. */
       rc = sqlite3OsWrite(pPager->fd, pData, pPager->pageSize, offset);
@@ -4002,6 +4557,10 @@ static int pager_write_pagelist(Pager *pPager, PgHdr *pList){
     pList = pList->pDirty;
   }
 
+  if( bBatch ){
+    int rc2 = sqlite3OsFileControl(pPager->fd, SQLITE_FCNTL_END_BATCH, 0);
+    if( rc==SQLITE_OK ) rc = rc2;
+  }
   return rc;
 }
 
@@ -4045,9 +4604,12 @@ static int subjournalPage(PgHdr *pPg){
 
     /* Open the sub-journal, if it has not already been opened */
     assert( pPager->useJournal );
-    assert( isOpen(pPager->jfd) || pagerUseWal(pPager) );
+    assert( isOpen(pPager->jfd) || pagerUseWal(pPager) 
+         || pPager->journalMode==PAGER_JOURNALMODE_DOUBLEWRITE 
+    );
     assert( isOpen(pPager->sjfd) || pPager->nSubRec==0 );
     assert( pagerUseWal(pPager) 
+         || pPager->journalMode==PAGER_JOURNALMODE_DOUBLEWRITE 
          || pageInJournal(pPg) 
          || pPg->pgno>pPager->dbOrigSize 
     );
@@ -4119,6 +4681,16 @@ static int pagerStress(void *p, PgHdr *pPg){
   */
   if( NEVER(pPager->errCode) ) return SQLITE_OK;
   if( pPager->doNotSpill ) return SQLITE_OK;
+
+  /* A BEGIN CONCURRENT transaction does not hold the WAL write-lock
+  ** until it commits, so it cannot write frames to the log before then.
+  */
+  if( pPager->pAllRead ) return SQLITE_OK;
+
+  /* In doublewrite mode, the database file may not be written until the
+  ** double-write file has been written and synced at commit time.
+  */
+  if( pPager->journalMode==PAGER_JOURNALMODE_DOUBLEWRITE ) return SQLITE_OK;
   if( pPager->doNotSyncSpill && (pPg->flags & PGHDR_NEED_SYNC)!=0 ){
     return SQLITE_OK;
   }
@@ -4305,16 +4877,20 @@ int sqlite3PagerOpen(
   **     Database file handle            (pVfs->szOsFile bytes)
   **     Sub-journal file handle         (journalFileSize bytes)
   **     Main journal file handle        (journalFileSize bytes)
+  **     Change-tracking file handle     (pVfs->szOsFile bytes)
   **     Database file name              (nPathname+1 bytes)
   **     Journal file name               (nPathname+8+1 bytes)
+  **     Change-tracking file name       (nPathname+6+1 bytes)
   */
   pPtr = (u8 *)sqlite3MallocZero(
     ROUND8(sizeof(*pPager)) +      /* Pager structure */
     ROUND8(pcacheSize) +           /* PCache object */
     ROUND8(pVfs->szOsFile) +       /* The main db file */
     journalFileSize * 2 +          /* The two journal files */ 
+    ROUND8(pVfs->szOsFile) +       /* The change-tracking file */
     nPathname + 1 +                /* zFilename */
-    nPathname + 8 + 1              /* zJournal */
+    nPathname + 8 + 1 +            /* zJournal */
+    nPathname + 6 + 1              /* zTrack */
 #ifndef SQLITE_OMIT_WAL
     + nPathname + 4 + 1              /* zWal */
 #endif
@@ -4329,7 +4905,8 @@ int sqlite3PagerOpen(
   pPager->fd =   (sqlite3_file*)(pPtr += ROUND8(pcacheSize));
   pPager->sjfd = (sqlite3_file*)(pPtr += ROUND8(pVfs->szOsFile));
   pPager->jfd =  (sqlite3_file*)(pPtr += journalFileSize);
-  pPager->zFilename =    (char*)(pPtr += journalFileSize);
+  pPager->tfd =  (sqlite3_file*)(pPtr += journalFileSize);
+  pPager->zFilename =    (char*)(pPtr += ROUND8(pVfs->szOsFile));
   assert( EIGHT_BYTE_ALIGNMENT(pPager->jfd) );
 
   /* Fill in the Pager.zFilename and Pager.zJournal buffers, if required. */
@@ -4339,8 +4916,11 @@ int sqlite3PagerOpen(
     memcpy(pPager->zFilename, zPathname, nPathname);
     memcpy(pPager->zJournal, zPathname, nPathname);
     memcpy(&pPager->zJournal[nPathname], "-journal", 8);
+    pPager->zTrack = &pPager->zJournal[nPathname+8+1];
+    memcpy(pPager->zTrack, zPathname, nPathname);
+    memcpy(&pPager->zTrack[nPathname], "-track", 6);
 #ifndef SQLITE_OMIT_WAL
-    pPager->zWal = &pPager->zJournal[nPathname+8+1];
+    pPager->zWal = &pPager->zTrack[nPathname+6+1];
     memcpy(pPager->zWal, zPathname, nPathname);
     memcpy(&pPager->zWal[nPathname], "-wal", 4);
 #endif
@@ -4455,6 +5035,7 @@ int sqlite3PagerOpen(
   pPager->changeCountDone = pPager->tempFile;
   pPager->memDb = (u8)memDb;
   pPager->readOnly = (u8)readOnly;
+  if( pPager->zTrack && !tempFile ) pPager->eTrack = PAGER_TRACK_UNKNOWN;
   assert( useJournal || pPager->tempFile );
   pPager->noSync = pPager->tempFile;
   pPager->fullSync = pPager->noSync ?0:1;
@@ -4914,6 +5495,18 @@ int sqlite3PagerAcquire(
     return SQLITE_CORRUPT_BKPT;
   }
 
+  /* Record the pages read by a BEGIN CONCURRENT transaction.  Pages
+  ** beyond the end of the database at the start of the transaction
+  ** are not recorded, as they cannot have been read from its snapshot.
+  */
+  if( pPager->pAllRead && pgno<=sqlite3BitvecSize(pPager->pAllRead) ){
+    rc = sqlite3BitvecSet(pPager->pAllRead, pgno);
+    if( rc!=SQLITE_OK ){
+      *ppPage = 0;
+      return rc;
+    }
+  }
+
   /* If the pager is in the error state, return an error immediately. 
   ** Otherwise, request the page from the PCache layer. */
   if( pPager->errCode!=SQLITE_OK ){
@@ -5037,6 +5630,16 @@ void sqlite3PagerUnref(DbPage *pPg){
   }
 }
 
+/*
+** Pass a chunk size to file pFile using SQLITE_FCNTL_CHUNK_SIZE, unless
+** pFile is an in-memory journal, which does not support file-controls.
+*/
+static void pagerSetChunkSize(sqlite3_file *pFile, int szChunk){
+  if( pFile->pMethods->xFileControl ){
+    sqlite3OsFileControl(pFile, SQLITE_FCNTL_CHUNK_SIZE, (void*)&szChunk);
+  }
+}
+
 /*
 ** This function is called at the start of every write transaction.
 ** There must already be a RESERVED or EXCLUSIVE lock on the database 
@@ -5072,7 +5675,12 @@ static int pager_open_journal(Pager *pPager){
   ** an error state. */
   if( NEVER(pPager->errCode) ) return pPager->errCode;
 
-  if( !pagerUseWal(pPager) && pPager->journalMode!=PAGER_JOURNALMODE_OFF ){
+  /* No rollback journal is written in doublewrite mode. The double-write
+  ** file is opened and written when the transaction is committed.
+  */
+  if( !pagerUseWal(pPager) && pPager->journalMode!=PAGER_JOURNALMODE_OFF 
+   && pPager->journalMode!=PAGER_JOURNALMODE_DOUBLEWRITE 
+  ){
     pPager->pInJournal = sqlite3BitvecCreate(pPager->dbSize);
     if( pPager->pInJournal==0 ){
       return SQLITE_NOMEM;
@@ -5098,6 +5706,9 @@ static int pager_open_journal(Pager *pPager){
   #endif
       }
       assert( rc!=SQLITE_OK || isOpen(pPager->jfd) );
+      if( rc==SQLITE_OK && pPager->szChunk ){
+        pagerSetChunkSize(pPager->jfd, pPager->szChunk);
+      }
     }
   
   
@@ -5125,6 +5736,60 @@ static int pager_open_journal(Pager *pPager){
   return rc;
 }
 
+/*
+** This function is called when a BEGIN CONCURRENT transaction opens
+** its snapshot of a WAL database.  From now until the end of the
+** transaction, the pager records the set of pages read, and does not
+** take the WAL write-lock when the transaction starts writing.  Instead,
+** the transaction is checked for conflicts with other writers when it
+** commits.
+**
+** If the database is not in WAL mode, this is a no-op, and a BEGIN
+** CONCURRENT transaction is the same as a BEGIN DEFERRED one.
+*/
+int sqlite3PagerBeginConcurrent(Pager *pPager){
+  assert( pPager->eState>=PAGER_READER );
+  if( pagerUseWal(pPager) && pPager->eState==PAGER_READER
+   && pPager->pAllRead==0
+  ){
+    pPager->pAllRead = sqlite3BitvecCreate(pPager->dbSize ? pPager->dbSize : 1);
+    if( pPager->pAllRead==0 ) return SQLITE_NOMEM;
+  }
+  return SQLITE_OK;
+}
+
+#ifndef SQLITE_OMIT_WAL
+/*
+** Obtain the WAL write-lock for a BEGIN CONCURRENT transaction that is
+** about to commit, invoking the busy-handler while it is held by another
+** connection.  Return SQLITE_BUSY_SNAPSHOT if the transaction conflicts
+** with one committed since its snapshot was opened.
+**
+** If other transactions have extended the database file and this one
+** has not (which would have modified page 1, and therefore conflicted),
+** the database size written with the commit is the new size.
+*/
+static int pagerLockForCommit(Pager *pPager){
+  int rc;
+  PgHdr *pPg1 = pager_lookup(pPager, 1);
+  const u8 *aPg1 = pPg1 ? (const u8 *)pPg1->pData : 0;
+  int bPg1Dirty = pPg1 && (pPg1->flags & PGHDR_DIRTY);
+
+  do{
+    rc = sqlite3WalLockForCommit(pPager->pWal, pPager->pAllRead,aPg1,bPg1Dirty);
+  }while( rc==SQLITE_BUSY && pPager->xBusyHandler(pPager->pBusyHandlerArg) );
+  if( pPg1 ) sqlite3PagerUnref(pPg1);
+
+  if( rc==SQLITE_OK && !bPg1Dirty ){
+    Pgno nPage = sqlite3WalDbsize(pPager->pWal);
+    if( nPage>pPager->dbSize ) pPager->dbSize = nPage;
+  }
+  return rc;
+}
+#else
+# define pagerLockForCommit(x) SQLITE_OK
+#endif
+
 /*
 ** Begin a write-transaction on the specified pager object. If a 
 ** write-transaction has already been opened, this function is a no-op.
@@ -5168,8 +5833,13 @@ int sqlite3PagerBegin(Pager *pPager, int exFlag, int subjInMemory){
       ** PAGER_RESERVED state. Otherwise, return an error code to the caller.
       ** The busy-handler is not invoked if another connection already
       ** holds the write-lock. If possible, the upper layer will call it.
+      **
+      ** A BEGIN CONCURRENT transaction does not take the write lock until
+      ** it commits. See pagerLockForCommit().
       */
-      rc = sqlite3WalBeginWriteTransaction(pPager->pWal);
+      if( pPager->pAllRead==0 ){
+        rc = sqlite3WalBeginWriteTransaction(pPager->pWal);
+      }
     }else{
       /* Obtain a RESERVED lock on the database file. If the exFlag parameter
       ** is true, then immediately upgrade this to an EXCLUSIVE lock. The
@@ -5268,7 +5938,9 @@ static int pager_write(PgHdr *pPg){
     ** EXCLUSIVE lock on the main database file.  Write the current page to
     ** the transaction journal if it is not there already.
     */
-    if( !pageInJournal(pPg) && !pagerUseWal(pPager) ){
+    if( !pageInJournal(pPg) && !pagerUseWal(pPager)
+     && pPager->journalMode!=PAGER_JOURNALMODE_DOUBLEWRITE
+    ){
       assert( pagerUseWal(pPager)==0 );
       if( pPg->pgno<=pPager->dbOrigSize && isOpen(pPager->jfd) ){
         u32 cksum;
@@ -5623,6 +6295,120 @@ int sqlite3PagerExclusiveLock(Pager *pPager){
   return rc;
 }
 
+/*
+** This function is called in place of syncJournal() when a transaction
+** is committed in doublewrite mode. It obtains an EXCLUSIVE lock on the
+** database file, writes each dirty page that will be written to the
+** database file into the double-write file followed by the header that
+** makes it valid, and syncs the double-write file (unless the pager is
+** in no-sync mode). The double-write file is opened first if necessary.
+**
+** Pager.journalOff is set to the size of the double-write file before 
+** anything is written to it, so that it is zeroed when the transaction
+** is concluded. If successful, the pager moves to WRITER_DBMOD state and
+** SQLITE_OK is returned. Otherwise, an SQLite error code is returned and
+** the database file has not been written.
+*/
+static int pagerWriteDoubleWrite(Pager *pPager){
+  int rc;                         /* Return code */
+  int bBatch;                     /* True if the VFS is batching writes */
+  u8 aHdr[DOUBLEWRITE_HDR_SZ];    /* Double-write file header */
+  u32 aCksum[2] = {0, 0};         /* Checksum of the file content */
+  u32 nRec = 0;                   /* Number of page records written */
+  i64 iOff = DOUBLEWRITE_HDR_SZ;  /* Offset of next page record */
+  PgHdr *pList;                   /* Dirty pages to write */
+  PgHdr *p;                       /* Iterator variable */
+
+  assert( pPager->journalMode==PAGER_JOURNALMODE_DOUBLEWRITE );
+  assert( pPager->eState==PAGER_WRITER_CACHEMOD );
+  assert( pPager->journalOff==0 );
+  assert( !pPager->tempFile );
+
+  rc = sqlite3PagerExclusiveLock(pPager);
+  if( rc!=SQLITE_OK ) return rc;
+
+  /* The double-write file is left in place after each transaction. Try 
+  ** to open an existing file before creating one, as the VFS may sync the
+  ** directory after a new journal file is first synced.
+  */
+  if( !isOpen(pPager->jfd) ){
+    const int flags = SQLITE_OPEN_READWRITE|SQLITE_OPEN_MAIN_JOURNAL;
+    rc = sqlite3OsOpen(pPager->pVfs, pPager->zJournal, pPager->jfd, flags, 0);
+    if( rc!=SQLITE_OK ){
+      rc = sqlite3OsOpen(pPager->pVfs, pPager->zJournal, pPager->jfd, 
+                         flags|SQLITE_OPEN_CREATE, 0);
+    }
+    if( rc!=SQLITE_OK ) return rc;
+    if( pPager->szChunk ){
+      pagerSetChunkSize(pPager->jfd, pPager->szChunk);
+    }
+  }
+  bBatch = SQLITE_OK==
+      sqlite3OsFileControl(pPager->jfd, SQLITE_FCNTL_BEGIN_BATCH, 0);
+
+  /* Count the page records, so that Pager.journalOff can be set first. */
+  pList = sqlite3PcacheDirtyList(pPager->pPCache);
+  for(p=pList; p; p=p->pDirty){
+    if( p->pgno<=pPager->dbSize && 0==(p->flags&PGHDR_DONT_WRITE) ){
+      nRec++;
+    }
+  }
+  pPager->journalOff = DOUBLEWRITE_HDR_SZ + nRec*(i64)(4+pPager->pageSize);
+
+  /* The change counter after this transaction is taken from page 1, if it
+  ** is written. Otherwise it does not change. */
+  memcpy(&aHdr[24], pPager->dbFileVers, 4);
+  for(p=pList; rc==SQLITE_OK && p; p=p->pDirty){
+    if( p->pgno<=pPager->dbSize && 0==(p->flags&PGHDR_DONT_WRITE) ){
+      u8 aPgno[4];
+      char *pData;
+      put32bits(aPgno, p->pgno);
+      CODEC2(pPager, p->pData, p->pgno, 6, rc = SQLITE_NOMEM; break, pData);
+      rc = sqlite3OsWrite(pPager->jfd, aPgno, 4, iOff);
+      if( rc==SQLITE_OK ){
+        rc = sqlite3OsWrite(pPager->jfd, pData, pPager->pageSize, iOff+4);
+      }
+      pagerDoubleWriteCksum(aPgno, 4, aCksum);
+      pagerDoubleWriteCksum((u8*)pData, pPager->pageSize, aCksum);
+      if( p->pgno==1 ){
+        memcpy(&aHdr[24], &pData[24], 4);
+      }
+      IOTRACE(("DWOUT %p %d %lld %d\n", pPager, p->pgno, iOff,
+               pPager->pageSize));
+      iOff += 4+pPager->pageSize;
+    }
+  }
+  assert( rc!=SQLITE_OK || iOff==pPager->journalOff );
+
+  /* Write the header. The file is not valid until this is done. */
+  if( rc==SQLITE_OK ){
+    memcpy(aHdr, aDoubleWriteMagic, sizeof(aDoubleWriteMagic));
+    put32bits(&aHdr[8], nRec);
+    put32bits(&aHdr[12], pPager->pageSize);
+    put32bits(&aHdr[16], pPager->dbSize);
+    memcpy(&aHdr[20], pPager->dbFileVers, 4);
+    pagerDoubleWriteCksum(aHdr, 28, aCksum);
+    put32bits(&aHdr[28], aCksum[0]);
+    put32bits(&aHdr[32], aCksum[1]);
+    rc = sqlite3OsWrite(pPager->jfd, aHdr, DOUBLEWRITE_HDR_SZ, 0);
+  }
+  if( rc==SQLITE_OK && !pPager->noSync ){
+    IOTRACE(("DWSYNC %p\n", pPager))
+    rc = sqlite3OsSync(pPager->jfd, pPager->syncFlags);
+  }
+  if( bBatch ){
+    int rc2 = sqlite3OsFileControl(pPager->jfd, SQLITE_FCNTL_END_BATCH, 0);
+    if( rc==SQLITE_OK ) rc = rc2;
+  }
+
+  if( rc==SQLITE_OK ){
+    sqlite3PcacheClearSyncFlags(pPager->pPCache);
+    pPager->eState = PAGER_WRITER_DBMOD;
+    assert( assert_pager_state(pPager) );
+  }
+  return rc;
+}
+
 /*
 ** Sync the database file for the pager pPager. zMaster points to the name
 ** of a master journal file that should be written into the individual
@@ -5655,6 +6441,7 @@ int sqlite3PagerCommitPhaseOne(
   int noSync                      /* True to omit the xSync on the db file */
 ){
   int rc = SQLITE_OK;             /* Return code */
+  int bBatch = 0;                 /* True if the VFS is batching writes */
 
   assert( pPager->eState==PAGER_WRITER_LOCKED
        || pPager->eState==PAGER_WRITER_CACHEMOD
@@ -5681,7 +6468,10 @@ int sqlite3PagerCommitPhaseOne(
   }else{
     if( pagerUseWal(pPager) ){
       PgHdr *pList = sqlite3PcacheDirtyList(pPager->pPCache);
-      if( pList ){
+      if( pList && pPager->pAllRead ){
+        rc = pagerLockForCommit(pPager);
+      }
+      if( pList && rc==SQLITE_OK ){
         rc = pagerWalFrames(pPager, pList, pPager->dbSize, 1, 
             (pPager->fullSync ? pPager->syncFlags : 0)
         );
@@ -5755,6 +6545,7 @@ int sqlite3PagerCommitPhaseOne(
   #ifndef SQLITE_OMIT_AUTOVACUUM
       if( pPager->dbSize<pPager->dbOrigSize 
        && pPager->journalMode!=PAGER_JOURNALMODE_OFF
+       && pPager->journalMode!=PAGER_JOURNALMODE_DOUBLEWRITE
       ){
         Pgno i;                                   /* Iterator variable */
         const Pgno iSkip = PAGER_MJ_PGNO(pPager); /* Pending lock page */
@@ -5791,9 +6582,20 @@ int sqlite3PagerCommitPhaseOne(
       ** on a system under memory pressure it is just possible that this is 
       ** not the case. In this case it is likely enough that the redundant
       ** xSync() call will be changed to a no-op by the OS anyhow. 
+      **
+      ** In doublewrite mode, write and sync the double-write file instead.
       */
-      rc = syncJournal(pPager, 0);
+      if( pPager->journalMode==PAGER_JOURNALMODE_DOUBLEWRITE ){
+        rc = pagerWriteDoubleWrite(pPager);
+      }else{
+        rc = syncJournal(pPager, 0);
+      }
       if( rc!=SQLITE_OK ) goto commit_phase_one_exit;
+
+      /* Let the VFS issue the page writes and the sync that follows them
+      ** together. The batch ends at commit_phase_one_exit. */
+      bBatch = isOpen(pPager->fd) && SQLITE_OK==
+          sqlite3OsFileControl(pPager->fd, SQLITE_FCNTL_BEGIN_BATCH, 0);
   
       rc = pager_write_pagelist(pPager,sqlite3PcacheDirtyList(pPager->pPCache));
       if( rc!=SQLITE_OK ){
@@ -5821,6 +6623,10 @@ int sqlite3PagerCommitPhaseOne(
   }
 
 commit_phase_one_exit:
+  if( bBatch ){
+    int rc2 = sqlite3OsFileControl(pPager->fd, SQLITE_FCNTL_END_BATCH, 0);
+    if( rc==SQLITE_OK ) rc = rc2;
+  }
   if( rc==SQLITE_OK && !pagerUseWal(pPager) ){
     pPager->eState = PAGER_WRITER_FINISHED;
   }
@@ -5920,14 +6726,38 @@ int sqlite3PagerRollback(Pager *pPager){
   if( pPager->eState==PAGER_ERROR ) return pPager->errCode;
   if( pPager->eState<=PAGER_READER ) return SQLITE_OK;
 
-  if( pagerUseWal(pPager) ){
+  /* If this transaction created the change-tracking file, delete it.
+  ** Otherwise, other connections might not notice that it exists, as the
+  ** rollback undoes the change to page 1 that would make them check.
+  */
+  if( pPager->trackCreated ){
+    sqlite3OsClose(pPager->tfd);
+    rc = sqlite3OsDelete(pPager->pVfs, pPager->zTrack, 0);
+    pPager->eTrack = (rc==SQLITE_OK ? PAGER_TRACK_OFF : PAGER_TRACK_UNKNOWN);
+  }
+
+  if( rc!=SQLITE_OK ){
+    /* Leave the transaction to be rolled back by pager_error() */
+  }else if( pagerUseWal(pPager) ){
     int rc2;
     rc = sqlite3PagerSavepoint(pPager, SAVEPOINT_ROLLBACK, -1);
     rc2 = pager_end_transaction(pPager, pPager->setMaster);
     if( rc==SQLITE_OK ) rc = rc2;
+  }else if( pPager->journalMode==PAGER_JOURNALMODE_DOUBLEWRITE
+         && pPager->eState<PAGER_WRITER_DBMOD
+  ){
+    int rc2;
+    rc = pagerRollbackDoubleWrite(pPager);
+    rc2 = pager_end_transaction(pPager, 0);
+    if( rc==SQLITE_OK ) rc = rc2;
   }else if( !isOpen(pPager->jfd) || pPager->eState==PAGER_WRITER_LOCKED ){
     rc = pager_end_transaction(pPager, 0);
   }else{
+    /* In doublewrite mode, the database file may already have been
+    ** partly written by this transaction, and the original content of
+    ** the pages written is not stored anywhere. The transaction is
+    ** completed from the double-write file instead of being rolled back.
+    */
     rc = pager_playback(pPager, 0);
   }
 
@@ -5974,6 +6804,16 @@ int sqlite3PagerPageRefcount(DbPage *pPage){
   return sqlite3PcachePageRefcount(pPage);
 }
 
+/*
+** Return a value that changes each time the page cache is discarded,
+** for example because the database file was modified by another
+** connection. Data that the caller derived from the contents of the
+** cache is stale if this value has changed since it was derived.
+*/
+u32 sqlite3PagerDataVersion(Pager *pPager){
+  return pPager->iDataVersion;
+}
+
 #ifdef SQLITE_TEST
 /*
 ** This routine is used for testing and analysis only.
@@ -6127,8 +6967,12 @@ int sqlite3PagerSavepoint(Pager *pPager, int op, int iSavepoint){
     ** If this is a temp-file, it is possible that the journal file has
     ** not yet been opened. In this case there have been no changes to
     ** the database file, so the playback operation can be skipped.
+    ** In doublewrite mode the journal file is not opened until commit
+    ** time, and the savepoint is played back from the sub-journal only.
     */
-    else if( pagerUseWal(pPager) || isOpen(pPager->jfd) ){
+    else if( pagerUseWal(pPager) || isOpen(pPager->jfd) 
+          || pPager->journalMode==PAGER_JOURNALMODE_DOUBLEWRITE 
+    ){
       PagerSavepoint *pSavepoint = (nNew==0)?0:&pPager->aSavepoint[nNew-1];
       rc = pagerPlaybackSavepoint(pPager, pSavepoint);
       assert(rc!=SQLITE_DONE);
@@ -6428,7 +7272,8 @@ int sqlite3PagerSetJournalMode(Pager *pPager, int eMode){
             || eMode==PAGER_JOURNALMODE_PERSIST
             || eMode==PAGER_JOURNALMODE_OFF 
             || eMode==PAGER_JOURNALMODE_WAL 
-            || eMode==PAGER_JOURNALMODE_MEMORY );
+            || eMode==PAGER_JOURNALMODE_MEMORY
+            || eMode==PAGER_JOURNALMODE_DOUBLEWRITE );
 
   /* This routine is only called from the OP_JournalMode opcode, and
   ** the logic there will never allow a temporary file to be changed
@@ -6446,6 +7291,13 @@ int sqlite3PagerSetJournalMode(Pager *pPager, int eMode){
     }
   }
 
+  /* A temporary file is never synced, so there is nothing to be gained
+  ** by using a double-write file for it.
+  */
+  if( pPager->tempFile && eMode==PAGER_JOURNALMODE_DOUBLEWRITE ){
+    eMode = eOld;
+  }
+
   if( eMode!=eOld ){
 
     /* Change the journal mode. */
@@ -6453,8 +7305,9 @@ int sqlite3PagerSetJournalMode(Pager *pPager, int eMode){
     pPager->journalMode = (u8)eMode;
 
     /* When transistioning from TRUNCATE or PERSIST to any other journal
-    ** mode except WAL, unless the pager is in locking_mode=exclusive mode,
-    ** delete the journal file.
+    ** mode except WAL, or from DOUBLEWRITE to any other journal mode,
+    ** unless the pager is in locking_mode=exclusive mode, delete the 
+    ** journal file.
     */
     assert( (PAGER_JOURNALMODE_TRUNCATE & 5)==1 );
     assert( (PAGER_JOURNALMODE_PERSIST & 5)==1 );
@@ -6464,7 +7317,11 @@ int sqlite3PagerSetJournalMode(Pager *pPager, int eMode){
     assert( (PAGER_JOURNALMODE_WAL & 5)==5 );
 
     assert( isOpen(pPager->fd) || pPager->exclusiveMode );
-    if( !pPager->exclusiveMode && (eOld & 5)==1 && (eMode & 1)==0 ){
+    assert( (PAGER_JOURNALMODE_DOUBLEWRITE & 5)==4 );
+    if( !pPager->exclusiveMode 
+     && (((eOld & 5)==1 && (eMode & 1)==0) 
+         || eOld==PAGER_JOURNALMODE_DOUBLEWRITE)
+    ){
 
       /* In this case we would like to delete the journal file. If it is
       ** not possible, then that is not a problem. Deleting the journal file
@@ -6537,6 +7394,30 @@ i64 sqlite3PagerJournalSizeLimit(Pager *pPager, i64 iLimit){
   return pPager->journalSizeLimit;
 }
 
+/*
+** Get/set the chunk size, in bytes, used to extend and truncate the
+** database file, its journal file and its WAL file. The VFS preallocates
+** space in these files a chunk at a time. A chunk size of zero turns this
+** off. A negative value leaves the chunk size unchanged.
+*/
+int sqlite3PagerChunkSize(Pager *pPager, int szChunk){
+  if( szChunk>=0 ){
+    pPager->szChunk = szChunk;
+    if( isOpen(pPager->fd) ){
+      sqlite3OsFileControl(pPager->fd, SQLITE_FCNTL_CHUNK_SIZE, &szChunk);
+    }
+    if( isOpen(pPager->jfd) ){
+      pagerSetChunkSize(pPager->jfd, szChunk);
+    }
+#ifndef SQLITE_OMIT_WAL
+    if( pPager->pWal ){
+      sqlite3WalChunkSize(pPager->pWal, szChunk);
+    }
+#endif
+  }
+  return pPager->szChunk;
+}
+
 /*
 ** Return a pointer to the pPager->pBackup variable. The backup module
 ** in backup.c maintains the content of this variable. This module
@@ -6621,6 +7502,9 @@ static int pagerOpenWal(Pager *pPager){
         pPager->fd, pPager->zWal, pPager->exclusiveMode, &pPager->pWal
     );
   }
+  if( rc==SQLITE_OK && pPager->szChunk ){
+    sqlite3WalChunkSize(pPager->pWal, pPager->szChunk);
+  }
 
   return rc;
 }
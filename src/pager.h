@@ -78,6 +78,7 @@ typedef struct PgHdr DbPage;
 #define PAGER_JOURNALMODE_TRUNCATE    3   /* Commit by truncating journal */
 #define PAGER_JOURNALMODE_MEMORY      4   /* In-memory journal file */
 #define PAGER_JOURNALMODE_WAL         5   /* Use write-ahead logging */
+#define PAGER_JOURNALMODE_DOUBLEWRITE 6   /* Commit through a double-write file */
 
 /*
 ** The remainder of this file contains the declarations of the functions
@@ -109,6 +110,7 @@ int sqlite3PagerSetJournalMode(Pager *, int);
 int sqlite3PagerGetJournalMode(Pager*);
 int sqlite3PagerOkToChangeJournalMode(Pager*);
 i64 sqlite3PagerJournalSizeLimit(Pager *, i64);
+int sqlite3PagerChunkSize(Pager*, int);
 sqlite3_backup **sqlite3PagerBackupPtr(Pager*);
 
 /* Functions used to obtain and release page references. */ 
@@ -125,10 +127,15 @@ int sqlite3PagerMovepage(Pager*,DbPage*,Pgno,int);
 int sqlite3PagerPageRefcount(DbPage*);
 void *sqlite3PagerGetData(DbPage *); 
 void *sqlite3PagerGetExtra(DbPage *); 
+int sqlite3PagerReadRun(Pager*, Pgno, int, u8*);
+int sqlite3PagerTrackChanges(Pager*, int, u32*);
+int sqlite3PagerTrackNext(Pager*, u32*, u32*);
+int sqlite3PagerTrackRead(Pager*, Pgno, int, u32*);
 
 /* Functions used to manage pager transactions and savepoints. */
 void sqlite3PagerPagecount(Pager*, int*);
 int sqlite3PagerBegin(Pager*, int exFlag, int);
+int sqlite3PagerBeginConcurrent(Pager*);
 int sqlite3PagerCommitPhaseOne(Pager*,const char *zMaster, int);
 int sqlite3PagerExclusiveLock(Pager*);
 int sqlite3PagerSync(Pager *pPager);
@@ -147,6 +154,7 @@ int sqlite3PagerCloseWal(Pager *pPager);
 /* Functions used to query pager state and configuration. */
 u8 sqlite3PagerIsreadonly(Pager*);
 int sqlite3PagerRefcount(Pager*);
+u32 sqlite3PagerDataVersion(Pager*);
 int sqlite3PagerMemUsed(Pager*);
 const char *sqlite3PagerFilename(Pager*);
 const sqlite3_vfs *sqlite3PagerVfs(Pager*);
@@ -123,6 +123,7 @@ transtype(A) ::= .             {A = TK_DEFERRED;}
 transtype(A) ::= DEFERRED(X).  {A = @X;}
 transtype(A) ::= IMMEDIATE(X). {A = @X;}
 transtype(A) ::= EXCLUSIVE(X). {A = @X;}
+transtype(A) ::= CONCURRENT(X). {A = @X;}
 cmd ::= COMMIT trans_opt.      {sqlite3CommitTransaction(pParse);}
 cmd ::= END trans_opt.         {sqlite3CommitTransaction(pParse);}
 cmd ::= ROLLBACK trans_opt.    {sqlite3RollbackTransaction(pParse);}
@@ -195,7 +196,7 @@ id(A) ::= INDEXED(X).    {A = X;}
 //
 %fallback ID
   ABORT ACTION AFTER ANALYZE ASC ATTACH BEFORE BEGIN BY CASCADE CAST COLUMNKW
-  CONFLICT DATABASE DEFERRED DESC DETACH EACH END EXCLUSIVE EXPLAIN FAIL FOR
+  CONCURRENT CONFLICT DATABASE DEFERRED DESC DETACH EACH END EXCLUSIVE EXPLAIN FAIL FOR
   IGNORE IMMEDIATE INITIALLY INSTEAD LIKE_KW MATCH NO PLAN
   QUERY KEY OF OFFSET PRAGMA RAISE RELEASE REPLACE RESTRICT ROW ROLLBACK
   SAVEPOINT TEMP TRIGGER VACUUM VIEW VIRTUAL
@@ -678,19 +679,30 @@ setlist(A) ::= nm(X) EQ expr(Y). {
 
 ////////////////////////// The INSERT command /////////////////////////////////
 //
-cmd ::= insert_cmd(R) INTO fullname(X) inscollist_opt(F) 
-        VALUES LP itemlist(Y) RP.
-            {sqlite3Insert(pParse, X, Y, 0, F, R);}
+cmd ::= insert_cmd(R) INTO fullname(X) inscollist_opt(F) valuelist(Y).
+            {sqlite3Insert(pParse, X, 0, 0, Y, F, R);}
 cmd ::= insert_cmd(R) INTO fullname(X) inscollist_opt(F) select(S).
-            {sqlite3Insert(pParse, X, 0, S, F, R);}
+            {sqlite3Insert(pParse, X, 0, S, 0, F, R);}
 cmd ::= insert_cmd(R) INTO fullname(X) inscollist_opt(F) DEFAULT VALUES.
-            {sqlite3Insert(pParse, X, 0, 0, F, R);}
+            {sqlite3Insert(pParse, X, 0, 0, 0, F, R);}
 
 %type insert_cmd {u8}
 insert_cmd(A) ::= INSERT orconf(R).   {A = R;}
 insert_cmd(A) ::= REPLACE.            {A = OE_Replace;}
 
 
+// A VALUES clause may contain any number of rows.  Each row is kept as a
+// separate expression list, rather than being converted into a compound
+// SELECT, so that large multi-row INSERTs remain cheap to parse and code.
+//
+%type valuelist {ValueList*}
+%destructor valuelist {sqlite3ValueListDelete(pParse->db, $$);}
+
+valuelist(A) ::= VALUES LP itemlist(X) RP.
+    {A = sqlite3ValueListAppend(pParse->db,0,X);}
+valuelist(A) ::= valuelist(X) COMMA LP itemlist(Y) RP.
+    {A = sqlite3ValueListAppend(pParse->db,X,Y);}
+
 %type itemlist {ExprList*}
 %destructor itemlist {sqlite3ExprListDelete(pParse->db, $$);}
 
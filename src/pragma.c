@@ -199,6 +199,7 @@ static int flagPragma(Parse *pParse, const char *zLeft, const char *zRight){
 #if !defined(SQLITE_OMIT_FOREIGN_KEY) && !defined(SQLITE_OMIT_TRIGGER)
     { "foreign_keys",             SQLITE_ForeignKeys },
 #endif
+    { "lazy_schema",              SQLITE_LazySchema },
   };
   int i;
   const struct sPragmaType *p;
@@ -266,10 +267,13 @@ static const char *actionName(u8 action){
 */
 const char *sqlite3JournalModename(int eMode){
   static char * const azModeName[] = {
-    "delete", "persist", "off", "truncate", "memory"
+    "delete", "persist", "off", "truncate", "memory",
 #ifndef SQLITE_OMIT_WAL
-     , "wal"
+    "wal",
+#else
+    "",
 #endif
+    "doublewrite"
   };
   assert( PAGER_JOURNALMODE_DELETE==0 );
   assert( PAGER_JOURNALMODE_PERSIST==1 );
@@ -277,6 +281,7 @@ const char *sqlite3JournalModename(int eMode){
   assert( PAGER_JOURNALMODE_TRUNCATE==3 );
   assert( PAGER_JOURNALMODE_MEMORY==4 );
   assert( PAGER_JOURNALMODE_WAL==5 );
+  assert( PAGER_JOURNALMODE_DOUBLEWRITE==6 );
   assert( eMode>=0 && eMode<=ArraySize(azModeName) );
 
   if( eMode==ArraySize(azModeName) ) return 0;
@@ -445,6 +450,115 @@ void sqlite3Pragma(
     returnSingleInt(pParse, "secure_delete", b);
   }else
 
+  /*
+  **  PRAGMA [database.]prefix_keys
+  **  PRAGMA [database.]prefix_keys=ON/OFF
+  **
+  ** The first form reports the current setting for the prefix_keys
+  ** flag. The second form changes the flag and reports the new value.
+  ** While the flag is set, new indexes store the bytes that their keys
+  ** on each page have in common only once per page.
+  */
+  if( sqlite3StrICmp(zLeft,"prefix_keys")==0 ){
+    Btree *pBt = pDb->pBt;
+    int b = -1;
+    assert( pBt!=0 );
+    if( zRight ){
+      b = getBoolean(zRight);
+    }
+    if( pId2->n==0 && b>=0 ){
+      int ii;
+      for(ii=0; ii<db->nDb; ii++){
+        sqlite3BtreePrefixKeys(db->aDb[ii].pBt, b);
+      }
+    }
+    b = sqlite3BtreePrefixKeys(pBt, b);
+    returnSingleInt(pParse, "prefix_keys", b);
+  }else
+
+  /*
+  **  PRAGMA [database.]free_page_map
+  **  PRAGMA [database.]free_page_map=ON/OFF
+  **
+  ** The first form reports the current setting for the free_page_map
+  ** flag. The second form changes the flag and reports the new value.
+  ** While the flag is set, pages are reused from the free-list in an
+  ** order that keeps the pages of each b-tree close together.
+  */
+  if( sqlite3StrICmp(zLeft,"free_page_map")==0 ){
+    Btree *pBt = pDb->pBt;
+    int b = -1;
+    assert( pBt!=0 );
+    if( zRight ){
+      b = getBoolean(zRight);
+    }
+    if( pId2->n==0 && b>=0 ){
+      int ii;
+      for(ii=0; ii<db->nDb; ii++){
+        sqlite3BtreeFreePageMap(db->aDb[ii].pBt, b);
+      }
+    }
+    b = sqlite3BtreeFreePageMap(pBt, b);
+    returnSingleInt(pParse, "free_page_map", b);
+  }else
+
+  /*
+  **  PRAGMA [database.]extent_size
+  **  PRAGMA [database.]extent_size=N
+  **
+  ** The first form reports the number of pages in each extent reserved
+  ** for a growing b-tree. The second form sets it. While the free-page
+  ** map is in use and the extent size is 2 or more, each b-tree grows
+  ** into runs of pages reserved for it, so that its pages stay together
+  ** when several b-trees grow at the same time.
+  */
+  if( sqlite3StrICmp(zLeft,"extent_size")==0 ){
+    Btree *pBt = pDb->pBt;
+    int n = -1;
+    assert( pBt!=0 );
+    if( zRight ){
+      sqlite3GetInt32(zRight, &n);
+    }
+    if( pId2->n==0 && n>=0 ){
+      int ii;
+      for(ii=0; ii<db->nDb; ii++){
+        sqlite3BtreeExtentSize(db->aDb[ii].pBt, n);
+      }
+    }
+    n = sqlite3BtreeExtentSize(pBt, n);
+    returnSingleInt(pParse, "extent_size", n);
+  }else
+
+  /*
+  **  PRAGMA [database.]lazy_clear
+  **  PRAGMA [database.]lazy_clear=ON/OFF
+  **
+  ** The first form reports the current setting for the lazy_clear flag.
+  ** The second form changes the flag and reports the new value. While the
+  ** flag is set, a table or index emptied by "DELETE FROM" without a WHERE
+  ** clause, or by DROP TABLE or DROP INDEX, is detached from the database
+  ** without reading its pages. The pages are returned to the free-list
+  ** later, as they are needed or by "PRAGMA incremental_reclaim". Rows
+  ** deleted this way are not counted by sqlite3_changes(). The flag has no
+  ** effect on auto-vacuum databases or while secure_delete is on.
+  */
+  if( sqlite3StrICmp(zLeft,"lazy_clear")==0 ){
+    Btree *pBt = pDb->pBt;
+    int b = -1;
+    assert( pBt!=0 );
+    if( zRight ){
+      b = getBoolean(zRight);
+    }
+    if( pId2->n==0 && b>=0 ){
+      int ii;
+      for(ii=0; ii<db->nDb; ii++){
+        sqlite3BtreeLazyClear(db->aDb[ii].pBt, b);
+      }
+    }
+    b = sqlite3BtreeLazyClear(pBt, b);
+    returnSingleInt(pParse, "lazy_clear", b);
+  }else
+
   /*
   **  PRAGMA [database.]max_page_count
   **  PRAGMA [database.]max_page_count=N
@@ -525,7 +639,7 @@ void sqlite3Pragma(
   /*
   **  PRAGMA [database.]journal_mode
   **  PRAGMA [database.]journal_mode =
-  **                      (delete|persist|off|truncate|memory|wal|off)
+  **                 (delete|persist|off|truncate|memory|wal|doublewrite)
   */
   if( sqlite3StrICmp(zLeft,"journal_mode")==0 ){
     int eMode;        /* One of the PAGER_JOURNALMODE_XXX symbols */
@@ -548,7 +662,7 @@ void sqlite3Pragma(
       const char *zMode;
       int n = sqlite3Strlen30(zRight);
       for(eMode=0; (zMode = sqlite3JournalModename(eMode))!=0; eMode++){
-        if( sqlite3StrNICmp(zRight, zMode, n)==0 ) break;
+        if( zMode[0] && sqlite3StrNICmp(zRight, zMode, n)==0 ) break;
       }
       if( !zMode ){
         /* If the "=MODE" part does not match any known journal mode,
@@ -587,6 +701,55 @@ void sqlite3Pragma(
     returnSingleInt(pParse, "journal_size_limit", iLimit);
   }else
 
+  /*
+  **  PRAGMA [database.]chunk_size
+  **  PRAGMA [database.]chunk_size=N
+  **
+  ** Get or set the number of bytes by which the database file, its
+  ** journal and its WAL file are extended at a time. Space is
+  ** preallocated a chunk at a time, so that appending to these files
+  ** seldom changes their size. Zero means no preallocation.
+  */
+  if( sqlite3StrICmp(zLeft,"chunk_size")==0 ){
+    Pager *pPager = sqlite3BtreePager(pDb->pBt);
+    int n = -1;
+    if( zRight ){
+      sqlite3GetInt32(zRight, &n);
+      if( n<0 ) n = 0;
+    }
+    n = sqlite3PagerChunkSize(pPager, n);
+    returnSingleInt(pParse, "chunk_size", n);
+  }else
+
+  /*
+  **  PRAGMA [database.]change_tracking
+  **  PRAGMA [database.]change_tracking=ON/OFF
+  **
+  ** Enable or disable change tracking. While it is enabled, the
+  ** generation at which each page was last written is recorded in a
+  ** "-track" file next to the database, so that incremental backups can
+  ** copy only the pages that have changed. Both forms return the current
+  ** generation number, or 0 if change tracking is disabled. The second
+  ** form writes to the database, so that other connections notice the
+  ** change.
+  */
+  if( sqlite3StrICmp(zLeft,"change_tracking")==0 ){
+    int iReg;
+    int eMode = -1;
+    if( sqlite3ReadSchema(pParse) ) goto pragma_out;
+    if( zRight ){
+      eMode = getBoolean(zRight);
+      sqlite3BeginWriteOperation(pParse, 0, iDb);
+    }else{
+      sqlite3CodeVerifySchema(pParse, iDb);
+    }
+    iReg = ++pParse->nMem;
+    sqlite3VdbeAddOp3(v, OP_ChangeTracking, iDb, iReg, eMode);
+    sqlite3VdbeAddOp2(v, OP_ResultRow, iReg, 1);
+    sqlite3VdbeSetNumCols(v, 1);
+    sqlite3VdbeSetColName(v, 0, COLNAME_NAME, "change_tracking", SQLITE_STATIC);
+  }else
+
 #endif /* SQLITE_OMIT_PAGER_PRAGMAS */
 
   /*
@@ -672,8 +835,59 @@ void sqlite3Pragma(
     sqlite3VdbeAddOp2(v, OP_IfPos, 1, addr);
     sqlite3VdbeJumpHere(v, addr);
   }else
+
+  /*
+  **  PRAGMA [database.]defragment
+  **  PRAGMA [database.]defragment(N)
+  **
+  ** Move up to N pages of an auto-vacuum database so that the pages of
+  ** each b-tree are stored contiguously and in order, and then shrink
+  ** the file. Return the number of pages moved. The work is finished
+  ** when fewer than N pages are moved, so the application may run this
+  ** repeatedly, committing in between, while other connections read
+  ** the database. If N is omitted, the whole database is defragmented.
+  */
+  if( sqlite3StrICmp(zLeft,"defragment")==0 ){
+    int iLimit;
+    if( sqlite3ReadSchema(pParse) ){
+      goto pragma_out;
+    }
+    if( zRight==0 || !sqlite3GetInt32(zRight, &iLimit) || iLimit<=0 ){
+      iLimit = 0x7fffffff;
+    }
+    sqlite3BeginWriteOperation(pParse, 0, iDb);
+    sqlite3VdbeAddOp3(v, OP_Defragment, iDb, 1, iLimit);
+    sqlite3VdbeAddOp2(v, OP_ResultRow, 1, 1);
+    sqlite3VdbeSetNumCols(v, 1);
+    sqlite3VdbeSetColName(v, 0, COLNAME_NAME, "defragment", SQLITE_STATIC);
+  }else
 #endif
 
+  /*
+  **  PRAGMA [database.]incremental_reclaim
+  **  PRAGMA [database.]incremental_reclaim(N)
+  **
+  ** Return up to N pages of the tables and indexes detached while the
+  ** lazy_clear flag was set to the free-list, and report the number of
+  ** pages returned. Fewer than N pages are returned only once no detached
+  ** pages remain. If N is omitted, all detached pages are returned.
+  */
+  if( sqlite3StrICmp(zLeft,"incremental_reclaim")==0 ){
+    int iLimit;
+    if( sqlite3ReadSchema(pParse) ){
+      goto pragma_out;
+    }
+    if( zRight==0 || !sqlite3GetInt32(zRight, &iLimit) || iLimit<=0 ){
+      iLimit = 0x7fffffff;
+    }
+    sqlite3BeginWriteOperation(pParse, 0, iDb);
+    sqlite3VdbeAddOp3(v, OP_Reclaim, iDb, 1, iLimit);
+    sqlite3VdbeAddOp2(v, OP_ResultRow, 1, 1);
+    sqlite3VdbeSetNumCols(v, 1);
+    sqlite3VdbeSetColName(v, 0, COLNAME_NAME, "incremental_reclaim",
+                          SQLITE_STATIC);
+  }else
+
 #ifndef SQLITE_OMIT_PAGER_PRAGMAS
   /*
   **  PRAGMA [database.]cache_size
@@ -1051,6 +1265,20 @@ void sqlite3Pragma(
     }
   }else
 
+#ifndef SQLITE_OMIT_SCHEMA_SNAPSHOT
+  /*
+  **   PRAGMA [database.]schema_snapshot
+  **
+  ** Save a compiled copy of the schema of the database in the
+  ** sqlite_schema1 table.  When lazy schema loading is enabled, tables
+  ** are loaded from this copy instead of being parsed.
+  */
+  if( sqlite3StrICmp(zLeft, "schema_snapshot")==0 ){
+    if( sqlite3ReadSchema(pParse) ) goto pragma_out;
+    sqlite3SchemaSnapshot(pParse, iDb);
+  }else
+#endif
+
 #ifndef SQLITE_INTEGRITY_CHECK_ERROR_MAX
 # define SQLITE_INTEGRITY_CHECK_ERROR_MAX 100
 #endif
@@ -1112,6 +1340,7 @@ void sqlite3Pragma(
       ** Begin by filling registers 2, 3, ... with the root pages numbers
       ** for all tables and indices in the database.
       */
+      sqlite3LazyLoadAll(db, i);
       pTbls = &db->aDb[i].pSchema->tblHash;
       for(x=sqliteHashFirst(pTbls); x; x=sqliteHashNext(x)){
         Table *pTab = sqliteHashData(x);
@@ -37,6 +37,113 @@ static void corruptSchema(
   pData->rc = db->mallocFailed ? SQLITE_NOMEM : SQLITE_CORRUPT;
 }
 
+/*
+** Return true if the text of CREATE statement zSql contains the keyword
+** REFERENCES anywhere.  False positives are harmless.
+*/
+static int containsReferences(const char *zSql){
+  for(; *zSql; zSql++){
+    if( sqlite3Tolower(*zSql)=='r' && sqlite3StrNICmp(zSql, "references", 10)==0 ){
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+** This routine is called by sqlite3InitCallback() for each row of the
+** sqlite_master table when lazy schema loading is enabled.  If the object
+** described by the row may be parsed later on, save it on the LazyObj
+** list for its table and return non-zero.  Or, if the object must be
+** parsed immediately, return zero.
+**
+** A table or view is deferred unless its name begins with "sqlite_" or
+** its definition contains a REFERENCES clause.  Foreign key processing
+** needs the child table of each foreign key to be present in the schema
+** in order to find it from the parent table.  An index or trigger is
+** deferred only if the table it is attached to has been.
+**
+**     argv[0] = name of thing being created
+**     argv[1] = root page number for table or index. 0 for trigger or view.
+**     argv[2] = SQL text for the CREATE statement.
+**     argv[3] = type of object: "table", "index", "view" or "trigger".
+**     argv[4] = name of the table the object is attached to.
+*/
+static int lazyDefer(InitData *pData, char **argv){
+  sqlite3 *db = pData->db;
+  Schema *pSchema = db->aDb[pData->iDb].pSchema;
+  const char *zSql = argv[2] ? argv[2] : "";
+  LazyObj *pList;              /* Objects already deferred for this table */
+  LazyObj *pNew;               /* New object */
+  int nName, nTbl, nSql;       /* Sizes of the strings, including nul-terms */
+  int iRoot = 0;               /* Root page number */
+  u8 eType;                    /* LAZY_TABLE, LAZY_INDEX or LAZY_TRIGGER */
+
+  if( argv[0]==0 || argv[1]==0 || argv[3]==0 || argv[4]==0 ) return 0;
+  if( sqlite3StrICmp(argv[3], "index")==0 ){
+    eType = LAZY_INDEX;
+  }else if( sqlite3StrICmp(argv[3], "trigger")==0 ){
+    eType = LAZY_TRIGGER;
+  }else{
+    eType = LAZY_TABLE;
+  }
+  nTbl = sqlite3Strlen30(argv[4]);
+  pList = sqlite3HashFind(&pSchema->lazyHash, argv[4], nTbl);
+  if( pList==0 && (eType!=LAZY_TABLE || zSql[0]==0
+                || sqlite3StrICmp(argv[0], argv[4])
+                || sqlite3StrNICmp(argv[0], "sqlite_", 7)==0
+                || containsReferences(zSql))
+  ){
+    return 0;
+  }
+  if( zSql[0] ){
+    iRoot = sqlite3Atoi(argv[1]);
+  }else if( sqlite3GetInt32(argv[1], &iRoot)==0 ){
+    /* An automatic index with a malformed root page number.  Let the
+    ** usual path report the corruption. */
+    return 0;
+  }
+
+  nName = sqlite3Strlen30(argv[0]) + 1;
+  nTbl++;
+  nSql = sqlite3Strlen30(zSql) + 1;
+  pNew = (LazyObj*)sqlite3DbMallocRaw(0, sizeof(LazyObj)+nName+nTbl+nSql);
+  if( pNew==0 ){
+    db->mallocFailed = 1;
+    corruptSchema(pData, argv[0], 0);
+    return 1;
+  }
+  pNew->zName = (char*)&pNew[1];
+  pNew->zTbl = &pNew->zName[nName];
+  pNew->zSql = &pNew->zTbl[nTbl];
+  memcpy(pNew->zName, argv[0], nName);
+  memcpy(pNew->zTbl, argv[4], nTbl);
+  memcpy(pNew->zSql, zSql, nSql);
+  pNew->zStat = 0;
+  pNew->iRoot = iRoot;
+  pNew->eType = eType;
+  pNew->pNext = 0;
+
+  if( pList ){
+    while( pList->pNext ) pList = pList->pNext;
+    pList->pNext = pNew;
+  }else if( sqlite3HashInsert(&pSchema->lazyHash, pNew->zTbl, nTbl-1, pNew) ){
+    sqlite3DbFree(0, pNew);
+    db->mallocFailed = 1;
+  }
+  if( eType!=LAZY_TABLE && !db->mallocFailed ){
+    Hash *pHash = eType==LAZY_INDEX ? &pSchema->lazyIdxHash
+                                    : &pSchema->lazyTrigHash;
+    if( sqlite3HashInsert(pHash, pNew->zName, nName-1, pNew)==pNew ){
+      db->mallocFailed = 1;
+    }
+  }
+  if( db->mallocFailed ){
+    corruptSchema(pData, argv[0], 0);
+  }
+  return 1;
+}
+
 /*
 ** This is the callback routine for the code that initializes the
 ** database.  See sqlite3Init() below for additional information.
@@ -48,14 +155,16 @@ static void corruptSchema(
 **     argv[1] = root page number for table or index. 0 for trigger or view.
 **     argv[2] = SQL text for the CREATE statement.
 **
+** If lazy schema loading is enabled, sqlite3InitOne() also supplies the
+** type and tbl_name columns of sqlite_master as argv[3] and argv[4].
 */
 int sqlite3InitCallback(void *pInit, int argc, char **argv, char **NotUsed){
   InitData *pData = (InitData*)pInit;
   sqlite3 *db = pData->db;
   int iDb = pData->iDb;
 
-  assert( argc==3 );
-  UNUSED_PARAMETER2(NotUsed, argc);
+  assert( argc==3 || argc==5 );
+  UNUSED_PARAMETER(NotUsed);
   assert( sqlite3_mutex_held(db->mutex) );
   DbClearProperty(db, iDb, DB_Empty);
   if( db->mallocFailed ){
@@ -65,6 +174,7 @@ int sqlite3InitCallback(void *pInit, int argc, char **argv, char **NotUsed){
 
   assert( iDb>=0 && iDb<db->nDb );
   if( argv==0 ) return 0;   /* Might happen if EMPTY_RESULT_CALLBACKS are on */
+  if( argc==5 && lazyDefer(pData, argv) ) return 0;
   if( argv[1]==0 ){
     corruptSchema(pData, argv[0], 0);
   }else if( argv[2] && argv[2][0] ){
@@ -123,6 +233,189 @@ int sqlite3InitCallback(void *pInit, int argc, char **argv, char **NotUsed){
   return 0;
 }
 
+/*
+** Remove the objects on list pList from the lazy-loading hash tables
+** of schema pSchema.
+*/
+static void lazyUnlink(Schema *pSchema, LazyObj *pList){
+  LazyObj *p;
+  sqlite3HashInsert(&pSchema->lazyHash, pList->zTbl,
+                    sqlite3Strlen30(pList->zTbl), 0);
+  for(p=pList; p; p=p->pNext){
+    Hash *pHash;
+    int nName;
+    if( p->eType==LAZY_TABLE ) continue;
+    pHash = p->eType==LAZY_INDEX ? &pSchema->lazyIdxHash
+                                 : &pSchema->lazyTrigHash;
+    nName = sqlite3Strlen30(p->zName);
+    if( sqlite3HashFind(pHash, p->zName, nName)==p ){
+      sqlite3HashInsert(pHash, p->zName, nName, 0);
+    }
+  }
+}
+
+/*
+** Free all objects on the list pList.
+*/
+static void lazyFreeList(LazyObj *pList){
+  while( pList ){
+    LazyObj *pNext = pList->pNext;
+    sqlite3DbFree(0, pList->zStat);
+    sqlite3DbFree(0, pList);
+    pList = pNext;
+  }
+}
+
+/*
+** Run the parser over each object on list pList, which has already been
+** removed from the lazy-loading hash tables of database iDb, exactly as
+** sqlite3InitOne() would have done when the schema was first read.
+** Then free the list.
+**
+** If the table and its indices can be loaded from the snapshot in the
+** sqlite_schema1 table, only the triggers are parsed.
+**
+** This may be called while another statement is being compiled, so the
+** state in sqlite3.init is saved and restored around the call.  If an
+** object cannot be parsed it is simply omitted from the schema.
+*/
+static void lazyParseList(sqlite3 *db, int iDb, LazyObj *pList){
+  struct sqlite3InitInfo saved = db->init;
+  int commit_internal = !(db->flags&SQLITE_InternChanges);
+  char *zErrMsg = 0;
+  InitData initData;
+  LazyObj *p;
+  int isSnapshot;              /* True if loaded from sqlite_schema1 */
+
+  assert( sqlite3_mutex_held(db->mutex) );
+  initData.db = db;
+  initData.iDb = iDb;
+  initData.rc = SQLITE_OK;
+  initData.pzErrMsg = &zErrMsg;
+  db->init.busy = 1;
+  isSnapshot = sqlite3SnapshotLoad(db, iDb, pList);
+  for(p=pList; p && !db->mallocFailed; p=p->pNext){
+    char zRoot[16];
+    char *azArg[3];
+    if( isSnapshot && p->eType!=LAZY_TRIGGER ) continue;
+    sqlite3_snprintf(sizeof(zRoot), zRoot, "%d", p->iRoot);
+    azArg[0] = p->zName;
+    azArg[1] = zRoot;
+    azArg[2] = p->zSql;
+    sqlite3InitCallback(&initData, 3, azArg, 0);
+  }
+  db->init = saved;
+#ifndef SQLITE_OMIT_ANALYZE
+  for(p=pList; p; p=p->pNext){
+    if( p->zStat ){
+      const char *zIdx = p->eType==LAZY_INDEX ? p->zName : 0;
+      sqlite3AnalysisApply(db, iDb, p->zTbl, zIdx, p->zStat);
+    }
+  }
+#endif
+  if( commit_internal ){
+    sqlite3CommitInternalChanges(db);
+  }
+  sqlite3DbFree(db, zErrMsg);
+  lazyFreeList(pList);
+}
+
+/*
+** If the table or view zTab in database iDb has not yet been parsed
+** because lazy schema loading is enabled, parse it now along with all
+** of its indices and triggers.  Return non-zero if anything was loaded.
+*/
+int sqlite3LazyLoadTable(sqlite3 *db, int iDb, const char *zTab){
+  Schema *pSchema = db->aDb[iDb].pSchema;
+  LazyObj *pList;
+
+  if( pSchema->lazyHash.count==0 ) return 0;
+  pList = sqlite3HashFind(&pSchema->lazyHash, zTab, sqlite3Strlen30(zTab));
+  if( pList==0 ) return 0;
+  lazyUnlink(pSchema, pList);
+  lazyParseList(db, iDb, pList);
+  return 1;
+}
+
+/*
+** If the index (eType==LAZY_INDEX) or trigger (eType==LAZY_TRIGGER)
+** named zName in database iDb has not yet been parsed, load the table
+** it is attached to.  Return non-zero if anything was loaded.
+*/
+int sqlite3LazyLoadObject(sqlite3 *db, int iDb, int eType, const char *zName){
+  Schema *pSchema = db->aDb[iDb].pSchema;
+  Hash *pHash;
+  LazyObj *p;
+
+  assert( eType==LAZY_INDEX || eType==LAZY_TRIGGER );
+  pHash = eType==LAZY_INDEX ? &pSchema->lazyIdxHash : &pSchema->lazyTrigHash;
+  if( pHash->count==0 ) return 0;
+  p = sqlite3HashFind(pHash, zName, sqlite3Strlen30(zName));
+  if( p==0 ) return 0;
+  return sqlite3LazyLoadTable(db, iDb, p->zTbl);
+}
+
+/*
+** Parse every object in database iDb that is still waiting to be
+** loaded.  This is used before operations that visit every table.
+*/
+void sqlite3LazyLoadAll(sqlite3 *db, int iDb){
+  Schema *pSchema = db->aDb[iDb].pSchema;
+  HashElem *pElem;
+  while( (pElem = sqliteHashFirst(&pSchema->lazyHash))!=0 ){
+    LazyObj *pList = (LazyObj*)sqliteHashData(pElem);
+    lazyUnlink(pSchema, pList);
+    lazyParseList(db, iDb, pList);
+  }
+}
+
+#ifndef SQLITE_OMIT_ANALYZE
+/*
+** This routine is called for each row of the sqlite_stat1 table of
+** database iDb:
+**
+**     argv[0] = name of the table
+**     argv[1] = name of the index (might be NULL)
+**     argv[2] = results of analysis
+**
+** If the table has not yet been parsed, save the results of analysis
+** so that they can be applied when it is, and return non-zero.
+** Otherwise return zero.
+*/
+int sqlite3LazySaveStat(sqlite3 *db, int iDb, char **argv){
+  Schema *pSchema = db->aDb[iDb].pSchema;
+  LazyObj *p;
+
+  if( pSchema->lazyHash.count==0 ) return 0;
+  p = sqlite3HashFind(&pSchema->lazyHash, argv[0], sqlite3Strlen30(argv[0]));
+  if( p==0 ) return 0;
+  if( argv[1] ){
+    p = sqlite3HashFind(&pSchema->lazyIdxHash, argv[1],
+                        sqlite3Strlen30(argv[1]));
+    if( p==0 || sqlite3StrICmp(p->zTbl, argv[0]) ) return 1;
+  }
+  sqlite3DbFree(0, p->zStat);
+  p->zStat = sqlite3DbStrDup(0, argv[2]);
+  if( p->zStat==0 ) db->mallocFailed = 1;
+  return 1;
+}
+#endif
+
+/*
+** Free all objects waiting to be loaded from schema pSchema.
+*/
+void sqlite3LazyFree(Schema *pSchema){
+  HashElem *pElem;
+  Hash temp = pSchema->lazyHash;
+  sqlite3HashInit(&pSchema->lazyHash);
+  sqlite3HashClear(&pSchema->lazyIdxHash);
+  sqlite3HashClear(&pSchema->lazyTrigHash);
+  for(pElem=sqliteHashFirst(&temp); pElem; pElem=sqliteHashNext(pElem)){
+    lazyFreeList((LazyObj*)sqliteHashData(pElem));
+  }
+  sqlite3HashClear(&temp);
+}
+
 /*
 ** Attempt to read the database schema and initialize internal
 ** data structures for a single database file.  The index of the
@@ -315,9 +608,13 @@ static int sqlite3InitOne(sqlite3 *db, int iDb, char **pzErrMsg){
   assert( db->init.busy );
   {
     char *zSql;
+    const char *zLazy = "";
+    if( (db->flags & SQLITE_LazySchema) && iDb!=1 ){
+      zLazy = ", type, tbl_name";
+    }
     zSql = sqlite3MPrintf(db, 
-        "SELECT name, rootpage, sql FROM '%q'.%s ORDER BY rowid",
-        db->aDb[iDb].zName, zMasterName);
+        "SELECT name, rootpage, sql%s FROM '%q'.%s ORDER BY rowid",
+        zLazy, db->aDb[iDb].zName, zMasterName);
 #ifndef SQLITE_OMIT_AUTHORIZATION
     {
       int (*xAuth)(void*,int,const char*,const char*,const char*,const char*);
@@ -0,0 +1,691 @@
+/*
+** 2011 January 24
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+** This file contains code used to save a compiled copy of the schema
+** of a database in the sqlite_schema1 table ("PRAGMA schema_snapshot")
+** and to load tables and their indices from that copy instead of running
+** the parser over their CREATE statements.
+**
+** The sqlite_schema1 table has the following layout:
+**
+**     CREATE TABLE sqlite_schema1(rootpage INTEGER PRIMARY KEY, cookie, data)
+**
+** There is one row for each table that can be represented, keyed by the
+** root page of the table.  The "cookie" column holds the schema cookie
+** of the database at the time the snapshot was taken.  A row is only
+** used if its cookie matches the current schema cookie, so a snapshot
+** becomes stale, but never wrong, as soon as the schema is modified.
+**
+** The "data" column is a blob.  All integers in it are varints.  A string
+** is stored as its length plus one followed by its bytes, or as a single
+** 0x00 byte if it is NULL.  The layout of the blob is:
+**
+**     version (currently 1), table name, nCol, iPKey+1, tabFlags, keyConf,
+**     addColOffset,
+**     for each column:
+**         name, type, collation, default text, default kind, default
+**         value, notNull, isPrimKey, affinity
+**     nIndex,
+**     for each index:
+**         name, tnum, onError, autoIndex, nColumn,
+**         for each index column: iColumn, sortOrder, collation
+**
+** Only ordinary tables without CHECK constraints or foreign keys, whose
+** column defaults are all simple literals, are stored.  Everything else,
+** and all views and triggers, is always loaded by the parser.  Snapshots
+** are only read when lazy schema loading is enabled, as the first use of
+** a table is the point at which its definition is needed.
+*/
+#ifndef SQLITE_OMIT_SCHEMA_SNAPSHOT
+#include "sqliteInt.h"
+#include "vdbeInt.h"
+
+/*
+** Version number stored at the start of each snapshot blob.
+*/
+#define SNAPSHOT_VERSION 1
+
+/*
+** Values stored for the "default kind" of each column.  These are
+** independent of the TK_* values generated by the parser, which may
+** change from one build to the next.  SNAP_DFLT_NEGATE is ORed in
+** if the literal is preceded by a unary minus.
+*/
+#define SNAP_DFLT_NONE     0
+#define SNAP_DFLT_NULL     1
+#define SNAP_DFLT_INTEGER  2
+#define SNAP_DFLT_FLOAT    3
+#define SNAP_DFLT_STRING   4
+#define SNAP_DFLT_BLOB     5
+#define SNAP_DFLT_NEGATE   0x80
+
+/*
+** Append integer v to the snapshot being built in p.
+*/
+static void snapPutInt(StrAccum *p, u32 v){
+  unsigned char aBuf[9];
+  int n = sqlite3PutVarint32(aBuf, v);
+  sqlite3StrAccumAppend(p, (char*)aBuf, n);
+}
+
+/*
+** Append string z, which may be NULL, to the snapshot being built in p.
+*/
+static void snapPutString(StrAccum *p, const char *z){
+  if( z==0 ){
+    snapPutInt(p, 0);
+  }else{
+    int n = sqlite3Strlen30(z);
+    snapPutInt(p, n+1);
+    sqlite3StrAccumAppend(p, z, n);
+  }
+}
+
+/*
+** Figure out the kind of the default value expression pExpr and the text
+** of the literal.  Return zero if the expression is not a simple literal,
+** possibly negated.  The text is written into zBuf if the literal is an
+** integer stored in Expr.u.iValue, otherwise *pz is set to point at the
+** token of the expression.
+*/
+static int snapDefaultKind(Expr *pExpr, char *zBuf, int nBuf, const char **pz){
+  int eKind = 0;
+  if( pExpr->op==TK_UMINUS ){
+    pExpr = pExpr->pLeft;
+    if( pExpr==0 || (pExpr->op!=TK_INTEGER && pExpr->op!=TK_FLOAT) ){
+      return 0;
+    }
+    eKind = SNAP_DFLT_NEGATE;
+  }
+  switch( pExpr->op ){
+    case TK_NULL:     eKind |= SNAP_DFLT_NULL;     break;
+    case TK_INTEGER:  eKind |= SNAP_DFLT_INTEGER;  break;
+    case TK_FLOAT:    eKind |= SNAP_DFLT_FLOAT;    break;
+    case TK_STRING:   eKind |= SNAP_DFLT_STRING;   break;
+    case TK_BLOB:     eKind |= SNAP_DFLT_BLOB;     break;
+    default:          return 0;
+  }
+  if( ExprHasProperty(pExpr, EP_IntValue) ){
+    sqlite3_snprintf(nBuf, zBuf, "%d", pExpr->u.iValue);
+    *pz = zBuf;
+  }else{
+    *pz = pExpr->u.zToken;
+  }
+  return eKind;
+}
+
+/*
+** Encode table pTab as a snapshot blob.  Return a pointer to the blob,
+** obtained from sqlite3DbMalloc(), and set *pnData to its size.  Return
+** NULL if the table cannot be represented or a malloc fails.
+*/
+static char *snapshotEncode(sqlite3 *db, Table *pTab, int *pnData){
+  StrAccum acc;
+  Index *pIdx;
+  int nIdx = 0;
+  int i;
+
+  if( IsVirtual(pTab) || pTab->pSelect || pTab->pFKey || pTab->tnum<=0 ){
+    return 0;
+  }
+#ifndef SQLITE_OMIT_CHECK
+  if( pTab->pCheck ) return 0;
+#endif
+  sqlite3StrAccumInit(&acc, 0, 0, db->aLimit[SQLITE_LIMIT_LENGTH]);
+  acc.db = db;
+
+  snapPutInt(&acc, SNAPSHOT_VERSION);
+  snapPutString(&acc, pTab->zName);
+  snapPutInt(&acc, pTab->nCol);
+  snapPutInt(&acc, pTab->iPKey+1);
+  snapPutInt(&acc, pTab->tabFlags);
+  snapPutInt(&acc, pTab->keyConf);
+#ifndef SQLITE_OMIT_ALTERTABLE
+  snapPutInt(&acc, pTab->addColOffset);
+#else
+  snapPutInt(&acc, 0);
+#endif
+  for(i=0; i<pTab->nCol; i++){
+    Column *pCol = &pTab->aCol[i];
+    char zBuf[30];
+    const char *zVal = 0;
+    int eKind = SNAP_DFLT_NONE;
+    if( pCol->pDflt ){
+      eKind = snapDefaultKind(pCol->pDflt, zBuf, sizeof(zBuf), &zVal);
+      if( eKind==0 || pCol->zDflt==0 ) goto not_representable;
+    }
+    snapPutString(&acc, pCol->zName);
+    snapPutString(&acc, pCol->zType);
+    snapPutString(&acc, pCol->zColl);
+    snapPutString(&acc, pCol->zDflt);
+    snapPutInt(&acc, eKind);
+    snapPutString(&acc, zVal);
+    snapPutInt(&acc, pCol->notNull);
+    snapPutInt(&acc, pCol->isPrimKey);
+    snapPutInt(&acc, (u8)pCol->affinity);
+  }
+
+  for(pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext) nIdx++;
+  snapPutInt(&acc, nIdx);
+  for(pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext){
+    snapPutString(&acc, pIdx->zName);
+    snapPutInt(&acc, pIdx->tnum);
+    snapPutInt(&acc, pIdx->onError);
+    snapPutInt(&acc, pIdx->autoIndex);
+    snapPutInt(&acc, pIdx->nColumn);
+    for(i=0; i<pIdx->nColumn; i++){
+      if( pIdx->azColl[i]==0 ) goto not_representable;
+      snapPutInt(&acc, pIdx->aiColumn[i]);
+      snapPutInt(&acc, pIdx->aSortOrder[i]);
+      snapPutString(&acc, pIdx->azColl[i]);
+    }
+  }
+
+  if( acc.mallocFailed ){
+    db->mallocFailed = 1;
+  }else if( !acc.tooBig ){
+    *pnData = acc.nChar;
+    return sqlite3StrAccumFinish(&acc);
+  }
+
+not_representable:
+  sqlite3StrAccumReset(&acc);
+  return 0;
+}
+
+/*
+** This routine implements "PRAGMA [database.]schema_snapshot".  Code is
+** generated to replace the contents of the sqlite_schema1 table of
+** database iDb, creating it first if necessary, with a snapshot of the
+** current schema.
+*/
+void sqlite3SchemaSnapshot(Parse *pParse, int iDb){
+  sqlite3 *db = pParse->db;
+  Db *pDb = &db->aDb[iDb];
+  Vdbe *v;
+  Table *pSnap;
+  HashElem *k;
+  int iRoot;
+  int isCreated = 0;
+  int iCookie;
+  int iCur;
+  int regRowid, regCol, regRec;
+
+  if( iDb==1 ){
+    sqlite3ErrorMsg(pParse, "cannot snapshot the temp schema");
+    return;
+  }
+  sqlite3LazyLoadAll(db, iDb);
+  v = sqlite3GetVdbe(pParse);
+  if( v==0 ) return;
+  sqlite3BeginWriteOperation(pParse, 0, iDb);
+  iCookie = pDb->pSchema->schema_cookie;
+
+  pSnap = sqlite3FindTable(db, "sqlite_schema1", pDb->zName);
+  if( pSnap==0 ){
+    /* The table does not exist.  Create it.  As in analyze.c, the root
+    ** page of the new table is left in register pParse->regRoot.  Creating
+    ** it also increments the schema cookie, so the rows written below must
+    ** carry the incremented value. */
+    sqlite3NestedParse(pParse,
+        "CREATE TABLE %Q.sqlite_schema1"
+        "(rootpage INTEGER PRIMARY KEY, cookie, data)", pDb->zName
+    );
+    iRoot = pParse->regRoot;
+    isCreated = 1;
+    iCookie++;
+  }else{
+    iRoot = pSnap->tnum;
+    sqlite3TableLock(pParse, iDb, iRoot, 1, pSnap->zName);
+    sqlite3VdbeAddOp2(v, OP_Clear, iRoot, iDb);
+  }
+  iCur = pParse->nTab++;
+  sqlite3VdbeAddOp3(v, OP_OpenWrite, iCur, iRoot, iDb);
+  sqlite3VdbeChangeP4(v, -1, (char *)3, P4_INT32);
+  sqlite3VdbeChangeP5(v, (u8)isCreated);
+
+  regRowid = ++pParse->nMem;
+  regCol = pParse->nMem+1;
+  pParse->nMem += 3;
+  regRec = ++pParse->nMem;
+  for(k=sqliteHashFirst(&pDb->pSchema->tblHash); k; k=sqliteHashNext(k)){
+    Table *pTab = (Table*)sqliteHashData(k);
+    char *aData;
+    int nData = 0;
+    if( sqlite3StrNICmp(pTab->zName, "sqlite_", 7)==0 ) continue;
+    aData = snapshotEncode(db, pTab, &nData);
+    if( aData==0 ) continue;
+    sqlite3VdbeAddOp2(v, OP_Null, 0, regCol);
+    sqlite3VdbeAddOp2(v, OP_Integer, iCookie, regCol+1);
+    sqlite3VdbeAddOp4(v, OP_Blob, nData, regCol+2, 0, aData, P4_DYNAMIC);
+    sqlite3VdbeAddOp3(v, OP_MakeRecord, regCol, 3, regRec);
+    sqlite3VdbeAddOp2(v, OP_Integer, pTab->tnum, regRowid);
+    sqlite3VdbeAddOp3(v, OP_Insert, iCur, regRec, regRowid);
+  }
+}
+
+/*
+** An instance of the following structure is used to read a snapshot
+** blob.  If the blob is found to be malformed, bad is set and all further
+** reads return zero or NULL.
+*/
+typedef struct SnapReader SnapReader;
+struct SnapReader {
+  sqlite3 *db;              /* Database connection, for mallocs */
+  const unsigned char *a;   /* The blob */
+  int n;                    /* Size of a[] in bytes */
+  int i;                    /* Offset of the next byte to read */
+  int bad;                  /* True if the blob is malformed */
+};
+
+/*
+** Read an integer from the snapshot blob.  The blob is always followed
+** by at least 9 zero bytes, so a truncated varint cannot cause a read
+** past the end of the buffer.
+*/
+static u32 snapGetInt(SnapReader *p){
+  u32 v = 0;
+  if( p->bad || p->i>=p->n ){
+    p->bad = 1;
+    return 0;
+  }
+  p->i += getVarint32(&p->a[p->i], v);
+  if( p->i>p->n ){
+    p->bad = 1;
+    return 0;
+  }
+  return v;
+}
+
+/*
+** Read a string from the snapshot blob.  If it is not NULL, return a
+** pointer to it and set *pn to its length.  The string is not nul
+** terminated.
+*/
+static const char *snapGetString(SnapReader *p, int *pn){
+  u32 n = snapGetInt(p);
+  *pn = 0;
+  if( n==0 ) return 0;
+  n--;
+  if( p->bad || n>(u32)(p->n - p->i) ){
+    p->bad = 1;
+    return 0;
+  }
+  p->i += n;
+  *pn = (int)n;
+  return (const char*)&p->a[p->i - n];
+}
+
+/*
+** Read a string from the snapshot blob and return a nul-terminated copy
+** of it obtained from sqlite3DbMalloc().
+*/
+static char *snapGetStrDup(SnapReader *p){
+  int n;
+  const char *z = snapGetString(p, &n);
+  if( z==0 ) return 0;
+  return sqlite3DbStrNDup(p->db, z, n);
+}
+
+/*
+** Build the default value expression for a column from its kind and the
+** text of the literal.
+*/
+static Expr *snapDefaultExpr(sqlite3 *db, int eKind, char *zVal){
+  static const u8 aOp[] = {
+    0, TK_NULL, TK_INTEGER, TK_FLOAT, TK_STRING, TK_BLOB
+  };
+  Token t;
+  Expr *pExpr;
+  int e = eKind & ~SNAP_DFLT_NEGATE;
+
+  if( e<=SNAP_DFLT_NONE || e>SNAP_DFLT_BLOB || zVal==0 ) return 0;
+  t.z = zVal;
+  t.n = sqlite3Strlen30(zVal);
+  pExpr = sqlite3ExprAlloc(db, aOp[e], e==SNAP_DFLT_NULL ? 0 : &t, 0);
+  if( pExpr && (eKind & SNAP_DFLT_NEGATE) ){
+    Expr *pNeg = sqlite3ExprAlloc(db, TK_UMINUS, 0, 0);
+    sqlite3ExprAttachSubtrees(db, pNeg, pExpr, 0);
+    pExpr = pNeg;
+  }
+  return pExpr;
+}
+
+/*
+** Free a table that was partly or completely built by snapshotDecode()
+** but has not been added to the schema.
+*/
+static void snapFreeTable(sqlite3 *db, Table *pTab){
+  Index *pIdx, *pNext;
+  for(pIdx=pTab->pIndex; pIdx; pIdx=pNext){
+    pNext = pIdx->pNext;
+    sqlite3DbFree(db, pIdx->zColAff);
+    sqlite3DbFree(db, pIdx);
+  }
+  pTab->pIndex = 0;
+  sqlite3DeleteTable(db, pTab);
+}
+
+/*
+** Decode a snapshot blob into a new Table object, with its list of
+** indices, for database iDb.  Return NULL if the blob is malformed or
+** a malloc fails.
+*/
+static Table *snapshotDecode(
+  sqlite3 *db,              /* Database connection */
+  int iDb,                  /* Database the table belongs to */
+  const unsigned char *a,   /* The blob */
+  int n                     /* Size of the blob in bytes */
+){
+  Schema *pSchema = db->aDb[iDb].pSchema;
+  SnapReader r;
+  Table *pTab;
+  Index **ppIdx;
+  int nIdx;
+  int i, j;
+
+  r.db = db;
+  r.a = a;
+  r.n = n;
+  r.i = 0;
+  r.bad = 0;
+  if( snapGetInt(&r)!=SNAPSHOT_VERSION ) return 0;
+
+  pTab = (Table*)sqlite3DbMallocZero(db, sizeof(Table));
+  if( pTab==0 ) return 0;
+  pTab->nRef = 1;
+  pTab->pSchema = pSchema;
+  pTab->nRowEst = 1000000;
+  pTab->zName = snapGetStrDup(&r);
+  pTab->nCol = (int)snapGetInt(&r);
+  pTab->iPKey = (int)snapGetInt(&r) - 1;
+  pTab->tabFlags = (u8)snapGetInt(&r);
+  pTab->keyConf = (u8)snapGetInt(&r);
+#ifndef SQLITE_OMIT_ALTERTABLE
+  pTab->addColOffset = (int)snapGetInt(&r);
+#else
+  snapGetInt(&r);
+#endif
+  if( r.bad || pTab->zName==0 || pTab->nCol<=0
+   || pTab->nCol>db->aLimit[SQLITE_LIMIT_COLUMN] || pTab->iPKey>=pTab->nCol
+  ){
+    goto decode_failed;
+  }
+  pTab->aCol = (Column*)sqlite3DbMallocZero(db, sizeof(Column)*pTab->nCol);
+  if( pTab->aCol==0 ) goto decode_failed;
+  for(i=0; i<pTab->nCol; i++){
+    Column *pCol = &pTab->aCol[i];
+    int eKind;
+    char *zVal;
+    pCol->zName = snapGetStrDup(&r);
+    pCol->zType = snapGetStrDup(&r);
+    pCol->zColl = snapGetStrDup(&r);
+    pCol->zDflt = snapGetStrDup(&r);
+    eKind = (int)snapGetInt(&r);
+    zVal = snapGetStrDup(&r);
+    if( eKind!=SNAP_DFLT_NONE ){
+      pCol->pDflt = snapDefaultExpr(db, eKind, zVal);
+      if( pCol->pDflt==0 ) r.bad = 1;
+    }
+    sqlite3DbFree(db, zVal);
+    pCol->notNull = (u8)snapGetInt(&r);
+    pCol->isPrimKey = (u8)snapGetInt(&r);
+    pCol->affinity = (char)snapGetInt(&r);
+    if( r.bad || pCol->zName==0 || db->mallocFailed ) goto decode_failed;
+  }
+
+  nIdx = (int)snapGetInt(&r);
+  ppIdx = &pTab->pIndex;
+  for(i=0; i<nIdx && !r.bad; i++){
+    Index *pIdx;
+    const char *zName;
+    int nName, nCol, nColl;
+    int tnum;
+    u8 onError, autoIndex;
+    int iColl;
+    char *zExtra;
+
+    zName = snapGetString(&r, &nName);
+    tnum = (int)snapGetInt(&r);
+    onError = (u8)snapGetInt(&r);
+    autoIndex = (u8)snapGetInt(&r);
+    nCol = (int)snapGetInt(&r);
+    if( r.bad || zName==0 || nCol<=0 || nCol>pTab->nCol ) goto decode_failed;
+
+    /* Find the total size of the collation sequence names, so that the
+    ** index can be allocated as a single block as sqlite3CreateIndex()
+    ** does.  Then rewind and read the fields for real. */
+    iColl = r.i;
+    nColl = 0;
+    for(j=0; j<nCol; j++){
+      int nZ;
+      snapGetInt(&r);
+      snapGetInt(&r);
+      if( snapGetString(&r, &nZ)==0 ) r.bad = 1;
+      nColl += nZ + 1;
+    }
+    if( r.bad ) goto decode_failed;
+    r.i = iColl;
+
+    pIdx = sqlite3DbMallocZero(db,
+        sizeof(Index) +              /* Index structure  */
+        sizeof(int)*nCol +           /* Index.aiColumn   */
+        sizeof(int)*(nCol+1) +       /* Index.aiRowEst   */
+        sizeof(char *)*nCol +        /* Index.azColl     */
+        sizeof(u8)*nCol +            /* Index.aSortOrder */
+        nName + 1 +                  /* Index.zName      */
+        nColl                        /* Collation sequence names */
+    );
+    if( pIdx==0 ) goto decode_failed;
+    *ppIdx = pIdx;
+    ppIdx = &pIdx->pNext;
+    pIdx->azColl = (char**)(&pIdx[1]);
+    pIdx->aiColumn = (int *)(&pIdx->azColl[nCol]);
+    pIdx->aiRowEst = (unsigned *)(&pIdx->aiColumn[nCol]);
+    pIdx->aSortOrder = (u8 *)(&pIdx->aiRowEst[nCol+1]);
+    pIdx->zName = (char *)(&pIdx->aSortOrder[nCol]);
+    zExtra = (char *)(&pIdx->zName[nName+1]);
+    memcpy(pIdx->zName, zName, nName);
+    pIdx->zName[nName] = 0;
+    pIdx->pTable = pTab;
+    pIdx->pSchema = pSchema;
+    pIdx->nColumn = nCol;
+    pIdx->tnum = tnum;
+    pIdx->onError = onError;
+    pIdx->autoIndex = autoIndex;
+    for(j=0; j<nCol; j++){
+      int nZ;
+      const char *zColl;
+      pIdx->aiColumn[j] = (int)snapGetInt(&r);
+      pIdx->aSortOrder[j] = (u8)snapGetInt(&r);
+      zColl = snapGetString(&r, &nZ);
+      if( pIdx->aiColumn[j]<0 || pIdx->aiColumn[j]>=pTab->nCol ) r.bad = 1;
+      if( r.bad ) goto decode_failed;
+      memcpy(zExtra, zColl, nZ);
+      zExtra[nZ] = 0;
+      pIdx->azColl[j] = zExtra;
+      zExtra += nZ + 1;
+    }
+    sqlite3DefaultRowEst(pIdx);
+  }
+  if( r.bad || r.i!=r.n ) goto decode_failed;
+  return pTab;
+
+decode_failed:
+  snapFreeTable(db, pTab);
+  return 0;
+}
+
+/*
+** Read the sqlite_schema1 row for the table with root page iRoot in
+** database iDb.  If the row exists and was written with schema cookie
+** iCookie, return a copy of its "data" blob obtained from sqlite3DbMalloc()
+** and followed by 9 zero bytes, and set *pnData to the size of the blob.
+** Otherwise return NULL.
+*/
+static unsigned char *snapshotRead(
+  sqlite3 *db,              /* Database connection */
+  int iDb,                  /* Database to read */
+  int iSnapRoot,            /* Root page of the sqlite_schema1 table */
+  int iRoot,                /* Root page of the table to look up */
+  int iCookie,              /* Required schema cookie */
+  int *pnData               /* OUT: Size of the blob */
+){
+  Btree *pBt = db->aDb[iDb].pBt;
+  BtCursor *pCur;
+  unsigned char *aRec = 0;
+  unsigned char *aData = 0;
+  int openedTransaction = 0;
+  int res = 0;
+  u32 nRec = 0;
+  int rc;
+
+  pCur = (BtCursor*)sqlite3DbMallocRaw(db, sqlite3BtreeCursorSize());
+  if( pCur==0 ) return 0;
+  sqlite3BtreeCursorZero(pCur);
+  sqlite3BtreeEnter(pBt);
+  if( !sqlite3BtreeIsInReadTrans(pBt) ){
+    rc = sqlite3BtreeBeginTrans(pBt, 0);
+    if( rc!=SQLITE_OK ) goto read_out;
+    openedTransaction = 1;
+  }
+  rc = sqlite3BtreeLockTable(pBt, iSnapRoot, 0);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3BtreeCursor(pBt, iSnapRoot, 0, 0, pCur);
+  }
+  if( rc==SQLITE_OK ){
+    rc = sqlite3BtreeMovetoUnpacked(pCur, 0, iRoot, 0, &res);
+  }
+  if( rc==SQLITE_OK && res==0 ){
+    rc = sqlite3BtreeDataSize(pCur, &nRec);
+    if( rc==SQLITE_OK && nRec>0 && nRec<=(u32)db->aLimit[SQLITE_LIMIT_LENGTH] ){
+      aRec = (unsigned char*)sqlite3DbMallocRaw(db, nRec);
+      if( aRec ) rc = sqlite3BtreeData(pCur, 0, nRec, aRec);
+    }
+  }
+  if( rc==SQLITE_OK && aRec ){
+    /* The record must be (NULL, integer cookie, blob). */
+    u32 nHdr, t0, t1, t2;
+    int i;
+    Mem m;
+    i = getVarint32(aRec, nHdr);
+    if( nHdr<4 || nHdr>nRec ) goto read_out;
+    i += getVarint32(&aRec[i], t0);
+    i += getVarint32(&aRec[i], t1);
+    i += getVarint32(&aRec[i], t2);
+    if( (u32)i!=nHdr || t0!=0 || t1<1 || t1>9 || t1==7 ) goto read_out;
+    if( t2<12 || (t2&1) ) goto read_out;
+    if( nHdr + sqlite3VdbeSerialTypeLen(t1) + sqlite3VdbeSerialTypeLen(t2)
+          != nRec ){
+      goto read_out;
+    }
+    sqlite3VdbeSerialGet(&aRec[nHdr], t1, &m);
+    if( m.u.i!=iCookie ) goto read_out;
+    *pnData = (int)sqlite3VdbeSerialTypeLen(t2);
+    aData = (unsigned char*)sqlite3DbMallocZero(db, *pnData + 9);
+    if( aData ){
+      memcpy(aData, &aRec[nRec - *pnData], *pnData);
+    }
+  }
+
+read_out:
+  sqlite3BtreeCloseCursor(pCur);
+  if( openedTransaction ){
+    sqlite3BtreeCommit(pBt);
+  }
+  sqlite3BtreeLeave(pBt);
+  sqlite3DbFree(db, pCur);
+  sqlite3DbFree(db, aRec);
+  return aData;
+}
+
+/*
+** Attempt to load the table at the head of list pList, which contains
+** the objects of database iDb attached to a single table that have not
+** yet been parsed, and all of its indices from the snapshot stored in
+** the sqlite_schema1 table.  Return non-zero if successful, in which
+** case the table and its indices have been added to the schema and the
+** caller need only parse the triggers on the list.  Return zero if
+** there is no usable snapshot of the table.
+*/
+int sqlite3SnapshotLoad(sqlite3 *db, int iDb, LazyObj *pList){
+  Schema *pSchema = db->aDb[iDb].pSchema;
+  Table *pSnap;
+  Table *pTab;
+  Index *pIdx;
+  LazyObj *p;
+  unsigned char *aData;
+  int nData = 0;
+  int nIdx = 0;
+  u8 enableLookaside;
+
+  if( iDb==1 || pList->eType!=LAZY_TABLE || pList->iRoot<=0 ) return 0;
+  pSnap = sqlite3HashFind(&pSchema->tblHash, "sqlite_schema1", 14);
+  if( pSnap==0 || pSnap->tnum<=0 ) return 0;
+
+  aData = snapshotRead(db, iDb, pSnap->tnum, pList->iRoot,
+                       pSchema->schema_cookie, &nData);
+  if( aData==0 ) return 0;
+
+  /* Schema objects must not be allocated from lookaside memory, as they
+  ** outlive the statement being compiled. */
+  enableLookaside = db->lookaside.bEnabled;
+  db->lookaside.bEnabled = 0;
+  pTab = snapshotDecode(db, iDb, aData, nData);
+  db->lookaside.bEnabled = enableLookaside;
+  sqlite3DbFree(db, aData);
+  if( pTab==0 ) return 0;
+
+  /* The table must be the one named on the list, and its indices must
+  ** be exactly those on the list, with the same root pages. */
+  if( sqlite3StrICmp(pTab->zName, pList->zName) ) goto load_failed;
+  pTab->tnum = pList->iRoot;
+  for(p=pList->pNext; p; p=p->pNext){
+    if( p->eType!=LAZY_INDEX ) continue;
+    for(pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext){
+      if( sqlite3StrICmp(pIdx->zName, p->zName)==0 ) break;
+    }
+    if( pIdx==0 || pIdx->tnum!=p->iRoot ) goto load_failed;
+    nIdx++;
+  }
+  for(pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext) nIdx--;
+  if( nIdx!=0 ) goto load_failed;
+  for(pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext){
+    if( sqlite3HashFind(&pSchema->idxHash, pIdx->zName,
+                        sqlite3Strlen30(pIdx->zName)) ){
+      goto load_failed;
+    }
+  }
+
+  /* Add the table and its indices to the schema, as sqlite3EndTable()
+  ** and sqlite3CreateIndex() do when db->init.busy is set. */
+  if( sqlite3HashInsert(&pSchema->tblHash, pTab->zName,
+                        sqlite3Strlen30(pTab->zName), pTab) ){
+    db->mallocFailed = 1;
+    goto load_failed;
+  }
+  for(pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext){
+    if( sqlite3HashInsert(&pSchema->idxHash, pIdx->zName,
+                          sqlite3Strlen30(pIdx->zName), pIdx) ){
+      /* Malloc failure.  The index is still on the table's list, so it
+      ** will be freed along with the rest of the schema. */
+      db->mallocFailed = 1;
+      break;
+    }
+  }
+  db->flags |= SQLITE_InternChanges;
+  return 1;
+
+load_failed:
+  snapFreeTable(db, pTab);
+  return 0;
+}
+#endif /* SQLITE_OMIT_SCHEMA_SNAPSHOT */
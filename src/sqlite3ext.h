@@ -212,6 +212,10 @@ struct sqlite3_api_routines {
   int (*wal_autocheckpoint)(sqlite3*,int);
   int (*wal_checkpoint)(sqlite3*,const char*);
   void *(*wal_hook)(sqlite3*,int(*)(void*,sqlite3*,const char*,int),void*);
+  int (*bind_array)(sqlite3_stmt*,int,int,const void*);
+  int (*step_array)(sqlite3_stmt*,int,int*);
+  int (*tvp_create)(sqlite3*,const char*,const char*,sqlite3_tvp**);
+  int (*tvp_bind)(sqlite3_tvp*,int,void**,int,void(*)(void*));
 };
 
 /*
@@ -412,6 +416,10 @@ struct sqlite3_api_routines {
 #define sqlite3_wal_autocheckpoint     sqlite3_api->wal_autocheckpoint
 #define sqlite3_wal_checkpoint         sqlite3_api->wal_checkpoint
 #define sqlite3_wal_hook               sqlite3_api->wal_hook
+#define sqlite3_bind_array             sqlite3_api->bind_array
+#define sqlite3_step_array             sqlite3_api->step_array
+#define sqlite3_tvp_create             sqlite3_api->tvp_create
+#define sqlite3_tvp_bind               sqlite3_api->tvp_bind
 #endif /* SQLITE_CORE */
 
 #define SQLITE_EXTENSION_INIT1     const sqlite3_api_routines *sqlite3_api = 0;
@@ -614,6 +614,7 @@ typedef struct Index Index;
 typedef struct IndexSample IndexSample;
 typedef struct KeyClass KeyClass;
 typedef struct KeyInfo KeyInfo;
+typedef struct LazyObj LazyObj;
 typedef struct Lookaside Lookaside;
 typedef struct LookasideSlot LookasideSlot;
 typedef struct Module Module;
@@ -631,6 +632,7 @@ typedef struct Trigger Trigger;
 typedef struct TriggerPrg TriggerPrg;
 typedef struct TriggerStep TriggerStep;
 typedef struct UnpackedRecord UnpackedRecord;
+typedef struct ValueList ValueList;
 typedef struct VTable VTable;
 typedef struct Walker Walker;
 typedef struct WherePlan WherePlan;
@@ -676,12 +678,43 @@ struct Schema {
   Hash trigHash;       /* All triggers indexed by name */
   Hash fkeyHash;       /* All foreign keys by referenced table name */
   Table *pSeqTab;      /* The sqlite_sequence table used by AUTOINCREMENT */
+  Hash lazyHash;       /* Unparsed objects (LazyObj lists) by table name */
+  Hash lazyIdxHash;    /* Unparsed indices by name */
+  Hash lazyTrigHash;   /* Unparsed triggers by name */
   u8 file_format;      /* Schema format version for this file */
   u8 enc;              /* Text encoding used by this database */
   u16 flags;           /* Flags associated with this schema */
   int cache_size;      /* Number of pages to use in the cache */
 };
 
+/*
+** When lazy schema loading is enabled (PRAGMA lazy_schema), the rows of
+** the sqlite_master table that describe an ordinary table or view, along
+** with the indices and triggers attached to it, are not passed to the
+** parser when the schema is read.  Instead, each such row is saved in an
+** instance of the following structure until the table is first used.
+**
+** All objects that belong to the same table are linked together through
+** the LazyObj.pNext pointers, in the order in which they appear in the
+** sqlite_master table.  The table itself is always first on the list.
+*/
+struct LazyObj {
+  char *zName;         /* Name of the table, view, index or trigger */
+  char *zTbl;          /* Name of the table this object is attached to */
+  char *zSql;          /* Text of the CREATE statement.  Might be empty */
+  char *zStat;         /* Saved sqlite_stat1.stat value, or NULL */
+  int iRoot;           /* Root page number.  0 for views and triggers */
+  u8 eType;            /* One of the LAZY_* values below */
+  LazyObj *pNext;      /* Next object attached to the same table */
+};
+
+/*
+** Allowed values for LazyObj.eType
+*/
+#define LAZY_TABLE    1   /* A table or view */
+#define LAZY_INDEX    2   /* An index */
+#define LAZY_TRIGGER  3   /* A trigger */
+
 /*
 ** These macros can be used to test, set, or clear bits in the 
 ** Db.pSchema->flags field.
@@ -791,6 +824,7 @@ struct sqlite3 {
   int errCode;                  /* Most recent error code (SQLITE_*) */
   int errMask;                  /* & result codes with this before returning */
   u8 autoCommit;                /* The auto-commit flag. */
+  u8 isConcurrent;              /* True if open transaction is CONCURRENT */
   u8 temp_store;                /* 1: file 2: memory 0: default */
   u8 mallocFailed;              /* True if we have seen a malloc failure */
   u8 dfltLockMode;              /* Default locking-mode for attached dbs */
@@ -816,6 +850,7 @@ struct sqlite3 {
   struct Vdbe *pVdbe;           /* List of active virtual machines */
   int activeVdbeCnt;            /* Number of VDBEs currently executing */
   int writeVdbeCnt;             /* Number of active VDBEs that are writing */
+  int nParkedCsr;               /* Number of parked cursors in all VDBEs */
   void (*xTrace)(void*,const char*);        /* Trace function */
   void *pTraceArg;                          /* Argument to the trace function */
   void (*xProfile)(void*,const char*,u64);  /* Profiling function */
@@ -862,6 +897,7 @@ struct sqlite3 {
   Hash aCollSeq;                /* All collating sequences */
   BusyHandler busyHandler;      /* Busy callback */
   int busyTimeout;              /* Busy handler timeout, in msec */
+  sqlite3_int64 busyStart;      /* Time of first busy callback, in msec */
   Db aDbStatic[2];              /* Static space for the 2 default backends */
   Savepoint *pSavepoint;        /* List of active savepoints */
   int nSavepoint;               /* Number of non-transaction savepoints */
@@ -923,6 +959,7 @@ struct sqlite3 {
 #define SQLITE_AutoIndex      0x08000000  /* Enable automatic indexes */
 #define SQLITE_PreferBuiltin  0x10000000  /* Preference to built-in funcs */
 #define SQLITE_LoadExtension  0x20000000  /* Enable load_extension */
+#define SQLITE_LazySchema     0x40000000  /* Defer parsing of the schema */
 
 /*
 ** Bits of the sqlite3.flags field that are used by the
@@ -1779,6 +1816,20 @@ struct IdList {
   int nAlloc;      /* Number of entries allocated for a[] below */
 };
 
+/*
+** A ValueList holds the rows of a VALUES clause in an INSERT statement
+** such as:
+**
+**      INSERT INTO t(a,b,c) VALUES(1,2,3), (4,5,6), (7,8,9);
+**
+** There is one ExprList in ValueList.a[] for each row.
+*/
+struct ValueList {
+  ExprList **a;    /* One list of expressions for each row */
+  int nRow;        /* Number of rows on the list */
+  int nAlloc;      /* Number of entries allocated for a[] below */
+};
+
 /*
 ** The bitmask datatype defined below is used for various optimizations.
 **
@@ -2579,6 +2630,13 @@ const sqlite3_mem_methods *sqlite3MemGetMemsys5(void);
   int sqlite3MutexInit(void);
   int sqlite3MutexEnd(void);
 #endif
+#ifdef SQLITE_MUTEX_PTHREADS
+  void sqlite3LockWakeup(void);
+  int sqlite3LockWait(int);
+#else
+# define sqlite3LockWakeup()
+# define sqlite3LockWait(X) 0
+#endif
 
 int sqlite3StatusValue(int);
 void sqlite3StatusAdd(int, int);
@@ -2627,6 +2685,17 @@ void sqlite3ExprListSetSpan(Parse*,ExprList*,ExprSpan*);
 void sqlite3ExprListDelete(sqlite3*, ExprList*);
 int sqlite3Init(sqlite3*, char**);
 int sqlite3InitCallback(void*, int, char**, char**);
+int sqlite3LazyLoadTable(sqlite3*, int, const char*);
+int sqlite3LazyLoadObject(sqlite3*, int, int, const char*);
+void sqlite3LazyLoadAll(sqlite3*, int);
+int sqlite3LazySaveStat(sqlite3*, int, char**);
+void sqlite3LazyFree(Schema*);
+#ifndef SQLITE_OMIT_SCHEMA_SNAPSHOT
+  void sqlite3SchemaSnapshot(Parse*, int);
+  int sqlite3SnapshotLoad(sqlite3*, int, LazyObj*);
+#else
+# define sqlite3SnapshotLoad(X,Y,Z) 0
+#endif
 void sqlite3Pragma(Parse*,Token*,Token*,Token*,int);
 void sqlite3ResetInternalSchema(sqlite3*, int);
 void sqlite3BeginParse(Parse*,int);
@@ -2674,7 +2743,9 @@ void sqlite3DeleteTable(sqlite3*, Table*);
 # define sqlite3AutoincrementBegin(X)
 # define sqlite3AutoincrementEnd(X)
 #endif
-void sqlite3Insert(Parse*, SrcList*, ExprList*, Select*, IdList*, int);
+void sqlite3Insert(Parse*,SrcList*,ExprList*,Select*,ValueList*,IdList*,int);
+ValueList *sqlite3ValueListAppend(sqlite3*, ValueList*, ExprList*);
+void sqlite3ValueListDelete(sqlite3*, ValueList*);
 void *sqlite3ArrayAllocate(sqlite3*,void*,int,int,int*,int*,int*);
 IdList *sqlite3IdListAppend(sqlite3*, IdList*, Token*);
 int sqlite3IdListIndex(IdList*,const char*);
@@ -2948,6 +3019,7 @@ int sqlite3InvokeBusyHandler(BusyHandler*);
 int sqlite3FindDb(sqlite3*, Token*);
 int sqlite3FindDbName(sqlite3 *, const char *);
 int sqlite3AnalysisLoad(sqlite3*,int iDB);
+void sqlite3AnalysisApply(sqlite3*,int,const char*,const char*,const char*);
 void sqlite3DeleteIndexSamples(sqlite3*,Index*);
 void sqlite3DefaultRowEst(Index*);
 void sqlite3RegisterLikeFunctions(sqlite3*, int);
@@ -174,11 +174,25 @@ int sqlite3_db_status(
             + pSchema->trigHash.count
             + pSchema->idxHash.count
             + pSchema->fkeyHash.count
+            + pSchema->lazyHash.count
+            + pSchema->lazyIdxHash.count
+            + pSchema->lazyTrigHash.count
           );
           nByte += sqlite3MallocSize(pSchema->tblHash.ht);
           nByte += sqlite3MallocSize(pSchema->trigHash.ht);
           nByte += sqlite3MallocSize(pSchema->idxHash.ht);
           nByte += sqlite3MallocSize(pSchema->fkeyHash.ht);
+          nByte += sqlite3MallocSize(pSchema->lazyHash.ht);
+          nByte += sqlite3MallocSize(pSchema->lazyIdxHash.ht);
+          nByte += sqlite3MallocSize(pSchema->lazyTrigHash.ht);
+
+          for(p=sqliteHashFirst(&pSchema->lazyHash); p; p=sqliteHashNext(p)){
+            LazyObj *pObj;
+            for(pObj=sqliteHashData(p); pObj; pObj=pObj->pNext){
+              nByte += sqlite3MallocSize(pObj);
+              nByte += sqlite3MallocSize(pObj->zStat);
+            }
+          }
 
           for(p=sqliteHashFirst(&pSchema->trigHash); p; p=sqliteHashNext(p)){
             sqlite3DeleteTrigger(db, (Trigger*)sqliteHashData(p));
@@ -3580,6 +3580,7 @@ static void init_all(Tcl_Interp *interp){
     extern int Sqlitetestrtree_Init(Tcl_Interp*);
     extern int Sqlitequota_Init(Tcl_Interp*);
     extern int Sqlitemultiplex_Init(Tcl_Interp*);
+    extern int Sqlitecompress_Init(Tcl_Interp*);
     extern int SqliteSuperlock_Init(Tcl_Interp*);
 
 #ifdef SQLITE_ENABLE_ZIPVFS
@@ -3617,6 +3618,7 @@ static void init_all(Tcl_Interp *interp){
     Sqlitetestrtree_Init(interp);
     Sqlitequota_Init(interp);
     Sqlitemultiplex_Init(interp);
+    Sqlitecompress_Init(interp);
     SqliteSuperlock_Init(interp);
 
     Tcl_CreateObjCommand(interp,"load_testfixture_extensions",init_all_cmd,0,0);
@@ -122,6 +122,7 @@ const char *sqlite3TestErrorName(int rc){
     case SQLITE_PERM:                zName = "SQLITE_PERM";              break;
     case SQLITE_ABORT:               zName = "SQLITE_ABORT";             break;
     case SQLITE_BUSY:                zName = "SQLITE_BUSY";              break;
+    case SQLITE_BUSY_SNAPSHOT:       zName = "SQLITE_BUSY_SNAPSHOT";     break;
     case SQLITE_LOCKED:              zName = "SQLITE_LOCKED";            break;
     case SQLITE_LOCKED_SHAREDCACHE:  zName = "SQLITE_LOCKED_SHAREDCACHE";break;
     case SQLITE_NOMEM:               zName = "SQLITE_NOMEM";             break;
@@ -3378,6 +3379,255 @@ static int test_clear_bindings(
   return TCL_OK;
 }
 
+/*
+** Copy the elements of the Tcl list pList into a new array of type iType,
+** where iType is 0 for sqlite3_int64, 1 for double or 2 for text.  In a
+** text list, an element that is the string "NULL" is stored as a NULL
+** pointer.  Set *pa to the array, which must be freed using ckfree(),
+** and return TCL_OK.  Or leave an error in interp and return TCL_ERROR.
+*/
+static int testArrayFromList(
+  Tcl_Interp *interp,
+  int iType,
+  Tcl_Obj *pList,
+  char **pa
+){
+  int nElem;
+  Tcl_Obj **apElem;
+  int nByte;
+  char *a;
+  char *zCsr;
+  int i;
+
+  *pa = 0;
+  if( Tcl_ListObjGetElements(interp, pList, &nElem, &apElem) ){
+    return TCL_ERROR;
+  }
+  nByte = nElem*(sizeof(double) + sizeof(char*)) + 1;
+  if( iType==2 ){
+    for(i=0; i<nElem; i++){
+      int n;
+      Tcl_GetStringFromObj(apElem[i], &n);
+      nByte += n+1;
+    }
+  }
+  a = ckalloc(nByte);
+  zCsr = &a[nElem*sizeof(char*)];
+  for(i=0; i<nElem; i++){
+    if( iType==0 ){
+      Tcl_WideInt v;
+      if( Tcl_GetWideIntFromObj(interp, apElem[i], &v) ) goto array_error;
+      ((sqlite3_int64*)a)[i] = (sqlite3_int64)v;
+    }else if( iType==1 ){
+      double r;
+      if( Tcl_GetDoubleFromObj(interp, apElem[i], &r) ) goto array_error;
+      ((double*)a)[i] = r;
+    }else{
+      const char *z = Tcl_GetString(apElem[i]);
+      if( strcmp(z, "NULL")==0 ){
+        ((char**)a)[i] = 0;
+      }else{
+        ((char**)a)[i] = zCsr;
+        strcpy(zCsr, z);
+        zCsr += strlen(z)+1;
+      }
+    }
+  }
+  *pa = a;
+  return TCL_OK;
+
+array_error:
+  ckfree(a);
+  return TCL_ERROR;
+}
+
+/*
+** Usage:   sqlite3_bind_array STMT N TYPE LIST
+**
+** Test the sqlite3_bind_array interface.  TYPE is one of "int64",
+** "double" or "text".  The elements of LIST are copied into an array of
+** that type, which is bound to wildcard N of STMT.  The array is kept
+** until the next call to this command for the same N.  If LIST is
+** omitted, a NULL array pointer is bound instead.  In a "text" list, an
+** element that is the string "NULL" is stored as a NULL pointer.
+*/
+static int test_bind_array(
+  void * clientData,
+  Tcl_Interp *interp,
+  int objc,
+  Tcl_Obj *CONST objv[]
+){
+  static char *aArray[32];        /* Arrays bound by this command */
+  static const char *azType[] = { "int64", "double", "text", 0 };
+  sqlite3_stmt *pStmt;
+  int idx;
+  int iType;
+  char *a = 0;
+  int rc;
+
+  if( objc!=4 && objc!=5 ){
+    Tcl_WrongNumArgs(interp, 1, objv, "STMT N TYPE ?LIST?");
+    return TCL_ERROR;
+  }
+  if( getStmtPointer(interp, Tcl_GetString(objv[1]), &pStmt) ) return TCL_ERROR;
+  if( Tcl_GetIntFromObj(interp, objv[2], &idx) ) return TCL_ERROR;
+  if( idx<0 || idx>=(int)(sizeof(aArray)/sizeof(aArray[0])) ){
+    Tcl_AppendResult(interp, "parameter index out of range", 0);
+    return TCL_ERROR;
+  }
+  if( Tcl_GetIndexFromObj(interp, objv[3], azType, "type", 0, &iType) ){
+    return TCL_ERROR;
+  }
+  if( objc==5 && testArrayFromList(interp, iType, objv[4], &a) ){
+    return TCL_ERROR;
+  }
+  rc = sqlite3_bind_array(pStmt, idx, iType+1, a);
+  if( aArray[idx] ) ckfree(aArray[idx]);
+  aArray[idx] = a;
+  if( sqlite3TestErrCode(interp, StmtToDb(pStmt), rc) ) return TCL_ERROR;
+  Tcl_SetResult(interp, (char *)t1ErrorName(rc), 0);
+  return TCL_OK;
+}
+
+/*
+** Usage:   sqlite3_step_array STMT NROW
+**
+** Test the sqlite3_step_array interface.  Return a list of two elements,
+** the result code and the number of runs completed.
+*/
+static int test_step_array(
+  void * clientData,
+  Tcl_Interp *interp,
+  int objc,
+  Tcl_Obj *CONST objv[]
+){
+  sqlite3_stmt *pStmt;
+  int nRow;
+  int nDone = -1;
+  int rc;
+  Tcl_Obj *pRet;
+
+  if( objc!=3 ){
+    Tcl_WrongNumArgs(interp, 1, objv, "STMT NROW");
+    return TCL_ERROR;
+  }
+  if( getStmtPointer(interp, Tcl_GetString(objv[1]), &pStmt) ) return TCL_ERROR;
+  if( Tcl_GetIntFromObj(interp, objv[2], &nRow) ) return TCL_ERROR;
+  rc = sqlite3_step_array(pStmt, nRow, &nDone);
+  pRet = Tcl_NewObj();
+  Tcl_ListObjAppendElement(0, pRet, Tcl_NewStringObj(t1ErrorName(rc), -1));
+  Tcl_ListObjAppendElement(0, pRet, Tcl_NewIntObj(nDone));
+  Tcl_SetObjResult(interp, pRet);
+  return TCL_OK;
+}
+
+#ifndef SQLITE_OMIT_VIRTUALTABLE
+/*
+** Usage:   sqlite3_tvp_create DB NAME COLUMNS
+**
+** Invoke the sqlite3_tvp_create interface.  Return a pointer to the
+** new sqlite3_tvp object.
+*/
+static int test_tvp_create(
+  void * clientData,
+  Tcl_Interp *interp,
+  int objc,
+  Tcl_Obj *CONST objv[]
+){
+  sqlite3 *db;
+  sqlite3_tvp *pTvp;
+  int rc;
+  char zPtr[100];
+
+  if( objc!=4 ){
+    Tcl_WrongNumArgs(interp, 1, objv, "DB NAME COLUMNS");
+    return TCL_ERROR;
+  }
+  if( getDbPointer(interp, Tcl_GetString(objv[1]), &db) ) return TCL_ERROR;
+  rc = sqlite3_tvp_create(db, Tcl_GetString(objv[2]),
+                          Tcl_GetString(objv[3]), &pTvp);
+  if( rc!=SQLITE_OK ){
+    Tcl_AppendResult(interp, t1ErrorName(rc), " ", sqlite3_errmsg(db), 0);
+    return TCL_ERROR;
+  }
+  if( sqlite3TestMakePointerStr(interp, zPtr, pTvp) ) return TCL_ERROR;
+  Tcl_AppendResult(interp, zPtr, 0);
+  return TCL_OK;
+}
+
+/*
+** Destructor for arrays bound by sqlite3_tvp_bind.
+*/
+static void testFreeArray(void *p){
+  ckfree((char*)p);
+}
+
+/*
+** Usage:   sqlite3_tvp_bind TVP ?-sorted? ?TYPE LIST ...?
+**
+** Invoke the sqlite3_tvp_bind interface.  There is one TYPE LIST pair for
+** each column of the table-valued parameter.  TYPE and LIST are as for
+** the sqlite3_bind_array command, and the number of rows is the length
+** of the first LIST.  The arrays are freed by the destructor passed to
+** sqlite3_tvp_bind.
+*/
+static int test_tvp_bind(
+  void * clientData,
+  Tcl_Interp *interp,
+  int objc,
+  Tcl_Obj *CONST objv[]
+){
+  static const char *azType[] = { "int64", "double", "text", 0 };
+  sqlite3_tvp *pTvp;
+  int flags = 0;
+  int nRow = 0;
+  int nCol;
+  int iArg = 2;
+  char **apCol;
+  int i;
+  int rc;
+
+  if( objc<2 ){
+    Tcl_WrongNumArgs(interp, 1, objv, "TVP ?-sorted? ?TYPE LIST ...?");
+    return TCL_ERROR;
+  }
+  pTvp = (sqlite3_tvp*)sqlite3TestTextToPtr(Tcl_GetString(objv[1]));
+  if( objc>2 && strcmp(Tcl_GetString(objv[2]), "-sorted")==0 ){
+    flags |= SQLITE_TVP_SORTED;
+    iArg++;
+  }
+  if( (objc-iArg)%2 ){
+    Tcl_WrongNumArgs(interp, 1, objv, "TVP ?-sorted? ?TYPE LIST ...?");
+    return TCL_ERROR;
+  }
+  nCol = (objc-iArg)/2;
+  apCol = (char**)ckalloc(sizeof(char*)*(nCol+1));
+  memset(apCol, 0, sizeof(char*)*(nCol+1));
+  for(i=0; i<nCol; i++){
+    Tcl_Obj *pType = objv[iArg+i*2];
+    Tcl_Obj *pList = objv[iArg+i*2+1];
+    int iType;
+    if( Tcl_GetIndexFromObj(interp, pType, azType, "type", 0, &iType)
+     || testArrayFromList(interp, iType, pList, &apCol[i])
+    ){
+      goto tvp_bind_error;
+    }
+    if( i==0 ) Tcl_ListObjLength(0, pList, &nRow);
+  }
+  rc = sqlite3_tvp_bind(pTvp, nRow, (void**)apCol, flags, testFreeArray);
+  ckfree((char*)apCol);
+  Tcl_SetResult(interp, (char *)t1ErrorName(rc), 0);
+  return TCL_OK;
+
+tvp_bind_error:
+  for(i=0; i<nCol; i++){
+    if( apCol[i] ) ckfree(apCol[i]);
+  }
+  ckfree((char*)apCol);
+  return TCL_ERROR;
+}
+#endif /* SQLITE_OMIT_VIRTUALTABLE */
+
 /*
 ** Usage:   sqlite3_sleep MILLISECONDS
 */
@@ -5454,6 +5704,12 @@ int Sqlitetest1_Init(Tcl_Interp *interp){
      { "sqlite3_bind_parameter_name",   test_bind_parameter_name,  0},
      { "sqlite3_bind_parameter_index",  test_bind_parameter_index, 0},
      { "sqlite3_clear_bindings",        test_clear_bindings, 0},
+     { "sqlite3_bind_array",            test_bind_array,    0 },
+     { "sqlite3_step_array",            test_step_array,    0 },
+#ifndef SQLITE_OMIT_VIRTUALTABLE
+     { "sqlite3_tvp_create",            test_tvp_create,    0 },
+     { "sqlite3_tvp_bind",              test_tvp_bind,      0 },
+#endif
      { "sqlite3_sleep",                 test_sleep,          0},
      { "sqlite3_errcode",               test_errcode       ,0 },
      { "sqlite3_extended_errcode",      test_ex_errcode    ,0 },
@@ -5680,6 +5936,29 @@ int Sqlitetest1_Init(Tcl_Interp *interp){
       (char*)&sqlite3_sync_count, TCL_LINK_INT);
   Tcl_LinkVar(interp, "sqlite_fullsync_count",
       (char*)&sqlite3_fullsync_count, TCL_LINK_INT);
+#if SQLITE_OS_UNIX
+  {
+    extern int sqlite3_direct_write_count;
+    Tcl_LinkVar(interp, "sqlite_direct_write_count",
+        (char*)&sqlite3_direct_write_count, TCL_LINK_INT);
+  }
+#endif
+#ifdef SQLITE_MUTEX_PTHREADS
+  {
+    extern int sqlite3_lockwait_wakeup_count;
+    Tcl_LinkVar(interp, "sqlite_lockwait_wakeup_count",
+        (char*)&sqlite3_lockwait_wakeup_count, TCL_LINK_INT);
+  }
+#endif
+#if defined(HAVE_IO_URING) && HAVE_IO_URING
+  {
+    extern int sqlite3_uring_enter_count, sqlite3_uring_op_count;
+    Tcl_LinkVar(interp, "sqlite_uring_enter_count",
+        (char*)&sqlite3_uring_enter_count, TCL_LINK_INT);
+    Tcl_LinkVar(interp, "sqlite_uring_op_count",
+        (char*)&sqlite3_uring_op_count, TCL_LINK_INT);
+  }
+#endif
 #if defined(SQLITE_ENABLE_FTS3) && defined(SQLITE_TEST)
   Tcl_LinkVar(interp, "sqlite_fts3_enable_parentheses",
       (char*)&sqlite3_fts3_enable_parentheses, TCL_LINK_INT);
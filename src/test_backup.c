@@ -28,7 +28,8 @@ static int backupTestCmd(
   Tcl_Obj *const*objv
 ){
   enum BackupSubCommandEnum {
-    BACKUP_STEP, BACKUP_FINISH, BACKUP_REMAINING, BACKUP_PAGECOUNT
+    BACKUP_STEP, BACKUP_FINISH, BACKUP_REMAINING, BACKUP_PAGECOUNT,
+    BACKUP_CONFIG, BACKUP_GENERATION
   };
   struct BackupSubCommand {
     const char *zCmd;
@@ -40,6 +41,8 @@ static int backupTestCmd(
     {"finish",    BACKUP_FINISH    , 0, ""      },
     {"remaining", BACKUP_REMAINING , 0, ""      },
     {"pagecount", BACKUP_PAGECOUNT , 0, ""      },
+    {"config",    BACKUP_CONFIG    , 2, "option value" },
+    {"generation", BACKUP_GENERATION, 0, ""     },
     {0, 0, 0, 0}
   };
 
@@ -91,6 +94,47 @@ static int backupTestCmd(
     case BACKUP_PAGECOUNT:
       Tcl_SetObjResult(interp, Tcl_NewIntObj(sqlite3_backup_pagecount(p)));
       break;
+
+    case BACKUP_GENERATION:
+      Tcl_SetObjResult(interp,
+          Tcl_NewWideIntObj((Tcl_WideInt)sqlite3_backup_generation(p))
+      );
+      break;
+
+    case BACKUP_CONFIG: {
+      struct BackupConfigOption {
+        const char *zOpt;
+        int op;
+      } aOpt[] = {
+        {"snapshot",  SQLITE_BACKUPCONFIG_SNAPSHOT  },
+        {"readsize",  SQLITE_BACKUPCONFIG_READSIZE  },
+        {"ratelimit", SQLITE_BACKUPCONFIG_RATELIMIT },
+        {"incremental", SQLITE_BACKUPCONFIG_INCREMENTAL },
+        {"pagesize",  SQLITE_BACKUPCONFIG_PAGESIZE  },
+        {0, 0}
+      };
+      int iOpt;
+      int iVal;
+      Tcl_WideInt iVal64;
+      rc = Tcl_GetIndexFromObjStruct(
+          interp, objv[2], aOpt, sizeof(aOpt[0]), "option", 0, &iOpt
+      );
+      if( rc!=TCL_OK ) return rc;
+      if( aOpt[iOpt].op==SQLITE_BACKUPCONFIG_INCREMENTAL ){
+        /* This option takes an sqlite3_int64 argument */
+        if( TCL_OK!=Tcl_GetWideIntFromObj(interp, objv[3], &iVal64) ){
+          return TCL_ERROR;
+        }
+        rc = sqlite3_backup_config(p, aOpt[iOpt].op, (sqlite3_int64)iVal64);
+      }else{
+        if( TCL_OK!=Tcl_GetIntFromObj(interp, objv[3], &iVal) ){
+          return TCL_ERROR;
+        }
+        rc = sqlite3_backup_config(p, aOpt[iOpt].op, iVal);
+      }
+      Tcl_SetResult(interp, (char *)sqlite3TestErrorName(rc), TCL_STATIC);
+      break;
+    }
   }
 
   return TCL_OK;
@@ -0,0 +1,135 @@
+/*
+** 2011 February 10
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** Code for testing the "compress" VFS implemented in compress.c.
+*/
+#include "sqliteInt.h"
+#include <tcl.h>
+
+#ifndef SQLITE_OMIT_COMPRESS
+
+extern const char *sqlite3TestErrorName(int);
+
+/*
+** tclcmd: sqlite3_compress_initialize NAME MAKEDEFAULT
+*/
+static int test_compress_initialize(
+  void * clientData,
+  Tcl_Interp *interp,
+  int objc,
+  Tcl_Obj *CONST objv[]
+){
+  const char *zName;              /* Name of underlying VFS */
+  int makeDefault;                /* True to make the new VFS the default */
+  int rc;                         /* Value returned by compress_initialize() */
+
+  UNUSED_PARAMETER(clientData);
+
+  if( objc!=3 ){
+    Tcl_WrongNumArgs(interp, 1, objv, "NAME MAKEDEFAULT");
+    return TCL_ERROR;
+  }
+  zName = Tcl_GetString(objv[1]);
+  if( Tcl_GetBooleanFromObj(interp, objv[2], &makeDefault) ) return TCL_ERROR;
+  if( zName[0]=='\0' ) zName = 0;
+
+  rc = sqlite3_compress_initialize(zName, makeDefault);
+  Tcl_SetResult(interp, (char *)sqlite3TestErrorName(rc), TCL_STATIC);
+  return TCL_OK;
+}
+
+/*
+** tclcmd: sqlite3_compress_shutdown
+*/
+static int test_compress_shutdown(
+  void * clientData,
+  Tcl_Interp *interp,
+  int objc,
+  Tcl_Obj *CONST objv[]
+){
+  int rc;                         /* Value returned by compress_shutdown() */
+
+  UNUSED_PARAMETER(clientData);
+
+  if( objc!=1 ){
+    Tcl_WrongNumArgs(interp, 1, objv, "");
+    return TCL_ERROR;
+  }
+  rc = sqlite3_compress_shutdown();
+  Tcl_SetResult(interp, (char *)sqlite3TestErrorName(rc), TCL_STATIC);
+  return TCL_OK;
+}
+
+/*
+** tclcmd: sqlite3_compress_stats ?-reset?
+**
+** Return a list of two integers: the number of bytes of database pages
+** written and the number of bytes used to store them.
+*/
+static int test_compress_stats(
+  void * clientData,
+  Tcl_Interp *interp,
+  int objc,
+  Tcl_Obj *CONST objv[]
+){
+  sqlite3_int64 nIn;
+  sqlite3_int64 nOut;
+  int resetFlag = 0;
+  Tcl_Obj *pRet;
+  int rc;
+
+  UNUSED_PARAMETER(clientData);
+
+  if( objc==2 && strcmp(Tcl_GetString(objv[1]), "-reset")==0 ){
+    resetFlag = 1;
+  }else if( objc!=1 ){
+    Tcl_WrongNumArgs(interp, 1, objv, "?-reset?");
+    return TCL_ERROR;
+  }
+  rc = sqlite3_compress_stats(&nIn, &nOut, resetFlag);
+  if( rc!=SQLITE_OK ){
+    Tcl_SetResult(interp, (char *)sqlite3TestErrorName(rc), TCL_STATIC);
+    return TCL_ERROR;
+  }
+  pRet = Tcl_NewObj();
+  Tcl_ListObjAppendElement(interp, pRet, Tcl_NewWideIntObj(nIn));
+  Tcl_ListObjAppendElement(interp, pRet, Tcl_NewWideIntObj(nOut));
+  Tcl_SetObjResult(interp, pRet);
+  return TCL_OK;
+}
+
+#endif /* SQLITE_OMIT_COMPRESS */
+
+/*
+** This routine registers the custom TCL commands defined in this
+** module.  This should be the only procedure visible from outside
+** of this module.
+*/
+int Sqlitecompress_Init(Tcl_Interp *interp){
+#ifndef SQLITE_OMIT_COMPRESS
+  static struct {
+     char *zName;
+     Tcl_ObjCmdProc *xProc;
+  } aCmd[] = {
+    { "sqlite3_compress_initialize", test_compress_initialize },
+    { "sqlite3_compress_shutdown", test_compress_shutdown },
+    { "sqlite3_compress_stats", test_compress_stats },
+  };
+  int i;
+
+  for(i=0; i<sizeof(aCmd)/sizeof(aCmd[0]); i++){
+    Tcl_CreateObjCommand(interp, aCmd[i].zName, aCmd[i].xProc, 0, 0);
+  }
+#endif
+
+  return TCL_OK;
+}
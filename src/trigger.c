@@ -165,6 +165,7 @@ void sqlite3BeginTrigger(
   if( !zName || SQLITE_OK!=sqlite3CheckObjectName(pParse, zName) ){
     goto trigger_cleanup;
   }
+  sqlite3LazyLoadObject(db, iDb, LAZY_TRIGGER, zName);
   if( sqlite3HashFind(&(db->aDb[iDb].pSchema->trigHash),
                       zName, sqlite3Strlen30(zName)) ){
     if( !noErr ){
@@ -490,6 +491,9 @@ void sqlite3DropTrigger(Parse *pParse, SrcList *pName, int noErr){
     int j = (i<2) ? i^1 : i;  /* Search TEMP before MAIN */
     if( zDb && sqlite3StrICmp(db->aDb[j].zName, zDb) ) continue;
     pTrigger = sqlite3HashFind(&(db->aDb[j].pSchema->trigHash), zName, nName);
+    if( pTrigger==0 && sqlite3LazyLoadObject(db, j, LAZY_TRIGGER, zName) ){
+      pTrigger = sqlite3HashFind(&(db->aDb[j].pSchema->trigHash), zName, nName);
+    }
     if( pTrigger ) break;
   }
   if( !pTrigger ){
@@ -716,6 +720,7 @@ static int codeTriggerProgram(
           targetSrcList(pParse, pStep),
           sqlite3ExprListDup(db, pStep->pExprList, 0), 
           sqlite3SelectDup(db, pStep->pSelect, 0), 
+          0,
           sqlite3IdListDup(db, pStep->pIdList), 
           pParse->eOrconf
         );
@@ -0,0 +1,699 @@
+/*
+** 2011 February 7
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+** This file implements table-valued parameters.  A table-valued parameter
+** is a virtual table in the TEMP database whose content is a set of C
+** arrays owned by the application, one array per column.  The arrays
+** are used in place and are never copied.  See sqlite3_tvp_create() and
+** sqlite3_tvp_bind() for the interface.
+**
+** The first column of a table-valued parameter is its key.  An equality
+** constraint on the key is answered using a hash index that is built
+** the first time it is needed after each call to sqlite3_tvp_bind().  If
+** the application binds the rows in ascending order of the key and says
+** so by passing the SQLITE_TVP_SORTED flag, then equality and range
+** constraints on the key are answered by binary search instead, and
+** the rows are returned in key order.
+**
+** The constraints passed to xFilter are also checked again by the core,
+** so a lookup may return extra rows, but never too few.  Lookups are
+** abandoned in favor of a full scan whenever a constraint value cannot
+** be converted exactly to the type of the key column.
+*/
+#include "sqliteInt.h"
+
+#ifndef SQLITE_OMIT_VIRTUALTABLE
+
+/*
+** An instance of this structure is the content of one table-valued
+** parameter.  Column types are SQLITE_ARRAY_INT64, SQLITE_ARRAY_DOUBLE
+** or SQLITE_ARRAY_TEXT.
+*/
+struct sqlite3_tvp {
+  sqlite3 *db;              /* Database connection that owns this object */
+  int nCol;                 /* Number of columns */
+  u8 *aType;                /* Type of each column */
+  char *zDecl;              /* CREATE TABLE statement for the virtual table */
+  int nRow;                 /* Number of rows currently bound */
+  const void **apCol;       /* Array of values for each column */
+  void (*xDel)(void*);      /* Destructor for each apCol[] array, or NULL */
+  int flags;                /* SQLITE_TVP_* flags passed to bind */
+  int nHash;                /* Number of slots in aHash[], a power of 2 */
+  int *aHash;               /* Hash index on column 0, or NULL */
+};
+
+/*
+** A key value to be compared against column 0 of a table-valued
+** parameter.  Which field is used depends on the type of column 0.
+** For text keys, z is NULL if the key is an SQL NULL.
+*/
+typedef struct TvpKey TvpKey;
+struct TvpKey {
+  i64 i;                    /* Key for SQLITE_ARRAY_INT64 columns */
+  double r;                 /* Key for SQLITE_ARRAY_DOUBLE columns */
+  char *z;                  /* Key for SQLITE_ARRAY_TEXT columns */
+};
+
+typedef struct tvp_vtab tvp_vtab;
+typedef struct tvp_cursor tvp_cursor;
+
+/* A table-valued parameter virtual table */
+struct tvp_vtab {
+  sqlite3_vtab base;        /* Base class.  Must be first */
+  sqlite3_tvp *pTvp;        /* Content of the table */
+};
+
+/* A cursor on a table-valued parameter */
+struct tvp_cursor {
+  sqlite3_vtab_cursor base; /* Base class.  Must be first */
+  int iRow;                 /* Current row */
+  int iEnd;                 /* One past the last row of a scan */
+  int iSlot;                /* Current aHash[] slot, or -1 if not a lookup */
+  TvpKey key;               /* Key being looked up when iSlot>=0 */
+};
+
+/*
+** Values for the idxNum passed from xBestIndex to xFilter.  Each
+** constraint used consumes one argument, in the order listed here.
+*/
+#define TVP_EQ    0x01      /* key==? */
+#define TVP_GE    0x02      /* key>=? */
+#define TVP_GT    0x04      /* key>? */
+#define TVP_LE    0x08      /* key<=? */
+#define TVP_LT    0x10      /* key<? */
+
+/*
+** Discard the rows bound to p, calling the destructor for each column
+** array if there is one, and the hash index on them.
+*/
+static void tvpUnbind(sqlite3_tvp *p){
+  int i;
+  if( p->xDel ){
+    for(i=0; i<p->nCol; i++){
+      if( p->apCol[i] ) p->xDel((void*)p->apCol[i]);
+    }
+  }
+  memset(p->apCol, 0, sizeof(p->apCol[0])*p->nCol);
+  p->xDel = 0;
+  p->nRow = 0;
+  p->flags = 0;
+  sqlite3_free(p->aHash);
+  p->aHash = 0;
+  p->nHash = 0;
+}
+
+/*
+** Free a table-valued parameter.  This is the destructor for the module
+** created by sqlite3_tvp_create().
+*/
+static void tvpFree(void *pArg){
+  sqlite3_tvp *p = (sqlite3_tvp*)pArg;
+  tvpUnbind(p);
+  sqlite3_free(p->zDecl);
+  sqlite3_free(p->apCol);
+  sqlite3_free(p->aType);
+  sqlite3_free(p);
+}
+
+/*
+** Set the key in *pKey from value pVal, for a lookup on column 0 of p.
+** Return 0 if the value could be converted exactly to the type of the
+** column, or non-zero if it could not.  A NULL value converts exactly
+** to a NULL text key but cannot be converted to any other type.
+**
+** The value passed to xFilter is the right-hand side of the comparison
+** before any affinity is applied.  The core compares it with a numeric
+** key column after applying numeric affinity, so the same is done here
+** for text values.  A comparison with a text key column might use text
+** or numeric affinity, depending on the other operand, so only text
+** values are converted exactly for a text key.
+*/
+static int tvpSetKey(sqlite3_tvp *p, sqlite3_value *pVal, TvpKey *pKey){
+  int eType = sqlite3_value_type(pVal);
+  i64 iVal = 0;
+  double rVal = 0.0;
+
+  if( eType==SQLITE_INTEGER ){
+    iVal = sqlite3_value_int64(pVal);
+    rVal = (double)iVal;
+  }else if( eType==SQLITE_FLOAT ){
+    rVal = sqlite3_value_double(pVal);
+  }else if( eType==SQLITE_TEXT && p->aType[0]!=SQLITE_ARRAY_TEXT ){
+    const char *z = (const char*)sqlite3_value_text(pVal);
+    int n = sqlite3_value_bytes(pVal);
+    if( z && sqlite3AtoF(z, &rVal, n, SQLITE_UTF8) ){
+      if( sqlite3Atoi64(z, &iVal, n, SQLITE_UTF8)==0 ){
+        eType = SQLITE_INTEGER;
+        rVal = (double)iVal;
+      }else{
+        eType = SQLITE_FLOAT;
+      }
+    }
+  }
+
+  switch( p->aType[0] ){
+    case SQLITE_ARRAY_INT64: {
+      if( eType==SQLITE_INTEGER ){
+        pKey->i = iVal;
+        return 0;
+      }
+      if( eType==SQLITE_FLOAT ){
+        if( rVal>-9223372036854775808.0 && rVal<9223372036854775808.0 ){
+          pKey->i = (i64)rVal;
+          return (double)pKey->i!=rVal;
+        }
+      }
+      return 1;
+    }
+    case SQLITE_ARRAY_DOUBLE: {
+      if( eType==SQLITE_INTEGER || eType==SQLITE_FLOAT ){
+        pKey->r = rVal;
+        if( pKey->r==0.0 ) pKey->r = 0.0;   /* Treat -0.0 as 0.0 */
+        return 0;
+      }
+      return 1;
+    }
+    default: {
+      assert( p->aType[0]==SQLITE_ARRAY_TEXT );
+      sqlite3_free(pKey->z);
+      pKey->z = 0;
+      if( eType==SQLITE_NULL ) return 0;
+      if( eType!=SQLITE_TEXT ) return 1;
+      pKey->z = sqlite3_mprintf("%s", sqlite3_value_text(pVal));
+      return pKey->z==0;
+    }
+  }
+}
+
+/*
+** Compare column 0 of row iRow of p against pKey.  Return negative,
+** zero or positive if the column value is less than, equal to or greater
+** than the key.  NULL text values are less than any other text.
+*/
+static int tvpCompare(sqlite3_tvp *p, int iRow, TvpKey *pKey){
+  switch( p->aType[0] ){
+    case SQLITE_ARRAY_INT64: {
+      i64 i = ((const i64*)p->apCol[0])[iRow];
+      return i<pKey->i ? -1 : i>pKey->i;
+    }
+    case SQLITE_ARRAY_DOUBLE: {
+      double r = ((const double*)p->apCol[0])[iRow];
+      return r<pKey->r ? -1 : r>pKey->r;
+    }
+    default: {
+      const char *z = ((const char*const*)p->apCol[0])[iRow];
+      if( z==0 || pKey->z==0 ) return (z!=0) - (pKey->z!=0);
+      return strcmp(z, pKey->z);
+    }
+  }
+}
+
+/*
+** Return the hash of column 0 of row iRow of p, or of pKey if iRow<0.
+*/
+static unsigned int tvpHash(sqlite3_tvp *p, int iRow, TvpKey *pKey){
+  u64 h;
+  switch( p->aType[0] ){
+    case SQLITE_ARRAY_INT64: {
+      h = iRow<0 ? (u64)pKey->i : (u64)((const i64*)p->apCol[0])[iRow];
+      break;
+    }
+    case SQLITE_ARRAY_DOUBLE: {
+      double r = iRow<0 ? pKey->r : ((const double*)p->apCol[0])[iRow];
+      if( r==0.0 ) r = 0.0;
+      memcpy(&h, &r, sizeof(h));
+      break;
+    }
+    default: {
+      const unsigned char *z;
+      z = (const unsigned char*)(iRow<0 ? pKey->z :
+              ((const char*const*)p->apCol[0])[iRow]);
+      for(h=0; z && *z; z++) h = (h<<3) ^ h ^ *z;
+      break;
+    }
+  }
+  h *= (((u64)0x9e3779b9)<<32) + 0x7f4a7c15;
+  return (unsigned int)(h>>32);
+}
+
+/*
+** Build the hash index on column 0 of p, if it does not already exist.
+** Rows with a NULL key are not entered into the index, since they cannot
+** satisfy an equality constraint.  Return SQLITE_OK or SQLITE_NOMEM.
+*/
+static int tvpBuildHash(sqlite3_tvp *p){
+  int i;
+  int nHash = 16;
+  if( p->aHash ) return SQLITE_OK;
+  while( nHash<p->nRow*2 ) nHash *= 2;
+  p->aHash = sqlite3_malloc(nHash*sizeof(int));
+  if( p->aHash==0 ) return SQLITE_NOMEM;
+  memset(p->aHash, 0xff, nHash*sizeof(int));
+  p->nHash = nHash;
+  for(i=0; i<p->nRow; i++){
+    int h;
+    if( p->aType[0]==SQLITE_ARRAY_TEXT
+     && ((const char*const*)p->apCol[0])[i]==0 ){
+      continue;
+    }
+    h = tvpHash(p, i, 0) & (nHash-1);
+    while( p->aHash[h]>=0 ) h = (h+1) & (nHash-1);
+    p->aHash[h] = i;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Return the index of the first row of p for which column 0 is greater
+** than pKey, or greater than or equal to it if bEq is true.  The rows
+** of p must be sorted on column 0.
+*/
+static int tvpSearch(sqlite3_tvp *p, TvpKey *pKey, int bEq){
+  int iLo = 0;
+  int iHi = p->nRow;
+  while( iLo<iHi ){
+    int iMid = iLo + (iHi-iLo)/2;
+    int c = tvpCompare(p, iMid, pKey);
+    if( c<0 || (c==0 && !bEq) ){
+      iLo = iMid+1;
+    }else{
+      iHi = iMid;
+    }
+  }
+  return iLo;
+}
+
+/*
+** Table constructor for the table-valued parameter module.  This is
+** used for both xCreate and xConnect.
+*/
+static int tvpConnect(
+  sqlite3 *db,
+  void *pAux,
+  int argc, const char *const*argv,
+  sqlite3_vtab **ppVtab,
+  char **pzErr
+){
+  sqlite3_tvp *p = (sqlite3_tvp*)pAux;
+  tvp_vtab *pVtab;
+  int rc;
+
+  UNUSED_PARAMETER(argc);
+  UNUSED_PARAMETER(argv);
+  UNUSED_PARAMETER(pzErr);
+  pVtab = sqlite3_malloc(sizeof(tvp_vtab));
+  if( pVtab==0 ) return SQLITE_NOMEM;
+  memset(pVtab, 0, sizeof(tvp_vtab));
+  pVtab->pTvp = p;
+  rc = sqlite3_declare_vtab(db, p->zDecl);
+  if( rc!=SQLITE_OK ){
+    sqlite3_free(pVtab);
+    pVtab = 0;
+  }
+  *ppVtab = (sqlite3_vtab*)pVtab;
+  return rc;
+}
+
+/*
+** Table destructor.  Used for both xDisconnect and xDestroy.  The
+** sqlite3_tvp object itself is freed when the module is destroyed.
+*/
+static int tvpDisconnect(sqlite3_vtab *pVtab){
+  sqlite3_free(pVtab);
+  return SQLITE_OK;
+}
+
+/*
+** Analyze the WHERE clause and ORDER BY clause of a query.
+*/
+static int tvpBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pInfo){
+  sqlite3_tvp *p = ((tvp_vtab*)tab)->pTvp;
+  int bSorted = (p->flags & SQLITE_TVP_SORTED)!=0;
+  int iEq = -1, iLower = -1, iUpper = -1;
+  int idxNum = 0;
+  int nArg = 0;
+  double nRow = p->nRow>0 ? (double)p->nRow : 1.0;
+  double nLog = 1.0;
+  int i;
+
+  while( (double)(1<<(int)nLog)<nRow && nLog<31.0 ) nLog += 1.0;
+  for(i=0; i<pInfo->nConstraint; i++){
+    const struct sqlite3_index_constraint *pCons = &pInfo->aConstraint[i];
+    if( !pCons->usable || pCons->iColumn!=0 ) continue;
+    switch( pCons->op ){
+      case SQLITE_INDEX_CONSTRAINT_EQ:
+        if( iEq<0 ) iEq = i;
+        break;
+      case SQLITE_INDEX_CONSTRAINT_GT:
+      case SQLITE_INDEX_CONSTRAINT_GE:
+        if( iLower<0 ) iLower = i;
+        break;
+      case SQLITE_INDEX_CONSTRAINT_LT:
+      case SQLITE_INDEX_CONSTRAINT_LE:
+        if( iUpper<0 ) iUpper = i;
+        break;
+    }
+  }
+
+  if( iEq>=0 ){
+    idxNum = TVP_EQ;
+    pInfo->aConstraintUsage[iEq].argvIndex = ++nArg;
+    pInfo->estimatedCost = bSorted ? nLog : 1.0;
+  }else if( bSorted && (iLower>=0 || iUpper>=0) ){
+    if( iLower>=0 ){
+      int op = pInfo->aConstraint[iLower].op;
+      idxNum |= (op==SQLITE_INDEX_CONSTRAINT_GE ? TVP_GE : TVP_GT);
+      pInfo->aConstraintUsage[iLower].argvIndex = ++nArg;
+    }
+    if( iUpper>=0 ){
+      int op = pInfo->aConstraint[iUpper].op;
+      idxNum |= (op==SQLITE_INDEX_CONSTRAINT_LE ? TVP_LE : TVP_LT);
+      pInfo->aConstraintUsage[iUpper].argvIndex = ++nArg;
+    }
+    pInfo->estimatedCost = nLog + nRow/(nArg==2 ? 4.0 : 2.0);
+  }else{
+    pInfo->estimatedCost = nRow;
+  }
+  pInfo->idxNum = idxNum;
+
+  if( bSorted && pInfo->nOrderBy==1
+   && pInfo->aOrderBy[0].iColumn==0 && pInfo->aOrderBy[0].desc==0
+  ){
+    pInfo->orderByConsumed = 1;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Open a new cursor.
+*/
+static int tvpOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor){
+  tvp_cursor *pCur;
+  UNUSED_PARAMETER(pVtab);
+  pCur = sqlite3_malloc(sizeof(tvp_cursor));
+  if( pCur==0 ) return SQLITE_NOMEM;
+  memset(pCur, 0, sizeof(tvp_cursor));
+  pCur->iSlot = -1;
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
+
+/*
+** Close a cursor.
+*/
+static int tvpClose(sqlite3_vtab_cursor *cur){
+  tvp_cursor *pCur = (tvp_cursor*)cur;
+  sqlite3_free(pCur->key.z);
+  sqlite3_free(pCur);
+  return SQLITE_OK;
+}
+
+/*
+** Advance a hash lookup cursor to the next row that matches its key,
+** starting with slot pCur->iSlot.  Set pCur->iRow to -1 at EOF.
+*/
+static void tvpHashNext(sqlite3_tvp *p, tvp_cursor *pCur){
+  int h = pCur->iSlot;
+  while( p->aHash[h]>=0 && tvpCompare(p, p->aHash[h], &pCur->key)!=0 ){
+    h = (h+1) & (p->nHash-1);
+  }
+  pCur->iSlot = h;
+  pCur->iRow = p->aHash[h];
+}
+
+/*
+** Begin a search of a table-valued parameter.
+*/
+static int tvpFilter(
+  sqlite3_vtab_cursor *cur,
+  int idxNum, const char *idxStr,
+  int argc, sqlite3_value **argv
+){
+  tvp_cursor *pCur = (tvp_cursor*)cur;
+  sqlite3_tvp *p = ((tvp_vtab*)cur->pVtab)->pTvp;
+  int iArg = 0;
+
+  UNUSED_PARAMETER(idxStr);
+  UNUSED_PARAMETER(argc);
+  pCur->iRow = 0;
+  pCur->iEnd = p->nRow;
+  pCur->iSlot = -1;
+
+  if( idxNum & TVP_EQ ){
+    sqlite3_value *pVal = argv[iArg++];
+    if( sqlite3_value_type(pVal)==SQLITE_NULL ){
+      /* NULL is not equal to anything */
+      pCur->iEnd = 0;
+    }else if( tvpSetKey(p, pVal, &pCur->key) ){
+      /* The value cannot be converted exactly to the type of the key,
+      ** but may still compare equal to some keys. Scan the whole table
+      ** and let the core check the constraint. */
+    }else if( p->flags & SQLITE_TVP_SORTED ){
+      pCur->iRow = tvpSearch(p, &pCur->key, 1);
+      pCur->iEnd = tvpSearch(p, &pCur->key, 0);
+    }else{
+      int rc = tvpBuildHash(p);
+      if( rc!=SQLITE_OK ) return rc;
+      pCur->iSlot = tvpHash(p, -1, &pCur->key) & (p->nHash-1);
+      tvpHashNext(p, pCur);
+    }
+    return SQLITE_OK;
+  }
+
+  /* Range constraints on a sorted key.  A constraint value that cannot
+  ** be converted exactly is ignored; the core checks it anyway. */
+  if( idxNum & (TVP_GE|TVP_GT) ){
+    if( tvpSetKey(p, argv[iArg++], &pCur->key)==0 ){
+      pCur->iRow = tvpSearch(p, &pCur->key, (idxNum & TVP_GE)!=0);
+    }
+  }
+  if( idxNum & (TVP_LE|TVP_LT) ){
+    if( tvpSetKey(p, argv[iArg++], &pCur->key)==0 ){
+      pCur->iEnd = tvpSearch(p, &pCur->key, (idxNum & TVP_LT)!=0);
+    }
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Advance a cursor to its next row.
+*/
+static int tvpNext(sqlite3_vtab_cursor *cur){
+  tvp_cursor *pCur = (tvp_cursor*)cur;
+  if( pCur->iSlot>=0 ){
+    sqlite3_tvp *p = ((tvp_vtab*)cur->pVtab)->pTvp;
+    pCur->iSlot = (pCur->iSlot+1) & (p->nHash-1);
+    tvpHashNext(p, pCur);
+  }else{
+    pCur->iRow++;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Return true if a cursor is at EOF.
+*/
+static int tvpEof(sqlite3_vtab_cursor *cur){
+  tvp_cursor *pCur = (tvp_cursor*)cur;
+  if( pCur->iSlot>=0 ) return pCur->iRow<0;
+  return pCur->iRow>=pCur->iEnd;
+}
+
+/*
+** Return the value of column i of the current row.
+*/
+static int tvpColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i){
+  tvp_cursor *pCur = (tvp_cursor*)cur;
+  sqlite3_tvp *p = ((tvp_vtab*)cur->pVtab)->pTvp;
+  int iRow = pCur->iRow;
+  switch( p->aType[i] ){
+    case SQLITE_ARRAY_INT64: {
+      sqlite3_result_int64(ctx, ((const i64*)p->apCol[i])[iRow]);
+      break;
+    }
+    case SQLITE_ARRAY_DOUBLE: {
+      sqlite3_result_double(ctx, ((const double*)p->apCol[i])[iRow]);
+      break;
+    }
+    default: {
+      const char *z = ((const char*const*)p->apCol[i])[iRow];
+      if( z ) sqlite3_result_text(ctx, z, -1, SQLITE_STATIC);
+      break;
+    }
+  }
+  return SQLITE_OK;
+}
+
+/*
+** The rowid of a row is its index in the column arrays.
+*/
+static int tvpRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid){
+  *pRowid = ((tvp_cursor*)cur)->iRow;
+  return SQLITE_OK;
+}
+
+static sqlite3_module tvpModule = {
+  0,                           /* iVersion */
+  tvpConnect,                  /* xCreate */
+  tvpConnect,                  /* xConnect */
+  tvpBestIndex,                /* xBestIndex */
+  tvpDisconnect,               /* xDisconnect */
+  tvpDisconnect,               /* xDestroy */
+  tvpOpen,                     /* xOpen */
+  tvpClose,                    /* xClose */
+  tvpFilter,                   /* xFilter */
+  tvpNext,                     /* xNext */
+  tvpEof,                      /* xEof */
+  tvpColumn,                   /* xColumn */
+  tvpRowid,                    /* xRowid */
+  0,                           /* xUpdate */
+  0,                           /* xBegin */
+  0,                           /* xSync */
+  0,                           /* xCommit */
+  0,                           /* xRollback */
+  0,                           /* xFindMethod */
+  0,                           /* xRename */
+};
+
+/*
+** Parse the column list zCols passed to sqlite3_tvp_create() and set
+** p->nCol and p->aType[] from the declared type of each column.  Return
+** SQLITE_OK, or an error code with an error message in *pzErr.
+*/
+static int tvpParseColumns(sqlite3_tvp *p, const char *zCols, char **pzErr){
+  const unsigned char *z = (const unsigned char*)zCols;
+  int nAlloc = 0;
+
+  while( 1 ){
+    int eTok;
+    int n;
+    const unsigned char *zType;
+    char *zCopy;
+    char aff;
+
+    /* Skip the column name, then take the rest of the definition up to
+    ** the next comma as its type. */
+    while( sqlite3Isspace(*z) ) z++;
+    n = sqlite3GetToken(z, &eTok);
+    if( eTok!=TK_ID && eTok!=TK_STRING && !sqlite3Isalpha(*z) ){
+      *pzErr = sqlite3_mprintf("syntax error in column list: %s", zCols);
+      return SQLITE_ERROR;
+    }
+    zType = z += n;
+    while( *z && *z!=',' ) z++;
+    zCopy = sqlite3_mprintf("%.*s", (int)(z-zType), zType);
+    if( zCopy==0 ) return SQLITE_NOMEM;
+    aff = sqlite3AffinityType(zCopy);
+    sqlite3_free(zCopy);
+
+    if( p->nCol>=nAlloc ){
+      u8 *aNew;
+      nAlloc = nAlloc*2 + 8;
+      aNew = sqlite3_realloc(p->aType, nAlloc);
+      if( aNew==0 ) return SQLITE_NOMEM;
+      p->aType = aNew;
+    }
+    if( aff==SQLITE_AFF_INTEGER ){
+      p->aType[p->nCol++] = SQLITE_ARRAY_INT64;
+    }else if( aff==SQLITE_AFF_REAL ){
+      p->aType[p->nCol++] = SQLITE_ARRAY_DOUBLE;
+    }else if( aff==SQLITE_AFF_TEXT ){
+      p->aType[p->nCol++] = SQLITE_ARRAY_TEXT;
+    }else{
+      *pzErr = sqlite3_mprintf(
+          "column %d must have type INTEGER, REAL or TEXT", p->nCol+1);
+      return SQLITE_ERROR;
+    }
+    if( *z==0 ) break;
+    z++;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Create a table-valued parameter named zName with the columns in zCols.
+*/
+int sqlite3_tvp_create(
+  sqlite3 *db,
+  const char *zName,
+  const char *zCols,
+  sqlite3_tvp **ppTvp
+){
+  sqlite3_tvp *p;
+  char *zErr = 0;
+  int rc;
+
+  *ppTvp = 0;
+  p = sqlite3_malloc(sizeof(sqlite3_tvp));
+  if( p==0 ) return SQLITE_NOMEM;
+  memset(p, 0, sizeof(sqlite3_tvp));
+  p->db = db;
+  rc = tvpParseColumns(p, zCols, &zErr);
+  if( rc==SQLITE_OK ){
+    p->zDecl = sqlite3_mprintf("CREATE TABLE x(%s)", zCols);
+    p->apCol = sqlite3_malloc(p->nCol*sizeof(p->apCol[0]));
+    if( p->zDecl==0 || p->apCol==0 ){
+      rc = SQLITE_NOMEM;
+    }else{
+      memset(p->apCol, 0, p->nCol*sizeof(p->apCol[0]));
+    }
+  }
+  if( rc!=SQLITE_OK ){
+    sqlite3_mutex_enter(db->mutex);
+    sqlite3Error(db, rc, zErr ? "%s" : 0, zErr);
+    sqlite3_mutex_leave(db->mutex);
+    sqlite3_free(zErr);
+    sqlite3_free(p->zDecl);
+    sqlite3_free(p->apCol);
+    sqlite3_free(p->aType);
+    sqlite3_free(p);
+    return rc;
+  }
+
+  /* From here on, p is freed by the module destructor */
+  rc = sqlite3_create_module_v2(db, zName, &tvpModule, p, tvpFree);
+  if( rc==SQLITE_OK ){
+    char *zSql = sqlite3_mprintf(
+        "CREATE VIRTUAL TABLE temp.%Q USING %Q", zName, zName);
+    rc = zSql ? sqlite3_exec(db, zSql, 0, 0, 0) : SQLITE_NOMEM;
+    sqlite3_free(zSql);
+  }
+  if( rc==SQLITE_OK ) *ppTvp = p;
+  return rc;
+}
+
+/*
+** Bind nRow rows to a table-valued parameter.
+*/
+int sqlite3_tvp_bind(
+  sqlite3_tvp *p,
+  int nRow,
+  void **apCol,
+  int flags,
+  void (*xDel)(void*)
+){
+  int i;
+  if( nRow<0 || (nRow>0 && apCol==0) ){
+    return SQLITE_MISUSE_BKPT;
+  }
+  sqlite3_mutex_enter(p->db->mutex);
+  tvpUnbind(p);
+  if( nRow>0 ){
+    for(i=0; i<p->nCol; i++) p->apCol[i] = apCol[i];
+    p->nRow = nRow;
+    p->flags = flags;
+    p->xDel = xDel;
+  }
+  sqlite3_mutex_leave(p->db->mutex);
+  return SQLITE_OK;
+}
+
+#endif /* SQLITE_OMIT_VIRTUALTABLE */
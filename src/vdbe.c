@@ -571,7 +571,11 @@ int sqlite3VdbeExec(
   /*** INSERT STACK UNION HERE ***/
 
   assert( p->magic==VDBE_MAGIC_RUN );  /* sqlite3_step() verifies this */
-  sqlite3VdbeMutexArrayEnter(p);
+  if( p->readShared ){
+    sqlite3VdbeMutexArrayEnterRead(p, p->readShared==2);
+  }else{
+    sqlite3VdbeMutexArrayEnter(p);
+  }
   if( p->rc==SQLITE_NOMEM ){
     /* This happens if a malloc() inside a call to sqlite3_column_text() or
     ** sqlite3_column_text16() failed.  */
@@ -738,15 +742,25 @@ int sqlite3VdbeExec(
 **
 *****************************************************************************/
 
-/* Opcode:  Goto * P2 * * *
+/* Opcode:  Goto * P2 * * P5
 **
 ** An unconditional jump to address P2.
 ** The next instruction executed will be 
 ** the one at index P2 from the beginning of
 ** the program.
+**
+** P5 is non-zero for the jump back to the start of the program from
+** the code that opens transactions and obtains table locks. Once that
+** code has run, a read-only statement on a shared cache may exchange
+** the BtShared mutexes it holds for shared locks, so that other 
+** read-only statements may use the shared cache at the same time.
 */
 case OP_Goto: {             /* jump */
   CHECK_FOR_INTERRUPT;
+  if( pOp->p5 && p->readShared ){
+    sqlite3BtreeMutexArrayDowngrade(&p->aMutex);
+    p->readShared = 2;
+  }
   pc = pOp->p2 - 1;
   break;
 }
@@ -2624,6 +2638,9 @@ case OP_Savepoint: {
         rc = p->rc;
       }else{
         iSavepoint = db->nSavepoint - iSavepoint - 1;
+        if( p1==SAVEPOINT_ROLLBACK ){
+          sqlite3VdbeCloseParkedCursors(db);
+        }
         for(ii=0; ii<db->nDb; ii++){
           rc = sqlite3BtreeSavepoint(db->aDb[ii].pBt, p1, iSavepoint);
           if( rc!=SQLITE_OK ){
@@ -2666,13 +2683,17 @@ case OP_Savepoint: {
   break;
 }
 
-/* Opcode: AutoCommit P1 P2 * * *
+/* Opcode: AutoCommit P1 P2 P3 * *
 **
 ** Set the database auto-commit flag to P1 (1 or 0). If P2 is true, roll
 ** back any currently active btree transactions. If there are any active
 ** VMs (apart from this one), then a ROLLBACK fails.  A COMMIT fails if
 ** there are active writing VMs or active VMs that use shared cache.
 **
+** If P1 is 0 and P3 is true, the transaction being opened is a BEGIN
+** CONCURRENT transaction.  Such a transaction cannot be committed while
+** any other VMs are active.
+**
 ** This instruction causes the VM to halt.
 */
 case OP_AutoCommit: {
@@ -2695,7 +2716,8 @@ case OP_AutoCommit: {
     sqlite3SetString(&p->zErrMsg, db, "cannot rollback transaction - "
         "SQL statements in progress");
     rc = SQLITE_BUSY;
-  }else if( turnOnAC && !iRollback && db->writeVdbeCnt>0 ){
+  }else if( turnOnAC && !iRollback && (db->writeVdbeCnt>0
+          || (db->isConcurrent && db->activeVdbeCnt>1)) ){
     /* If this instruction implements a COMMIT and other VMs are writing
     ** return an error indicating that the other VMs must complete first. 
     */
@@ -2711,6 +2733,7 @@ case OP_AutoCommit: {
       goto vdbe_return;
     }else{
       db->autoCommit = (u8)desiredAutoCommit;
+      if( !desiredAutoCommit ) db->isConcurrent = (u8)pOp->p3;
       if( sqlite3VdbeHalt(p)==SQLITE_BUSY ){
         p->pc = pc;
         db->autoCommit = (u8)(1-desiredAutoCommit);
@@ -3033,12 +3056,41 @@ case OP_OpenWrite: {
     nField = pOp->p4.i;
   }
   assert( pOp->p1>=0 );
+
+  /* If this cursor was left open when the statement last halted, and it
+  ** is open on the same b-tree, reuse it.  The b-tree cursor keeps its
+  ** position, which makes the next seek cheaper.  */
+  pCur = p->apCsr[pOp->p1];
+  if( pCur && pCur->isParked ){
+    if( wrFlag==0 && pCur->pgnoRoot==(Pgno)p2 && pCur->iDb==iDb
+     && pCur->nField==nField && pCur->pKeyInfo==pKeyInfo
+    ){
+      BtCursor *pBtCur = pCur->pCursor;
+      u32 *aType = pCur->aType;
+      memset(pCur, 0, sizeof(VdbeCursor));
+      pCur->pCursor = pBtCur;
+      pCur->aType = aType;
+      pCur->iDb = iDb;
+      pCur->nField = nField;
+      pCur->pgnoRoot = (Pgno)p2;
+      pCur->pKeyInfo = pKeyInfo;
+      pCur->nullRow = 1;
+      pCur->isOrdered = 1;
+      pCur->isTable = pOp->p4type!=P4_KEYINFO;
+      pCur->isIndex = !pCur->isTable;
+      p->nParked--;
+      db->nParkedCsr--;
+      break;
+    }
+  }
+
   pCur = allocateCursor(p, pOp->p1, nField, iDb, 1);
   if( pCur==0 ) goto no_mem;
   pCur->nullRow = 1;
   pCur->isOrdered = 1;
   rc = sqlite3BtreeCursor(pX, p2, wrFlag, pKeyInfo, pCur->pCursor);
   pCur->pKeyInfo = pKeyInfo;
+  if( wrFlag==0 && rc==SQLITE_OK ) pCur->pgnoRoot = (Pgno)p2;
 
   /* Since it performs no memory allocation or IO, the only values that
   ** sqlite3BtreeCursor() may return are SQLITE_EMPTY and SQLITE_OK. 
@@ -3967,6 +4019,128 @@ case OP_Delete: {
   if( pOp->p2 & OPFLAG_NCHANGE ) p->nChange++;
   break;
 }
+/* Opcode: DeleteRange P1 P2 P3 P4 P5
+**
+** Delete every row of the table that cursor P1 is open on whose rowid
+** lies between the values in registers P2 and P2+1. The lower bound in
+** register P2 is exclusive if bit 0x01 of P5 is set, and the upper bound
+** in register P2+1 is exclusive if bit 0x02 of P5 is set. The bounds are
+** compared with rowids in the same way as by OP_SeekGe and OP_Le: if
+** either is NULL no rows are deleted, and a bound that cannot be 
+** converted to a number is greater than every rowid.
+**
+** If the P3 value is non-zero, then the row change count is incremented
+** by the number of rows deleted. If P3 is greater than zero, then the
+** value stored in register P3 is also incremented by the same amount.
+**
+** P4 is the name of the table that P1 is open on. If an update hook is
+** registered the rows are deleted one at a time and the hook invoked for
+** each. Otherwise sub-trees of the table that lie entirely within the
+** range are freed without visiting the individual rows.
+**
+** The cursor is left pointing at an arbitrary location.
+*/
+case OP_DeleteRange: {
+  VdbeCursor *pC;
+  BtCursor *pCrsr;
+  Mem *pBound;
+  i64 aBound[2];      /* First and last rowid to delete */
+  i64 iKey;
+  int bEmpty;         /* True if no rows can lie within the range */
+  int nChange;
+  int res;
+  int i;
+
+  assert( pOp->p1>=0 && pOp->p1<p->nCursor );
+  pC = p->apCsr[pOp->p1];
+  assert( pC!=0 );
+  assert( pC->isTable );
+  pCrsr = pC->pCursor;
+  assert( pCrsr!=0 );
+
+  /* Convert the bounds to an inclusive range of integer rowids. */
+  bEmpty = 0;
+  for(i=0; i<2 && !bEmpty; i++){
+    pBound = &aMem[pOp->p2+i];
+    applyNumericAffinity(pBound);
+    if( pBound->flags & MEM_Int ){
+      iKey = pBound->u.i;
+    }else if( pBound->flags & MEM_Real ){
+      iKey = sqlite3VdbeIntValue(pBound);
+      if( iKey==SMALLEST_INT64 && (pBound->r<(double)iKey || pBound->r>0) ){
+        /* The bound is too large in magnitude to be expressed as an 
+        ** integer. Either it excludes every rowid, or none of them. */
+        if( (pBound->r<0)!=(i==0) ){
+          bEmpty = 1;
+        }else{
+          aBound[i] = (i==0 ? SMALLEST_INT64 : LARGEST_INT64);
+        }
+        continue;
+      }
+      if( pBound->r!=(double)iKey ){
+        /* Use ceiling() for the lower bound and floor() for the upper.
+        ** The bound is not itself a rowid, so it makes no difference 
+        ** whether or not it is exclusive. */
+        if( i==0 && pBound->r>(double)iKey ) iKey++;
+        if( i==1 && pBound->r<(double)iKey ) iKey--;
+        aBound[i] = iKey;
+        continue;
+      }
+    }else if( i==1 && (pBound->flags & MEM_Null)==0 ){
+      /* A text or blob upper bound is greater than every rowid */
+      aBound[i] = LARGEST_INT64;
+      continue;
+    }else{
+      bEmpty = 1;
+      continue;
+    }
+    if( (pOp->p5 & (1<<i))==0 ){
+      aBound[i] = iKey;
+    }else if( iKey==(i==0 ? LARGEST_INT64 : SMALLEST_INT64) ){
+      bEmpty = 1;
+    }else{
+      aBound[i] = iKey + (i==0 ? 1 : -1);
+    }
+  }
+
+  nChange = 0;
+  if( !bEmpty && aBound[0]<=aBound[1] ){
+    sqlite3BtreeSetCachedRowid(pCrsr, 0);
+    if( db->xUpdateCallback && pOp->p4.z ){
+      const char *zDb = db->aDb[pC->iDb].zName;
+      const char *zTbl = pOp->p4.z;
+      for(;;){
+        rc = sqlite3BtreeMovetoUnpacked(pCrsr, 0, aBound[0], 0, &res);
+        if( rc==SQLITE_OK && res<0 ){
+          rc = sqlite3BtreeNext(pCrsr, &res);
+        }
+        if( rc!=SQLITE_OK || sqlite3BtreeEof(pCrsr) ) break;
+        rc = sqlite3BtreeKeySize(pCrsr, &iKey);
+        if( rc!=SQLITE_OK || iKey>aBound[1] ) break;
+        rc = sqlite3BtreeDelete(pCrsr);
+        if( rc!=SQLITE_OK ) break;
+        nChange++;
+        db->xUpdateCallback(db->pUpdateArg, SQLITE_DELETE, zDb, zTbl, iKey);
+        if( iKey==aBound[1] ) break;
+        aBound[0] = iKey+1;
+      }
+    }else{
+      rc = sqlite3BtreeDeleteRange(pCrsr, aBound[0], aBound[1], &nChange);
+    }
+  }
+  pC->cacheStatus = CACHE_STALE;
+  pC->rowidIsValid = 0;
+  if( pOp->p3 ){
+    p->nChange += nChange;
+    if( pOp->p3>0 ){
+      assert( memIsValid(&aMem[pOp->p3]) );
+      memAboutToChange(p, &aMem[pOp->p3]);
+      aMem[pOp->p3].u.i += nChange;
+    }
+  }
+  break;
+}
+
 /* Opcode: ResetCount * * * * *
 **
 ** The value of the change counter is copied to the database handle
@@ -4493,6 +4667,7 @@ case OP_Destroy: {     /* out2-prerelease */
     iDb = pOp->p3;
     assert( iCnt==1 );
     assert( (p->btreeMask & (1<<iDb))!=0 );
+    sqlite3VdbeCloseParkedCursors(db);
     rc = sqlite3BtreeDropTable(db->aDb[iDb].pBt, pOp->p1, &iMoved);
     pOut->flags = MEM_Int;
     pOut->u.i = iMoved;
@@ -4582,6 +4757,7 @@ case OP_CreateTable: {          /* out2-prerelease */
   }else{
     flags = BTREE_BLOBKEY;
   }
+  sqlite3VdbeCloseParkedCursors(db);
   rc = sqlite3BtreeCreateTable(pDb->pBt, &pgno, flags);
   pOut->u.i = pgno;
   break;
@@ -5231,8 +5407,8 @@ case OP_Checkpoint: {
 **
 ** Change the journal mode of database P1 to P3. P3 must be one of the
 ** PAGER_JOURNALMODE_XXX values. If changing between the various rollback
-** modes (delete, truncate, persist, off and memory), this is a simple
-** operation. No IO is required.
+** modes (delete, truncate, persist, off, memory and doublewrite), this is
+** a simple operation. No IO is required.
 **
 ** If changing into or out of WAL mode the procedure is more complicated.
 **
@@ -5252,6 +5428,7 @@ case OP_JournalMode: {    /* out2-prerelease */
        || eNew==PAGER_JOURNALMODE_OFF
        || eNew==PAGER_JOURNALMODE_MEMORY
        || eNew==PAGER_JOURNALMODE_WAL
+       || eNew==PAGER_JOURNALMODE_DOUBLEWRITE
        || eNew==PAGER_JOURNALMODE_QUERY
   );
   assert( pOp->p1>=0 && pOp->p1<db->nDb );
@@ -5374,6 +5551,7 @@ case OP_IncrVacuum: {        /* jump */
   assert( pOp->p1>=0 && pOp->p1<db->nDb );
   assert( (p->btreeMask & (1<<pOp->p1))!=0 );
   pBt = db->aDb[pOp->p1].pBt;
+  sqlite3VdbeCloseParkedCursors(db);
   rc = sqlite3BtreeIncrVacuum(pBt);
   if( rc==SQLITE_DONE ){
     pc = pOp->p2 - 1;
@@ -5381,8 +5559,41 @@ case OP_IncrVacuum: {        /* jump */
   }
   break;
 }
+
+/* Opcode: Defragment P1 P2 P3 * *
+**
+** Move up to P3 pages of database P1 towards an online defragmentation
+** of that database. Write the number of pages moved into register P2.
+** Fewer than P3 pages are moved only if the defragmentation is finished.
+*/
+case OP_Defragment: {        /* out2-prerelease */
+  int nDone;
+
+  assert( pOp->p1>=0 && pOp->p1<db->nDb );
+  assert( (p->btreeMask & (1<<pOp->p1))!=0 );
+  sqlite3VdbeCloseParkedCursors(db);
+  rc = sqlite3BtreeDefragment(db->aDb[pOp->p1].pBt, pOp->p3, &nDone);
+  pOut->u.i = nDone;
+  break;
+}
 #endif
 
+/* Opcode: Reclaim P1 P2 P3 * *
+**
+** Return up to P3 pages of the detached b-trees of database P1 to its
+** free-list. Write the number of pages returned into register P2. Fewer
+** than P3 pages are returned only if no detached b-trees remain.
+*/
+case OP_Reclaim: {        /* out2-prerelease */
+  int nDone;
+
+  assert( pOp->p1>=0 && pOp->p1<db->nDb );
+  assert( (p->btreeMask & (1<<pOp->p1))!=0 );
+  rc = sqlite3BtreeReclaim(db->aDb[pOp->p1].pBt, pOp->p3, &nDone);
+  pOut->u.i = nDone;
+  break;
+}
+
 /* Opcode: Expire P1 * * * *
 **
 ** Cause precompiled statements to become expired. An expired statement
@@ -5788,6 +5999,29 @@ case OP_Pagecount: {            /* out2-prerelease */
 #endif
 
 
+#ifndef  SQLITE_OMIT_PAGER_PRAGMAS
+/* Opcode: ChangeTracking P1 P2 P3 * *
+**
+** Enable (if P3 is 1) or disable (if P3 is 0) change tracking for
+** database P1. If P3 is negative, the setting is not changed. Write the
+** current change-tracking generation number, or 0 if change tracking is
+** disabled, to memory cell P2.
+**
+** Unless P3 is negative, there must be a write transaction open on
+** database P1.
+*/
+case OP_ChangeTracking: {       /* out2-prerelease */
+  u32 iGen = 0;
+  assert( pOp->p1>=0 && pOp->p1<db->nDb );
+  assert( (p->btreeMask & (1<<pOp->p1))!=0 );
+  rc = sqlite3PagerTrackChanges(
+      sqlite3BtreePager(db->aDb[pOp->p1].pBt), pOp->p3, &iGen
+  );
+  pOut->u.i = (i64)iGen;
+  break;
+}
+#endif
+
 #ifndef  SQLITE_OMIT_PAGER_PRAGMAS
 /* Opcode: MaxPgcnt P1 P2 P3 * *
 **
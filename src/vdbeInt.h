@@ -58,6 +58,8 @@ struct VdbeCursor {
   Bool isTable;         /* True if a table requiring integer keys */
   Bool isIndex;         /* True if an index containing keys only - no data */
   Bool isOrdered;       /* True if the underlying table is BTREE_UNORDERED */
+  Bool isParked;        /* Left open by a halted VM for reuse by OP_OpenRead */
+  Pgno pgnoRoot;        /* Root page of an OP_OpenRead cursor, or 0 */
   i64 movetoTarget;     /* Argument to the deferred sqlite3BtreeMoveto() */
   Btree *pBt;           /* Separate file holding temporary table */
   int pseudoTableReg;   /* Register holding pseudotable content. */
@@ -276,6 +278,17 @@ struct Set {
   HashElem *prev;        /* Previously accessed hash elemen */
 };
 
+/*
+** An array bound to an SQL parameter by sqlite3_bind_array().  The
+** Vdbe.aArray[] array holds one of these for each parameter of the
+** statement.  eType is zero for parameters that have no array bound.
+*/
+typedef struct VdbeArray VdbeArray;
+struct VdbeArray {
+  int eType;              /* One of the SQLITE_ARRAY_* constants, or 0 */
+  const void *aValue;     /* The array of values */
+};
+
 /*
 ** An instance of the virtual machine.  This structure contains the complete
 ** state of the virtual machine.
@@ -305,11 +318,13 @@ struct Vdbe {
   Mem *pResultSet;        /* Pointer to an array of results */
   u16 nResColumn;         /* Number of columns in one row of the result set */
   u16 nCursor;            /* Number of slots in apCsr[] */
+  u16 nParked;            /* Number of cursors in apCsr[] with isParked set */
   VdbeCursor **apCsr;     /* One element of this array for each open cursor */
   u8 errorAction;         /* Recovery action to do in case of an error */
   u8 okVar;               /* True if azVar[] has been initialized */
   ynVar nVar;             /* Number of entries in aVar[] */
   Mem *aVar;              /* Values for the OP_Variable opcode. */
+  VdbeArray *aArray;      /* Arrays bound to variables, or NULL */
   char **azVar;           /* Name of variables */
   u32 magic;              /* Magic number for sanity checking */
   int nMem;               /* Number of memory locations currently allocated */
@@ -326,6 +341,7 @@ struct Vdbe {
   u8 inVtabMethod;        /* See comments above */
   u8 usesStmtJournal;     /* True if uses a statement journal */
   u8 readOnly;            /* True for read-only statements */
+  u8 readShared;          /* 1: may use shared btree locks. 2: is doing so */
   u8 isPrepareV2;         /* True if prepared with prepare_v2() */
   int nChange;            /* Number of db changes made since last reset */
   int btreeMask;          /* Bitmask of db->aDb[] entries referenced */
@@ -424,8 +440,10 @@ int sqlite3VdbeCheckFk(Vdbe *, int);
 
 #ifndef SQLITE_OMIT_SHARED_CACHE
 void sqlite3VdbeMutexArrayEnter(Vdbe *p);
+void sqlite3VdbeMutexArrayEnterRead(Vdbe *p, int bShared);
 #else
 # define sqlite3VdbeMutexArrayEnter(p)
+# define sqlite3VdbeMutexArrayEnterRead(p,b)
 #endif
 
 int sqlite3VdbeMemTranslate(Mem*, u8);
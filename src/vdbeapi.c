@@ -125,6 +125,8 @@ int sqlite3_clear_bindings(sqlite3_stmt *pStmt){
     sqlite3VdbeMemRelease(&p->aVar[i]);
     p->aVar[i].flags = MEM_Null;
   }
+  sqlite3DbFree(p->db, p->aArray);
+  p->aArray = 0;
   if( p->isPrepareV2 && p->expmask ){
     p->expired = 1;
   }
@@ -439,26 +441,21 @@ end_of_step:
 }
 
 /*
-** This is the top-level implementation of sqlite3_step().  Call
-** sqlite3Step() to do most of the work.  If a schema error occurs,
-** call sqlite3Reprepare() and try again.
+** Call sqlite3Step() to do most of the work of sqlite3_step().  If a
+** schema error occurs, call sqlite3Reprepare() and try again.  The
+** database connection mutex must be held.
 */
-int sqlite3_step(sqlite3_stmt *pStmt){
+static int vdbeStepRetry(Vdbe *v){
   int rc = SQLITE_OK;      /* Result from sqlite3Step() */
   int rc2 = SQLITE_OK;     /* Result from sqlite3Reprepare() */
-  Vdbe *v = (Vdbe*)pStmt;  /* the prepared statement */
   int cnt = 0;             /* Counter to prevent infinite loop of reprepares */
-  sqlite3 *db;             /* The database connection */
+  sqlite3 *db = v->db;     /* The database connection */
 
-  if( vdbeSafetyNotNull(v) ){
-    return SQLITE_MISUSE_BKPT;
-  }
-  db = v->db;
-  sqlite3_mutex_enter(db->mutex);
+  assert( sqlite3_mutex_held(db->mutex) );
   while( (rc = sqlite3Step(v))==SQLITE_SCHEMA
          && cnt++ < 5
          && (rc2 = rc = sqlite3Reprepare(v))==SQLITE_OK ){
-    sqlite3_reset(pStmt);
+    sqlite3_reset((sqlite3_stmt*)v);
     v->expired = 0;
   }
   if( rc2!=SQLITE_OK && ALWAYS(v->isPrepareV2) && ALWAYS(db->pErr) ){
@@ -480,6 +477,23 @@ int sqlite3_step(sqlite3_stmt *pStmt){
       v->rc = rc = SQLITE_NOMEM;
     }
   }
+  return rc;
+}
+
+/*
+** This is the top-level implementation of sqlite3_step().
+*/
+int sqlite3_step(sqlite3_stmt *pStmt){
+  int rc;                  /* Result from vdbeStepRetry() */
+  Vdbe *v = (Vdbe*)pStmt;  /* the prepared statement */
+  sqlite3 *db;             /* The database connection */
+
+  if( vdbeSafetyNotNull(v) ){
+    return SQLITE_MISUSE_BKPT;
+  }
+  db = v->db;
+  sqlite3_mutex_enter(db->mutex);
+  rc = vdbeStepRetry(v);
   rc = sqlite3ApiExit(db, rc);
   sqlite3_mutex_leave(db->mutex);
   return rc;
@@ -976,6 +990,7 @@ static int vdbeUnbind(Vdbe *p, int i){
   pVar = &p->aVar[i];
   sqlite3VdbeMemRelease(pVar);
   pVar->flags = MEM_Null;
+  if( p->aArray ) p->aArray[i].eType = 0;
   sqlite3Error(p->db, SQLITE_OK, 0);
 
   /* If the bit corresponding to this variable in Vdbe.expmask is set, then 
@@ -1135,6 +1150,191 @@ int sqlite3_bind_zeroblob(sqlite3_stmt *pStmt, int i, int n){
   return rc;
 }
 
+/*
+** Bind an array of values to a variable, for use by sqlite3_step_array().
+*/
+int sqlite3_bind_array(
+  sqlite3_stmt *pStmt,
+  int i,
+  int eType,
+  const void *aValue
+){
+  int rc;
+  Vdbe *p = (Vdbe *)pStmt;
+  rc = vdbeUnbind(p, i);
+  if( rc==SQLITE_OK ){
+    if( eType<SQLITE_ARRAY_INT64 || eType>SQLITE_ARRAY_TEXT ){
+      rc = SQLITE_MISUSE_BKPT;
+    }else if( aValue ){
+      if( p->aArray==0 ){
+        p->aArray = sqlite3DbMallocZero(p->db, sizeof(VdbeArray)*p->nVar);
+      }
+      if( p->aArray ){
+        p->aArray[i-1].eType = eType;
+        p->aArray[i-1].aValue = aValue;
+      }else{
+        rc = SQLITE_NOMEM;
+      }
+    }
+    sqlite3Error(p->db, rc, 0);
+    rc = sqlite3ApiExit(p->db, rc);
+    sqlite3_mutex_leave(p->db->mutex);
+  }
+  return rc;
+}
+
+/*
+** Load element iRow of each array bound to a variable of statement p
+** into the variable.  Return SQLITE_OK, or SQLITE_NOMEM if a text value
+** cannot be converted to the database encoding.
+*/
+static int vdbeLoadArrays(Vdbe *p, int iRow){
+  int i;
+  int rc = SQLITE_OK;
+  for(i=0; i<p->nVar && rc==SQLITE_OK; i++){
+    VdbeArray *pArray = &p->aArray[i];
+    Mem *pVar = &p->aVar[i];
+    Mem sNew;
+    if( pArray->eType==0 ) continue;
+    memset(&sNew, 0, sizeof(sNew));
+    sNew.flags = MEM_Null;
+    sNew.db = p->db;
+    switch( pArray->eType ){
+      case SQLITE_ARRAY_INT64: {
+        sqlite3VdbeMemSetInt64(&sNew, ((const i64*)pArray->aValue)[iRow]);
+        break;
+      }
+      case SQLITE_ARRAY_DOUBLE: {
+        sqlite3VdbeMemSetDouble(&sNew, ((const double*)pArray->aValue)[iRow]);
+        break;
+      }
+      default: {
+        const char *z = ((const char *const*)pArray->aValue)[iRow];
+        assert( pArray->eType==SQLITE_ARRAY_TEXT );
+        if( z ){
+          rc = sqlite3VdbeMemSetStr(&sNew, z, -1, SQLITE_UTF8, SQLITE_STATIC);
+          if( rc==SQLITE_OK ){
+            rc = sqlite3VdbeChangeEncoding(&sNew, ENC(p->db));
+          }
+        }
+        break;
+      }
+    }
+
+    /* As in vdbeUnbind(), a new value for this variable may invalidate
+    ** the current query plan. The plan was made using the value of the
+    ** previous run, so it only needs to be remade if the value differs. */
+    if( rc==SQLITE_OK && p->isPrepareV2
+     && ((i<32 && p->expmask & ((u32)1 << i)) || p->expmask==0xffffffff)
+     && ((pVar->flags ^ sNew.flags) & (MEM_Null|MEM_Int|MEM_Real|MEM_Str)
+          || sqlite3MemCompare(pVar, &sNew, 0)!=0)
+    ){
+      p->expired = 1;
+    }
+    sqlite3VdbeMemMove(pVar, &sNew);
+  }
+  return rc;
+}
+
+/*
+** Run statement pStmt to completion once for each of the first nRow
+** elements of the arrays bound to its variables.
+*/
+int sqlite3_step_array(sqlite3_stmt *pStmt, int nRow, int *pnDone){
+  Vdbe *p = (Vdbe*)pStmt;
+  sqlite3 *db;
+  int rc = SQLITE_OK;
+  int iRow;
+  int nDone = 0;
+  int bTrans = 0;         /* True if a transaction was opened here */
+  char *zErr = 0;         /* Error message from COMMIT */
+  int i;
+
+  if( pnDone ) *pnDone = 0;
+  if( vdbeSafetyNotNull(p) ){
+    return SQLITE_MISUSE_BKPT;
+  }
+  db = p->db;
+  sqlite3_mutex_enter(db->mutex);
+  if( p->magic!=VDBE_MAGIC_RUN || p->pc>=0 ){
+    sqlite3Error(db, SQLITE_MISUSE, 0);
+    sqlite3_mutex_leave(db->mutex);
+    sqlite3_log(SQLITE_MISUSE, 
+        "step_array on a busy prepared statement: [%s]", p->zSql);
+    return SQLITE_MISUSE_BKPT;
+  }
+
+  /* Unless the application has already opened a transaction, run all
+  ** rows in a single transaction so that the cost of committing is paid
+  ** only once.  This is not done if other statements are running, as
+  ** they might prevent the transaction from being rolled back. */
+  if( nRow>0 && db->autoCommit && !p->readOnly && db->activeVdbeCnt==0 ){
+    rc = sqlite3_exec(db, "BEGIN", 0, 0, 0);
+    bTrans = (rc==SQLITE_OK);
+  }
+
+  for(iRow=0; rc==SQLITE_OK && iRow<nRow; iRow++){
+    if( p->aArray ){
+      rc = vdbeLoadArrays(p, iRow);
+      if( rc!=SQLITE_OK ) break;
+    }
+    while( (rc = vdbeStepRetry(p))==SQLITE_ROW ){}
+    if( rc==SQLITE_DONE ){
+      nDone++;
+      if( iRow<nRow-1 && p->magic==VDBE_MAGIC_HALT && p->rc==SQLITE_OK ){
+        /* Rewind the program for the next run. The full reset, which
+        ** also transfers the result to the database handle, is only
+        ** needed after the last one. */
+        sqlite3VdbeRerun(p);
+        rc = SQLITE_OK;
+      }else{
+        rc = sqlite3_reset(pStmt);
+      }
+    }else{
+      /* Roll back the transaction opened above, if any, before calling
+      ** sqlite3_reset() so that the error message from the failed run is
+      ** the one left in the database handle. */
+      int rc2;
+      if( bTrans ){
+        if( !db->autoCommit ) sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+        bTrans = 0;
+        nDone = 0;
+      }
+      rc2 = sqlite3_reset(pStmt);
+      if( rc2!=SQLITE_OK ) rc = rc2;
+    }
+  }
+
+  if( bTrans ){
+    if( rc==SQLITE_OK ){
+      rc = sqlite3_exec(db, "COMMIT", 0, 0, &zErr);
+    }
+    if( rc!=SQLITE_OK ){
+      if( !db->autoCommit ){
+        sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+      }
+      sqlite3Error(db, rc, zErr ? "%s" : 0, zErr);
+      sqlite3_free(zErr);
+      nDone = 0;
+    }
+  }
+
+  /* The arrays may not outlive this call, so do not leave pointers to
+  ** them in the variables. */
+  if( p->aArray ){
+    for(i=0; i<p->nVar; i++){
+      if( p->aArray[i].eType ){
+        sqlite3VdbeMemRelease(&p->aVar[i]);
+        p->aVar[i].flags = MEM_Null;
+      }
+    }
+  }
+  if( pnDone ) *pnDone = nDone;
+  rc = sqlite3ApiExit(db, rc);
+  sqlite3_mutex_leave(db->mutex);
+  return rc;
+}
+
 /*
 ** Return the number of wildcards that can be potentially bound to.
 ** This routine is added to support DBD::SQLite.  
@@ -1223,6 +1423,9 @@ int sqlite3TransferBindings(sqlite3_stmt *pFromStmt, sqlite3_stmt *pToStmt){
   for(i=0; i<pFrom->nVar; i++){
     sqlite3VdbeMemMove(&pTo->aVar[i], &pFrom->aVar[i]);
   }
+  sqlite3DbFree(pTo->db, pTo->aArray);
+  pTo->aArray = pFrom->aArray;
+  pFrom->aArray = 0;
   sqlite3_mutex_leave(pTo->db->mutex);
   return SQLITE_OK;
 }
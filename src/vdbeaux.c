@@ -402,6 +402,7 @@ static void resolveP2Values(Vdbe *p, int *pMaxFuncArgs){
   Op *pOp;
   int *aLabel = p->aLabel;
   p->readOnly = 1;
+  p->readShared = 1;
   for(pOp=p->aOp, i=p->nOp-1; i>=0; i--, pOp++){
     u8 opcode = pOp->opcode;
 
@@ -410,6 +411,14 @@ static void resolveP2Values(Vdbe *p, int *pMaxFuncArgs){
       if( pOp->p5>nMaxArgs ) nMaxArgs = pOp->p5;
     }else if( (opcode==OP_Transaction && pOp->p2!=0) || opcode==OP_Vacuum ){
       p->readOnly = 0;
+    }else if( opcode==OP_IntegrityCk || opcode==OP_Checkpoint
+           || opcode==OP_JournalMode || opcode==OP_MaxPgcnt
+           || opcode==OP_IncrVacuum || opcode==OP_ParseSchema
+           || opcode==OP_LoadAnalysis || opcode==OP_ChangeTracking
+    ){
+      /* These opcodes modify the BtShared or pager, or reinitialize
+      ** btree pages, so they require exclusive btree locks. */
+      p->readShared = 0;
 #ifndef SQLITE_OMIT_VIRTUALTABLE
     }else if( opcode==OP_VUpdate ){
       if( pOp->p2>nMaxArgs ) nMaxArgs = pOp->p2;
@@ -429,6 +438,7 @@ static void resolveP2Values(Vdbe *p, int *pMaxFuncArgs){
   }
   sqlite3DbFree(p->db, p->aLabel);
   p->aLabel = 0;
+  if( p->readOnly==0 ) p->readShared = 0;
 
   *pMaxFuncArgs = nMaxArgs;
 }
@@ -1325,6 +1335,39 @@ static void *allocSpace(
   return pBuf;
 }
 
+/*
+** Set the program counter and other per-run state of VDBE p back to
+** their initial values, so that the program can be run from the start.
+*/
+static void vdbeRewind(Vdbe *p){
+#ifdef SQLITE_DEBUG
+  int n;
+  for(n=1; n<p->nMem; n++){
+    assert( p->aMem[n].db==p->db );
+  }
+#endif
+
+  p->pc = -1;
+  p->rc = SQLITE_OK;
+  p->errorAction = OE_Abort;
+  if( p->readShared ) p->readShared = 1;
+  p->magic = VDBE_MAGIC_RUN;
+  p->nChange = 0;
+  p->cacheCtr = 1;
+  p->minWriteFileFormat = 255;
+  p->iStatement = 0;
+  p->nFkConstraint = 0;
+#ifdef VDBE_PROFILE
+  {
+    int i;
+    for(i=0; i<p->nOp; i++){
+      p->aOp[i].cnt = 0;
+      p->aOp[i].cycles = 0;
+    }
+  }
+#endif
+}
+
 /*
 ** Prepare a virtual machine for execution.  This involves things such
 ** as allocating stack space and initializing the program counter.
@@ -1436,31 +1479,8 @@ void sqlite3VdbeMakeReady(
       }
     }
   }
-#ifdef SQLITE_DEBUG
-  for(n=1; n<p->nMem; n++){
-    assert( p->aMem[n].db==db );
-  }
-#endif
-
-  p->pc = -1;
-  p->rc = SQLITE_OK;
-  p->errorAction = OE_Abort;
   p->explain |= isExplain;
-  p->magic = VDBE_MAGIC_RUN;
-  p->nChange = 0;
-  p->cacheCtr = 1;
-  p->minWriteFileFormat = 255;
-  p->iStatement = 0;
-  p->nFkConstraint = 0;
-#ifdef VDBE_PROFILE
-  {
-    int i;
-    for(i=0; i<p->nOp; i++){
-      p->aOp[i].cnt = 0;
-      p->aOp[i].cycles = 0;
-    }
-  }
-#endif
+  vdbeRewind(p);
 }
 
 /*
@@ -1471,6 +1491,11 @@ void sqlite3VdbeFreeCursor(Vdbe *p, VdbeCursor *pCx){
   if( pCx==0 ){
     return;
   }
+  if( pCx->isParked ){
+    assert( p->nParked>0 && p->db->nParkedCsr>0 );
+    p->nParked--;
+    p->db->nParkedCsr--;
+  }
   if( pCx->pBt ){
     sqlite3BtreeClose(pCx->pBt);
     /* The pCx->pCursor will be close automatically, if it exists, by
@@ -1507,6 +1532,26 @@ int sqlite3VdbeFrameRestore(VdbeFrame *pFrame){
   return pFrame->pc;
 }
 
+/*
+** Release the memory cells that hold the VdbeCursor objects of a VM,
+** except for those cells that belong to cursors that are still open.
+** Memory cell (nMem-i) holds the allocation for cursor i.  See
+** allocateCursor() in vdbe.c.
+*/
+static void releaseCursorMem(
+  Mem *aMem,                      /* Memory cells, from 1 to nMem */
+  int nMem,                       /* Number of memory cells */
+  VdbeCursor **apCsr,             /* Cursor array */
+  int nCursor                     /* Number of entries in apCsr[] */
+){
+  int i;
+  for(i=0; i<nCursor; i++){
+    if( apCsr==0 || apCsr[i]==0 ){
+      releaseMemArray(&aMem[nMem-i], 1);
+    }
+  }
+}
+
 /*
 ** Close all cursors.
 **
@@ -1514,8 +1559,20 @@ int sqlite3VdbeFrameRestore(VdbeFrame *pFrame){
 ** cell array. This is necessary as the memory cell array may contain
 ** pointers to VdbeFrame objects, which may in turn contain pointers to
 ** open cursors.
+**
+** If the VM is a read-only statement that has run without error inside
+** a transaction, its b-tree cursors are not closed but are marked as
+** parked instead.  The transaction stays open after the statement halts,
+** so the cursors remain valid, and if the statement is run again then
+** OP_OpenRead picks them up still positioned where they were rather than
+** opening new cursors and seeking down from the root page.  Parked
+** cursors are closed by sqlite3VdbeCloseParkedCursors() before the
+** transaction ends or the b-tree is changed in a way that would make
+** them unusable, and when the statement is finalized.
 */
 static void closeAllCursors(Vdbe *p){
+  sqlite3 *db = p->db;
+  int bPark;
   if( p->pFrame ){
     VdbeFrame *pFrame = p->pFrame;
     for(pFrame=p->pFrame; pFrame->pParent; pFrame=pFrame->pParent);
@@ -1524,18 +1581,27 @@ static void closeAllCursors(Vdbe *p){
   p->pFrame = 0;
   p->nFrame = 0;
 
+  bPark = p->magic==VDBE_MAGIC_RUN && p->readOnly && p->rc==SQLITE_OK
+       && db->autoCommit==0 && db->mallocFailed==0;
   if( p->apCsr ){
     int i;
     for(i=0; i<p->nCursor; i++){
       VdbeCursor *pC = p->apCsr[i];
-      if( pC ){
-        sqlite3VdbeFreeCursor(p, pC);
-        p->apCsr[i] = 0;
+      if( pC && !pC->isParked ){
+        if( bPark && pC->pgnoRoot ){
+          pC->isParked = 1;
+          p->nParked++;
+          db->nParkedCsr++;
+        }else{
+          sqlite3VdbeFreeCursor(p, pC);
+          p->apCsr[i] = 0;
+        }
       }
     }
   }
   if( p->aMem ){
-    releaseMemArray(&p->aMem[1], p->nMem);
+    releaseMemArray(&p->aMem[1], p->nMem - p->nCursor);
+    releaseCursorMem(p->aMem, p->nMem, p->apCsr, p->nCursor);
   }
   while( p->pDelFrame ){
     VdbeFrame *pDel = p->pDelFrame;
@@ -1544,6 +1610,49 @@ static void closeAllCursors(Vdbe *p){
   }
 }
 
+/*
+** Close the parked cursors of VM p, if it has any.  If p is running a
+** trigger program, the parked cursors belong to the top-level frame.
+*/
+static void closeParkedCursors(Vdbe *p){
+  VdbeCursor **apCsr = p->apCsr;
+  Mem *aMem = p->aMem;
+  int nCursor = p->nCursor;
+  int nMem = p->nMem;
+  int i;
+
+  if( p->nParked==0 ) return;
+  if( p->pFrame ){
+    VdbeFrame *pFrame;
+    for(pFrame=p->pFrame; pFrame->pParent; pFrame=pFrame->pParent);
+    apCsr = pFrame->apCsr;
+    aMem = pFrame->aMem;
+    nCursor = pFrame->nCursor;
+    nMem = pFrame->nMem;
+  }
+  for(i=0; i<nCursor; i++){
+    VdbeCursor *pC = apCsr[i];
+    if( pC && pC->isParked ){
+      sqlite3VdbeFreeCursor(p, pC);
+      apCsr[i] = 0;
+      releaseMemArray(&aMem[nMem-i], 1);
+    }
+  }
+  assert( p->nParked==0 );
+}
+
+/*
+** Close all parked cursors belonging to VMs of database connection db.
+** See closeAllCursors() for a description of parked cursors.
+*/
+void sqlite3VdbeCloseParkedCursors(sqlite3 *db){
+  Vdbe *p;
+  for(p=db->pVdbe; p && db->nParkedCsr>0; p=p->pNext){
+    closeParkedCursors(p);
+  }
+  assert( db->nParkedCsr==0 );
+}
+
 /*
 ** Clean up the VM after execution.
 **
@@ -1558,7 +1667,9 @@ static void Cleanup(Vdbe *p){
   /* Execute assert() statements to ensure that the Vdbe.apCsr[] and 
   ** Vdbe.aMem[] arrays have already been cleaned up.  */
   int i;
-  for(i=0; i<p->nCursor; i++) assert( p->apCsr==0 || p->apCsr[i]==0 );
+  for(i=0; i<p->nCursor; i++){
+    assert( p->apCsr==0 || p->apCsr[i]==0 || p->apCsr[i]->isParked );
+  }
   for(i=1; i<=p->nMem; i++) assert( p->aMem==0 || p->aMem[i].flags==MEM_Null );
 #endif
 
@@ -1983,6 +2094,22 @@ void sqlite3VdbeMutexArrayEnter(Vdbe *p){
   sqlite3BtreeEnterAll(p->db);
 #endif
 }
+
+/*
+** This routine is used instead of sqlite3VdbeMutexArrayEnter() by
+** read-only statements. If bShared is true, shared locks are taken 
+** on the BtShared structures where possible, allowing other read-only
+** statements to use them at the same time. This is done once the 
+** statement has opened its read transactions (see OP_Goto).
+*/
+void sqlite3VdbeMutexArrayEnterRead(Vdbe *p, int bShared){
+#if SQLITE_THREADSAFE
+  sqlite3BtreeMutexArrayEnterRead(&p->aMutex, bShared);
+#else
+  UNUSED_PARAMETER(bShared);
+  sqlite3BtreeEnterAll(p->db);
+#endif
+}
 #endif
 
 /*
@@ -2056,8 +2183,14 @@ int sqlite3VdbeHalt(Vdbe *p){
     int eStatementOp = 0;
     int isSpecialError;            /* Set to true if a 'special' error */
 
-    /* Lock all btrees used by the statement */
-    sqlite3VdbeMutexArrayEnter(p);
+    /* Lock all btrees used by the statement. A read-only statement that
+    ** ran successfully only needs to close its read transactions, which
+    ** may be done while other statements hold shared locks. */
+    if( p->readShared && p->rc==SQLITE_OK ){
+      sqlite3VdbeMutexArrayEnterRead(p, 0);
+    }else{
+      sqlite3VdbeMutexArrayEnter(p);
+    }
 
     /* Check for one of the special errors */
     mrc = p->rc & 0xff;
@@ -2107,6 +2240,7 @@ int sqlite3VdbeHalt(Vdbe *p){
      && db->autoCommit 
      && db->writeVdbeCnt==(p->readOnly==0) 
     ){
+      sqlite3VdbeCloseParkedCursors(db);
       if( p->rc==SQLITE_OK || (p->errorAction==OE_Fail && !isSpecialError) ){
         if( sqlite3VdbeCheckFk(p, 1) ){
           sqlite3BtreeMutexArrayLeave(&p->aMutex);
@@ -2311,6 +2445,20 @@ int sqlite3VdbeReset(Vdbe *p){
   return p->rc & db->errMask;
 }
  
+/*
+** VDBE p has just run to completion without error. Make it ready to be
+** run again, without transferring its result to the database handle.
+** This has the same effect as sqlite3VdbeReset() followed by
+** sqlite3VdbeMakeReady(), but is cheaper. It is used between the runs
+** made by sqlite3_step_array().
+*/
+void sqlite3VdbeRerun(Vdbe *p){
+  assert( p->magic==VDBE_MAGIC_HALT && p->rc==SQLITE_OK && p->pc>=0 );
+  if( p->runOnlyOnce ) p->expired = 1;
+  Cleanup(p);
+  vdbeRewind(p);
+}
+ 
 /*
 ** Clean up and delete a VDBE after execution.  Return an integer which is
 ** the result code.  Write any error message text into *pzErrMsg.
@@ -2355,6 +2503,7 @@ void sqlite3VdbeDeleteObject(sqlite3 *db, Vdbe *p){
   assert( p->db==0 || p->db==db );
   releaseMemArray(p->aVar, p->nVar);
   releaseMemArray(p->aColName, p->nResColumn*COLNAME_N);
+  sqlite3DbFree(db, p->aArray);
   for(pSub=p->pProgram; pSub; pSub=pNext){
     pNext = pSub->pNext;
     vdbeFreeOpArray(db, pSub->aOp, pSub->nOp);
@@ -2376,6 +2525,7 @@ void sqlite3VdbeDelete(Vdbe *p){
 
   if( NEVER(p==0) ) return;
   db = p->db;
+  closeParkedCursors(p);
   if( p->pPrev ){
     p->pPrev->pNext = p->pNext;
   }else{
@@ -414,12 +414,14 @@ struct Wal {
   u32 iCallback;             /* Value to pass to log callback (or 0) */
   int nWiData;               /* Size of array apWiData */
   volatile u32 **apWiData;   /* Pointer to wal-index content in memory */
+  int nWiContig;             /* Pages mapped contiguously from apWiData[0] */
   u32 szPage;                /* Database page size */
   i16 readLock;              /* Which read lock is being held.  -1 for none */
   u8 exclusiveMode;          /* Non-zero if connection is in exclusive mode */
   u8 writeLock;              /* True if in a write transaction */
   u8 ckptLock;               /* True if holding a checkpoint lock */
   u8 readOnly;               /* True if the WAL file is open read-only */
+  u8 staleCache;             /* Report a change at next read transaction */
   WalIndexHdr hdr;           /* Wal-index header for current transaction */
   const char *zWalName;      /* Name of WAL file */
   u32 nCkpt;                 /* Checkpoint sequence counter in the wal-header */
@@ -492,6 +494,16 @@ struct WalIterator {
     sizeof(ht_slot)*HASHTABLE_NSLOT + HASHTABLE_NPAGE*sizeof(u32) \
 )
 
+/*
+** If the VFS maps the pages of the wal-index at consecutive addresses, as
+** the unix VFS does where it can, pages 0 to (Wal.nWiContig-1) are known
+** to be mapped at offsets of WALINDEX_PGSZ bytes from apWiData[0]. A
+** pointer to any of these pages is found without loading it from the
+** apWiData[] array, or calling walIndexPage().
+*/
+#define walIndexContig(pWal, iPage) \
+    (&(pWal)->apWiData[0][(iPage)*(WALINDEX_PGSZ/sizeof(u32))])
+
 /*
 ** Obtain a pointer to the iPage'th page of the wal-index. The wal-index
 ** is broken into pages of WALINDEX_PGSZ bytes. Wal-index pages are
@@ -504,6 +516,11 @@ struct WalIterator {
 static int walIndexPage(Wal *pWal, int iPage, volatile u32 **ppPage){
   int rc = SQLITE_OK;
 
+  if( iPage<pWal->nWiContig ){
+    *ppPage = walIndexContig(pWal, iPage);
+    return SQLITE_OK;
+  }
+
   /* Enlarge the pWal->apWiData[] array if required */
   if( pWal->nWiData<=iPage ){
     int nByte = sizeof(u32*)*(iPage+1);
@@ -531,6 +548,14 @@ static int walIndexPage(Wal *pWal, int iPage, volatile u32 **ppPage){
     }
   }
 
+  /* Extend the run of pages mapped at consecutive addresses. */
+  while( pWal->nWiContig<pWal->nWiData
+      && pWal->apWiData[pWal->nWiContig]
+      && pWal->apWiData[pWal->nWiContig]==walIndexContig(pWal, pWal->nWiContig)
+  ){
+    pWal->nWiContig++;
+  }
+
   *ppPage = pWal->apWiData[iPage];
   assert( iPage==0 || *ppPage || rc!=SQLITE_OK );
   return rc;
@@ -768,6 +793,7 @@ static void walUnlockShared(Wal *pWal, int lockIdx){
   if( pWal->exclusiveMode ) return;
   (void)sqlite3OsShmLock(pWal->pDbFd, lockIdx, 1,
                          SQLITE_SHM_UNLOCK | SQLITE_SHM_SHARED);
+  sqlite3LockWakeup();
   WALTRACE(("WAL%p: release SHARED-%s\n", pWal, walLockName(lockIdx)));
 }
 static int walLockExclusive(Wal *pWal, int lockIdx, int n){
@@ -784,6 +810,7 @@ static void walUnlockExclusive(Wal *pWal, int lockIdx, int n){
   if( pWal->exclusiveMode ) return;
   (void)sqlite3OsShmLock(pWal->pDbFd, lockIdx, n,
                          SQLITE_SHM_UNLOCK | SQLITE_SHM_EXCLUSIVE);
+  sqlite3LockWakeup();
   WALTRACE(("WAL%p: release EXCLUSIVE-%s cnt=%d\n", pWal,
              walLockName(lockIdx), n));
 }
@@ -823,10 +850,14 @@ static int walHashGet(
   volatile u32 **paPgno,          /* OUT: Pointer to page number array */
   u32 *piZero                     /* OUT: Frame associated with *paPgno[0] */
 ){
-  int rc;                         /* Return code */
+  int rc = SQLITE_OK;             /* Return code */
   volatile u32 *aPgno;
 
-  rc = walIndexPage(pWal, iHash, &aPgno);
+  if( iHash<pWal->nWiContig ){
+    aPgno = walIndexContig(pWal, iHash);
+  }else{
+    rc = walIndexPage(pWal, iHash, &aPgno);
+  }
   assert( rc==SQLITE_OK || iHash>0 );
 
   if( rc==SQLITE_OK ){
@@ -873,6 +904,11 @@ static u32 walFramePgno(Wal *pWal, u32 iFrame){
   if( iHash==0 ){
     return pWal->apWiData[0][WALINDEX_HDR_SIZE/sizeof(u32) + iFrame - 1];
   }
+  if( iHash<pWal->nWiContig ){
+    return walIndexContig(pWal, iHash)[
+      (iFrame-1-HASHTABLE_NPAGE_ONE)%HASHTABLE_NPAGE
+    ];
+  }
   return pWal->apWiData[iHash][(iFrame-1-HASHTABLE_NPAGE_ONE)%HASHTABLE_NPAGE];
 }
 
@@ -1212,6 +1248,7 @@ static void walIndexClose(Wal *pWal, int isDelete){
   }else{
     sqlite3OsShmUnmap(pWal->pDbFd, isDelete);
   }
+  pWal->nWiContig = 0;
 }
 
 /* 
@@ -1652,6 +1689,7 @@ static int walCheckpoint(
   ){
     i64 nSize;                    /* Current size of database file */
     u32 nBackfill = pInfo->nBackfill;
+    int bBatch = 0;               /* True if the VFS is batching writes */
 
     /* Sync the WAL to disk */
     if( sync_flags ){
@@ -1669,6 +1707,13 @@ static int walCheckpoint(
       }
     }
 
+    /* Let the VFS issue the writes to the db file, and the sync that
+    ** follows them, together. */
+    if( rc==SQLITE_OK ){
+      bBatch = SQLITE_OK==
+          sqlite3OsFileControl(pWal->pDbFd, SQLITE_FCNTL_BEGIN_BATCH, 0);
+    }
+
     /* Iterate through the contents of the WAL, copying data to the db file. */
     while( rc==SQLITE_OK && 0==walIteratorNext(pIter, &iDbpage, &iFrame) ){
       i64 iOffset;
@@ -1694,9 +1739,13 @@ static int walCheckpoint(
           rc = sqlite3OsSync(pWal->pDbFd, sync_flags);
         }
       }
-      if( rc==SQLITE_OK ){
-        pInfo->nBackfill = mxSafeFrame;
-      }
+    }
+    if( bBatch ){
+      int rc2 = sqlite3OsFileControl(pWal->pDbFd, SQLITE_FCNTL_END_BATCH, 0);
+      if( rc==SQLITE_OK ) rc = rc2;
+    }
+    if( rc==SQLITE_OK ){
+      pInfo->nBackfill = mxSafeFrame;
     }
 
     /* Release the reader lock held while backfilling */
@@ -2124,6 +2173,13 @@ int sqlite3WalBeginReadTransaction(Wal *pWal, int *pChanged){
   do{
     rc = walTryBeginRead(pWal, pChanged, 0, ++cnt);
   }while( rc==WAL_RETRY );
+  if( rc==SQLITE_OK && pWal->staleCache ){
+    /* The last write transaction was a BEGIN CONCURRENT transaction that
+    ** was committed on top of changes made by other connections.  Pages
+    ** cached by the pager may predate those changes. */
+    *pChanged = 1;
+    pWal->staleCache = 0;
+  }
   return rc;
 }
 
@@ -2317,6 +2373,121 @@ int sqlite3WalBeginWriteTransaction(Wal *pWal){
   return rc;
 }
 
+/*
+** This function is called at commit time by a BEGIN CONCURRENT
+** transaction.  Such a transaction modifies pages in the pager cache
+** without holding the WRITER lock, so that other connections may do
+** the same.  pAllRead contains the set of pages read (and therefore
+** also the set of pages written) by the transaction.  aPg1 points to
+** the cached content of page 1 and bPg1Dirty is true if the transaction
+** has modified it.
+**
+** Obtain the WRITER lock.  Then, if other transactions have been
+** committed since the snapshot used by this one was opened, check
+** that none of them modified a page in pAllRead.  Page 1 is treated
+** specially, as it is modified by any transaction that changes the
+** size of the database file or the freelist:  a change to page 1 by
+** another transaction is a conflict only if this transaction has also
+** modified page 1 or if any field of the database header other than
+** the change counter, database size, freelist and version-valid-for
+** fields (bytes 24 to 39 and 92 to 99) differ.
+**
+** If there is no conflict, the WAL header is advanced to include the
+** other transactions so that the frames written by this transaction
+** are appended after theirs, and SQLITE_OK is returned.  If there is
+** a conflict, SQLITE_BUSY_SNAPSHOT is returned.  SQLITE_BUSY is returned
+** if the WRITER lock cannot be obtained.
+*/
+int sqlite3WalLockForCommit(
+  Wal *pWal,                      /* WAL connection */
+  Bitvec *pAllRead,               /* Pages read by the transaction */
+  const u8 *aPg1,                 /* Cached content of page 1, or NULL */
+  int bPg1Dirty                   /* True if page 1 has been modified */
+){
+  WalIndexHdr live;               /* Current wal-index header */
+  u32 iFirst;                     /* First frame written by others */
+  u32 iFrame;                     /* Frame iterator */
+  u32 iPg1Frame = 0;              /* Last frame containing page 1 */
+  u32 nRead;                      /* Size of pAllRead in bits */
+  int rc;
+
+  assert( pWal->readLock>=0 && pWal->writeLock==0 );
+  if( pWal->readOnly ){
+    return SQLITE_READONLY;
+  }
+  rc = walLockExclusive(pWal, WAL_WRITE_LOCK, 1);
+  if( rc ){
+    return rc;
+  }
+  pWal->writeLock = 1;
+
+  memcpy(&live, (void *)walIndexHdr(pWal), sizeof(WalIndexHdr));
+  if( memcmp(&pWal->hdr, &live, sizeof(WalIndexHdr))==0 ){
+    return SQLITE_OK;
+  }
+
+  /* If the salt values have changed, another writer has restarted the
+  ** log.  This is only possible if this connection is not reading from
+  ** the log (readLock==0), in which case every frame in the log was
+  ** written after the snapshot was opened.  Otherwise, the frames written
+  ** by other transactions are those after this snapshot's mxFrame. */
+  if( memcmp(live.aSalt, pWal->hdr.aSalt, sizeof(live.aSalt)) ){
+    iFirst = 1;
+  }else{
+    iFirst = pWal->hdr.mxFrame+1;
+  }
+  nRead = sqlite3BitvecSize(pAllRead);
+  for(iFrame=iFirst; rc==SQLITE_OK && iFrame<=live.mxFrame; iFrame++){
+    volatile u32 *aPgno;
+    u32 iPg;
+    rc = walIndexPage(pWal, walFramePage(iFrame), &aPgno);
+    if( rc!=SQLITE_OK ) break;
+    iPg = walFramePgno(pWal, iFrame);
+    if( iPg==1 ){
+      iPg1Frame = iFrame;
+    }else if( iPg<=nRead && sqlite3BitvecTest(pAllRead, iPg) ){
+      rc = SQLITE_BUSY_SNAPSHOT;
+    }
+  }
+  if( rc==SQLITE_OK && iPg1Frame ){
+    if( bPg1Dirty || aPg1==0 ){
+      rc = SQLITE_BUSY_SNAPSHOT;
+    }else{
+      u8 aHdr[100];
+      i64 iOff = walFrameOffset(iPg1Frame, pWal->szPage) + WAL_FRAME_HDRSIZE;
+      rc = sqlite3OsRead(pWal->pWalFd, aHdr, sizeof(aHdr), iOff);
+      if( rc==SQLITE_OK
+       && (memcmp(aHdr, aPg1, 24) || memcmp(&aHdr[40], &aPg1[40], 52)) 
+      ){
+        rc = SQLITE_BUSY_SNAPSHOT;
+      }
+    }
+  }
+
+  if( rc==SQLITE_OK ){
+    if( pWal->readLock==0 ){
+      /* This connection was reading from the database file only.  Take a
+      ** read-lock that covers the frames just validated instead, as is
+      ** done by walRestartLog().  This also loads the new header. */
+      int cnt = 0;
+      walUnlockShared(pWal, WAL_READ_LOCK(0));
+      pWal->readLock = -1;
+      do{
+        int notUsed;
+        rc = walTryBeginRead(pWal, &notUsed, 1, ++cnt);
+      }while( rc==WAL_RETRY );
+    }else{
+      memcpy(&pWal->hdr, &live, sizeof(WalIndexHdr));
+    }
+    pWal->staleCache = 1;
+  }
+  if( rc!=SQLITE_OK ){
+    walUnlockExclusive(pWal, WAL_WRITE_LOCK, 1);
+    pWal->writeLock = 0;
+  }
+  return rc;
+}
+
 /*
 ** End a write transaction.  The commit has already been done.  This
 ** routine merely releases the lock.
@@ -2340,10 +2511,14 @@ int sqlite3WalEndWriteTransaction(Wal *pWal){
 **
 ** Otherwise, if the callback function does not return an error, this
 ** function returns SQLITE_OK.
+**
+** A BEGIN CONCURRENT transaction that has not yet started to commit does
+** not hold the WRITER lock, and has not written anything to the log.
+** This function is a no-op in that case.
 */
 int sqlite3WalUndo(Wal *pWal, int (*xUndo)(void *, Pgno), void *pUndoCtx){
   int rc = SQLITE_OK;
-  if( ALWAYS(pWal->writeLock) ){
+  if( pWal->writeLock ){
     Pgno iMax = pWal->hdr.mxFrame;
     Pgno iFrame;
   
@@ -2381,9 +2556,11 @@ int sqlite3WalUndo(Wal *pWal, int (*xUndo)(void *, Pgno), void *pUndoCtx){
 ** values. This function populates the array with values required to 
 ** "rollback" the write position of the WAL handle back to the current 
 ** point in the event of a savepoint rollback (via WalSavepointUndo()).
+**
+** This may be called by a BEGIN CONCURRENT transaction that does not
+** hold the WRITER lock. The values are not used in that case.
 */
 void sqlite3WalSavepoint(Wal *pWal, u32 *aWalData){
-  assert( pWal->writeLock );
   aWalData[0] = pWal->hdr.mxFrame;
   aWalData[1] = pWal->hdr.aFrameCksum[0];
   aWalData[2] = pWal->hdr.aFrameCksum[1];
@@ -2399,7 +2576,9 @@ void sqlite3WalSavepoint(Wal *pWal, u32 *aWalData){
 int sqlite3WalSavepointUndo(Wal *pWal, u32 *aWalData){
   int rc = SQLITE_OK;
 
-  assert( pWal->writeLock );
+  /* A BEGIN CONCURRENT transaction that does not hold the WRITER lock
+  ** has not written any frames, so there is nothing to undo. */
+  if( pWal->writeLock==0 ) return SQLITE_OK;
   assert( aWalData[3]!=pWal->nCkpt || aWalData[0]<=pWal->hdr.mxFrame );
 
   if( aWalData[3]!=pWal->nCkpt ){
@@ -2497,6 +2676,7 @@ int sqlite3WalFrames(
   PgHdr *p;                       /* Iterator to run through pList with. */
   PgHdr *pLast = 0;               /* Last frame in list */
   int nLast = 0;                  /* Number of extra copies of last page */
+  int bBatch;                     /* True if the VFS is batching writes */
 
   assert( pList );
   assert( pWal->writeLock );
@@ -2515,6 +2695,12 @@ int sqlite3WalFrames(
     return rc;
   }
 
+  /* Let the VFS issue the writes below, and the sync that follows them,
+  ** together. The batch ends at wal_frames_out.
+  */
+  bBatch = SQLITE_OK==
+      sqlite3OsFileControl(pWal->pWalFd, SQLITE_FCNTL_BEGIN_BATCH, 0);
+
   /* If this is the first frame written into the log, write the WAL
   ** header to the start of the WAL file. See comments at the top of
   ** this source file for a description of the WAL header format.
@@ -2542,7 +2728,7 @@ int sqlite3WalFrames(
     rc = sqlite3OsWrite(pWal->pWalFd, aWalHdr, sizeof(aWalHdr), 0);
     WALTRACE(("WAL%p: wal-header write %s\n", pWal, rc ? "failed" : "ok"));
     if( rc!=SQLITE_OK ){
-      return rc;
+      goto wal_frames_out;
     }
   }
   assert( (int)pWal->szPage==szPage );
@@ -2559,20 +2745,23 @@ int sqlite3WalFrames(
     /* Populate and write the frame header */
     nDbsize = (isCommit && p->pDirty==0) ? nTruncate : 0;
 #if defined(SQLITE_HAS_CODEC)
-    if( (pData = sqlite3PagerCodec(p))==0 ) return SQLITE_NOMEM;
+    if( (pData = sqlite3PagerCodec(p))==0 ){
+      rc = SQLITE_NOMEM;
+      goto wal_frames_out;
+    }
 #else
     pData = p->pData;
 #endif
     walEncodeFrame(pWal, p->pgno, nDbsize, pData, aFrame);
     rc = sqlite3OsWrite(pWal->pWalFd, aFrame, sizeof(aFrame), iOffset);
     if( rc!=SQLITE_OK ){
-      return rc;
+      goto wal_frames_out;
     }
 
     /* Write the page data */
     rc = sqlite3OsWrite(pWal->pWalFd, pData, szPage, iOffset+sizeof(aFrame));
     if( rc!=SQLITE_OK ){
-      return rc;
+      goto wal_frames_out;
     }
     pLast = p;
   }
@@ -2589,7 +2778,10 @@ int sqlite3WalFrames(
     while( iOffset<iSegment ){
       void *pData;
 #if defined(SQLITE_HAS_CODEC)
-      if( (pData = sqlite3PagerCodec(pLast))==0 ) return SQLITE_NOMEM;
+      if( (pData = sqlite3PagerCodec(pLast))==0 ){
+        rc = SQLITE_NOMEM;
+        goto wal_frames_out;
+      }
 #else
       pData = pLast->pData;
 #endif
@@ -2597,12 +2789,12 @@ int sqlite3WalFrames(
       /* testcase( IS_BIG_INT(iOffset) ); // requires a 4GiB WAL */
       rc = sqlite3OsWrite(pWal->pWalFd, aFrame, sizeof(aFrame), iOffset);
       if( rc!=SQLITE_OK ){
-        return rc;
+        goto wal_frames_out;
       }
       iOffset += WAL_FRAME_HDRSIZE;
       rc = sqlite3OsWrite(pWal->pWalFd, pData, szPage, iOffset); 
       if( rc!=SQLITE_OK ){
-        return rc;
+        goto wal_frames_out;
       }
       nLast++;
       iOffset += szPage;
@@ -2611,6 +2803,15 @@ int sqlite3WalFrames(
     rc = sqlite3OsSync(pWal->pWalFd, sync_flags);
   }
 
+ wal_frames_out:
+  if( bBatch ){
+    int rc2 = sqlite3OsFileControl(pWal->pWalFd, SQLITE_FCNTL_END_BATCH, 0);
+    if( rc==SQLITE_OK ) rc = rc2;
+  }
+  if( rc!=SQLITE_OK ){
+    return rc;
+  }
+
   /* Append data to the wal-index. It is not necessary to lock the 
   ** wal-index to do this as the SQLITE_SHM_WRITE lock held on the wal-index
   ** guarantees that there are no other writers, and no data that may
@@ -2782,4 +2983,15 @@ int sqlite3WalHeapMemory(Wal *pWal){
   return (pWal && pWal->exclusiveMode==WAL_HEAPMEMORY_MODE );
 }
 
+/*
+** Set the chunk size used to extend the WAL file. Once the log has been
+** checkpointed, it is overwritten from the start, so a log that has grown
+** to its working size stays that size and is written in place. With a
+** chunk size, it grows to that size in a few steps, each of which
+** preallocates space, instead of one frame at a time.
+*/
+void sqlite3WalChunkSize(Wal *pWal, int szChunk){
+  sqlite3OsFileControl(pWal->pWalFd, SQLITE_FCNTL_CHUNK_SIZE, &szChunk);
+}
+
 #endif /* #ifndef SQLITE_OMIT_WAL */
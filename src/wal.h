@@ -28,6 +28,7 @@
 # define sqlite3WalDbsize(y)                   0
 # define sqlite3WalBeginWriteTransaction(y)    0
 # define sqlite3WalEndWriteTransaction(x)      0
+# define sqlite3WalLockForCommit(w,x,y,z)      0
 # define sqlite3WalUndo(x,y,z)                 0
 # define sqlite3WalSavepoint(y,z)
 # define sqlite3WalSavepointUndo(y,z)          0
@@ -36,6 +37,7 @@
 # define sqlite3WalCallback(z)                 0
 # define sqlite3WalExclusiveMode(y,z)          0
 # define sqlite3WalHeapMemory(z)               0
+# define sqlite3WalChunkSize(y,z)
 #else
 
 #define WAL_SAVEPOINT_NDATA 4
@@ -69,6 +71,11 @@ Pgno sqlite3WalDbsize(Wal *pWal);
 int sqlite3WalBeginWriteTransaction(Wal *pWal);
 int sqlite3WalEndWriteTransaction(Wal *pWal);
 
+/* Obtain the WRITER lock for a BEGIN CONCURRENT transaction at commit
+** time, checking for conflicts with transactions committed since its
+** snapshot was taken. */
+int sqlite3WalLockForCommit(Wal *pWal, Bitvec *pAllRead, const u8*, int);
+
 /* Undo any frames written (but not committed) to the log */
 int sqlite3WalUndo(Wal *pWal, int (*xUndo)(void *, Pgno), void *pUndoCtx);
 
@@ -109,5 +116,9 @@ int sqlite3WalExclusiveMode(Wal *pWal, int op);
 */
 int sqlite3WalHeapMemory(Wal *pWal);
 
+/* Set the chunk size used to extend the WAL file.
+*/
+void sqlite3WalChunkSize(Wal *pWal, int szChunk);
+
 #endif /* ifndef SQLITE_OMIT_WAL */
 #endif /* _WAL_H_ */
@@ -0,0 +1,60 @@
+# 2011 February 10
+#
+# The author disclaims copyright to this source code.  In place of
+# a legal notice, here is a blessing:
+#
+#    May you do good and not evil.
+#    May you find forgiveness for yourself and forgive others.
+#    May you share freely, never taking more than you give.
+#
+#***********************************************************************
+# This file contains code used by several different test scripts. The
+# procs in this file create test data and inspect the database files
+# it is written to.
+#
+
+# Create table t1, with an index, holding $n rows in database $db. Some
+# of the rows are large enough to use overflow pages.
+#
+proc populate_t1 {db n} {
+  $db eval {
+    CREATE TABLE t1(a INTEGER PRIMARY KEY, b, c);
+    CREATE INDEX i1 ON t1(c, b);
+    BEGIN;
+  }
+  for {set i 1} {$i<=$n} {incr i} {
+    set b [string repeat [format %05d $i] [expr {10+($i%40==0)*1000}]]
+    $db eval { INSERT INTO t1 VALUES($i, $b, $i%11) }
+  }
+  $db eval COMMIT
+}
+
+# Return a checksum of the contents of table t1 of database $db.
+#
+proc t1_cksum {db} {
+  $db eval { SELECT md5sum(a, b, c) FROM t1 }
+}
+
+# Return the result of a query against the backup in file test2.db.
+#
+proc backup_query {sql} {
+  sqlite3 db3 test2.db
+  set res [db3 eval $sql]
+  db3 close
+  set res
+}
+
+# Return the non-root pages of b-tree $name in depth-first order.
+#
+proc tree_pages {db name} {
+  set res [list]
+  register_dbstat_vtab $db
+  $db eval {
+    CREATE VIRTUAL TABLE temp.stat USING dbstat;
+    SELECT path, pageno FROM temp.stat WHERE name=$name
+  } {
+    if {$path ne "/" && [string first + $path]<0} { lappend res $pageno }
+  }
+  $db eval { DROP TABLE temp.stat }
+  set res
+}
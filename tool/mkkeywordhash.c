@@ -166,6 +166,7 @@ static Keyword aKeywordTable[] = {
   { "COLLATE",          "TK_COLLATE",      ALWAYS                 },
   { "COLUMN",           "TK_COLUMNKW",     ALTER                  },
   { "COMMIT",           "TK_COMMIT",       ALWAYS                 },
+  { "CONCURRENT",       "TK_CONCURRENT",   ALWAYS                 },
   { "CONFLICT",         "TK_CONFLICT",     CONFLICT               },
   { "CONSTRAINT",       "TK_CONSTRAINT",   ALWAYS                 },
   { "CREATE",           "TK_CREATE",       ALWAYS                 },
@@ -344,6 +345,7 @@ int main(int argc, char **argv){
   int count;
   int nChar;
   int totalLen = 0;
+  int mxLen = 0;
   int aHash[1000];  /* 1000 is much bigger than nKeyword */
   char zText[2000];
 
@@ -364,9 +366,18 @@ int main(int argc, char **argv){
     assert( p->len<sizeof(p->zOrigName) );
     strcpy(p->zOrigName, p->zName);
     totalLen += p->len;
+    if( p->len>mxLen ) mxLen = p->len;
     p->hash = (UpperToLower[(int)p->zName[0]]*4) ^
               (UpperToLower[(int)p->zName[p->len-1]]*3) ^ p->len;
     p->id = i+1;
+
+    /* The tokenizer does not look up identifiers that begin with X, Y,
+    ** Z or an underscore in the keyword hash (see aiClass[] in 
+    ** tokenize.c) */
+    if( strchr("XYZ_", p->zName[0]) ){
+      fprintf(stderr, "keyword %s has a bad first character\n", p->zName);
+      exit(1);
+    }
   }
 
   /* Sort the table from shortest to longest keyword */
@@ -577,7 +588,7 @@ int main(int argc, char **argv){
   printf("%s  };\n", j==0 ? "" : "\n");
 
   printf("  int h, i;\n");
-  printf("  if( n<2 ) return TK_ID;\n");
+  printf("  if( n<2 || n>%d ) return TK_ID;\n", mxLen);
   printf("  h = ((charMap(z[0])*4) ^\n"
          "      (charMap(z[n-1])*3) ^\n"
          "      n) %% %d;\n", bestSize);
@@ -239,6 +239,7 @@ foreach file {
    os_os2.c
    os_unix.c
    os_win.c
+   compress.c
 
    bitvec.c
    pcache.c
@@ -278,11 +279,13 @@ foreach file {
    pragma.c
    prepare.c
    select.c
+   snapshot.c
    table.c
    trigger.c
    update.c
    vacuum.c
    vtab.c
+   tvp.c
    where.c
 
    parse.c
@@ -0,0 +1,233 @@
+/*
+** Performance test for the SQLite tokenizer and parser.
+**
+** This program generates several large SQL scripts in memory and times
+** how long it takes sqlite3_prepare_v2() to compile every statement in
+** each of them. The statements are never run, so the times reported
+** are dominated by tokenizing, parsing and code generation. The scripts
+** are:
+**
+**    insert    Many single-row "INSERT INTO ... VALUES(...)" statements
+**              containing integer, real, string and blob literals, as
+**              generated by bulk loaders and by the ".dump" command.
+**
+**    wide      A few INSERT statements, each of which inserts the rows
+**              of a long compound SELECT of literal values.
+**
+**    values    A few INSERT statements with multi-row VALUES clauses,
+**              inserting the same rows as the "wide" script.
+**
+**    select    Many SELECT statements with long WHERE clauses made up
+**              of identifiers, keywords and operators.
+**
+** To compile this program, first compile the SQLite library separately
+** with full optimizations.  For example:
+**
+**     gcc -c -O6 -DSQLITE_THREADSAFE=0 sqlite3.c
+**
+** Then link against this program:
+**
+**     gcc -O2 tokenspeed.c sqlite3.o -ldl
+**
+** Run with no arguments to run every test, or name the tests to run.
+** The "-n N" option sets the number of times each script is compiled
+** (default 10).
+**
+**     ./a.out -n 20 insert select
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "sqlite3.h"
+
+/*
+** A growable string used to build the test scripts.
+*/
+typedef struct Str Str;
+struct Str {
+  char *z;         /* Text of the script */
+  int n;           /* Bytes of z[] used, not counting the nul-terminator */
+  int nAlloc;      /* Bytes allocated for z[] */
+};
+
+/*
+** Append printf()-style formatted text to the string.
+*/
+static void strAppendf(Str *p, const char *zFormat, ...){
+  va_list ap;
+  char *z;
+  int n;
+  va_start(ap, zFormat);
+  z = sqlite3_vmprintf(zFormat, ap);
+  va_end(ap);
+  if( z==0 ){
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  n = (int)strlen(z);
+  if( p->n+n+1>p->nAlloc ){
+    p->nAlloc = (p->nAlloc+n)*2 + 100;
+    p->z = realloc(p->z, p->nAlloc);
+    if( p->z==0 ){
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+  }
+  memcpy(&p->z[p->n], z, n+1);
+  p->n += n;
+  sqlite3_free(z);
+}
+
+/*
+** Return a pseudo-random integer. The sequence is the same every time
+** the program is run, so that timings may be compared across runs.
+*/
+static unsigned int randInt(void){
+  static unsigned int x = 0x12345678;
+  x = (x>>1) ^ (-(int)(x&1) & 0xd0000001);
+  return x;
+}
+
+/*
+** Append one row of values for table t1 to the script.
+*/
+static void appendRow(Str *p){
+  unsigned int r = randInt();
+  strAppendf(p, "(%u, %d.%02d, 'text value number %u', x'%08x', NULL, -1)",
+      r, (int)(r%1000)-500, (int)(r%100), r/7, r);
+}
+
+static void genInsert(Str *p){
+  int i;
+  for(i=0; i<10000; i++){
+    strAppendf(p, "INSERT INTO t1 VALUES");
+    appendRow(p);
+    strAppendf(p, ";\n");
+  }
+}
+
+static void genWide(Str *p){
+  int i, j;
+  for(i=0; i<10; i++){
+    strAppendf(p, "INSERT INTO t1 SELECT * FROM (");
+    for(j=0; j<400; j++){
+      strAppendf(p, "%sSELECT %u, 1.5, 'abc', x'00', NULL, -1",
+          j==0 ? "" : " UNION ALL ", randInt());
+    }
+    strAppendf(p, ");\n");
+  }
+}
+
+static void genValues(Str *p){
+  int i, j;
+  for(i=0; i<10; i++){
+    strAppendf(p, "INSERT INTO t1 VALUES");
+    for(j=0; j<400; j++){
+      strAppendf(p, "%s(%u, 1.5, 'abc', x'00', NULL, -1)",
+          j==0 ? "" : ",", randInt());
+    }
+    strAppendf(p, ";\n");
+  }
+}
+
+static void genSelect(Str *p){
+  int i;
+  for(i=0; i<2000; i++){
+    unsigned int r = randInt();
+    strAppendf(p,
+        "SELECT a, b, c AS column_c, max(d), count(*) FROM t1 AS alias_one "
+        "WHERE (a>%u AND b<=%u.5) OR (c LIKE 'prefix%%' AND d IS NOT NULL) "
+        "   OR e BETWEEN %u AND %u OR _hidden_column_name = ? "
+        "GROUP BY a, b, column_c HAVING count(*)>1 "
+        "ORDER BY 1 DESC, 2 ASC LIMIT 10 OFFSET 5;\n",
+        r%1000, r%77, r%13, r%13+100
+    );
+  }
+}
+
+/*
+** Compile, but do not run, each statement in zSql. Return the number
+** of statements compiled.
+*/
+static int prepareAll(sqlite3 *db, const char *zSql){
+  int nStmt = 0;
+  while( zSql[0] ){
+    sqlite3_stmt *pStmt = 0;
+    const char *zTail;
+    int rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, &zTail);
+    if( rc!=SQLITE_OK ){
+      fprintf(stderr, "error: %s\n", sqlite3_errmsg(db));
+      exit(1);
+    }
+    if( pStmt ){
+      sqlite3_finalize(pStmt);
+      nStmt++;
+    }
+    zSql = zTail;
+  }
+  return nStmt;
+}
+
+static const struct {
+  const char *zName;
+  void (*xGen)(Str*);
+} aTest[] = {
+  { "insert", genInsert },
+  { "wide",   genWide   },
+  { "values", genValues },
+  { "select", genSelect },
+};
+
+int main(int argc, char **argv){
+  sqlite3 *db;
+  int nIter = 10;
+  int i, j;
+  int nTest = 0;
+  int *aRun;
+
+  aRun = calloc(sizeof(aTest)/sizeof(aTest[0]), sizeof(int));
+  for(i=1; i<argc; i++){
+    if( strcmp(argv[i], "-n")==0 && i+1<argc ){
+      nIter = atoi(argv[++i]);
+    }else{
+      for(j=0; j<(int)(sizeof(aTest)/sizeof(aTest[0])); j++){
+        if( strcmp(argv[i], aTest[j].zName)==0 ) break;
+      }
+      if( j==(int)(sizeof(aTest)/sizeof(aTest[0])) ){
+        fprintf(stderr, "Usage: %s ?-n N? ?TEST ...?\n", argv[0]);
+        exit(1);
+      }
+      aRun[j] = 1;
+      nTest++;
+    }
+  }
+
+  sqlite3_open(":memory:", &db);
+  sqlite3_exec(db, "CREATE TABLE t1(a, b, c, d, e, _hidden_column_name)",
+               0, 0, 0);
+
+  for(i=0; i<(int)(sizeof(aTest)/sizeof(aTest[0])); i++){
+    Str s = {0, 0, 0};
+    clock_t iStart;
+    double rElapse;
+    int nStmt = 0;
+    if( nTest>0 && !aRun[i] ) continue;
+    aTest[i].xGen(&s);
+    iStart = clock();
+    for(j=0; j<nIter; j++){
+      nStmt += prepareAll(db, s.z);
+    }
+    rElapse = (double)(clock() - iStart)/CLOCKS_PER_SEC;
+    printf("%-8s %8d statements %10d bytes %8.3f seconds %8.2f ns/byte\n",
+        aTest[i].zName, nStmt, s.n*nIter, rElapse,
+        rElapse*1.0e9/((double)s.n*nIter));
+    free(s.z);
+  }
+
+  sqlite3_close(db);
+  free(aRun);
+  return 0;
+}